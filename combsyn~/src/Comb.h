@@ -28,9 +28,8 @@ public:
     virtual T* process (const T* input, T* output, long size) {
         for (long i = 0; i < size; ++i) {
             output[i] = Base::m_delay[Base::m_ptr];
-            //undenormalise (output[i]);
+            // no undenormalise: combsyn~ runs this with flush-to-zero on (denorm.h)
             m_lp = (output[i] * m_udamp) + (m_lp * m_damp);
-            //undenormalise (m_lp);
             Base::m_delay[Base::m_ptr] = input[i] + (Base::m_feedback * m_lp);
             Base::m_ptr++;
             if (Base::m_ptr < 0) Base::m_ptr = 0;
@@ -37,7 +37,7 @@ public:
     virtual T* process (const T* input, T* output, long size) {
         for (long i = 0; i < size; ++i) {
             output[i] = m_delay[m_ptr];
-            //undenormalise (output[i]);
+            // no undenormalise: combsyn~ runs this with flush-to-zero on (denorm.h)
             m_delay[m_ptr++] = input[i] +  (m_feedback * output[i]);
             m_ptr %= m_samples;		
         }
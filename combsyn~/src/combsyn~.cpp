@@ -6,6 +6,8 @@
 #include "Comb.h"
 #include "maxmix.h"
 #include "maxcpp5.h"
+#define DENORM_PERFORM32
+#include "denorm.h"
 #include <string>
 #include <vector>
 
@@ -41,9 +43,11 @@ public:
     
     float* obuff;
 //    float* obuffS;
+    t_denorm_counter* m_denorm;
     
     CombSynMax(t_symbol * sym, long ac, t_atom * av) {
         setupIO (&CombSynMax::perform, 1, 1);
+        m_denorm = denorm_counter_new ((t_object*) this);
 
         //parameters initialisation        
         m_soundness = .999;
@@ -94,6 +98,7 @@ public:
     }
 
     ~CombSynMax() {
+        denorm_counter_free (m_denorm);
         for (unsigned int i = 0; i < m_freqs.size (); ++i)  {
             delete m_combs[i];
         }
@@ -155,6 +160,8 @@ public:
     void perform (int vs, t_sample ** inputs, t_sample ** outputs) {
         t_sample *in = inputs[0];
         t_sample *out = outputs[0];
+        // flush-to-zero keeps the comb feedback out of denormals; the scrub catches what gets out
+        t_denorm_fpstate fpstate = denorm_enter ();
         
         memset (out, 0, sizeof (float) * vs);
         for (unsigned int j = 0; j < m_freqs.size (); ++j) {
@@ -172,6 +179,8 @@ public:
             }
 
         }
+        denorm_exit (fpstate);
+        denorm_countf (m_denorm, (float*) out, vs);
 
 
     }
@@ -248,6 +257,7 @@ t_max_err setAttr (CombSynMax *self, void *attr, long ac, t_atom *av) {
 }
 
 extern "C" int main(void) {
+    denorm_init ();
     // create a class with the given name:
     CombSynMax::makeMaxClass("combsyn~");
     t_class* c = (t_class *)CombSynMax::m_class;
@@ -270,7 +280,7 @@ extern "C" int main(void) {
     REGISTER_METHOD(CombSynMax, bang);
 	REGISTER_METHOD_GIMME(CombSynMax, tune);
    	REGISTER_METHOD_GIMME(CombSynMax, design);
-
+    return 0;
 }
 
 
@@ -0,0 +1,604 @@
+/**
+	@file
+	arraylist.h - a list of pointers kept in one growable ring, for threadpool and anything else that would use a t_linklist
+
+	A t_arraylist keeps its items side by side in a ring that doubles when
+	it fills, so walking it reads memory in order instead of chasing
+	links. It can push and pop at either end in O(1), and reach an item
+	by index in O(1). Inserting or removing by index moves the items on
+	the shorter side of it.
+
+	Every item also gets a handle when it goes in. The handle stays good
+	while the item moves about the ring and goes stale once the item is
+	out, so an item can be removed by handle in O(1) without knowing its
+	index: it leaves a hole, which the ends skip and which is squeezed out
+	when the holes are half the ring or something asks for an index. A
+	slot table indexed by handle tracks each item's place in the ring.
+
+	The arraylist_ functions named after linklist_ ones take the same
+	arguments and return the same things, and the list takes the same
+	OBJ_FLAG_ values for freeing its items, so code written for a
+	t_linklist can switch by changing the prefix. Unlike a t_linklist it
+	has no lock of its own: callers on more than one thread hold theirs.
+
+	t_arrayqueue is the lock-free one: a fixed-size ring that any number
+	of threads push to and pop from at once, without a lock. It is
+	D. Vyukov's bounded MPMC queue, with every cell carrying a sequence
+	number that says whose turn it is. It only goes from one end to the
+	other and doesn't grow, so there is no removing from the middle.
+*/
+
+#ifndef _ARRAYLIST_H_
+#define _ARRAYLIST_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+
+#define ARRAYLIST_MINSIZE		16
+#define ARRAYQUEUE_LINE			64		// bytes, to keep the two ends' counters off each other's cache line
+
+typedef t_uint64 t_arraylist_handle;	// slot + 1 in the low word, its generation in the high one; 0 is none
+
+typedef struct _arraylist_item
+{
+	void			*obj;
+	t_uint32		slot;			// its slot + 1, 0 for a hole
+} t_arraylist_item;
+
+typedef struct _arraylist_slot
+{
+	t_uint32		gen;			// bumped when the slot is freed, so that old handles stop matching
+	t_uint32		pos;			// where the item is in the ring, or the next free slot + 1
+} t_arraylist_slot;
+
+typedef struct _arraylist
+{
+	t_arraylist_item	*items;
+	t_arraylist_slot	*slots;		// as many as items, since only items hold slots
+	long				capacity;	// a power of 2
+	long				head;		// where the first item is
+	long				count;		// items, holes included
+	long				holes;
+	long				numslots;	// slots ever used
+	long				freeslot;	// first free slot + 1, 0 if none
+	long				flags;		// OBJ_FLAG_OBJ (the default), _REF, _DATA or _MEMORY, as for a t_linklist
+} t_arraylist;
+
+
+//***********************************************************************************************
+// the ring
+
+#define ARRAYLIST_POS(x, i)		(((x)->head + (i)) & ((x)->capacity - 1))
+
+// put an item at pos, keeping its slot up to date
+static inline void arraylist_place(t_arraylist *x, long pos, t_arraylist_item item)
+{
+	x->items[pos] = item;
+	if (item.slot)
+		x->slots[item.slot - 1].pos = (t_uint32)pos;
+}
+
+// squeeze the holes out, in place
+static inline void arraylist_compact(t_arraylist *x)
+{
+	long r, w;
+
+	if (!x->holes)
+		return;
+	for (r = 0, w = 0; r < x->count; r++) {
+		t_arraylist_item item = x->items[ARRAYLIST_POS(x, r)];
+
+		if (item.slot)
+			arraylist_place(x, ARRAYLIST_POS(x, w++), item);
+	}
+	x->count = w;
+	x->holes = 0;
+}
+
+// room for n more items: squeezing out the holes if they are half the ring, or
+// laying the items out from 0 in one twice the size
+static inline t_max_err arraylist_reserve(t_arraylist *x, long n)
+{
+	t_arraylist_item	*items;
+	t_arraylist_slot	*slots;
+	long				capacity = x->capacity ? x->capacity * 2 : ARRAYLIST_MINSIZE;
+	long				i, w;
+
+	if (x->count + n <= x->capacity)
+		return MAX_ERR_NONE;
+	if (x->count - x->holes + n <= x->capacity / 2) {
+		arraylist_compact(x);		// half holes: room enough without growing
+		return MAX_ERR_NONE;
+	}
+	while (capacity < x->count - x->holes + n)
+		capacity *= 2;
+	items = (t_arraylist_item *)sysmem_newptr(capacity * sizeof(t_arraylist_item));
+	slots = (t_arraylist_slot *)sysmem_newptr(capacity * sizeof(t_arraylist_slot));
+	if (!items || !slots) {
+		if (items)
+			sysmem_freeptr(items);
+		if (slots)
+			sysmem_freeptr(slots);
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	if (x->numslots)
+		sysmem_copyptr(x->slots, slots, x->numslots * sizeof(t_arraylist_slot));
+	for (i = 0, w = 0; i < x->count; i++) {
+		t_arraylist_item item = x->items[ARRAYLIST_POS(x, i)];
+
+		if (item.slot) {
+			items[w] = item;
+			slots[item.slot - 1].pos = (t_uint32)w++;
+		}
+	}
+	if (x->items)
+		sysmem_freeptr(x->items);
+	if (x->slots)
+		sysmem_freeptr(x->slots);
+	x->items = items;
+	x->slots = slots;
+	x->capacity = capacity;
+	x->head = 0;
+	x->count = w;
+	x->holes = 0;
+	return MAX_ERR_NONE;
+}
+
+// a slot for the item just put at pos
+static inline t_arraylist_handle arraylist_slot_new(t_arraylist *x, long pos)
+{
+	long s;
+
+	if (x->freeslot) {
+		s = x->freeslot - 1;
+		x->freeslot = x->slots[s].pos;
+	}
+	else {
+		s = x->numslots++;
+		x->slots[s].gen = 1;
+	}
+	x->slots[s].pos = (t_uint32)pos;
+	x->items[pos].slot = (t_uint32)(s + 1);
+	return ((t_arraylist_handle)x->slots[s].gen << 32) | (t_arraylist_handle)(s + 1);
+}
+
+static inline void arraylist_slot_free(t_arraylist *x, long s)
+{
+	x->slots[s].gen++;
+	x->slots[s].pos = (t_uint32)x->freeslot;
+	x->freeslot = s + 1;
+}
+
+// the slot of h, or -1 if it is stale
+static inline long arraylist_handle2slot(t_arraylist *x, t_arraylist_handle h)
+{
+	long s = (long)(h & 0xffffffff) - 1;
+
+	if (s < 0 || s >= x->numslots || x->slots[s].gen != (t_uint32)(h >> 32))
+		return -1;
+	return s;
+}
+
+// drop the holes at either end
+static inline void arraylist_trim(t_arraylist *x)
+{
+	while (x->count && !x->items[x->head].slot) {
+		x->head = (x->head + 1) & (x->capacity - 1);
+		x->count--;
+		x->holes--;
+	}
+	while (x->count && !x->items[ARRAYLIST_POS(x, x->count - 1)].slot) {
+		x->count--;
+		x->holes--;
+	}
+}
+
+static inline void arraylist_freeitem(t_arraylist *x, void *o)
+{
+	if (!o || (x->flags & (OBJ_FLAG_REF | OBJ_FLAG_DATA)))
+		return;
+	if (x->flags & OBJ_FLAG_MEMORY)
+		sysmem_freeptr(o);
+	else
+		object_free(o);
+}
+
+
+//***********************************************************************************************
+// life cycle
+
+static inline t_arraylist *arraylist_new(void)
+{
+	return (t_arraylist *)sysmem_newptrclear(sizeof(t_arraylist));
+}
+
+static inline void arraylist_flags(t_arraylist *x, long flags)
+{
+	x->flags = flags;
+}
+
+static inline long arraylist_getflags(t_arraylist *x)
+{
+	return x->flags;
+}
+
+// take every item out, freeing them as the flags say
+static inline void arraylist_clear(t_arraylist *x)
+{
+	long i;
+
+	for (i = 0; i < x->count; i++) {
+		t_arraylist_item item = x->items[ARRAYLIST_POS(x, i)];
+
+		if (item.slot) {
+			arraylist_slot_free(x, item.slot - 1);
+			arraylist_freeitem(x, item.obj);
+		}
+	}
+	x->head = x->count = x->holes = 0;
+}
+
+// free the list without freeing the items
+static inline void arraylist_chuck(t_arraylist *x)
+{
+	if (!x)
+		return;
+	if (x->items)
+		sysmem_freeptr(x->items);
+	if (x->slots)
+		sysmem_freeptr(x->slots);
+	sysmem_freeptr(x);
+}
+
+// free the list and the items, as the flags say
+static inline void arraylist_free(t_arraylist *x)
+{
+	if (!x)
+		return;
+	arraylist_clear(x);
+	arraylist_chuck(x);
+}
+
+static inline t_atom_long arraylist_getsize(t_arraylist *x)
+{
+	return x->count - x->holes;
+}
+
+
+//***********************************************************************************************
+// the ends, and handles
+
+
+// a handle for the item, or 0 if there was no memory
+static inline t_arraylist_handle arraylist_pushback(t_arraylist *x, void *o)
+{
+	long pos;
+
+	if (arraylist_reserve(x, 1))
+		return 0;
+	pos = ARRAYLIST_POS(x, x->count);
+	x->items[pos].obj = o;
+	x->count++;
+	return arraylist_slot_new(x, pos);
+}
+
+static inline t_arraylist_handle arraylist_pushfront(t_arraylist *x, void *o)
+{
+	if (arraylist_reserve(x, 1))
+		return 0;
+	x->head = (x->head - 1) & (x->capacity - 1);
+	x->items[x->head].obj = o;
+	x->count++;
+	return arraylist_slot_new(x, x->head);
+}
+
+// take the first item out (without freeing it), or NULL if there are none
+static inline void *arraylist_popfront(t_arraylist *x)
+{
+	t_arraylist_item item;
+
+	if (!x->count)
+		return NULL;
+	item = x->items[x->head];		// never a hole: the ends are trimmed
+	arraylist_slot_free(x, item.slot - 1);
+	x->head = (x->head + 1) & (x->capacity - 1);
+	x->count--;
+	arraylist_trim(x);
+	return item.obj;
+}
+
+static inline void *arraylist_popback(t_arraylist *x)
+{
+	t_arraylist_item item;
+
+	if (!x->count)
+		return NULL;
+	item = x->items[ARRAYLIST_POS(x, x->count - 1)];
+	arraylist_slot_free(x, item.slot - 1);
+	x->count--;
+	arraylist_trim(x);
+	return item.obj;
+}
+
+// the item h was handed out for, or NULL once it is out of the list
+static inline void *arraylist_gethandle(t_arraylist *x, t_arraylist_handle h)
+{
+	long s = arraylist_handle2slot(x, h);
+
+	return s < 0 ? NULL : x->items[x->slots[s].pos].obj;
+}
+
+// take h's item out (without freeing it), leaving a hole
+static inline t_max_err arraylist_chuckhandle(t_arraylist *x, t_arraylist_handle h)
+{
+	long s = arraylist_handle2slot(x, h);
+	long pos;
+
+	if (s < 0)
+		return MAX_ERR_GENERIC;
+	pos = x->slots[s].pos;
+	x->items[pos].obj = NULL;
+	x->items[pos].slot = 0;
+	x->holes++;
+	arraylist_slot_free(x, s);
+	arraylist_trim(x);
+	if (x->holes * 2 > x->count)
+		arraylist_compact(x);
+	return MAX_ERR_NONE;
+}
+
+// the handle of the first item that is o, or 0
+static inline t_arraylist_handle arraylist_objptr2handle(t_arraylist *x, void *o)
+{
+	long i;
+
+	for (i = 0; i < x->count; i++) {
+		t_arraylist_item item = x->items[ARRAYLIST_POS(x, i)];
+
+		if (item.slot && item.obj == o)
+			return ((t_arraylist_handle)x->slots[item.slot - 1].gen << 32) | item.slot;
+	}
+	return 0;
+}
+
+static inline t_arraylist_handle arraylist_index2handle(t_arraylist *x, long index)
+{
+	t_arraylist_item item;
+
+	arraylist_compact(x);
+	if (index < 0 || index >= x->count)
+		return 0;
+	item = x->items[ARRAYLIST_POS(x, index)];
+	return ((t_arraylist_handle)x->slots[item.slot - 1].gen << 32) | item.slot;
+}
+
+
+//***********************************************************************************************
+// what a t_linklist does
+
+// index of the item, or -1 if there was no memory
+static inline long arraylist_append(t_arraylist *x, void *o)
+{
+	if (!arraylist_pushback(x, o))
+		return -1;
+	return x->count - x->holes - 1;
+}
+
+// put o at index, moving the items on the shorter side of it along; index or -1
+static inline long arraylist_insertindex(t_arraylist *x, void *o, long index)
+{
+	long i, pos;
+
+	arraylist_compact(x);
+	if (index < 0 || index > x->count)
+		return -1;
+	if (arraylist_reserve(x, 1))
+		return -1;
+	if (index < x->count / 2) {
+		x->head = (x->head - 1) & (x->capacity - 1);
+		for (i = 0; i < index; i++)
+			arraylist_place(x, ARRAYLIST_POS(x, i), x->items[ARRAYLIST_POS(x, i + 1)]);
+	}
+	else {
+		for (i = x->count; i > index; i--)
+			arraylist_place(x, ARRAYLIST_POS(x, i), x->items[ARRAYLIST_POS(x, i - 1)]);
+	}
+	pos = ARRAYLIST_POS(x, index);
+	x->items[pos].obj = o;
+	x->count++;
+	arraylist_slot_new(x, pos);
+	return index;
+}
+
+static inline void *arraylist_getindex(t_arraylist *x, long index)
+{
+	arraylist_compact(x);
+	if (index < 0 || index >= x->count)
+		return NULL;
+	return x->items[ARRAYLIST_POS(x, index)].obj;
+}
+
+// take the item at index out, without freeing it; index or -1
+static inline long arraylist_chuckindex(t_arraylist *x, long index)
+{
+	long i;
+
+	arraylist_compact(x);
+	if (index < 0 || index >= x->count)
+		return -1;
+	arraylist_slot_free(x, x->items[ARRAYLIST_POS(x, index)].slot - 1);
+	if (index < x->count / 2) {
+		for (i = index; i > 0; i--)
+			arraylist_place(x, ARRAYLIST_POS(x, i), x->items[ARRAYLIST_POS(x, i - 1)]);
+		x->head = (x->head + 1) & (x->capacity - 1);
+	}
+	else {
+		for (i = index; i < x->count - 1; i++)
+			arraylist_place(x, ARRAYLIST_POS(x, i), x->items[ARRAYLIST_POS(x, i + 1)]);
+	}
+	x->count--;
+	return index;
+}
+
+// take the item at index out and free it, as the flags say; index or -1
+static inline long arraylist_deleteindex(t_arraylist *x, long index)
+{
+	void *o = arraylist_getindex(x, index);
+
+	if (arraylist_chuckindex(x, index) < 0)
+		return -1;
+	arraylist_freeitem(x, o);
+	return index;
+}
+
+static inline long arraylist_objptr2index(t_arraylist *x, void *o)
+{
+	long i;
+
+	arraylist_compact(x);
+	for (i = 0; i < x->count; i++) {
+		if (x->items[ARRAYLIST_POS(x, i)].obj == o)
+			return i;
+	}
+	return -1;
+}
+
+static inline t_max_err arraylist_chuckobject(t_arraylist *x, void *o)
+{
+	return arraylist_chuckhandle(x, arraylist_objptr2handle(x, o));
+}
+
+static inline t_max_err arraylist_deleteobject(t_arraylist *x, void *o)
+{
+	if (arraylist_chuckobject(x, o))
+		return MAX_ERR_GENERIC;
+	arraylist_freeitem(x, o);
+	return MAX_ERR_NONE;
+}
+
+// fun(item, arg) for every item, first to last; fun mustn't change the list
+static inline void arraylist_funall(t_arraylist *x, method fun, void *arg)
+{
+	long i;
+
+	for (i = 0; i < x->count; i++) {
+		t_arraylist_item item = x->items[ARRAYLIST_POS(x, i)];
+
+		if (item.slot)
+			(*fun)(item.obj, arg);
+	}
+}
+
+static inline void arraylist_reverse(t_arraylist *x)
+{
+	t_arraylist_item	item;
+	long				i, j;
+
+	arraylist_compact(x);
+	for (i = 0, j = x->count - 1; i < j; i++, j--) {
+		item = x->items[ARRAYLIST_POS(x, i)];
+		arraylist_place(x, ARRAYLIST_POS(x, i), x->items[ARRAYLIST_POS(x, j)]);
+		arraylist_place(x, ARRAYLIST_POS(x, j), item);
+	}
+}
+
+
+//***********************************************************************************************
+// the lock-free queue
+
+typedef struct _arrayqueue_cell
+{
+	volatile t_int32_atomic	seq;	// its position when it is free to push to, position + 1 when it holds an item
+	void					*obj;
+} t_arrayqueue_cell;
+
+typedef struct _arrayqueue
+{
+	t_arrayqueue_cell		*cells;
+	long					mask;
+	char					pad0[ARRAYQUEUE_LINE];
+	volatile t_int32_atomic	enqueue;	// next position to push to
+	char					pad1[ARRAYQUEUE_LINE];
+	volatile t_int32_atomic	dequeue;	// next position to pop from
+	char					pad2[ARRAYQUEUE_LINE];
+} t_arrayqueue;
+
+// a queue for at least size items
+static inline t_arrayqueue *arrayqueue_new(long size)
+{
+	t_arrayqueue	*q = (t_arrayqueue *)sysmem_newptrclear(sizeof(t_arrayqueue));
+	long			capacity = 2, i;
+
+	if (!q)
+		return NULL;
+	while (capacity < size)
+		capacity *= 2;
+	q->cells = (t_arrayqueue_cell *)sysmem_newptrclear(capacity * sizeof(t_arrayqueue_cell));
+	if (!q->cells) {
+		sysmem_freeptr(q);
+		return NULL;
+	}
+	for (i = 0; i < capacity; i++)
+		q->cells[i].seq = (t_int32_atomic)i;
+	q->mask = capacity - 1;
+	return q;
+}
+
+// once no thread uses it; the items left in it aren't freed
+static inline void arrayqueue_free(t_arrayqueue *q)
+{
+	if (q) {
+		sysmem_freeptr(q->cells);
+		sysmem_freeptr(q);
+	}
+}
+
+// any thread: MAX_ERR_GENERIC if the queue is full
+static inline t_max_err arrayqueue_push(t_arrayqueue *q, void *o)
+{
+	t_arrayqueue_cell	*cell;
+	unsigned int		pos = (unsigned int)q->enqueue;
+	int					diff;
+
+	while (1) {
+		cell = q->cells + (pos & q->mask);
+		diff = (int)((unsigned int)cell->seq - pos);
+		if (diff == 0) {
+			if (ATOMIC_COMPARE_SWAP32((int)pos, (int)(pos + 1), &q->enqueue))
+				break;		// the cell is ours
+		}
+		else if (diff < 0)
+			return MAX_ERR_GENERIC;		// a lap behind: full
+		pos = (unsigned int)q->enqueue;
+	}
+	cell->obj = o;
+	ATOMIC_COMPARE_SWAP32((int)pos, (int)(pos + 1), &cell->seq);	// publish, behind a barrier; only we can change it now
+	return MAX_ERR_NONE;
+}
+
+// any thread: the oldest item, or NULL if the queue is empty
+static inline void *arrayqueue_pop(t_arrayqueue *q)
+{
+	t_arrayqueue_cell	*cell;
+	unsigned int		pos = (unsigned int)q->dequeue;
+	int					diff;
+	void				*o;
+
+	while (1) {
+		cell = q->cells + (pos & q->mask);
+		diff = (int)((unsigned int)cell->seq - (pos + 1));
+		if (diff == 0) {
+			if (ATOMIC_COMPARE_SWAP32((int)pos, (int)(pos + 1), &q->dequeue))
+				break;
+		}
+		else if (diff < 0)
+			return NULL;		// not pushed yet: empty
+		pos = (unsigned int)q->dequeue;
+	}
+	o = cell->obj;
+	ATOMIC_COMPARE_SWAP32((int)(pos + 1), (int)(pos + q->mask + 1), &cell->seq);	// free for the next lap
+	return o;
+}
+
+#endif // _ARRAYLIST_H_
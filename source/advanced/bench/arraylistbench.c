@@ -0,0 +1,141 @@
+/**
+	@file
+	arraylistbench - t_arraylist against t_linklist, from a thousand to ten million items
+
+	usage: arraylistbench [largest]
+
+	For each size from 1000 up to largest (10000000), in steps of ten,
+	both lists are filled by appending, walked with funall, read at 1000
+	random indices, given 100 inserts in the middle and emptied from the
+	front. Each line gives the time per operation in ns. Both lists have
+	to come up with the same sums on the way, or the exit code is 1.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_linklist.h"
+#include "arraylist.h"
+
+#define ARRAYLISTBENCH_LOOKUPS	1000
+#define ARRAYLISTBENCH_INSERTS	100
+
+typedef struct _arraylistbench_times
+{
+	double		append;
+	double		walk;
+	double		lookup;
+	double		insert;
+	double		pop;
+	t_uint64	walksum;
+	t_uint64	lookupsum;
+} t_arraylistbench_times;
+
+static void arraylistbench_add(void *o, t_uint64 *sum)
+{
+	*sum += (t_uint64)(t_ptr_uint)o;
+}
+
+// the same sequence of indices for both lists
+static long arraylistbench_rand(t_uint32 *seed, long n)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return (long)(*seed % (t_uint32)n);
+}
+
+static void arraylistbench_linklist(long n, t_arraylistbench_times *t)
+{
+	t_linklist *ll = linklist_new();
+	t_uint32 seed = 2463534242u;
+	double start;
+	long i;
+
+	linklist_flags(ll, OBJ_FLAG_DATA);
+	start = systimer_gettime();
+	for (i = 0; i < n; i++)
+		linklist_append(ll, (void *)(t_ptr_uint)(i + 1));
+	t->append = (systimer_gettime() - start) * 1e6 / n;
+
+	t->walksum = 0;
+	start = systimer_gettime();
+	linklist_funall(ll, (method)arraylistbench_add, &t->walksum);
+	t->walk = (systimer_gettime() - start) * 1e6 / n;
+
+	t->lookupsum = 0;
+	start = systimer_gettime();
+	for (i = 0; i < ARRAYLISTBENCH_LOOKUPS; i++)
+		t->lookupsum += (t_ptr_uint)linklist_getindex(ll, arraylistbench_rand(&seed, n));
+	t->lookup = (systimer_gettime() - start) * 1e6 / ARRAYLISTBENCH_LOOKUPS;
+
+	start = systimer_gettime();
+	for (i = 0; i < ARRAYLISTBENCH_INSERTS; i++)
+		linklist_insertindex(ll, (void *)(t_ptr_uint)(n + i + 1), (long)(linklist_getsize(ll) / 2));
+	t->insert = (systimer_gettime() - start) * 1e6 / ARRAYLISTBENCH_INSERTS;
+
+	start = systimer_gettime();
+	for (i = 0; i < n + ARRAYLISTBENCH_INSERTS; i++)
+		linklist_chuckindex(ll, 0);
+	t->pop = (systimer_gettime() - start) * 1e6 / (n + ARRAYLISTBENCH_INSERTS);
+	object_free(ll);
+}
+
+static void arraylistbench_arraylist(long n, t_arraylistbench_times *t)
+{
+	t_arraylist *al = arraylist_new();
+	t_uint32 seed = 2463534242u;
+	double start;
+	long i;
+
+	arraylist_flags(al, OBJ_FLAG_DATA);
+	start = systimer_gettime();
+	for (i = 0; i < n; i++)
+		arraylist_append(al, (void *)(t_ptr_uint)(i + 1));
+	t->append = (systimer_gettime() - start) * 1e6 / n;
+
+	t->walksum = 0;
+	start = systimer_gettime();
+	arraylist_funall(al, (method)arraylistbench_add, &t->walksum);
+	t->walk = (systimer_gettime() - start) * 1e6 / n;
+
+	t->lookupsum = 0;
+	start = systimer_gettime();
+	for (i = 0; i < ARRAYLISTBENCH_LOOKUPS; i++)
+		t->lookupsum += (t_ptr_uint)arraylist_getindex(al, arraylistbench_rand(&seed, n));
+	t->lookup = (systimer_gettime() - start) * 1e6 / ARRAYLISTBENCH_LOOKUPS;
+
+	start = systimer_gettime();
+	for (i = 0; i < ARRAYLISTBENCH_INSERTS; i++)
+		arraylist_insertindex(al, (void *)(t_ptr_uint)(n + i + 1), (long)(arraylist_getsize(al) / 2));
+	t->insert = (systimer_gettime() - start) * 1e6 / ARRAYLISTBENCH_INSERTS;
+
+	start = systimer_gettime();
+	for (i = 0; i < n + ARRAYLISTBENCH_INSERTS; i++)
+		arraylist_popfront(al);
+	t->pop = (systimer_gettime() - start) * 1e6 / (n + ARRAYLISTBENCH_INSERTS);
+	arraylist_free(al);
+}
+
+int main(int argc, char **argv)
+{
+	long largest = argc > 1 ? atol(argv[1]) : 10000000, n;
+	t_arraylistbench_times ll, al;
+	int result = 0;
+
+	if (largest < 1000) {
+		fprintf(stderr, "usage: arraylistbench [largest (at least 1000)]\n");
+		return 2;
+	}
+	printf("%9s %-10s %9s %9s %9s %9s %9s\n", "items", "list", "append", "walk", "lookup", "insert", "pop");
+	for (n = 1000; n <= largest; n *= 10) {
+		arraylistbench_linklist(n, &ll);
+		arraylistbench_arraylist(n, &al);
+		printf("%9ld %-10s %9.1f %9.1f %9.1f %9.1f %9.1f\n", n, "linklist", ll.append, ll.walk, ll.lookup, ll.insert, ll.pop);
+		printf("%9ld %-10s %9.1f %9.1f %9.1f %9.1f %9.1f\n", n, "arraylist", al.append, al.walk, al.lookup, al.insert, al.pop);
+		if (ll.walksum != al.walksum || ll.lookupsum != al.lookupsum) {
+			printf("%9ld the lists don't agree\n", n);
+			result = 1;
+		}
+	}
+	return result;
+}
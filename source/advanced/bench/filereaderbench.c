@@ -0,0 +1,170 @@
+/**
+	@file
+	filereaderbench - filereader's block cache, from 64 blocks up to 65536, the most it takes
+
+	usage: filereaderbench [megabytes] [largest]
+
+	Writes a file of megabytes (64) whose bytes can be worked out from
+	their offsets, then for cache sizes from 64 blocks up to largest
+	(65536), in steps of four, reads int32s from it through the cache:
+	one at a time moving forward, one at a time at random offsets, and in
+	lists of 1000 random offsets, which take more blocks than the smaller
+	caches hold. The mapped file is read the same way for comparison.
+	Each line gives the time per value in ns and the hit rate. Every
+	value read is checked against the file, or the exit code is 1.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_path.h"
+#include "ext_systhread.h"
+#include "filereader.h"
+
+#define FILEREADERBENCH_NAME	"filereaderbench.tmp"
+#define FILEREADERBENCH_READS	100000
+#define FILEREADERBENCH_LIST	1000
+
+typedef struct _filereaderbench_times
+{
+	double		forward;
+	double		random;
+	double		list;
+	double		hitrate;
+	long		wrong;
+} t_filereaderbench_times;
+
+// the byte at offset p of the file
+static unsigned char filereaderbench_byte(t_int64 p)
+{
+	return (unsigned char)(((t_uint64)p * 2654435761u) >> 13);
+}
+
+static t_atom_long filereaderbench_int32(t_int64 p)
+{
+	return (t_int32)((t_uint32)filereaderbench_byte(p) | (t_uint32)filereaderbench_byte(p + 1) << 8
+					 | (t_uint32)filereaderbench_byte(p + 2) << 16 | (t_uint32)filereaderbench_byte(p + 3) << 24);
+}
+
+static t_bool filereaderbench_write(t_int64 size)
+{
+	unsigned char buf[FILEREADER_BLOCKSIZE];
+	FILE *f = fopen(FILEREADERBENCH_NAME, "wb");
+	t_int64 p;
+	long i;
+
+	if (!f)
+		return false;
+	for (p = 0; p < size; p += FILEREADER_BLOCKSIZE) {
+		for (i = 0; i < FILEREADER_BLOCKSIZE; i++)
+			buf[i] = filereaderbench_byte(p + i);
+		if (fwrite(buf, 1, FILEREADER_BLOCKSIZE, f) != FILEREADER_BLOCKSIZE) {
+			fclose(f);
+			return false;
+		}
+	}
+	return !fclose(f);
+}
+
+// the same sequence of offsets for every cache
+static t_int64 filereaderbench_rand(t_uint32 *seed, t_int64 n)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return (t_int64)(((t_uint64)*seed * 2654435761u) % (t_uint64)n);
+}
+
+static long filereaderbench_check(long n, const t_atom *offsets, const t_atom *values)
+{
+	long i, wrong = 0;
+
+	for (i = 0; i < n; i++) {
+		if (atom_getlong(values + i) != filereaderbench_int32(atom_getlong(offsets + i)))
+			wrong++;
+	}
+	return wrong;
+}
+
+static void filereaderbench_run(t_filereader *r, t_bool map, long nblocks, t_filereaderbench_times *t)
+{
+	t_atom offsets[FILEREADERBENCH_LIST], values[FILEREADERBENCH_LIST];
+	t_uint32 seed = 2463534242u;
+	t_int64 last;
+	double start;
+	long i, j;
+
+	t->wrong = 0;
+	if (filereader_open(r, FILEREADERBENCH_NAME, 0, map, nblocks, 3)) {
+		t->wrong = 1;
+		return;
+	}
+	last = r->size - 4;
+
+	start = systimer_gettime();
+	for (i = 0; i < FILEREADERBENCH_READS; i++) {
+		atom_setlong(offsets, (i * 52) % last);
+		if (filereader_getv(r, 1, offsets, FILEREADER_INT32, false, values) != 1)
+			t->wrong++;
+		t->wrong += filereaderbench_check(1, offsets, values);
+	}
+	t->forward = (systimer_gettime() - start) * 1e6 / FILEREADERBENCH_READS;
+
+	start = systimer_gettime();
+	for (i = 0; i < FILEREADERBENCH_READS; i++) {
+		atom_setlong(offsets, filereaderbench_rand(&seed, last));
+		if (filereader_getv(r, 1, offsets, FILEREADER_INT32, false, values) != 1)
+			t->wrong++;
+		t->wrong += filereaderbench_check(1, offsets, values);
+	}
+	t->random = (systimer_gettime() - start) * 1e6 / FILEREADERBENCH_READS;
+
+	start = systimer_gettime();
+	for (i = 0; i < FILEREADERBENCH_READS; i += FILEREADERBENCH_LIST) {
+		for (j = 0; j < FILEREADERBENCH_LIST; j++)
+			atom_setlong(offsets + j, filereaderbench_rand(&seed, last));
+		if (filereader_getv(r, FILEREADERBENCH_LIST, offsets, FILEREADER_INT32, false, values) != FILEREADERBENCH_LIST)
+			t->wrong++;
+		t->wrong += filereaderbench_check(FILEREADERBENCH_LIST, offsets, values);
+	}
+	t->list = (systimer_gettime() - start) * 1e6 / FILEREADERBENCH_READS;
+
+	t->hitrate = r->reads ? 100. * r->hits / r->reads : 0.;
+	filereader_close(r);
+}
+
+int main(int argc, char **argv)
+{
+	long megabytes = argc > 1 ? atol(argv[1]) : 64;
+	long largest = argc > 2 ? atol(argv[2]) : 65536, n;
+	t_filereaderbench_times t;
+	t_filereader r;
+	int result = 0;
+
+	if (megabytes < 1 || largest < 64) {
+		fprintf(stderr, "usage: filereaderbench [megabytes (at least 1)] [largest (at least 64)]\n");
+		return 2;
+	}
+	if (!filereaderbench_write((t_int64)megabytes << 20)) {
+		fprintf(stderr, "filereaderbench: can't write %s\n", FILEREADERBENCH_NAME);
+		return 2;
+	}
+	filereader_init(&r);
+	printf("%9s %9s %9s %9s %9s\n", "blocks", "forward", "random", "list", "hit %");
+	for (n = 64; n <= largest; n *= 4) {
+		filereaderbench_run(&r, false, n, &t);
+		printf("%9ld %9.1f %9.1f %9.1f %9.1f\n", n, t.forward, t.random, t.list, t.hitrate);
+		if (t.wrong) {
+			printf("%9ld %ld values read wrong\n", n, t.wrong);
+			result = 1;
+		}
+	}
+	filereaderbench_run(&r, true, 0, &t);
+	printf("%9s %9.1f %9.1f %9.1f %9.1f\n", "mapped", t.forward, t.random, t.list, t.hitrate);
+	if (t.wrong) {
+		printf("%9s %ld values read wrong\n", "mapped", t.wrong);
+		result = 1;
+	}
+	filereader_free(&r);
+	remove(FILEREADERBENCH_NAME);
+	return result;
+}
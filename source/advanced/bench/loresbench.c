@@ -0,0 +1,192 @@
+/**
+	@file
+	loresbench - lores.h's filter bank, from one channel up to 64
+
+	usage: loresbench [largest]
+
+	For channel counts from 1 to twice LORES_LANES, one at a time, and
+	then doubling up to largest (64), a bank of lores filters runs
+	vectors of 64 samples at 44100 Hz, the way lores~ and mc.lores~ run it
+	from their perform routines: with a fixed cutoff, with a cutoff signal
+	per channel read once per vector, and with the same signals in
+	sample-accurate mode. Counts that don't fill the last group of
+	LORES_LANES channels show what the unused lanes cost. Each line gives
+	the time per channel-sample in ns. Every channel's output has to be
+	the same as that channel run through a bank of its own, or the exit
+	code is 1.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "lores.h"
+
+#define LORESBENCH_VS		64
+#define LORESBENCH_SR		44100.
+#define LORESBENCH_VECTORS	4			// vectors of input, gone through in turn
+#define LORESBENCH_REPEATS	10000000	// channel-samples per measurement, at least
+
+enum {
+	LORESBENCH_FIXED = 0,
+	LORESBENCH_VECTOR,
+	LORESBENCH_ACCURATE,
+	LORESBENCH_MODES
+};
+
+typedef struct _loresbench
+{
+	long		largest;
+	double		*noise;			// input, LORESBENCH_VECTORS vectors plus one sample per channel
+	double		*cutoff;		// cutoff signal, the same length
+	double		*out;			// LORESBENCH_VECTORS vectors per channel
+	double		**ins;
+	double		**outs;
+	double		**fins;
+} t_loresbench;
+
+static t_bool loresbench_alloc(t_loresbench *x, long largest)
+{
+	long length = LORESBENCH_VECTORS * LORESBENCH_VS + largest, i;
+	t_uint32 seed = 2463534242u;
+
+	x->largest = largest;
+	x->noise = (double *)sysmem_newptr(length * sizeof(double));
+	x->cutoff = (double *)sysmem_newptr(length * sizeof(double));
+	x->out = (double *)sysmem_newptr(largest * LORESBENCH_VECTORS * LORESBENCH_VS * sizeof(double));
+	x->ins = (double **)sysmem_newptr(largest * sizeof(double *));
+	x->outs = (double **)sysmem_newptr(largest * sizeof(double *));
+	x->fins = (double **)sysmem_newptr(largest * sizeof(double *));
+	if (!x->noise || !x->cutoff || !x->out || !x->ins || !x->outs || !x->fins)
+		return false;
+	for (i = 0; i < length; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		x->noise[i] = seed / 2147483648. - 1.;
+		x->cutoff[i] = 1000. + 800. * sin(i * 0.01);
+	}
+	return true;
+}
+
+static void loresbench_free(t_loresbench *x)
+{
+	if (x->noise)
+		sysmem_freeptr(x->noise);
+	if (x->cutoff)
+		sysmem_freeptr(x->cutoff);
+	if (x->out)
+		sysmem_freeptr(x->out);
+	if (x->ins)
+		sysmem_freeptr(x->ins);
+	if (x->outs)
+		sysmem_freeptr(x->outs);
+	if (x->fins)
+		sysmem_freeptr(x->fins);
+}
+
+// channel c of chans reads its input and cutoff c samples on from the first, so no two are the same
+static void loresbench_vector(t_loresbench *x, long chans, long first, long v, t_bool keep, int mode, t_lores_mod *mod)
+{
+	long c;
+
+	for (c = 0; c < chans; c++) {
+		x->ins[c] = x->noise + v * LORESBENCH_VS + first + c;
+		x->fins[c] = x->cutoff + v * LORESBENCH_VS + first + c;
+		x->outs[c] = x->out + ((first + c) * LORESBENCH_VECTORS + (keep ? v : 0)) * LORESBENCH_VS;
+	}
+	mod->fins = mode == LORESBENCH_FIXED ? NULL : (const double *const *)x->fins;
+	mod->fchans = chans;
+	mod->freq = 1000.;
+	mod->rins = NULL;
+	mod->rchans = 1;
+	mod->res = 0.5;
+	mod->accurate = mode == LORESBENCH_ACCURATE;
+}
+
+// ns per channel-sample for one way of running the bank
+static double loresbench_time(t_loresbench *x, t_lores_bank *b, long chans, int mode)
+{
+	long r, repeats = MAX(LORESBENCH_REPEATS / (chans * LORESBENCH_VS), 1);
+	t_lores_mod mod;
+	double start;
+
+	lores_bank_resize(b, chans, LORESBENCH_VS, LORESBENCH_SR);
+	start = systimer_gettime();
+	for (r = 0; r < repeats; r++) {
+		loresbench_vector(x, chans, 0, r % LORESBENCH_VECTORS, false, mode, &mod);
+		lores_bank_process(b, x->ins, x->outs, &mod, LORESBENCH_VS);
+	}
+	return (systimer_gettime() - start) * 1e6 / ((double)repeats * chans * LORESBENCH_VS);
+}
+
+// the number of channels whose output differs from running that channel on its own
+static long loresbench_check(t_loresbench *x, t_lores_bank *b, t_lores_bank *one, long chans, int mode)
+{
+	double solo[LORESBENCH_VS];
+	t_lores_mod mod;
+	long c, v, i, wrong = 0;
+
+	lores_bank_resize(b, chans, LORESBENCH_VS, LORESBENCH_SR);
+	for (v = 0; v < LORESBENCH_VECTORS; v++) {
+		loresbench_vector(x, chans, 0, v, true, mode, &mod);
+		lores_bank_process(b, x->ins, x->outs, &mod, LORESBENCH_VS);
+	}
+	for (c = 0; c < chans; c++) {
+		lores_bank_resize(one, 1, LORESBENCH_VS, LORESBENCH_SR);
+		for (v = 0; v < LORESBENCH_VECTORS; v++) {
+			double *out;
+
+			loresbench_vector(x, 1, c, v, true, mode, &mod);
+			out = x->outs[0];
+			x->outs[0] = solo;
+			lores_bank_process(one, x->ins, x->outs, &mod, LORESBENCH_VS);
+			for (i = 0; i < LORESBENCH_VS; i++) {
+				if (solo[i] != out[i] || !isfinite(out[i]))
+					break;
+			}
+			if (i < LORESBENCH_VS) {
+				wrong++;
+				break;
+			}
+		}
+	}
+	return wrong;
+}
+
+int main(int argc, char **argv)
+{
+	long largest = argc > 1 ? atol(argv[1]) : 64, chans, wrong;
+	t_loresbench x = { 0 };
+	t_lores_bank b, one;
+	double t[LORESBENCH_MODES];
+	int mode, result = 0;
+
+	if (largest < 1) {
+		fprintf(stderr, "usage: loresbench [largest (at least 1)]\n");
+		return 2;
+	}
+	if (!loresbench_alloc(&x, largest)) {
+		loresbench_free(&x);
+		return 2;
+	}
+	lores_tables_init();
+	lores_bank_init(&b);
+	lores_bank_init(&one);
+	printf("%9s %9s %9s %9s %9s\n", "channels", "groups", "fixed", "vector", "accurate");
+	for (chans = 1; chans <= largest; chans = chans < 2 * LORES_LANES ? chans + 1 : chans * 2) {
+		wrong = 0;
+		for (mode = 0; mode < LORESBENCH_MODES; mode++) {
+			t[mode] = loresbench_time(&x, &b, chans, mode);
+			wrong += loresbench_check(&x, &b, &one, chans, mode);
+		}
+		printf("%9ld %9ld %9.2f %9.2f %9.2f\n", chans, (chans + LORES_LANES - 1) / LORES_LANES,
+			   t[LORESBENCH_FIXED], t[LORESBENCH_VECTOR], t[LORESBENCH_ACCURATE]);
+		if (wrong) {
+			printf("%9ld %ld channels differ from running them on their own\n", chans, wrong);
+			result = 1;
+		}
+	}
+	lores_bank_free(&b);
+	lores_bank_free(&one);
+	loresbench_free(&x);
+	return result;
+}
@@ -0,0 +1,150 @@
+/**
+	@file
+	numlistbench - numlist.h against going through the atoms, from ten to a million numbers
+
+	usage: numlistbench [largest]
+
+	For each size from 10 up to largest (1000000), in steps of ten, a
+	list of ints and a list of floats are searched for their smallest
+	element and for every element equal to one value: once atom by atom,
+	checking each one's type as minimum and match used to, and once
+	through a numlist, both counting and not counting numlist_set(). Each
+	line gives the time per element in ns. Both ways have to find the
+	same elements, or the exit code is 1.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "numlist.h"
+
+#define NUMLISTBENCH_REPEATS	10000000	// elements gone through per measurement, at least
+
+typedef struct _numlistbench_times
+{
+	double		atoms;			// argmin and find, atom by atom
+	double		set;			// numlist_set()
+	double		numlist;		// argmin and find on the numlist
+	long		argmin;
+	long		found;
+} t_numlistbench_times;
+
+// the atom's value and whether it is a float, as the objects worked it out for each comparison
+static double numlistbench_value(const t_atom *a)
+{
+	if (atom_gettype(a) == A_FLOAT)
+		return atom_getfloat(a);
+	if (atom_gettype(a) == A_LONG)
+		return (double)atom_getlong(a);
+	return 0;
+}
+
+static long numlistbench_atoms_argmin(long ac, const t_atom *av)
+{
+	long i, at = 0;
+	double min = numlistbench_value(av);
+
+	for (i = 1; i < ac; i++) {
+		if (numlistbench_value(av + i) < min) {
+			min = numlistbench_value(av + i);
+			at = i;
+		}
+	}
+	return at;
+}
+
+static long numlistbench_atoms_count(long ac, const t_atom *av, double value)
+{
+	long i, found = 0;
+
+	for (i = 0; i < ac; i++)
+		found += numlistbench_value(av + i) == value;
+	return found;
+}
+
+static long numlistbench_numlist_count(t_numlist *nl, double value)
+{
+	long i, found = 0;
+
+	for (i = numlist_find(nl, 0, value); i < nl->count; i = numlist_find(nl, i + 1, value))
+		found++;
+	return found;
+}
+
+// a list of n numbers from 0 to 999, as ints or as floats, with the smallest somewhere in the middle
+static void numlistbench_fill(long n, t_bool floats, t_atom *av)
+{
+	t_uint32 seed = 2463534242u;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		if (floats)
+			atom_setfloat(av + i, 1 + seed % 999 + 0.5);
+		else
+			atom_setlong(av + i, 1 + seed % 999);
+	}
+	if (floats)
+		atom_setfloat(av + n / 2, 0.5);
+	else
+		atom_setlong(av + n / 2, 0);
+}
+
+static void numlistbench_run(long n, t_atom *av, t_numlist *nl, t_numlistbench_times *t)
+{
+	long r, repeats = MAX(NUMLISTBENCH_REPEATS / n, 1);
+	double value = numlistbench_value(av + n - 1), start;
+
+	start = systimer_gettime();
+	for (r = 0; r < repeats; r++) {
+		t->argmin = numlistbench_atoms_argmin(n, av);
+		t->found = numlistbench_atoms_count(n, av, value);
+	}
+	t->atoms = (systimer_gettime() - start) * 1e6 / ((double)repeats * n);
+
+	start = systimer_gettime();
+	for (r = 0; r < repeats; r++)
+		numlist_set(nl, n, av);
+	t->set = (systimer_gettime() - start) * 1e6 / ((double)repeats * n);
+
+	start = systimer_gettime();
+	for (r = 0; r < repeats; r++) {
+		if (numlist_argmin(nl) != t->argmin || numlistbench_numlist_count(nl, value) != t->found)
+			t->argmin = -1;
+	}
+	t->numlist = (systimer_gettime() - start) * 1e6 / ((double)repeats * n);
+}
+
+int main(int argc, char **argv)
+{
+	long largest = argc > 1 ? atol(argv[1]) : 1000000, n, floats;
+	t_numlistbench_times t;
+	t_numlist nl;
+	t_atom *av;
+	int result = 0;
+
+	if (largest < 10) {
+		fprintf(stderr, "usage: numlistbench [largest (at least 10)]\n");
+		return 2;
+	}
+	av = (t_atom *)sysmem_newptr(largest * sizeof(t_atom));
+	if (!av)
+		return 2;
+	numlist_init(&nl);
+	printf("%9s %-6s %9s %9s %9s %9s\n", "numbers", "type", "atoms", "set", "numlist", "both");
+	for (n = 10; n <= largest; n *= 10) {
+		for (floats = 0; floats < 2; floats++) {
+			numlistbench_fill(n, (t_bool)floats, av);
+			numlistbench_run(n, av, &nl, &t);
+			printf("%9ld %-6s %9.2f %9.2f %9.2f %9.2f\n", n, floats ? "float" : "int", t.atoms, t.set, t.numlist, t.set + t.numlist);
+			if (t.argmin != n / 2) {
+				printf("%9ld the two ways don't agree\n", n);
+				result = 1;
+			}
+		}
+	}
+	numlist_free(&nl);
+	sysmem_freeptr(av);
+	return result;
+}
@@ -0,0 +1,146 @@
+/**
+	@file
+	simdsigbench - simdsig.h's dispatched kernels against its scalar ones, from 1 sample to 4096
+
+	usage: simdsigbench [largest]
+
+	simdsig_init() picks the widest kernels this CPU has; for sizes from
+	1 up to largest (4096), at each power of two and one less than it so
+	the tails are taken too, every kernel is run both the way it was
+	picked and as the scalar version. Each line gives the time per sample
+	in ns for both and how many times faster the picked one is. split is
+	run with signal bounds and with constant ones. Both versions have to
+	give the same outputs, or the exit code is 1.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "simdsig.h"
+
+#define SIMDSIGBENCH_REPEATS	1000000		// samples per measurement, at least
+
+enum {
+	SIMDSIGBENCH_MUL = 0,
+	SIMDSIGBENCH_ADD,
+	SIMDSIGBENCH_SCALE,
+	SIMDSIGBENCH_OFFSET,
+	SIMDSIGBENCH_SPLIT,
+	SIMDSIGBENCH_SPLITK,	// split with constant bounds
+	SIMDSIGBENCH_KERNELS
+};
+
+static const char *s_simdsigbench_names[SIMDSIGBENCH_KERNELS] = { "mul", "add", "scale", "offset", "split", "split k" };
+
+typedef struct _simdsigbench
+{
+	double		*a;
+	double		*b;
+	double		*low;
+	double		*high;
+	double		*out[3];		// the picked kernel's outputs
+	double		*ref[3];		// the scalar kernel's
+} t_simdsigbench;
+
+static void simdsigbench_kernel(const t_simdsig_ops *ops, int kernel, t_simdsigbench *x, double **out, long n)
+{
+	switch (kernel) {
+	case SIMDSIGBENCH_MUL:
+		ops->mul(out[0], x->a, x->b, n);
+		break;
+	case SIMDSIGBENCH_ADD:
+		ops->add(out[0], x->a, x->b, n);
+		break;
+	case SIMDSIGBENCH_SCALE:
+		ops->scale(out[0], x->a, 0.5, n);
+		break;
+	case SIMDSIGBENCH_OFFSET:
+		ops->offset(out[0], x->a, 0.25, n);
+		break;
+	case SIMDSIGBENCH_SPLIT:
+		ops->split(x->a, x->low, 1, x->high, 1, out[0], out[1], out[2], n);
+		break;
+	case SIMDSIGBENCH_SPLITK:
+		ops->split(x->a, x->low, 0, x->high, 0, out[0], out[1], out[2], n);
+		break;
+	}
+}
+
+// ns per sample
+static double simdsigbench_time(const t_simdsig_ops *ops, int kernel, t_simdsigbench *x, double **out, long n)
+{
+	long r, repeats = MAX(SIMDSIGBENCH_REPEATS / n, 1);
+	double start = systimer_gettime();
+
+	for (r = 0; r < repeats; r++)
+		simdsigbench_kernel(ops, kernel, x, out, n);
+	return (systimer_gettime() - start) * 1e6 / ((double)repeats * n);
+}
+
+static t_bool simdsigbench_same(int kernel, t_simdsigbench *x, long n)
+{
+	int outs = kernel >= SIMDSIGBENCH_SPLIT ? 3 : 1, o;
+	long i;
+
+	for (o = 0; o < outs; o++) {
+		for (i = 0; i < n; i++) {
+			if (x->out[o][i] != x->ref[o][i])
+				return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	long largest = argc > 1 ? atol(argv[1]) : 4096, n, p, i;
+	t_simdsig_ops scalar = {
+		"scalar",
+		simdsig_mul_scalar, simdsig_add_scalar, simdsig_scale_scalar, simdsig_offset_scalar,
+		simdsig_split_scalar
+	};
+	t_simdsigbench x;
+	double **bufs[] = { &x.a, &x.b, &x.low, &x.high, x.out, x.out + 1, x.out + 2, x.ref, x.ref + 1, x.ref + 2 };
+	double picked, unpicked;
+	t_uint32 seed = 2463534242u;
+	int kernel, result = 0;
+
+	if (largest < 1) {
+		fprintf(stderr, "usage: simdsigbench [largest (at least 1)]\n");
+		return 2;
+	}
+	for (i = 0; i < (long)(sizeof(bufs) / sizeof(*bufs)); i++) {
+		*bufs[i] = (double *)sysmem_newptrclear(largest * sizeof(double));
+		if (!*bufs[i])
+			return 2;
+	}
+	// the bounds cross the input here and there, so split sends samples both ways
+	for (i = 0; i < largest; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		x.a[i] = seed / 2147483648. - 1.;
+		x.b[i] = 1. - x.a[i] * 0.5;
+		x.low[i] = -0.5 + 0.25 * sin(i * 0.1);
+		x.high[i] = 0.5 + 0.25 * cos(i * 0.1);
+	}
+
+	simdsig_init();
+	printf("kernels: %s\n", s_simdsig.name);
+	printf("%9s %-8s %9s %9s %9s\n", "samples", "kernel", "scalar", s_simdsig.name, "speedup");
+	for (p = 1; p <= largest; p *= 2) {
+		for (n = p > 2 ? p - 1 : p; n <= p; n++) {
+			for (kernel = 0; kernel < SIMDSIGBENCH_KERNELS; kernel++) {
+				unpicked = simdsigbench_time(&scalar, kernel, &x, x.ref, n);
+				picked = simdsigbench_time(&s_simdsig, kernel, &x, x.out, n);
+				printf("%9ld %-8s %9.3f %9.3f %9.2f\n", n, s_simdsigbench_names[kernel], unpicked, picked, unpicked / picked);
+				if (!simdsigbench_same(kernel, &x, n)) {
+					printf("%9ld %s gives different outputs from the scalar version\n", n, s_simdsigbench_names[kernel]);
+					result = 1;
+				}
+			}
+		}
+	}
+	for (i = 0; i < (long)(sizeof(bufs) / sizeof(*bufs)); i++)
+		sysmem_freeptr(*bufs[i]);
+	return result;
+}
@@ -0,0 +1,261 @@
+/**
+	@file
+	channel.h - a lock-free ring that carries fixed-size items from one thread to another
+
+	One thread writes, one thread reads, and neither takes a lock while
+	the ring has room and items: the writer publishes an item by moving
+	head past it, the reader frees it by moving tail past it, and each
+	side only ever writes its own index.
+
+	A reader on the main thread gives the channel a qelem. A write sets it
+	when the reader isn't already due to run, and channel_drain() hands
+	the reader everything that has arrived in one go, a batch at a time.
+
+	A full ring either drops the item, counting it as an overrun, or, with
+	CHANNEL_BLOCK, makes the writer wait for the reader to free a slot. A
+	reader on a worker thread can likewise wait for an item instead of
+	polling. Waits take the channel's lock; the side that frees a slot or
+	adds an item only takes it when the other side is waiting.
+	channel_close() wakes both sides and makes further waits fail, so a
+	thread can be stopped while it waits.
+*/
+
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+#include "ext_systhread.h"
+
+#ifdef WIN_VERSION
+#define CHANNEL_FENCE()		MemoryBarrier()
+#else
+#define CHANNEL_FENCE()		__sync_synchronize()
+#endif
+
+#define CHANNEL_LINE		64		// bytes per cache line, to keep the two sides' fields apart
+
+enum {
+	CHANNEL_BLOCK = 1			// a write to a full channel waits for room instead of dropping the item
+};
+
+enum {
+	CHANNEL_OK = 0,
+	CHANNEL_EMPTY,				// nothing to read
+	CHANNEL_FULL,				// the item was dropped (an overrun)
+	CHANNEL_CLOSED
+};
+
+enum {
+	CHANNEL_WRITER = 1,			// who is waiting
+	CHANNEL_READER
+};
+
+typedef void (*t_channel_fn)(void *arg, void *item);
+
+typedef struct _channel
+{
+	char				*items;
+	long				itemsize;
+	t_uint32			mask;			// capacity - 1
+	long				flags;
+	void				*qelem;			// set for the reader when items arrive, or NULL
+	t_systhread_mutex	lock;			// for waits only
+	t_systhread_cond	cond;
+	char				pad0[CHANNEL_LINE];
+
+	// the writer's
+	volatile t_uint32	head;			// next slot to write
+	t_uint32			tailseen;		// the reader's tail when last looked at
+	t_atom_long			written;
+	t_atom_long			overruns;		// items dropped because the ring was full
+	t_atom_long			blocked;		// writes that had to wait for room
+	long				highwater;		// most items ever waiting
+	char				pad1[CHANNEL_LINE];
+
+	// the reader's
+	volatile t_uint32	tail;			// next slot to read
+	t_uint32			headseen;
+	t_atom_long			read;
+	char				pad2[CHANNEL_LINE];
+
+	volatile t_int32_atomic	notified;	// the qelem is set
+	volatile long		waiting;		// CHANNEL_WRITER or CHANNEL_READER while one of them waits
+	volatile long		closed;
+} t_channel;
+
+
+// a channel of capacity (rounded up to a power of two) items of itemsize bytes
+static inline t_channel *channel_new(long itemsize, long capacity, long flags, void *qelem)
+{
+	t_channel *ch = (t_channel *)sysmem_newptrclear(sizeof(t_channel));
+	t_uint32 size = 2;
+
+	if (!ch)
+		return NULL;
+	while (size < (t_uint32)capacity && size < 0x40000000)
+		size <<= 1;
+	ch->items = (char *)sysmem_newptr(size * itemsize);
+	if (!ch->items) {
+		sysmem_freeptr(ch);
+		return NULL;
+	}
+	ch->itemsize = itemsize;
+	ch->mask = size - 1;
+	ch->flags = flags;
+	ch->qelem = qelem;
+	systhread_mutex_new(&ch->lock, 0);
+	systhread_cond_new(&ch->cond, 0);
+	return ch;
+}
+
+// neither side may be using it
+static inline void channel_free(t_channel *ch)
+{
+	if (!ch)
+		return;
+	systhread_cond_free(ch->cond);
+	systhread_mutex_free(ch->lock);
+	sysmem_freeptr(ch->items);
+	sysmem_freeptr(ch);
+}
+
+// any thread: wake whoever waits, and fail waits from now on; items already written can still be read
+static inline void channel_close(t_channel *ch)
+{
+	systhread_mutex_lock(ch->lock);
+	ch->closed = 1;
+	systhread_cond_broadcast(ch->cond);
+	systhread_mutex_unlock(ch->lock);
+}
+
+// any thread, while neither side is waiting: allow waits again after channel_close()
+static inline void channel_open(t_channel *ch)
+{
+	ch->closed = 0;
+}
+
+// the other side is waiting: wake it
+static inline void channel_wake(t_channel *ch, long who)
+{
+	CHANNEL_FENCE();		// our index is out before we look at waiting; the waiter sets waiting before it looks at our index
+	if (ch->waiting == who) {
+		systhread_mutex_lock(ch->lock);
+		systhread_cond_signal(ch->cond);
+		systhread_mutex_unlock(ch->lock);
+	}
+}
+
+// items waiting to be read, as either side sees it
+static inline long channel_count(t_channel *ch)
+{
+	return (long)(ch->head - ch->tail);
+}
+
+
+//***********************************************************************************************
+// the writer
+
+// writer: add a copy of item. CHANNEL_FULL means it was dropped; CHANNEL_CLOSED that a wait for room was cut short.
+static inline long channel_write(t_channel *ch, const void *item)
+{
+	t_uint32 head = ch->head;
+
+	if (head - ch->tailseen > ch->mask) {
+		ch->tailseen = ch->tail;
+		if (head - ch->tailseen > ch->mask) {
+			if (!(ch->flags & CHANNEL_BLOCK)) {
+				ch->overruns++;
+				return CHANNEL_FULL;
+			}
+			systhread_mutex_lock(ch->lock);
+			ch->waiting = CHANNEL_WRITER;
+			CHANNEL_FENCE();
+			while (head - ch->tail > ch->mask && !ch->closed)
+				systhread_cond_wait(ch->cond, ch->lock);
+			if (ch->waiting == CHANNEL_WRITER)
+				ch->waiting = 0;
+			systhread_mutex_unlock(ch->lock);
+			ch->tailseen = ch->tail;
+			if (head - ch->tailseen > ch->mask)
+				return CHANNEL_CLOSED;
+			ch->blocked++;
+		}
+	}
+	memcpy(ch->items + (size_t)(head & ch->mask) * ch->itemsize, item, ch->itemsize);
+	CHANNEL_FENCE();		// the item is in before the reader can see it
+	ch->head = head + 1;
+	ch->written++;
+	if (head + 1 - ch->tailseen > (t_uint32)ch->highwater) {		// only an upper bound: look at where the reader is now
+		ch->tailseen = ch->tail;
+		if (head + 1 - ch->tailseen > (t_uint32)ch->highwater)
+			ch->highwater = (long)(head + 1 - ch->tailseen);
+	}
+
+	channel_wake(ch, CHANNEL_READER);
+	if (ch->qelem && ATOMIC_COMPARE_SWAP32(0, 1, &ch->notified))
+		qelem_set(ch->qelem);
+	return CHANNEL_OK;
+}
+
+
+//***********************************************************************************************
+// the reader
+
+// reader: copy out the next item. With block set, wait for one if there is none (from a worker only).
+static inline long channel_read(t_channel *ch, void *item, t_bool block)
+{
+	t_uint32 tail = ch->tail;
+
+	if (tail == ch->headseen) {
+		ch->headseen = ch->head;
+		if (tail == ch->headseen) {
+			if (!block)
+				return CHANNEL_EMPTY;
+			systhread_mutex_lock(ch->lock);
+			ch->waiting = CHANNEL_READER;
+			CHANNEL_FENCE();
+			while (tail == ch->head && !ch->closed)
+				systhread_cond_wait(ch->cond, ch->lock);
+			if (ch->waiting == CHANNEL_READER)		// the writer may have filled the ring and started waiting since we were woken
+				ch->waiting = 0;
+			systhread_mutex_unlock(ch->lock);
+			ch->headseen = ch->head;
+			if (tail == ch->headseen)
+				return CHANNEL_CLOSED;
+		}
+	}
+	CHANNEL_FENCE();		// don't read the item before we have seen head move past it
+	memcpy(item, ch->items + (size_t)(tail & ch->mask) * ch->itemsize, ch->itemsize);
+	CHANNEL_FENCE();		// done with the slot before the writer can reuse it
+	ch->tail = tail + 1;
+	ch->read++;
+	channel_wake(ch, CHANNEL_WRITER);
+	return CHANNEL_OK;
+}
+
+// reader, usually from the qelem: call fn(arg, item) on up to max items, in place, and free their
+// slots in one go. Sets the qelem again if that left some behind. Returns the number read.
+static inline long channel_drain(t_channel *ch, long max, t_channel_fn fn, void *arg)
+{
+	t_uint32 tail = ch->tail, head, i;
+
+	ch->notified = 0;
+	CHANNEL_FENCE();		// a write from here on sets the qelem again
+	head = ch->headseen = ch->head;
+	CHANNEL_FENCE();		// don't read the items before we have seen head move past them
+	if ((t_uint32)max < head - tail)
+		head = tail + (t_uint32)max;
+	for (i = tail; i != head; i++)
+		fn(arg, ch->items + (size_t)(i & ch->mask) * ch->itemsize);
+	CHANNEL_FENCE();
+	ch->tail = head;
+	ch->read += head - tail;
+	channel_wake(ch, CHANNEL_WRITER);
+	if (head != ch->headseen && ch->qelem)
+		qelem_set(ch->qelem);
+	return (long)(head - tail);
+}
+
+#endif // _CHANNEL_H_
@@ -2,9 +2,19 @@
 	@file
 	collect - collect numbers and operate on them.
 			- demonstrates use of C++ and the STL in a Max external
-			- also demonstrates use of a mutex for thread safety
+			- also demonstrates use of a mutex for thread safety, and a lock-free append buffer in front of it
 			- on Windows, demonstrate project setup for static linking to the Microsoft Runtime
 
+	Numbers are kept in one contiguous column: 64-bit ints while only ints
+	have come in, doubles from the first float on, so ints come back out
+	as ints. int and float don't take the mutex; they go into a staging
+	buffer that is drained into the column whenever the column is used.
+
+	bang outputs the collection and clears it, count outputs its size.
+	sort and unique sort it in place (unique also drops repeats); mean,
+	percentile <p ...> (0 to 100) and histogram <bins> [<low> <high>]
+	output their result after a selector of the same name.
+
 	@ingroup	examples
 
 	Copyright 2009 - Cycling '74
@@ -18,6 +28,9 @@
 #include "ext_systhread.h"
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 using namespace std;
 
 // a wrapper for cpost() only called for debug builds on Windows
@@ -28,35 +41,122 @@ using namespace std;
 #define DPOST cpost
 #endif
 
+#define COLLECT_STAGE	4096	// ints and floats that can be waiting to be drained into the column
 
-// a c++ class representing a number, and types for a vector of those numbers
-class number {
-private:
-	double value;
+
+// a column of numbers: int64 until the first float arrives, double from then on
+class numberColumn {
 public:
-	number(double &newValue)
+	bool					isfloat = false;
+	vector<t_atom_long>		ints;
+	vector<double>			floats;
+
+	size_t size() const
+	{
+		return isfloat ? floats.size() : ints.size();
+	}
+
+	void append(t_atom_long value)
+	{
+		if (isfloat)
+			floats.push_back((double)value);
+		else
+			ints.push_back(value);
+	}
+
+	void append(double value)
 	{
-		value = newValue;
+		if (!isfloat)
+			promote();
+		floats.push_back(value);
 	}
 
-	void setValue(const double &newValue)
+	// the ints become doubles, once; the capacity of both is kept for reuse
+	void promote()
 	{
-		value = newValue;
+		floats.resize(ints.size());
+		for (size_t i = 0; i < ints.size(); i++)
+			floats[i] = (double)ints[i];
+		ints.clear();
+		isfloat = true;
 	}
 
-	void getValue(double &retrievedValue)
+	void clear()
 	{
-		retrievedValue = value;
+		ints.clear();
+		floats.clear();
+		isfloat = false;
 	}
 };
-typedef std::vector<number>		numberVector;
-typedef numberVector::iterator	numberIterator;
+
+
+// multiple writers append without a lock; the owner of the mutex drains
+class appendBuffer {
+public:
+	struct slot {
+		union {
+			t_atom_long	l;
+			double		f;
+		}		value;
+		bool	isfloat;
+	};
+
+	atomic<long>	reserved {0};		// slots handed out; COLLECT_STAGE or more while closed
+	atomic<long>	committed {0};		// slots written
+	slot			slots[COLLECT_STAGE];
+
+	// false if the buffer is full (or being drained): take the mutex and append to the column instead
+	bool push(t_atom_long l, double f, bool isfloat)
+	{
+		long i = reserved.fetch_add(1, memory_order_acquire);
+
+		if (i >= COLLECT_STAGE)
+			return false;
+		if (isfloat)
+			slots[i].value.f = f;
+		else
+			slots[i].value.l = l;
+		slots[i].isfloat = isfloat;
+		committed.fetch_add(1, memory_order_release);
+		return true;
+	}
+
+	// with the mutex held: close the buffer, wait for the slots already handed out, move them to the column
+	void drain(numberColumn &column)
+	{
+		long n = reserved.exchange(COLLECT_STAGE, memory_order_acquire);
+
+		if (n > COLLECT_STAGE)
+			n = COLLECT_STAGE;
+		while (committed.load(memory_order_acquire) != n)
+			;	// a writer is a couple of stores from done
+		for (long i = 0; i < n; i++) {
+			if (slots[i].isfloat)
+				column.append(slots[i].value.f);
+			else
+				column.append(slots[i].value.l);
+		}
+		committed.store(0, memory_order_relaxed);
+		reserved.store(0, memory_order_release);
+	}
+};
+
+
+// what the object keeps behind its mutex
+class numberStore {
+public:
+	numberColumn		column;
+	appendBuffer		stage;
+	vector<double>		scratch;	// percentile's copy of the column
+	vector<t_atom_long>	bins;		// histogram's counts
+};
 
 
 // max object instance data
 typedef struct _collect {
 	t_object			c_box;
-	numberVector		*c_vector;	// note: you must store this as a pointer and not directly as a member of the object's struct
+	numberStore			*c_store;	// note: you must store this as a pointer and not directly as a member of the object's struct
+	vector<t_atom>		*c_atoms;	// output buffer, reused from one output to the next; NULL while it is in use
 	void				*c_outlet;
 	t_systhread_mutex	c_mutex;
 } t_collect;
@@ -68,14 +168,20 @@ void	collect_free(t_collect *x);
 void	collect_assist(t_collect *x, void *b, long m, long a, char *s);
 void	collect_bang(t_collect *x);
 void	collect_count(t_collect *x);
-void	collect_int(t_collect *x, long value);
+void	collect_int(t_collect *x, t_atom_long value);
 void	collect_float(t_collect *x, double value);
 void	collect_list(t_collect *x, t_symbol *msg, long argc, t_atom *argv);
 void	collect_clear(t_collect *x);
+void	collect_sort(t_collect *x);
+void	collect_unique(t_collect *x);
+void	collect_mean(t_collect *x);
+void	collect_percentile(t_collect *x, t_symbol *msg, long argc, t_atom *argv);
+void	collect_histogram(t_collect *x, t_symbol *msg, long argc, t_atom *argv);
 
 
 // globals
 static t_class	*s_collect_class = NULL;
+static t_symbol	*ps_list, *ps_mean, *ps_percentile, *ps_histogram;
 
 /************************************************************************************/
 
@@ -89,17 +195,27 @@ void ext_main(void *r)
 						   A_GIMME,
 						   0);
 
-	class_addmethod(c, (method)collect_bang,	"bang",			0);
-	class_addmethod(c, (method)collect_int,		"int",			A_LONG,	0);
-	class_addmethod(c, (method)collect_float,	"float",		A_FLOAT,0);
-	class_addmethod(c, (method)collect_list,	"list",			A_GIMME,0);
-	class_addmethod(c, (method)collect_clear,	"clear",		0);
-	class_addmethod(c, (method)collect_count,	"count",		0);
-	class_addmethod(c, (method)collect_assist,	"assist",		A_CANT, 0);
-	class_addmethod(c, (method)stdinletinfo,	"inletinfo",	A_CANT, 0);
+	class_addmethod(c, (method)collect_bang,		"bang",			0);
+	class_addmethod(c, (method)collect_int,			"int",			A_LONG,	0);
+	class_addmethod(c, (method)collect_float,		"float",		A_FLOAT,0);
+	class_addmethod(c, (method)collect_list,		"list",			A_GIMME,0);
+	class_addmethod(c, (method)collect_clear,		"clear",		0);
+	class_addmethod(c, (method)collect_count,		"count",		0);
+	class_addmethod(c, (method)collect_sort,		"sort",			0);
+	class_addmethod(c, (method)collect_unique,		"unique",		0);
+	class_addmethod(c, (method)collect_mean,		"mean",			0);
+	class_addmethod(c, (method)collect_percentile,	"percentile",	A_GIMME,0);
+	class_addmethod(c, (method)collect_histogram,	"histogram",	A_GIMME,0);
+	class_addmethod(c, (method)collect_assist,		"assist",		A_CANT, 0);
+	class_addmethod(c, (method)stdinletinfo,		"inletinfo",	A_CANT, 0);
 
 	class_register(CLASS_BOX, c);
 	s_collect_class = c;
+
+	ps_list = gensym("list");
+	ps_mean = gensym("mean");
+	ps_percentile = gensym("percentile");
+	ps_histogram = gensym("histogram");
 }
 
 
@@ -114,9 +230,10 @@ void *collect_new(t_symbol *s, long argc, t_atom *argv)
 	if (x) {
 		systhread_mutex_new(&x->c_mutex, 0);
 		x->c_outlet = outlet_new(x, NULL);
-		x->c_vector = new numberVector;
-		x->c_vector->reserve(10);
-		collect_list(x, gensym("list"), argc, argv);
+		x->c_store = new numberStore;
+		x->c_store->column.ints.reserve(10);
+		x->c_atoms = new vector<t_atom>;
+		collect_list(x, ps_list, argc, argv);
 	}
 	return(x);
 }
@@ -125,7 +242,104 @@ void *collect_new(t_symbol *s, long argc, t_atom *argv)
 void collect_free(t_collect *x)
 {
 	systhread_mutex_free(x->c_mutex);
-	delete x->c_vector;
+	delete x->c_store;
+	delete x->c_atoms;
+}
+
+
+/************************************************************************************/
+// The column, with the mutex held
+
+// everything int and float have staged goes into the column first, so it comes out in order
+static numberColumn &collect_column(t_collect *x)
+{
+	x->c_store->stage.drain(x->c_store->column);
+	return x->c_store->column;
+}
+
+
+// the output buffer with room for n atoms; only allocates when it has to grow,
+// or if another thread is still sending out the last output
+static vector<t_atom> *collect_takeatoms(t_collect *x, size_t n)
+{
+	vector<t_atom> *atoms = x->c_atoms;
+
+	x->c_atoms = NULL;
+	if (!atoms)
+		atoms = new vector<t_atom>;
+	if (atoms->size() < n)
+		atoms->resize(n);
+	return atoms;
+}
+
+
+// without the mutex: hand the buffer back for the next output
+static void collect_giveatoms(t_collect *x, vector<t_atom> *atoms)
+{
+	systhread_mutex_lock(x->c_mutex);
+	if (!x->c_atoms) {
+		x->c_atoms = atoms;
+		atoms = NULL;
+	}
+	systhread_mutex_unlock(x->c_mutex);
+	delete atoms;
+}
+
+
+// summed four ways at once, so the compiler can keep the adds in vector registers
+template <typename T>
+static double collect_sum(const T *p, size_t n)
+{
+	double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		s0 += (double)p[i];
+		s1 += (double)p[i + 1];
+		s2 += (double)p[i + 2];
+		s3 += (double)p[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += (double)p[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+
+template <typename T>
+static void collect_range(const T *p, size_t n, double &lo, double &hi)
+{
+	T l0 = p[0], l1 = p[0], h0 = p[0], h1 = p[0];
+	size_t i = 0;
+
+	for (; i + 2 <= n; i += 2) {
+		l0 = p[i] < l0 ? p[i] : l0;
+		h0 = p[i] > h0 ? p[i] : h0;
+		l1 = p[i + 1] < l1 ? p[i + 1] : l1;
+		h1 = p[i + 1] > h1 ? p[i + 1] : h1;
+	}
+	for (; i < n; i++) {
+		l0 = p[i] < l0 ? p[i] : l0;
+		h0 = p[i] > h0 ? p[i] : h0;
+	}
+	lo = (double)(l0 < l1 ? l0 : l1);
+	hi = (double)(h0 > h1 ? h0 : h1);
+}
+
+
+template <typename T>
+static void collect_bin(const T *p, size_t n, double lo, double hi, t_atom_long *bins, long nbins)
+{
+	double scale = hi > lo ? nbins / (hi - lo) : 0.;
+
+	for (size_t i = 0; i < n; i++) {
+		double v = (double)p[i];
+		long b;
+
+		if (!(v >= lo && v <= hi))
+			continue;
+		b = (long)((v - lo) * scale);
+		bins[b < nbins ? b : nbins - 1]++;		// high itself goes in the last bin
+	}
 }
 
 
@@ -143,74 +357,66 @@ void collect_assist(t_collect *x, void *b, long msg, long arg, char *dst)
 
 void collect_bang(t_collect *x)
 {
-	numberIterator iter, begin, end;
-	int i = 0;
+	vector<t_atom> *atoms;
+	t_atom *av;
 	long ac = 0;
-	t_atom *av = NULL;
-	double value;
 
 	DPOST("head\n");
 	systhread_mutex_lock(x->c_mutex);
-	ac = x->c_vector->size();
+	numberColumn &column = collect_column(x);
+	ac = column.size();
 
 	DPOST("ac=%ld\n", ac);
-	if (ac)
-		av = new t_atom[ac];
-
-	if (ac && av) {
-		DPOST("assigning begin and end\n");
-		begin = x->c_vector->begin();
-		end = x->c_vector->end();
-
-		DPOST("assigning iter\n");
-		iter = begin;
-
-		DPOST("entering for\n", ac);
-		for (;;) {
-			DPOST("i=%i\n", i);
-			(*iter).getValue(value);
-			atom_setfloat(av+i, value);
-
-			DPOST("incrementing\n");
-			i++;
-			iter++;
-
-			DPOST("comparing\n");
-			if (iter == end)
-				break;
-		}
-		systhread_mutex_unlock(x->c_mutex);	// must unlock before calling _clear() or we will deadlock
-
-		DPOST("about to clear\n", ac);
-		collect_clear(x);
-
-		DPOST("about to outlet\n", ac);
-		outlet_anything(x->c_outlet, gensym("list"), ac, av); // don't want to call outlets in mutexes either
-
-		DPOST("about to delete\n", ac);
-		delete[] av;
-	}
-	else
+	if (!ac) {
 		systhread_mutex_unlock(x->c_mutex);
+		return;
+	}
+	atoms = collect_takeatoms(x, ac);
+	av = atoms->data();
+	if (column.isfloat) {
+		for (long i = 0; i < ac; i++)
+			atom_setfloat(av + i, column.floats[i]);
+	}
+	else {
+		for (long i = 0; i < ac; i++)
+			atom_setlong(av + i, column.ints[i]);
+	}
+	column.clear();		// under the same lock, so nothing appended since the copy is lost
+	systhread_mutex_unlock(x->c_mutex);
+
+	DPOST("about to outlet\n", ac);
+	outlet_anything(x->c_outlet, ps_list, ac, av); // don't want to call outlets in mutexes either
+	collect_giveatoms(x, atoms);
 }
 
 
 void collect_count(t_collect *x)
 {
-	outlet_int(x->c_outlet, x->c_vector->size());
+	long count;
+
+	systhread_mutex_lock(x->c_mutex);
+	count = collect_column(x).size();
+	systhread_mutex_unlock(x->c_mutex);
+	outlet_int(x->c_outlet, count);
 }
 
 
-void collect_int(t_collect *x, long value)
+void collect_int(t_collect *x, t_atom_long value)
 {
-	collect_float(x, value);
+	if (x->c_store->stage.push(value, 0., false))
+		return;
+	systhread_mutex_lock(x->c_mutex);
+	collect_column(x).append(value);
+	systhread_mutex_unlock(x->c_mutex);
 }
 
 
 void collect_float(t_collect *x, double value)
 {
+	if (x->c_store->stage.push(0, value, true))
+		return;
 	systhread_mutex_lock(x->c_mutex);
-	x->c_vector->push_back(value);
+	collect_column(x).append(value);
 	systhread_mutex_unlock(x->c_mutex);
 }
 
@@ -218,9 +424,12 @@ void collect_float(t_collect *x, double value)
 void collect_list(t_collect *x, t_symbol *msg, long argc, t_atom *argv)
 {
 	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
 	for (int i=0; i<argc; i++) {
-		double value = atom_getfloat(argv+i);
-		x->c_vector->push_back(value);
+		if (atom_gettype(argv+i) == A_LONG)
+			column.append(atom_getlong(argv+i));
+		else
+			column.append(atom_getfloat(argv+i));
 	}
 	systhread_mutex_unlock(x->c_mutex);
 }
@@ -229,7 +438,141 @@ void collect_list(t_collect *x, t_symbol *msg, long argc, t_atom *argv)
 void collect_clear(t_collect *x)
 {
 	systhread_mutex_lock(x->c_mutex);
-	x->c_vector->clear();
+	collect_column(x).clear();
+	systhread_mutex_unlock(x->c_mutex);
+}
+
+
+void collect_sort(t_collect *x)
+{
+	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
+	if (column.isfloat)
+		sort(column.floats.begin(), column.floats.end());
+	else
+		sort(column.ints.begin(), column.ints.end());
+	systhread_mutex_unlock(x->c_mutex);
+}
+
+
+void collect_unique(t_collect *x)
+{
+	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
+	if (column.isfloat) {
+		sort(column.floats.begin(), column.floats.end());
+		column.floats.erase(unique(column.floats.begin(), column.floats.end()), column.floats.end());
+	}
+	else {
+		sort(column.ints.begin(), column.ints.end());
+		column.ints.erase(unique(column.ints.begin(), column.ints.end()), column.ints.end());
+	}
+	systhread_mutex_unlock(x->c_mutex);
+}
+
+
+void collect_mean(t_collect *x)
+{
+	double mean;
+	size_t n;
+	t_atom a;
+
+	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
+	n = column.size();
+	if (n)
+		mean = (column.isfloat ? collect_sum(column.floats.data(), n) : collect_sum(column.ints.data(), n)) / n;
 	systhread_mutex_unlock(x->c_mutex);
+
+	if (n) {
+		atom_setfloat(&a, mean);
+		outlet_anything(x->c_outlet, ps_mean, 1, &a);
+	}
 }
 
+
+// percentile 50 gives the median; between two numbers the result is interpolated
+void collect_percentile(t_collect *x, t_symbol *msg, long argc, t_atom *argv)
+{
+	vector<t_atom> *atoms;
+	size_t n;
+
+	if (!argc) {
+		object_error((t_object *)x, "percentile: which percentile?");
+		return;
+	}
+	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
+	vector<double> &sorted = x->c_store->scratch;
+	n = column.size();
+	if (!n) {
+		systhread_mutex_unlock(x->c_mutex);
+		return;
+	}
+	if (column.isfloat)
+		sorted.assign(column.floats.begin(), column.floats.end());
+	else
+		sorted.assign(column.ints.begin(), column.ints.end());
+
+	// nth_element leaves everything above the rank after it, so its neighbour is the smallest of those
+	atoms = collect_takeatoms(x, argc);
+	for (long i = 0; i < argc; i++) {
+		double p = CLAMP(atom_getfloat(argv + i), 0., 100.);
+		double rank = p / 100. * (n - 1), frac;
+		size_t k = (size_t)rank;
+		double v;
+
+		nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+		v = sorted[k];
+		frac = rank - k;
+		if (frac > 0. && k + 1 < n)
+			v += frac * (*min_element(sorted.begin() + k + 1, sorted.end()) - v);
+		atom_setfloat(atoms->data() + i, v);
+	}
+	systhread_mutex_unlock(x->c_mutex);
+
+	outlet_anything(x->c_outlet, ps_percentile, argc, atoms->data());
+	collect_giveatoms(x, atoms);
+}
+
+
+// histogram <bins> [<low> <high>]: counts in equal bins over low to high (or the collection's range)
+void collect_histogram(t_collect *x, t_symbol *msg, long argc, t_atom *argv)
+{
+	long nbins = argc ? (long)atom_getlong(argv) : 0;
+	vector<t_atom> *atoms;
+	double lo = 0., hi = 0.;
+	size_t n;
+
+	if (nbins < 1) {
+		object_error((t_object *)x, "histogram: needs a number of bins");
+		return;
+	}
+	systhread_mutex_lock(x->c_mutex);
+	numberColumn &column = collect_column(x);
+	vector<t_atom_long> &bins = x->c_store->bins;
+	n = column.size();
+	if (argc >= 3) {
+		lo = atom_getfloat(argv + 1);
+		hi = atom_getfloat(argv + 2);
+	}
+	else if (n) {
+		if (column.isfloat)
+			collect_range(column.floats.data(), n, lo, hi);
+		else
+			collect_range(column.ints.data(), n, lo, hi);
+	}
+	bins.assign(nbins, 0);
+	if (column.isfloat)
+		collect_bin(column.floats.data(), n, lo, hi, bins.data(), nbins);
+	else
+		collect_bin(column.ints.data(), n, lo, hi, bins.data(), nbins);
+
+	atoms = collect_takeatoms(x, nbins);
+	for (long i = 0; i < nbins; i++)
+		atom_setlong(atoms->data() + i, bins[i]);
+	systhread_mutex_unlock(x->c_mutex);
+
+	outlet_anything(x->c_outlet, ps_histogram, nbins, atoms->data());
+	collect_giveatoms(x, atoms);
+}
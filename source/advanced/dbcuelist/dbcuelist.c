@@ -9,6 +9,18 @@
 	This object itself has a name.
 	All objects with the same name share the same database (and thus the same cues).
 
+	Every statement comes from s_dbcuelist_sql, with its parameters bound
+	in as quoted literals, so names and values may contain any character.
+	begin and commit batch any number of statements into one transaction;
+	load reads a text file of events (a cue name, then the event's values,
+	one per line) in a single transaction and posts how many events per
+	second it managed.
+
+	Nothing here waits for the database. Statements are queued to the
+	database's worker thread (dbworker.h) and run there in the order they
+	were sent; errors are reported, and cue.do's events come out, when
+	they come back to the main thread.
+
 	For the syntax of the SQL commands, refer to http://sqlite.org
 	For the information on the Max database API, refer to the ext_database.h header file.
 
@@ -21,16 +33,74 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_database.h"
+#include "ext_hashtab.h"
+#include "ext_systime.h"
+#include "dbworker.h"
 
 
 // Data Structures
 typedef struct _dbcuelist {
-	t_object	d_obj;
-	void		*d_outlet;
-	t_symbol	*d_name;
-	t_database	*d_db;
+	t_object			d_obj;
+	void				*d_outlet;
+	t_symbol			*d_name;
+	t_dbworker_client	*d_client;		// the way to the database's worker
+	long				d_batch;		// begin without a commit yet
 } t_dbcuelist;
 
+// a statement being bound, grown as needed
+typedef struct _dbcuelist_buf {
+	char		*text;
+	long		size;
+} t_dbcuelist_buf;
+
+// what load hands to the worker, and gets back
+typedef struct _dbcuelist_loading {
+	t_handle	text;
+	char		filename[MAX_PATH_CHARS];
+	long		nested;			// inside begin and commit already
+	long		events;
+	long		failed;
+	long		cues;
+	double		ms;
+} t_dbcuelist_loading;
+
+
+// the statements: ?n is bound as a quoted string literal, #n as a number
+enum {
+	DBCUELIST_SQL_CUE_CREATE = 0,
+	DBCUELIST_SQL_CUE_DESTROY,
+	DBCUELIST_SQL_CUE_RENAME,
+	DBCUELIST_SQL_CUE_FIND,
+	DBCUELIST_SQL_CUE_EVENTS,
+	DBCUELIST_SQL_EVENT_CREATE,
+	DBCUELIST_SQL_EVENT_INSERT,
+	DBCUELIST_SQL_EVENT_DESTROY,
+	DBCUELIST_SQL_COUNT
+};
+
+static const char *s_dbcuelist_sql[DBCUELIST_SQL_COUNT] = {
+	"INSERT INTO cues ( name ) VALUES ( ?1 )",
+	"DELETE FROM cues WHERE name = ?1",
+	"UPDATE cues SET name = ?2 WHERE name = ?1",
+	"SELECT cue_id FROM cues WHERE name = ?1",
+	"SELECT value FROM events WHERE cue_id_ext = (SELECT cue_id FROM cues WHERE name = ?1)",
+	"INSERT INTO events ( cue_id_ext , value ) VALUES ( (SELECT cue_id FROM cues WHERE name = ?1) , ?2 )",
+	"INSERT INTO events ( cue_id_ext , value ) VALUES ( #1 , ?2 )",
+	"DELETE FROM events WHERE event_id = #1"
+};
+
+// what to say when one of them fails
+static const char *s_dbcuelist_errors[DBCUELIST_SQL_COUNT] = {
+	"error creating cue",
+	"error deleting cue",
+	"error renaming cue",
+	"error finding cue",
+	"invalid cue specified for 'do'",
+	"error creating event",
+	"error creating event",
+	"error deleting event"
+};
+
 
 // Prototypes
 t_dbcuelist	*dbcuelist_new(t_symbol *s, short argc, t_atom *argv);
@@ -41,6 +111,10 @@ void			dbcuelist_cue_rename(t_dbcuelist *x, t_symbol *s1, t_symbol *s2);
 void			dbcuelist_cue_do(t_dbcuelist *x, t_symbol *s);
 void			dbcuelist_event_create(t_dbcuelist *x, t_symbol *s, long argc, t_atom *argv);
 void			dbcuelist_event_destroy(t_dbcuelist *x, long event_id);
+void			dbcuelist_begin(t_dbcuelist *x);
+void			dbcuelist_commit(t_dbcuelist *x);
+void			dbcuelist_load(t_dbcuelist *x, t_symbol *s);
+void			dbcuelist_doload(t_dbcuelist *x, t_symbol *s, long argc, t_atom *argv);
 t_max_err		dbcuelist_attr_name_set(t_dbcuelist *x, void *attr, long argc, t_atom *argv);
 
 
@@ -71,6 +145,10 @@ void ext_main(void *r)
 	class_addmethod(c, (method)dbcuelist_event_create,	"event.create",		A_GIMME, 0);
 	class_addmethod(c, (method)dbcuelist_event_destroy,	"event.destroy",	A_LONG, 0);
 
+	class_addmethod(c, (method)dbcuelist_begin,			"begin",			0);
+	class_addmethod(c, (method)dbcuelist_commit,		"commit",			0);
+	class_addmethod(c, (method)dbcuelist_load,			"load",				A_DEFSYM, 0);
+
 	CLASS_ATTR_SYM(c,		"name",	0,	t_dbcuelist, d_name);
 	CLASS_ATTR_ACCESSORS(c,	"name",	NULL,	dbcuelist_attr_name_set);
 
@@ -85,7 +163,7 @@ t_dbcuelist *dbcuelist_new(t_symbol *s, short argc, t_atom *argv)
 	t_dbcuelist *x;
 
 	x = (t_dbcuelist *)object_alloc(s_dbcuelist_class);
-	if (x) {
+	if(x) {
 		x->d_outlet = outlet_new(x, 0L);
 		attr_args_process(x, argc, argv);
 	}
@@ -95,7 +173,135 @@ t_dbcuelist *dbcuelist_new(t_symbol *s, short argc, t_atom *argv)
 
 void dbcuelist_free(t_dbcuelist *x)
 {
-	db_close(&x->d_db);
+	while(x->d_batch)
+		dbcuelist_commit(x);
+	dbworker_client_free(x->d_client);		// whatever is still queued runs first
+}
+
+
+/**********************************************************************/
+// Statements
+
+static t_bool dbcuelist_reserve(t_dbcuelist_buf *b, long size)
+{
+	char *text;
+
+	if(size <= b->size)
+		return true;
+	size = MAX(size, b->size * 2);
+	text = b->text ? (char *)sysmem_resizeptr(b->text, size) : (char *)sysmem_newptr(size);
+	if(!text)
+		return false;
+	b->text = text;
+	b->size = size;
+	return true;
+}
+
+
+// one of s_dbcuelist_sql with its parameters bound, in b; NULL if out of memory
+static const char *dbcuelist_bind(t_dbcuelist_buf *b, long which, long argc, const char **argv)
+{
+	const char *t, *p;
+	long len = 0, i;
+
+	// room for the statement with every parameter fully escaped
+	for(t = s_dbcuelist_sql[which]; *t; t++)
+		len++;
+	for(i = 0; i < argc; i++)
+		len += 2 * strlen(argv[i]) + 2;
+	if(!dbcuelist_reserve(b, len + 1))
+		return NULL;
+
+	len = 0;
+	for(t = s_dbcuelist_sql[which]; *t; t++) {
+		i = t[1] - '1';
+		if((*t != '?' && *t != '#') || i < 0 || i >= argc) {
+			b->text[len++] = *t;
+			continue;
+		}
+		if(*t == '#') {
+			for(p = argv[i]; *p; p++)
+				b->text[len++] = *p;
+		}
+		else {
+			b->text[len++] = '\'';
+			for(p = argv[i]; *p; p++) {
+				if(*p == '\'')
+					b->text[len++] = '\'';		// doubled, as SQL escapes it
+				b->text[len++] = *p;
+			}
+			b->text[len++] = '\'';
+		}
+		t++;
+	}
+	b->text[len] = 0;
+	return b->text;
+}
+
+
+// main thread: a statement has come back from the worker
+static void dbcuelist_done(t_dbcuelist *x, t_dbworker_job *job)
+{
+	char	*str = NULL;
+	long	i, numrecords;
+
+	if(job->err) {
+		object_error((t_object *)x, "%s", s_dbcuelist_errors[job->tag]);
+		return;
+	}
+	if(job->tag != DBCUELIST_SQL_CUE_EVENTS)
+		return;
+
+	numrecords = db_result_numrecords(job->result);
+	for(i=0; i<numrecords; i++) {
+		t_atom	*av = NULL;
+		long	ac = 0;
+
+		str = db_result_string(job->result, i, 0);
+		atom_setparse(&ac, &av, str);
+		if(ac && av) {
+			outlet_anything(x->d_outlet, ps_event, ac, av);
+			sysmem_freeptr(av);
+		}
+	}
+}
+
+
+// queue one of s_dbcuelist_sql to the worker
+static t_max_err dbcuelist_exec(t_dbcuelist *x, long which, long argc, const char **argv)
+{
+	t_dbcuelist_buf	b = { NULL, 0 };
+	t_dbworker_job	*job;
+
+	if(!x->d_client)
+		return MAX_ERR_INVALID_PTR;
+	job = dbworker_job_new(x->d_client, (t_dbworker_donefn)dbcuelist_done, which,
+						   which == DBCUELIST_SQL_CUE_EVENTS ? 0 : DBWORKER_WRITE);
+	if(!job)
+		return MAX_ERR_OUT_OF_MEM;
+	if(!dbcuelist_bind(&b, which, argc, argv)) {
+		dbworker_job_free(job);
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	job->sql = b.text;		// the job frees it
+	dbworker_submit(job);
+	return MAX_ERR_NONE;
+}
+
+
+// queue a function to run on the worker with the database
+static t_max_err dbcuelist_run(t_dbcuelist *x, t_dbworker_workfn work, long flags)
+{
+	t_dbworker_job *job;
+
+	if(!x->d_client)
+		return MAX_ERR_INVALID_PTR;
+	job = dbworker_job_new(x->d_client, NULL, 0, flags);
+	if(!job)
+		return MAX_ERR_OUT_OF_MEM;
+	job->work = work;
+	dbworker_submit(job);
+	return MAX_ERR_NONE;
 }
 
 
@@ -106,9 +312,9 @@ void dbcuelist_cue_create(t_dbcuelist *x, t_symbol *s)
 {
 	t_max_err	err = MAX_ERR_NONE;
 
-	err = db_query(x->d_db, NULL, "INSERT INTO cues ( 'name' ) VALUES ( \"%s\" )", s->s_name);
+	err = dbcuelist_exec(x, DBCUELIST_SQL_CUE_CREATE, 1, (const char **)&s->s_name);
 	if(err)
-		object_error((t_object *)x, "error creating event");
+		object_error((t_object *)x, "error creating cue");
 }
 
 
@@ -116,7 +322,7 @@ void dbcuelist_cue_destroy(t_dbcuelist *x, t_symbol *s)
 {
 	t_max_err	err = MAX_ERR_NONE;
 
-	err = db_query(x->d_db, NULL, "DELETE FROM cues WHERE name = \"%s\" ", s->s_name);
+	err = dbcuelist_exec(x, DBCUELIST_SQL_CUE_DESTROY, 1, (const char **)&s->s_name);
 	if(err)
 		object_error((t_object *)x, "error deleting cue");
 }
@@ -125,40 +331,22 @@ void dbcuelist_cue_destroy(t_dbcuelist *x, t_symbol *s)
 void dbcuelist_cue_rename(t_dbcuelist *x, t_symbol *s1, t_symbol *s2)
 {
 	t_max_err	err = MAX_ERR_NONE;
+	const char	*names[2] = { s1->s_name, s2->s_name };
 
-	err = db_query(x->d_db, NULL, "UPDATE cues SET name = \"%s\" WHERE name = \"%s\" ", s2->s_name, s1->s_name);
+	err = dbcuelist_exec(x, DBCUELIST_SQL_CUE_RENAME, 2, names);
 	if(err)
-		object_error((t_object *)x, "error deleting cue");
+		object_error((t_object *)x, "error renaming cue");
 }
 
 
+// the events come out once the query is back from the worker
 void dbcuelist_cue_do(t_dbcuelist *x, t_symbol *s)
 {
 	t_max_err	err = MAX_ERR_NONE;
-	t_db_result	*result = NULL;
-	char		*str = NULL;
-	int			i;
-	int			numrecords;
 
-	err = db_query(x->d_db, &result, "SELECT value FROM events WHERE cue_id_ext = \
-									  (SELECT cue_id FROM cues WHERE name = \"%s\") ", s->s_name);
-	if(err) {
+	err = dbcuelist_exec(x, DBCUELIST_SQL_CUE_EVENTS, 1, (const char **)&s->s_name);
+	if(err)
 		object_error((t_object *)x, "invalid cue specified for 'do'");
-		return;
-	}
-
-	numrecords = db_result_numrecords(result);
-	for(i=0; i<numrecords; i++) {
-		t_atom	*av = NULL;
-		long	ac = 0;
-
-		str = db_result_string(result, i, 0);
-		atom_setparse(&ac, &av, str);
-		if(ac && av) {
-			outlet_anything(x->d_outlet, ps_event, ac, av);
-			sysmem_freeptr(av);
-		}
-	}
 }
 
 
@@ -176,56 +364,255 @@ void dbcuelist_event_create(t_dbcuelist *x, t_symbol *s, long argc, t_atom *argv
 
 	atom_gettext(argc-1, argv+1, &textsize, &text, 0);
 	if(text && textsize) {
-		err = db_query(x->d_db, NULL, "INSERT INTO events ( 'cue_id_ext' , 'value' ) \
-				 VALUES ( (SELECT cue_id FROM cues WHERE name = \"%s\") , \"%s\") ",
-					   name->s_name, text);
+		const char *params[2] = { name->s_name, text };
+
+		err = dbcuelist_exec(x, DBCUELIST_SQL_EVENT_CREATE, 2, params);
 		if(err)
 			object_error((t_object *)x, "error creating event");
 	}
+	if(text)
+		sysmem_freeptr(text);
 }
 
 
 void dbcuelist_event_destroy(t_dbcuelist *x, long event_id)
 {
 	t_max_err	err = MAX_ERR_NONE;
+	char		idtext[32];
+	const char	*id = idtext;
 
-	err = db_query(x->d_db, NULL, "DELETE FROM events WHERE event_id = %ld", event_id);
+	snprintf_zero(idtext, sizeof(idtext), "%ld", event_id);
+	err = dbcuelist_exec(x, DBCUELIST_SQL_EVENT_DESTROY, 1, &id);
 	if(err)
 		object_error((t_object *)x, "error deleting event");
 }
 
 
+static t_max_err dbcuelist_dobegin(t_database *db, t_dbworker_job *job)
+{
+	return db_transaction_start(db);
+}
+
+
+static t_max_err dbcuelist_docommit(t_database *db, t_dbworker_job *job)
+{
+	return db_transaction_end(db);
+}
+
+
+void dbcuelist_begin(t_dbcuelist *x)
+{
+	if(x->d_client && !x->d_batch++)
+		dbcuelist_run(x, dbcuelist_dobegin, 0);
+}
+
+
+void dbcuelist_commit(t_dbcuelist *x)
+{
+	if(!x->d_batch)
+		return;
+	if(!--x->d_batch && x->d_client)
+		dbcuelist_run(x, dbcuelist_docommit, DBWORKER_WRITE);
+}
+
+
+void dbcuelist_load(t_dbcuelist *x, t_symbol *s)
+{
+	defer((t_object *)x, (method)dbcuelist_doload, s, 0, NULL);
+}
+
+
+static void dbcuelist_loading_free(t_dbcuelist_loading *l)
+{
+	if(l->text)
+		sysmem_freehandle(l->text);
+	sysmem_freeptr(l);
+}
+
+
+// worker thread: the id of the cue called name, created if need be; ids are kept in cues for the rest of the load
+static long dbcuelist_load_cue(t_database *db, t_dbcuelist_buf *b, t_hashtab *cues, const char *name)
+{
+	t_symbol	*key = gensym(name);
+	t_atom_long	id = 0;
+	t_db_result	*result = NULL;
+	long		lastid = 0;
+
+	if(hashtab_lookuplong(cues, key, &id) == MAX_ERR_NONE)
+		return (long)id;
+	if(dbcuelist_bind(b, DBCUELIST_SQL_CUE_FIND, 1, &name) && !db_query(db, &result, "%s", b->text) && db_result_numrecords(result))
+		id = db_result_long(result, 0, 0);
+	else if(dbcuelist_bind(b, DBCUELIST_SQL_CUE_CREATE, 1, &name) && !db_query(db, NULL, "%s", b->text)
+			&& !db_query_getlastinsertid(db, &lastid))
+		id = lastid;
+	if(result)
+		object_free(result);
+	if(id)
+		hashtab_storelong(cues, key, id);
+	return (long)id;
+}
+
+
+// worker thread: every line of the file, in one transaction
+static t_max_err dbcuelist_load_work(t_database *db, t_dbworker_job *job)
+{
+	t_dbcuelist_loading	*l = (t_dbcuelist_loading *)job->data;
+	t_dbcuelist_buf		b = { NULL, 0 };
+	char				cue[256], idtext[32];
+	const char			*params[2] = { idtext, NULL };
+	t_hashtab			*cues = hashtab_new(0);
+	char				*line, *end, *value, *last;
+	long				len, id;
+
+	l->ms = systimer_gettime();
+	if(!l->nested)
+		db_transaction_start(db);
+	for(line = *l->text; *line; line = end) {
+		for(end = line; *end && *end != '\n'; end++)
+			;
+		if(*end)
+			*end++ = 0;
+
+		// cue name, then the rest of the line (less a trailing semicolon) is the event
+		while(*line == ' ' || *line == '\t')
+			line++;
+		for(len = 0; line[len] && line[len] != ' ' && line[len] != '\t' && line[len] != ';'; len++)
+			;
+		for(value = line + len; *value == ' ' || *value == '\t'; value++)
+			;
+		for(last = value + strlen(value); last > value && (last[-1] == ';' || last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'); last--)
+			;
+		*last = 0;
+		if(!len || len >= (long)sizeof(cue) || !*value)
+			continue;
+		memcpy(cue, line, len);
+		cue[len] = 0;
+
+		id = dbcuelist_load_cue(db, &b, cues, cue);
+		snprintf_zero(idtext, sizeof(idtext), "%ld", id);
+		params[1] = value;
+		if(id && dbcuelist_bind(&b, DBCUELIST_SQL_EVENT_INSERT, 2, params) && !db_query(db, NULL, "%s", b.text))
+			l->events++;
+		else
+			l->failed++;
+	}
+	if(!l->nested)
+		db_transaction_end(db);
+	l->ms = systimer_gettime() - l->ms;
+	l->cues = (long)hashtab_getsize(cues);
+
+	object_free(cues);
+	if(b.text)
+		sysmem_freeptr(b.text);
+	return MAX_ERR_NONE;
+}
+
+
+// main thread: the load is in
+static void dbcuelist_load_done(t_dbcuelist *x, t_dbworker_job *job)
+{
+	t_dbcuelist_loading *l = (t_dbcuelist_loading *)job->data;
+
+	object_post((t_object *)x, "loaded %ld events into %ld cues from %s in %.0f ms, %.0f events/s",
+				l->events, l->cues, l->filename, l->ms, l->ms > 0. ? l->events * 1000. / l->ms : 0.);
+	if(l->failed)
+		object_error((t_object *)x, "%ld events in %s couldn't be stored", l->failed, l->filename);
+}
+
+
+void dbcuelist_doload(t_dbcuelist *x, t_symbol *s, long argc, t_atom *argv)
+{
+	char				filename[MAX_PATH_CHARS];
+	short				path;
+	t_fourcc			type = FOUR_CHAR_CODE('TEXT');
+	t_filehandle		fh;
+	t_dbcuelist_loading	*l;
+	t_dbworker_job		*job;
+
+	if(!x->d_client)
+		return;
+	if(s == gensym("")) {
+		filename[0] = 0;
+		if(open_dialog(filename, &path, &type, &type, 1))
+			return;
+	}
+	else {
+		strncpy_zero(filename, s->s_name, MAX_PATH_CHARS);
+		if(locatefile_extended(filename, &path, &type, &type, 1)) {
+			object_error((t_object *)x, "can't find file %s", filename);
+			return;
+		}
+	}
+	if(path_opensysfile(filename, path, &fh, READ_PERM)) {
+		object_error((t_object *)x, "can't open %s", filename);
+		return;
+	}
+	l = (t_dbcuelist_loading *)sysmem_newptrclear(sizeof(t_dbcuelist_loading));
+	job = l ? dbworker_job_new(x->d_client, (t_dbworker_donefn)dbcuelist_load_done, 0, DBWORKER_WRITE) : NULL;
+	if(!job) {
+		if(l)
+			sysmem_freeptr(l);
+		sysfile_close(fh);
+		return;
+	}
+	l->text = sysmem_newhandle(0);
+	sysfile_readtextfile(fh, l->text, 0, TEXT_LB_UNIX | TEXT_NULL_TERMINATE);
+	sysfile_close(fh);
+	strncpy_zero(l->filename, filename, MAX_PATH_CHARS);
+	l->nested = x->d_batch > 0;
+
+	job->work = dbcuelist_load_work;
+	job->data = l;
+	job->freedata = (method)dbcuelist_loading_free;
+	dbworker_submit(job);
+}
+
+
 /**********************************************************************/
 // Attribute Accessors
 
+// worker thread: set up the tables in the database
+static t_max_err dbcuelist_setup(t_database *db, t_dbworker_job *job)
+{
+	t_max_err	err = MAX_ERR_NONE;
+
+	err = db_query_table_new(db, "cues");
+	err = db_query_table_addcolumn(db, "cues", "name", "VARCHAR(256)", 0);
+
+	err = db_query_table_new(db, "events");
+	err = db_query_table_addcolumn(db, "events", "cue_id_ext",	"INTEGER", 0);
+	err = db_query_table_addcolumn(db, "events", "value",		"TEXT", 0);
+
+	// cues are looked up by name, and events by their cue, on every event.create and cue.do
+	err = db_query(db, NULL, "CREATE INDEX IF NOT EXISTS cues_name ON cues ( name )");
+	err = db_query(db, NULL, "CREATE INDEX IF NOT EXISTS events_cue ON events ( cue_id_ext )");
+
+	// The above will return error codes if the tables or columns already exist.
+	// This is okay, so we will always return MAX_ERR_NONE.
+	return MAX_ERR_NONE;
+}
+
+
 t_max_err dbcuelist_attr_name_set(t_dbcuelist *x, void *attr, long argc, t_atom *argv)
 {
 	t_symbol	*newname = atom_getsym(argv);
-	t_max_err	err = MAX_ERR_NONE;
 
 	if(newname == x->d_name)
 		return MAX_ERR_NONE;
 
-	// close the old database (if needed) and open the new one
+	// let go of the old database (if needed) and get the worker for the new one,
+	// which opens it
+	while(x->d_batch)
+		dbcuelist_commit(x);
+	dbworker_client_free(x->d_client);
 	x->d_name = newname;
-	db_close(&x->d_db);
-	db_open(x->d_name, NULL, &x->d_db);
+	x->d_client = dbworker_client_new((t_object *)x, x->d_name, NULL);
 
-	// by passing NULL for the second parameter to db_open() we are specifying that
-	// the db exist solely in memory.
+	// the worker's db_open() gets NULL for its second parameter: the db exists solely in memory.
 	// if you wish for it to be persistent (stored on disk),
 	// this is left as an exersize for the reader...
 
-	// set up the tables in the database
-	err = db_query_table_new(x->d_db, "cues");
-	err = db_query_table_addcolumn(x->d_db, "cues", "name", "VARCHAR(256)", 0);
-
-	err = db_query_table_new(x->d_db, "events");
-	err = db_query_table_addcolumn(x->d_db, "events", "cue_id_ext",	"INTEGER", 0);
-	err = db_query_table_addcolumn(x->d_db, "events", "value",		"TEXT", 0);
-
-	// The above will return error codes if the tables or columns already exist.
-	// This is okay, so we will always return MAX_ERR_NONE.
+	// set up the tables in the database, before anything else is queued
+	dbcuelist_run(x, dbcuelist_setup, DBWORKER_WRITE);
 	return MAX_ERR_NONE;
 }
-
@@ -2,6 +2,38 @@
 	@file
 	dbviewer - demonstrate use of database views for sqlite and jdataview
 
+	The query runs on the database's worker thread (dbworker.h), never on
+	the main thread. Cell text is read from pages of DBVIEWER_PAGEROWS rows,
+	fetched when the dataview first asks for a cell in one, so only the rows
+	that are scrolled into view are ever read and formatted; the last
+	DBVIEWER_PAGES pages are kept. Cells of a page that hasn't come back yet
+	are drawn empty, and drawn again once it has.
+
+	A refresh doesn't rebuild the dataview. The worker runs the query and
+	keeps, for every row, a hash of its first field (taken to identify the
+	row, as the id column does in most tables) and one of the whole row,
+	then compares them with the last refresh's. What comes back is which
+	rows went, which are new and which changed; the dataview deletes, adds
+	and redraws just those, and only pages from the first changed row on
+	are thrown away. When rows came back in a different order, or new ones
+	came before old ones, the dataview has no way to move them, so it is
+	filled again from scratch.
+
+	The object hears about changes from the worker, never by querying on
+	the main thread: jobs other objects queue as writes report back when
+	they are done, and every DBVIEWER_POLL ms the worker reads
+	total_changes() and PRAGMA data_version, which between them move with
+	any change made through the database's connection or another one, and
+	the answer comes back like any job's. Changes only schedule a refresh, at most one every DBVIEWER_INTERVAL ms, so a
+	table that is written to all the time doesn't keep the worker or the
+	display busy. Such a refresh first counts the rows, and if there are
+	no fewer it reads and hashes only the rows of the pages being shown:
+	when their keys haven't moved, just those rows are compared, and the
+	rest are read afresh whenever they are scrolled to anyway. Rows past
+	the old count are taken as appended, which is how a log grows, and
+	only they are read and added, once the last old row is found where it
+	was. Rows going, or shown keys moving, cost a full pass.
+
 	@ingroup	examples
 
 	Copyright 2009 - Cycling '74
@@ -18,6 +50,12 @@
 #include "jgraphics.h"
 #include "indexmap.h"
 #include "jdataview.h"
+#include "dbworker.h"
+
+#define DBVIEWER_PAGEROWS	256		// rows fetched at once
+#define DBVIEWER_PAGES		16		// pages kept
+#define DBVIEWER_INTERVAL	33		// ms between refreshes, about the display's rate
+#define DBVIEWER_POLL		250		// ms between asking the worker whether the database changed
 
 
 enum {
@@ -29,14 +67,70 @@ enum {
 };
 
 
+typedef struct _dbviewer_page {
+	long		p_page;			///< rows p_page * DBVIEWER_PAGEROWS on, or -1 for an empty slot
+	t_object	*p_result;		///< NULL until the page is back
+	long		p_used;			///< when it was last drawn from
+	long		p_request;		///< the request it is waiting on, 0 when it isn't
+} t_dbviewer_page;
+
+
+typedef struct _dbviewer_row {
+	t_uint64	r_key;			///< hash of the first field
+	t_uint64	r_sum;			///< hash of all of them
+	t_ptr_int	r_ref;			///< the rowref the dataview knows the row by; they go up with the row
+} t_dbviewer_row;
+
+
+typedef struct _dbviewer_rows {
+	long			count;
+	t_dbviewer_row	*rows;
+} t_dbviewer_rows;
+
+
+// what a refresh takes to the worker, and brings back
+typedef struct _dbviewer_refresh {
+	t_dbviewer_rows	*old;			///< the last refresh's rows; the job's while it is out
+	t_dbviewer_rows	*rows;			///< this one's
+	t_ptr_int		nextref;		///< the rowref for the next new row
+	long			numfields;
+	t_symbol		**fields;
+	t_rowref		*deleted;
+	long			numdeleted;
+	t_rowref		*inserted;		///< all after the last row that stayed
+	long			numinserted;
+	t_rowref		*updated;
+	long			numupdated;
+	long			first;			///< the first row whose page is out of date
+	long			lo;				///< the rows around the ones shown, lo to hi - 1, for a windowed refresh
+	long			hi;
+	char			windowed;		///< try comparing just the rows shown before a full pass
+	char			inwindow;		///< and that was enough
+	char			rebuild;		///< the order changed, so the dataview is filled again
+} t_dbviewer_refresh;
+
+
 typedef struct _dbviewer {
-	t_jbox		d_box;
-	t_object	*d_dataview;	///< The dataview object
-	t_hashtab	*d_columns;		///< The dataview columns:  column name -> column index
-	t_object	*d_view;		///< The dbview object that we need to display in a dataview
-	t_symbol	*d_query;		///< Attribute
-	t_symbol	*d_database;	///< Attribute
-	t_object	*d_db;			///< the actual database object
+	t_jbox				d_box;
+	t_object			*d_dataview;	///< The dataview object
+	t_hashtab			*d_columns;		///< The dataview columns:  column name -> column index
+	t_symbol			*d_query;		///< Attribute
+	t_symbol			*d_database;	///< Attribute
+	t_dbworker_client	*d_client;		///< where the queries run
+	long				d_generation;	///< bumped by each new query: refreshes of older ones are thrown away
+	long				d_numrows;
+	t_dbviewer_rows		*d_rows;		///< as of the last refresh; while one is out the worker reads it too
+	t_ptr_int			d_nextref;
+	char				d_refreshing;	///< a refresh is with the worker
+	char				d_dirty;		///< and another is wanted once it is back
+	char				d_scheduled;	///< d_clock is set
+	void				*d_clock;		///< for throttling refreshes
+	void				*d_poll;		///< for asking the worker about changes
+	t_atom_long			d_changes;		///< what the worker last said, or -1 before it has
+	char				d_polling;		///< a poll is with the worker
+	long				d_requests;		///< counts page requests
+	long				d_used;			///< counts page lookups, for p_used
+	t_dbviewer_page		d_pages[DBVIEWER_PAGES];
 } t_dbviewer;
 
 
@@ -50,14 +144,16 @@ void		dbviewer_freepatcherview(t_dbviewer *x, t_object *patcherview);
 t_max_err	dbviewer_notify(t_dbviewer *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 void		dbviewer_assist(t_dbviewer *x, void *b, long m, long a, char *s);
 void		dbviewer_bang(t_dbviewer *x);
+void		dbviewer_refresh(t_dbviewer *x, char windowed);
+void		dbviewer_tick(t_dbviewer *x);
 void		dbviewer_getcelltext(t_dbviewer *x, t_symbol *colname, long index, char *text, long maxlen);
 t_max_err	dbviewer_set_query(t_dbviewer *x, void *attr, long argc, t_atom *argv);
 t_max_err	dbviewer_set_database(t_dbviewer *x, void *attr, long argc, t_atom *argv);
+void		dbviewer_changed(t_dbviewer *x);
+void		dbviewer_poll(t_dbviewer *x);
 
 
 static t_class	*s_dbviewer_class = NULL;
-static t_symbol	*ps_dbview_update = NULL;
-static t_symbol	*ps_dbview_query_changed = NULL;
 
 /************************************************************************************/
 
@@ -91,9 +187,6 @@ void ext_main(void *r)
 
 	class_register(CLASS_BOX, c);
 	s_dbviewer_class = c;
-
-	ps_dbview_update = gensym("dbview_update");
-	ps_dbview_query_changed = gensym("dbview_query_changed");
 }
 
 
@@ -104,6 +197,7 @@ void *dbviewer_new(t_symbol *s, short argc, t_atom *argv)
 {
 	t_dbviewer		*x;
 	long			flags;
+	long			i;
 	t_dictionary	*d = NULL;
 
 	if (!(d=object_dictionaryarg(argc, argv)))
@@ -133,12 +227,17 @@ void *dbviewer_new(t_symbol *s, short argc, t_atom *argv)
 		x->d_columns = hashtab_new(13);
 		hashtab_flags(x->d_columns, OBJ_FLAG_DATA);
 		x->d_query = _sym_nothing;
+		x->d_nextref = 1;
+		x->d_clock = clock_new((t_object *)x, (method)dbviewer_tick);
+		x->d_poll = clock_new((t_object *)x, (method)dbviewer_poll);
+		x->d_changes = -1;
+		for (i = 0; i < DBVIEWER_PAGES; i++)
+			x->d_pages[i].p_page = -1;
 
 		dbviewer_initdataview(x);
 		attr_dictionary_process(x, d);
 
 		jbox_ready(&x->d_box);
-//		object_notify(x->d_view, ps_dbview_update, NULL);
 	}
 	return(x);
 }
@@ -153,11 +252,53 @@ void dbviewer_initdataview(t_dbviewer *x)
 }
 
 
+// throw away the pages holding row first and the ones after it
+static void dbviewer_clearpages(t_dbviewer *x, long first)
+{
+	long i;
+
+	for (i = 0; i < DBVIEWER_PAGES; i++) {
+		t_dbviewer_page *p = x->d_pages + i;
+
+		if (p->p_page < 0 || (p->p_page + 1) * DBVIEWER_PAGEROWS <= first)
+			continue;
+		if (p->p_result)
+			object_free(p->p_result);
+		p->p_result = NULL;
+		p->p_page = -1;
+		p->p_request = 0;		// a reply still out won't find it
+	}
+}
+
+
+static void dbviewer_rows_free(t_dbviewer_rows *rows)
+{
+	if (rows) {
+		if (rows->rows)
+			sysmem_freeptr(rows->rows);
+		sysmem_freeptr(rows);
+	}
+}
+
+
+// forget the rows: the dataview is to be filled from scratch by the next refresh
+static void dbviewer_droprows(t_dbviewer *x)
+{
+	if (!x->d_refreshing)
+		dbviewer_rows_free(x->d_rows);		// if not, the refresh has them, and frees them
+	x->d_rows = NULL;
+	x->d_numrows = 0;
+}
+
+
 // Memory Deallocation
 void dbviewer_free(t_dbviewer *x)
 {
-	db_view_remove(x->d_db, &x->d_view);
-	db_close(&x->d_db);
+	freeobject((t_object *)x->d_clock);
+	freeobject((t_object *)x->d_poll);
+	dbviewer_droprows(x);
+	dbworker_client_free(x->d_client);
+	dbviewer_clearpages(x, 0);
 	jbox_free(&x->d_box);
 }
 
@@ -175,32 +316,6 @@ void dbviewer_freepatcherview(t_dbviewer *x, t_object *patcherview)
 
 t_max_err dbviewer_notify(t_dbviewer *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
 {
-	if (sender == x->d_view) {
-		if (msg == ps_dbview_update) {
-			dbviewer_bang(x);
-		}
-		else if (msg == ps_dbview_query_changed) {	// dump all of the columns
-			t_object	*column = NULL;
-			t_symbol	**column_names = NULL;
-			long		numcolumns = 0;
-			long		i;
-
-			hashtab_getkeys(x->d_columns, &numcolumns, &column_names);
-			if (column_names) {
-				for (i=0; i<numcolumns; i++) {
-					column = jdataview_getnamedcolumn(x->d_dataview, column_names[i]);
-					if (column)
-						jdataview_deletecolumn(x->d_dataview, column);
-				}
-				sysmem_freeptr(column_names);
-			}
-			hashtab_clear(x->d_columns);
-		}
-		else if (msg == _sym_free) {
-			object_detach_byptr((t_object *)x, x->d_view);
-			x->d_view = NULL;
-		}
-	}
 	return jbox_notify((t_jbox *)x, s, msg, sender, data);
 }
 
@@ -228,31 +343,320 @@ void dbviewer_assist(t_dbviewer *x, void *b, long msg, long arg, char *dst)
 }
 
 
-void dbviewer_bang(t_dbviewer *x)
+// dump all of the columns
+static void dbviewer_clearcolumns(t_dbviewer *x)
 {
-	t_object	*result = NULL;
-	long		numrecords;
-	long		numfields;
+	t_object	*column = NULL;
+	t_symbol	**column_names = NULL;
+	long		numcolumns = 0;
 	long		i;
-	char		*fieldname = NULL;
-	t_symbol	*sfieldname = NULL;
-	t_object	*column;
-	t_atom_long	column_index;
-	t_rowref	*rowrefs = NULL;
-	t_max_err	err;
 
-	db_view_getresult(x->d_view, &result);
-	jdataview_clear(x->d_dataview);
-	if (!result)
-		return;
+	hashtab_getkeys(x->d_columns, &numcolumns, &column_names);
+	if (column_names) {
+		for (i=0; i<numcolumns; i++) {
+			column = jdataview_getnamedcolumn(x->d_dataview, column_names[i]);
+			if (column)
+				jdataview_deletecolumn(x->d_dataview, column);
+		}
+		sysmem_freeptr(column_names);
+	}
+	hashtab_clear(x->d_columns);
+}
 
-	numrecords = (long)object_method(result, _sym_numrecords);
-	if (numrecords) {
-		numfields = (long)object_method(result, _sym_numfields);
-		for (i = 0; i < numfields; i++) {
-			fieldname = (char *)object_method(result, _sym_fieldnamebyindex, i);
-			if (fieldname) {
-				sfieldname = gensym(fieldname);
+
+/************************************************************************************/
+// Refreshing
+
+static void dbviewer_refresh_free(t_dbviewer_refresh *r)
+{
+	dbviewer_rows_free(r->old);
+	dbviewer_rows_free(r->rows);
+	if (r->fields)
+		sysmem_freeptr(r->fields);
+	if (r->deleted)
+		sysmem_freeptr(r->deleted);
+	if (r->inserted)
+		sysmem_freeptr(r->inserted);
+	if (r->updated)
+		sysmem_freeptr(r->updated);
+	sysmem_freeptr(r);
+}
+
+
+// FNV-1a, and a step more at the end so that fields don't run into each other
+static t_uint64 dbviewer_hash(t_uint64 h, const char *s)
+{
+	if (s) {
+		while (*s) {
+			h ^= (unsigned char)*s++;
+			h *= 1099511628211ULL;
+		}
+	}
+	else
+		h ^= 0xff;		// NULL isn't ""
+	return h * 1099511628211ULL;
+}
+
+
+// worker thread: the field names, from the first result the refresh has
+static char dbviewer_refresh_fields(t_dbviewer_refresh *r, t_db_result *result)
+{
+	long f;
+
+	r->numfields = db_result_numfields(result);
+	r->fields = (t_symbol **)sysmem_newptr(sizeof(t_symbol *) * (r->numfields + 1));
+	if (!r->fields)
+		return false;
+	for (f = 0; f < r->numfields; f++)
+		r->fields[f] = gensym(db_result_fieldname(result, f));
+	return true;
+}
+
+
+// worker thread: if the query has at least as many rows as last time and the shown ones
+// have the same keys, compare just those; rows past the old count are taken as appended,
+// as long as the last old row is still where it was, and are read and added. Returns false
+// if a full pass is needed.
+static char dbviewer_refresh_window(t_database *db, t_dbworker_job *job)
+{
+	t_dbviewer_refresh	*r = (t_dbviewer_refresh *)job->data;
+	t_dbviewer_rows		*old = r->old;
+	t_db_result			*result = NULL;
+	t_dbviewer_row		*row;
+	t_uint64			sum;
+	t_ptr_int			nextref = r->nextref;
+	long				count, from, i, f, n;
+	char				ok = false;
+
+	if (db_query(db, &result, "SELECT count(*) FROM ( %s )", job->sql) || !result)
+		return false;
+	count = db_result_numrecords(result) ? db_result_long(result, 0, 0) : -1;
+	object_free(result);
+	result = NULL;
+	if (count < old->count)
+		return false;		// rows went: only a full pass can tell which
+
+	r->lo = MIN(r->lo, old->count);
+	r->hi = MIN(r->hi, old->count);
+	r->rows = (t_dbviewer_rows *)sysmem_newptrclear(sizeof(t_dbviewer_rows));
+	r->updated = (t_rowref *)sysmem_newptr(sizeof(t_rowref) * (r->hi - r->lo + 1));
+	r->inserted = (t_rowref *)sysmem_newptr(sizeof(t_rowref) * (count - old->count + 1));
+	if (r->rows)
+		r->rows->rows = (t_dbviewer_row *)sysmem_newptr(sizeof(t_dbviewer_row) * (count + 1));
+	if (!r->rows || !r->rows->rows || !r->updated || !r->inserted)
+		goto out;
+
+	// the rows outside the window keep the hashes they had
+	sysmem_copyptr(old->rows, r->rows->rows, sizeof(t_dbviewer_row) * old->count);
+	r->rows->count = count;
+	r->first = count;
+	if (r->hi > r->lo) {
+		if (db_query(db, &result, "SELECT * FROM ( %s ) LIMIT %ld OFFSET %ld", job->sql, r->hi - r->lo, r->lo) || !result)
+			goto out;
+		n = db_result_numrecords(result);
+		if (n != r->hi - r->lo || !dbviewer_refresh_fields(r, result))
+			goto out;
+		for (i = 0; i < n; i++) {
+			row = r->rows->rows + r->lo + i;
+			if (dbviewer_hash(14695981039346656037ULL, db_result_string(result, i, 0)) != row->r_key)
+				goto out;		// a row came or went in view
+			sum = row->r_key;
+			for (f = 1; f < r->numfields; f++)
+				sum = dbviewer_hash(sum, db_result_string(result, i, f));
+			if (sum != row->r_sum) {
+				row->r_sum = sum;
+				r->updated[r->numupdated++] = (t_rowref)row->r_ref;
+				r->first = MIN(r->first, r->lo + i);
+			}
+		}
+		object_free(result);
+		result = NULL;
+	}
+
+	if (count > old->count) {
+		// read from the last old row on, to see that it hasn't moved
+		from = old->count ? old->count - 1 : 0;
+		if (db_query(db, &result, "SELECT * FROM ( %s ) LIMIT %ld OFFSET %ld", job->sql, count - from, from) || !result)
+			goto out;
+		n = db_result_numrecords(result);
+		if (n != count - from || (!r->fields && !dbviewer_refresh_fields(r, result)))
+			goto out;
+		if (old->count && dbviewer_hash(14695981039346656037ULL, db_result_string(result, 0, 0)) != old->rows[from].r_key)
+			goto out;		// not an append
+		for (i = old->count; i < count; i++) {
+			row = r->rows->rows + i;
+			row->r_key = dbviewer_hash(14695981039346656037ULL, db_result_string(result, i - from, 0));
+			row->r_sum = row->r_key;
+			for (f = 1; f < r->numfields; f++)
+				row->r_sum = dbviewer_hash(row->r_sum, db_result_string(result, i - from, f));
+			row->r_ref = r->nextref++;
+			r->inserted[r->numinserted++] = (t_rowref)row->r_ref;
+		}
+		r->first = MIN(r->first, old->count);
+	}
+	ok = r->inwindow = true;
+out:
+	if (result)
+		object_free(result);
+	if (!ok) {
+		// start the full pass from nothing
+		dbviewer_rows_free(r->rows);
+		r->rows = NULL;
+		if (r->fields)
+			sysmem_freeptr(r->fields);
+		if (r->updated)
+			sysmem_freeptr(r->updated);
+		if (r->inserted)
+			sysmem_freeptr(r->inserted);
+		r->fields = NULL;
+		r->updated = NULL;
+		r->inserted = NULL;
+		r->numfields = r->numupdated = r->numinserted = 0;
+		r->nextref = nextref;
+	}
+	return ok;
+}
+
+
+// worker thread: run the query, hash its rows, and tell them apart from the last refresh's
+static t_max_err dbviewer_refresh_work(t_database *db, t_dbworker_job *job)
+{
+	t_dbviewer_refresh	*r = (t_dbviewer_refresh *)job->data;
+	t_dbviewer_rows		*old = r->old;
+	long				oldcount = old ? old->count : 0;
+	t_db_result			*result = NULL;
+	t_dbviewer_row		*row;
+	long				*slots = NULL;
+	char				*used = NULL;
+	long				count, i, j, k, f, mask = 0, last = -1;
+	char				inserting = false;
+	t_max_err			err;
+
+	if (r->windowed && old && dbviewer_refresh_window(db, job))
+		return MAX_ERR_NONE;
+
+	err = db_query(db, &result, "%s", job->sql);
+	if (err)
+		return err;
+	count = db_result_numrecords(result);
+	r->numfields = db_result_numfields(result);
+
+	r->rows = (t_dbviewer_rows *)sysmem_newptrclear(sizeof(t_dbviewer_rows));
+	r->fields = (t_symbol **)sysmem_newptr(sizeof(t_symbol *) * (r->numfields + 1));
+	r->deleted = (t_rowref *)sysmem_newptr(sizeof(t_rowref) * (oldcount + 1));
+	r->inserted = (t_rowref *)sysmem_newptr(sizeof(t_rowref) * (count + 1));
+	r->updated = (t_rowref *)sysmem_newptr(sizeof(t_rowref) * (count + 1));
+	if (r->rows)
+		r->rows->rows = (t_dbviewer_row *)sysmem_newptr(sizeof(t_dbviewer_row) * (count + 1));
+	if (oldcount) {
+		for (k = 1; k < oldcount * 2; k <<= 1)
+			;
+		mask = k - 1;
+		slots = (long *)sysmem_newptrclear(sizeof(long) * k);
+		used = (char *)sysmem_newptrclear(oldcount);
+	}
+	if (!r->rows || !r->rows->rows || !r->fields || !r->deleted || !r->inserted || !r->updated || (oldcount && (!slots || !used))) {
+		err = MAX_ERR_OUT_OF_MEM;
+		goto out;
+	}
+	for (f = 0; f < r->numfields; f++)
+		r->fields[f] = gensym(db_result_fieldname(result, f));
+
+	// the old rows by key; slots hold index + 1, rows with the same key one after the other
+	for (j = 0; j < oldcount; j++) {
+		for (k = old->rows[j].r_key & mask; slots[k]; k = (k + 1) & mask)
+			;
+		slots[k] = j + 1;
+	}
+
+	r->first = count;
+	for (i = 0; i < count; i++) {
+		row = r->rows->rows + i;
+		row->r_key = dbviewer_hash(14695981039346656037ULL, db_result_string(result, i, 0));
+		row->r_sum = row->r_key;
+		for (f = 1; f < r->numfields; f++)
+			row->r_sum = dbviewer_hash(row->r_sum, db_result_string(result, i, f));
+
+		j = -1;
+		if (oldcount) {
+			for (k = row->r_key & mask; slots[k]; k = (k + 1) & mask) {
+				if (!used[slots[k] - 1] && old->rows[slots[k] - 1].r_key == row->r_key) {
+					j = slots[k] - 1;
+					break;
+				}
+			}
+		}
+		if (j < 0) {
+			row->r_ref = r->nextref++;
+			r->inserted[r->numinserted++] = (t_rowref)row->r_ref;
+			inserting = true;
+			r->first = MIN(r->first, i);
+			continue;
+		}
+		used[j] = true;
+		row->r_ref = old->rows[j].r_ref;
+		if (j < last || inserting)
+			r->rebuild = true;		// moved, or a new row came before it
+		last = j;
+		if (row->r_sum != old->rows[j].r_sum) {
+			r->updated[r->numupdated++] = (t_rowref)row->r_ref;
+			r->first = MIN(r->first, i);
+		}
+		else if (j != i)
+			r->first = MIN(r->first, i);
+	}
+	for (j = 0; j < oldcount; j++) {
+		if (!used[j]) {
+			r->deleted[r->numdeleted++] = (t_rowref)old->rows[j].r_ref;
+			r->first = MIN(r->first, j);
+		}
+	}
+	r->rows->count = count;
+
+	if (r->rebuild) {
+		// new rowrefs all round, so that they go up with the rows again
+		r->numdeleted = r->numupdated = r->numinserted = 0;
+		for (j = 0; j < oldcount; j++)
+			r->deleted[r->numdeleted++] = (t_rowref)old->rows[j].r_ref;
+		for (i = 0; i < count; i++) {
+			r->rows->rows[i].r_ref = r->nextref++;
+			r->inserted[r->numinserted++] = (t_rowref)r->rows->rows[i].r_ref;
+		}
+		r->first = 0;
+	}
+
+out:
+	if (slots)
+		sysmem_freeptr(slots);
+	if (used)
+		sysmem_freeptr(used);
+	object_free(result);
+	return err;
+}
+
+
+// the refresh is back: add any new columns, and patch the rows that changed
+static void dbviewer_refreshed(t_dbviewer *x, t_dbworker_job *job)
+{
+	t_dbviewer_refresh	*r = (t_dbviewer_refresh *)job->data;
+	t_symbol			*sfieldname = NULL;
+	t_object			*column;
+	t_atom_long			column_index;
+	long				i;
+	t_max_err			err;
+
+	x->d_refreshing = false;
+	x->d_rows = NULL;		// they were r->old, and go with the job
+	if (job->tag == x->d_generation) {
+		if (job->err) {
+			object_error((t_object *)x, "can't run %s", x->d_query->s_name);
+			dbviewer_clearpages(x, 0);
+			jdataview_clear(x->d_dataview);
+			dbviewer_droprows(x);
+		}
+		else {
+			for (i = 0; i < r->numfields; i++) {
+				sfieldname = r->fields[i];
 				err = hashtab_lookuplong(x->d_columns, sfieldname, &column_index);
 				if (!err) {
 					; // column already exists, so we leave it alone
@@ -265,40 +669,295 @@ void dbviewer_bang(t_dbviewer *x)
 					hashtab_store(x->d_columns, sfieldname, (t_object *)i);
 				}
 			}
+
+			x->d_rows = r->rows;
+			x->d_numrows = r->rows->count;
+			x->d_nextref = r->nextref;
+			r->rows = NULL;
+
+			dbviewer_clearpages(x, r->first);
+			if (r->inwindow) {
+				// only the window was looked at: pages outside it are read again when they are drawn
+				for (i = 0; i < DBVIEWER_PAGES; i++) {
+					t_dbviewer_page *p = x->d_pages + i;
+
+					if (p->p_page >= 0 && (p->p_page * DBVIEWER_PAGEROWS < r->lo || p->p_page * DBVIEWER_PAGEROWS >= r->hi)) {
+						if (p->p_result)
+							object_free(p->p_result);
+						p->p_result = NULL;
+						p->p_page = -1;
+						p->p_request = 0;
+					}
+				}
+			}
+			if (r->rebuild)
+				jdataview_clear(x->d_dataview);
+			else if (r->numdeleted)
+				jdataview_deleterows(x->d_dataview, r->numdeleted, r->deleted);
+			if (r->numinserted)
+				jdataview_addrows(x->d_dataview, r->numinserted, r->inserted);
+			for (i = 0; i < r->numupdated; i++)
+				jdataview_redrawrow(x->d_dataview, r->updated[i]);
+			if (r->first < x->d_numrows)
+				jdataview_redraw(x->d_dataview);		// rows from first on may now be in other pages
 		}
+	}
+	if (x->d_dirty) {
+		x->d_dirty = false;
+		dbviewer_changed(x);
+	}
+}
+
+
+// refresh: ask the worker what changed since the last time, looking at every row
+void dbviewer_bang(t_dbviewer *x)
+{
+	dbviewer_refresh(x, false);
+}
+
+
+// windowed: start with just the rows of the pages held, which are the ones being shown
+void dbviewer_refresh(t_dbviewer *x, char windowed)
+{
+	t_dbworker_job		*job;
+	t_dbviewer_refresh	*r;
+	t_dbviewer_page		*p = NULL;
+	long				len, i;
 
-		rowrefs = (t_rowref *)malloc(sizeof(t_rowref) * numrecords);
-		for (i = 0; i < numrecords; i++)
-			rowrefs[i] = (t_rowref *)(i+1);
-		jdataview_addrows(x->d_dataview, numrecords, rowrefs);
-		free(rowrefs);
+	if (x->d_refreshing) {
+		x->d_dirty = true;		// once the one with the worker is back
+		return;
+	}
+	if (!x->d_client || !x->d_query || !x->d_query->s_name[0]) {
+		dbviewer_clearpages(x, 0);
+		jdataview_clear(x->d_dataview);
+		dbviewer_droprows(x);
+		return;
 	}
+
+	job = dbworker_job_new(x->d_client, (t_dbworker_donefn)dbviewer_refreshed, x->d_generation, 0);
+	if (!job)
+		return;
+	r = (t_dbviewer_refresh *)sysmem_newptrclear(sizeof(t_dbviewer_refresh));
+	len = (long)strlen(x->d_query->s_name);
+	job->sql = (char *)sysmem_newptr(len + 1);
+	if (!r || !job->sql) {
+		if (r)
+			sysmem_freeptr(r);
+		dbworker_job_free(job);
+		return;
+	}
+	memcpy(job->sql, x->d_query->s_name, len + 1);
+	r->old = x->d_rows;			// still read here until the refresh is back
+	r->nextref = x->d_nextref;
+	r->windowed = windowed;
+	// as many pages as are kept, around the one drawn from last
+	for (i = 0; i < DBVIEWER_PAGES; i++) {
+		if (x->d_pages[i].p_page >= 0 && (!p || x->d_pages[i].p_used > p->p_used))
+			p = x->d_pages + i;
+	}
+	if (p) {
+		r->lo = MAX(p->p_page - DBVIEWER_PAGES / 2, 0) * DBVIEWER_PAGEROWS;
+		r->hi = r->lo + DBVIEWER_PAGES * DBVIEWER_PAGEROWS;
+	}		// with nothing shown, the count is all there is to check
+	job->data = r;
+	job->freedata = (method)dbviewer_refresh_free;
+	job->work = dbviewer_refresh_work;
+	x->d_refreshing = true;
+	dbworker_submit(job);
+}
+
+
+void dbviewer_tick(t_dbviewer *x)
+{
+	x->d_scheduled = false;
+	dbviewer_refresh(x, true);
+}
+
+
+// the database changed: refresh, but not more often than the display can show it
+void dbviewer_changed(t_dbviewer *x)
+{
+	if (!x->d_scheduled) {
+		x->d_scheduled = true;
+		clock_delay(x->d_clock, DBVIEWER_INTERVAL);
+	}
+}
+
+
+// worker thread: a number that goes up with every change, made through this connection
+// (total_changes) or another one (data_version)
+static t_max_err dbviewer_poll_work(t_database *db, t_dbworker_job *job)
+{
+	t_db_result	*result = NULL;
+	t_max_err	err;
+
+	err = db_query(db, &result, "SELECT total_changes()");
+	if (err || !result)
+		return err ? err : MAX_ERR_GENERIC;
+	job->value = db_result_numrecords(result) ? db_result_long(result, 0, 0) : 0;
+	object_free(result);
+	result = NULL;
+	err = db_query(db, &result, "PRAGMA data_version");
+	if (err || !result)
+		return err ? err : MAX_ERR_GENERIC;
+	job->value += db_result_numrecords(result) ? db_result_long(result, 0, 0) : 0;
+	object_free(result);
+	return MAX_ERR_NONE;
+}
+
+
+// the poll is back: refresh if the number moved
+static void dbviewer_polled(t_dbviewer *x, t_dbworker_job *job)
+{
+	x->d_polling = false;
+	if (job->err)
+		return;
+	if (x->d_changes >= 0 && job->value != x->d_changes)
+		dbviewer_changed(x);
+	x->d_changes = job->value;
+}
+
+
+// ask the worker whether the database changed, unless the last answer isn't back yet
+void dbviewer_poll(t_dbviewer *x)
+{
+	t_dbworker_job *job;
+
+	if (!x->d_client)
+		return;
+	if (!x->d_polling) {
+		job = dbworker_job_new(x->d_client, (t_dbworker_donefn)dbviewer_polled, 0, 0);
+		if (job) {
+			job->work = dbviewer_poll_work;
+			x->d_polling = true;
+			dbworker_submit(job);
+		}
+	}
+	clock_delay(x->d_poll, DBVIEWER_POLL);
+}
+
+
+/************************************************************************************/
+// Cells
+
+// a page is back from the worker
+static void dbviewer_paged(t_dbviewer *x, t_dbworker_job *job)
+{
+	long i;
+
+	for (i = 0; i < DBVIEWER_PAGES; i++) {
+		t_dbviewer_page *p = x->d_pages + i;
+
+		if (p->p_request == job->tag) {
+			p->p_request = 0;
+			if (job->err || !job->result) {
+				p->p_page = -1;
+				return;
+			}
+			p->p_result = (t_object *)job->result;
+			job->result = NULL;
+			jdataview_redraw(x->d_dataview);
+			return;
+		}
+	}
+	// thrown away while it was out
+}
+
+
+// the page holding row (from 0) if it is here; if not, it is asked for and NULL returned
+static t_object *dbviewer_getpage(t_dbviewer *x, long row, long *offset)
+{
+	long			page = row / DBVIEWER_PAGEROWS;
+	t_dbviewer_page	*p, *victim = NULL;
+	t_dbworker_job	*job;
+	long			i, len;
+
+	*offset = row - page * DBVIEWER_PAGEROWS;
+	for (i = 0; i < DBVIEWER_PAGES; i++) {
+		p = x->d_pages + i;
+		if (p->p_page == page) {
+			p->p_used = ++x->d_used;
+			return p->p_result;
+		}
+		if (!p->p_request && (!victim || p->p_page < 0 || (victim->p_page >= 0 && p->p_used < victim->p_used)))
+			victim = p;
+	}
+	if (!victim || !x->d_client)
+		return NULL;		// every slot is waiting on the worker: this row will be asked for again when one is back
+
+	job = dbworker_job_new(x->d_client, (t_dbworker_donefn)dbviewer_paged, ++x->d_requests, 0);
+	if (!job)
+		return NULL;
+	len = (long)strlen(x->d_query->s_name) + 64;
+	job->sql = (char *)sysmem_newptr(len);
+	if (!job->sql) {
+		dbworker_job_free(job);
+		return NULL;
+	}
+	snprintf_zero(job->sql, len, "SELECT * FROM ( %s ) LIMIT %ld OFFSET %ld", x->d_query->s_name,
+				  (long)DBVIEWER_PAGEROWS, page * DBVIEWER_PAGEROWS);
+
+	if (victim->p_result)
+		object_free(victim->p_result);
+	victim->p_result = NULL;
+	victim->p_page = page;
+	victim->p_request = job->tag;
+	victim->p_used = ++x->d_used;
+	dbworker_submit(job);
+	return NULL;
+}
+
+
+// where the row the dataview knows as ref is, or -1: rowrefs go up with the rows
+static long dbviewer_findrow(t_dbviewer *x, t_ptr_int ref)
+{
+	long lo = 0, hi, mid;
+
+	if (!x->d_rows)
+		return -1;
+	hi = x->d_rows->count - 1;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (x->d_rows->rows[mid].r_ref == ref)
+			return mid;
+		if (x->d_rows->rows[mid].r_ref < ref)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
 }
 
 
 void dbviewer_getcelltext(t_dbviewer *x, t_symbol *colname, long index, char *text, long maxlen)
 {
-	t_object	*result = (t_object *)object_method(x->d_view, gensym("getresult"));
+	t_object	*result;
 	char		*itemtext;
 	t_atom_long	column_index;
 	t_max_err	err;
+	long		row;
+	long		offset;
 
-	if (!result)
+	row = dbviewer_findrow(x, index);
+	if (row < 0)
 		return;
-
 	err = hashtab_lookuplong(x->d_columns, colname, &column_index);
-	if (!err) {
-		itemtext = (char *)object_method(result, _sym_valuebyindex, index-1, column_index);
-
-		if (itemtext && itemtext[0]) {
-			if (strstr(colname->s_name, "date")) {
-				t_datetime td;
-				sysdateformat_strftimetodatetime(itemtext, &td);
-				sysdateformat_formatdatetime(&td, SYSDATEFORMAT_RELATIVE, 0, text, maxlen-1);
-			}
-			else
-				strncpy_zero(text, itemtext, maxlen-1);
+	if (err)
+		return;
+	result = dbviewer_getpage(x, row, &offset);
+	if (!result)
+		return;		// drawn again when the page is back
+
+	itemtext = (char *)object_method(result, _sym_valuebyindex, offset, column_index);
+	if (itemtext && itemtext[0]) {
+		if (strstr(colname->s_name, "date")) {
+			t_datetime td;
+			sysdateformat_strftimetodatetime(itemtext, &td);
+			sysdateformat_formatdatetime(&td, SYSDATEFORMAT_RELATIVE, 0, text, maxlen-1);
 		}
+		else
+			strncpy_zero(text, itemtext, maxlen-1);
 	}
 }
 
@@ -307,11 +966,12 @@ t_max_err dbviewer_set_query(t_dbviewer *x, void *attr, long argc, t_atom *argv)
 {
 	if (argc && argv) {
 		x->d_query = atom_getsym(argv);
-		object_attr_setsym(x->d_view, _sym_query, x->d_query);
-		if (x->d_db && x->d_query) {
-			db_view_create(x->d_db, x->d_query->s_name, &x->d_view);
-			object_attach_byptr_register(x, x->d_view, _sym_nobox);
-		}
+		x->d_generation++;		// whatever is still out for the old query is thrown away
+		dbviewer_clearpages(x, 0);
+		dbviewer_clearcolumns(x);
+		jdataview_clear(x->d_dataview);
+		dbviewer_droprows(x);
+		dbviewer_bang(x);
 	}
 	return MAX_ERR_NONE;
 }
@@ -319,19 +979,19 @@ t_max_err dbviewer_set_query(t_dbviewer *x, void *attr, long argc, t_atom *argv)
 
 t_max_err dbviewer_set_database(t_dbviewer *x, void *attr, long argc, t_atom *argv)
 {
-	t_max_err err;
-
 	if (argc && argv) {
-		db_view_remove(x->d_db, &x->d_view);
-		db_close(&x->d_db);
+		dbviewer_clearpages(x, 0);
+		jdataview_clear(x->d_dataview);
+		dbviewer_droprows(x);
+		dbworker_client_free(x->d_client);		// a refresh still out won't come back to us
+		x->d_refreshing = x->d_dirty = x->d_polling = false;		// and neither will a poll
+		x->d_changes = -1;
+		x->d_generation++;
 
 		x->d_database = atom_getsym(argv);
-		err = db_open(x->d_database, NULL, &x->d_db);
-		if (!err && x->d_db && x->d_query) {
-			db_view_create(x->d_db, x->d_query->s_name, &x->d_view);
-			object_attach_byptr_register(x, x->d_view, _sym_nobox);
-		}
+		x->d_client = dbworker_client_new((t_object *)x, x->d_database, (t_dbworker_changedfn)dbviewer_changed);
+		dbviewer_bang(x);
+		dbviewer_poll(x);
 	}
 	return MAX_ERR_NONE;
 }
-
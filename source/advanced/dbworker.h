@@ -0,0 +1,351 @@
+/**
+	@file
+	dbworker.h - one thread per database that runs its queries, for dbcuelist and dbviewer
+
+	Every database name gets a worker: a thread that runs the jobs queued
+	to it one after the other, in order, until the last object using it
+	goes. The database itself is opened and closed on the main thread,
+	since db_open() and db_close() register and free objects, and handed
+	to the thread in between; stopping never waits on the thread, which
+	finishes what is queued and then has the main thread close up after
+	it. A job is either a line of
+	SQL or a function to run on the worker with the database (for work
+	that takes more than one statement, like a bulk load). When it is done
+	the job goes back to the main thread with defer_low(), where its done
+	function gets the result; nothing the main thread does waits on the
+	database.
+
+	Objects hold a client of the worker. Jobs keep their client alive, so
+	one can still come back after its object is freed: it is then thrown
+	away without calling done. Jobs flagged DBWORKER_WRITE tell every
+	client of the database, through its changed function, once they are
+	done.
+
+	Workers live in one list per Max session, hung off a symbol's s_thing
+	as modbus.h does, so dbcuelist and dbviewer share the worker (and the
+	database) of a name.
+*/
+
+#ifndef _DBWORKER_H_
+#define _DBWORKER_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+#include "ext_systhread.h"
+#include "ext_database.h"
+
+#define DBWORKER_MAGIC		0x64627772	// 'dbwr', in case something else owns the symbol
+
+enum {
+	DBWORKER_WRITE = 1		// the job changes the database
+};
+
+typedef struct _dbworker			t_dbworker;
+typedef struct _dbworker_client		t_dbworker_client;
+typedef struct _dbworker_job		t_dbworker_job;
+
+typedef t_max_err (*t_dbworker_workfn)(t_database *db, t_dbworker_job *job);	// worker thread
+typedef void (*t_dbworker_donefn)(t_object *owner, t_dbworker_job *job);		// main thread
+typedef void (*t_dbworker_changedfn)(t_object *owner);							// main thread
+
+struct _dbworker_job
+{
+	t_dbworker_job		*next;
+	t_dbworker_client	*client;
+	char				*sql;			// run on the worker when there is no work function
+	t_dbworker_workfn	work;
+	t_dbworker_donefn	done;
+	void				*data;			// for work and done; freed with freedata when the job is
+	method				freedata;
+	long				tag;			// the caller's
+	long				flags;
+	t_atom_long			value;			// a number the work function hands back
+	t_db_result			*result;		// freed with the job unless done takes it (and sets this to NULL)
+	t_max_err			err;
+};
+
+struct _dbworker_client
+{
+	t_object				*owner;		// NULL once the owner is freed
+	t_dbworker				*worker;
+	t_dbworker_changedfn	changed;
+	t_dbworker_client		*next;		// the worker's clients (main thread)
+	t_int32_atomic			refs;		// the owner's, and one for every job
+};
+
+struct _dbworker
+{
+	t_symbol			*name;
+	t_database			*db;			// opened and closed on the main thread, queried on the worker
+	t_systhread			thread;
+	t_systhread_mutex	lock;			// for the queue and quit
+	t_systhread_cond	cond;
+	t_dbworker_job		*head;
+	t_dbworker_job		*tail;
+	long				quit;
+	t_dbworker_client	*clients;
+	t_dbworker			*next;			// in the session's list (main thread)
+};
+
+typedef struct _dbworker_registry
+{
+	long				magic;
+	t_dbworker			*workers;
+} t_dbworker_registry;
+
+
+static t_dbworker_registry *dbworker_registry(void)
+{
+	t_symbol *s = gensym("__dbworker_registry__");
+	t_dbworker_registry *reg = (t_dbworker_registry *)s->s_thing;
+
+	if (!reg) {
+		reg = (t_dbworker_registry *)sysmem_newptrclear(sizeof(t_dbworker_registry));
+		if (!reg)
+			return NULL;
+		reg->magic = DBWORKER_MAGIC;
+		s->s_thing = (t_object *)reg;
+	}
+	return reg->magic == DBWORKER_MAGIC ? reg : NULL;
+}
+
+
+//***********************************************************************************************
+// jobs
+
+// any thread: a job for client c, to be queued with dbworker_submit()
+static t_dbworker_job *dbworker_job_new(t_dbworker_client *c, t_dbworker_donefn done, long tag, long flags)
+{
+	t_dbworker_job *job = (t_dbworker_job *)sysmem_newptrclear(sizeof(t_dbworker_job));
+
+	if (!job)
+		return NULL;
+	job->client = c;
+	job->done = done;
+	job->tag = tag;
+	job->flags = flags;
+	ATOMIC_INCREMENT(&c->refs);
+	return job;
+}
+
+static void dbworker_client_release(t_dbworker_client *c)
+{
+	if (ATOMIC_DECREMENT(&c->refs) == 0)
+		sysmem_freeptr(c);
+}
+
+static void dbworker_job_free(t_dbworker_job *job)
+{
+	if (job->result)
+		object_free(job->result);
+	if (job->sql)
+		sysmem_freeptr(job->sql);
+	if (job->data && job->freedata)
+		job->freedata(job->data);
+	dbworker_client_release(job->client);
+	sysmem_freeptr(job);
+}
+
+// main thread, from the worker: hand the job to its owner, and tell the others if it wrote
+static void dbworker_deliver(t_dbworker_client *c, t_symbol *s, long argc, t_atom *argv)
+{
+	t_dbworker_job *job = (t_dbworker_job *)atom_getobj(argv);
+	t_dbworker_client *other;
+
+	if (c->owner && job->done)
+		job->done(c->owner, job);
+	if (c->owner && (job->flags & DBWORKER_WRITE) && !job->err) {		// owner NULL means the worker may be gone
+		for (other = c->worker->clients; other; other = other->next) {
+			if (other->owner && other->changed)
+				other->changed(other->owner);
+		}
+	}
+	dbworker_job_free(job);
+}
+
+// any thread: queue a job; it is freed once it has come back
+static void dbworker_submit(t_dbworker_job *job)
+{
+	t_dbworker *w = job->client->worker;
+
+	systhread_mutex_lock(w->lock);
+	if (w->tail)
+		w->tail->next = job;
+	else
+		w->head = job;
+	w->tail = job;
+	systhread_cond_signal(w->cond);
+	systhread_mutex_unlock(w->lock);
+}
+
+// any thread: queue a line of SQL (copied)
+static t_max_err dbworker_query(t_dbworker_client *c, t_dbworker_donefn done, long tag, long flags, const char *sql)
+{
+	t_dbworker_job *job;
+	long len = (long)strlen(sql);
+
+	if (!c)
+		return MAX_ERR_INVALID_PTR;
+	job = dbworker_job_new(c, done, tag, flags);
+	if (!job)
+		return MAX_ERR_OUT_OF_MEM;
+	job->sql = (char *)sysmem_newptr(len + 1);
+	if (!job->sql) {
+		dbworker_job_free(job);
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	memcpy(job->sql, sql, len + 1);
+	dbworker_submit(job);
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// the worker thread
+
+// main thread, from the worker once it has run its last job: the thread is on its way out
+static void dbworker_finish(t_dbworker *w)
+{
+	unsigned int ret;
+
+	systhread_join(w->thread, &ret);
+	db_close(&w->db);
+	systhread_cond_free(w->cond);
+	systhread_mutex_free(w->lock);
+	sysmem_freeptr(w);
+}
+
+static void *dbworker_threadproc(t_dbworker *w)
+{
+	t_dbworker_job *job;
+	t_atom a;
+
+	while (1) {
+		systhread_mutex_lock(w->lock);
+		while (!w->head && !w->quit)
+			systhread_cond_wait(w->cond, w->lock);
+		job = w->head;
+		if (job) {
+			w->head = job->next;
+			if (!w->head)
+				w->tail = NULL;
+			job->next = NULL;
+		}
+		systhread_mutex_unlock(w->lock);
+		if (!job)
+			break;		// told to quit, and everything queued before that is done
+
+		if (!w->db)
+			job->err = MAX_ERR_GENERIC;
+		else if (job->work)
+			job->err = job->work(w->db, job);
+		else if (job->sql)
+			job->err = db_query(w->db, &job->result, "%s", job->sql);
+		atom_setobj(&a, job);
+		defer_low(job->client, (method)dbworker_deliver, NULL, 1, &a);
+	}
+	defer_low(w, (method)dbworker_finish, NULL, 0, NULL);	// w is the main thread's from here on
+	systhread_exit(0);
+	return NULL;
+}
+
+// main thread: the worker for name, started if need be
+static t_dbworker *dbworker_get(t_symbol *name)
+{
+	t_dbworker_registry *reg = dbworker_registry();
+	t_dbworker *w;
+
+	if (!reg || !name || !name->s_name[0])
+		return NULL;
+	for (w = reg->workers; w; w = w->next) {
+		if (w->name == name)
+			return w;
+	}
+	w = (t_dbworker *)sysmem_newptrclear(sizeof(t_dbworker));
+	if (!w)
+		return NULL;
+	w->name = name;
+	db_open(name, NULL, &w->db);		// if it fails, every job comes back with an error
+	systhread_mutex_new(&w->lock, 0);
+	systhread_cond_new(&w->cond, 0);
+	if (systhread_create((method)dbworker_threadproc, w, 0, 0, 0, &w->thread)) {
+		db_close(&w->db);
+		systhread_cond_free(w->cond);
+		systhread_mutex_free(w->lock);
+		sysmem_freeptr(w);
+		return NULL;
+	}
+	w->next = reg->workers;
+	reg->workers = w;
+	return w;
+}
+
+// main thread: let the worker finish what is queued, then stop; returns at once, and
+// dbworker_finish() closes the database and frees the worker later
+static void dbworker_stop(t_dbworker *w)
+{
+	t_dbworker_registry *reg = dbworker_registry();
+	t_dbworker **p;
+
+	for (p = &reg->workers; *p; p = &(*p)->next) {
+		if (*p == w) {
+			*p = w->next;
+			break;
+		}
+	}
+	systhread_mutex_lock(w->lock);
+	w->quit = 1;
+	systhread_cond_signal(w->cond);
+	systhread_mutex_unlock(w->lock);
+}
+
+
+//***********************************************************************************************
+// clients
+
+// main thread: owner's way to the database called name, or NULL
+static t_dbworker_client *dbworker_client_new(t_object *owner, t_symbol *name, t_dbworker_changedfn changed)
+{
+	t_dbworker *w = dbworker_get(name);
+	t_dbworker_client *c;
+
+	if (!w)
+		return NULL;
+	c = (t_dbworker_client *)sysmem_newptrclear(sizeof(t_dbworker_client));
+	if (!c) {
+		if (!w->clients)
+			dbworker_stop(w);
+		return NULL;
+	}
+	c->owner = owner;
+	c->worker = w;
+	c->changed = changed;
+	c->refs = 1;
+	c->next = w->clients;
+	w->clients = c;
+	return c;
+}
+
+// main thread: the owner is done with the database; its jobs still run, but don't come back to it
+static void dbworker_client_free(t_dbworker_client *c)
+{
+	t_dbworker *w;
+	t_dbworker_client **p;
+
+	if (!c)
+		return;
+	w = c->worker;
+	for (p = &w->clients; *p; p = &(*p)->next) {
+		if (*p == c) {
+			*p = c->next;
+			break;
+		}
+	}
+	c->owner = NULL;
+	if (!w->clients)
+		dbworker_stop(w);
+	dbworker_client_release(c);
+}
+
+#endif // _DBWORKER_H_
@@ -13,14 +13,21 @@
 
 // max object instance data
 typedef struct _dllcounter {
-	t_object	d_obj;
+	t_object		d_obj;
+	t_mydll_segment	*d_segment;		// the segment last shared to
+	t_symbol		*d_segname;
 } t_dllcounter;
 
 
 // prototypes
 void	*dllcounter_new(t_symbol *s, long argc, t_atom *argv);
+void	dllcounter_free(t_dllcounter *x);
 void	dllcounter_assist(t_dllcounter *x, void *b, long m, long a, char *s);
 void	dllcounter_bang(t_dllcounter *x);
+void	dllcounter_add(t_dllcounter *x, t_symbol *name, long n);
+void	dllcounter_set(t_dllcounter *x, t_symbol *s, long argc, t_atom *argv);
+void	dllcounter_share(t_dllcounter *x, t_symbol *s, long argc, t_atom *argv);
+void	dllcounter_bench(t_dllcounter *x, long maxthreads, long iterations);
 
 
 // globals
@@ -34,8 +41,12 @@ void ext_main(void *r)
 
 	mydll_init(); // call the init function in our dll -- will post to the Max window the first time only (for all objects linked to our dll)
 
-	c = class_new("dllcounter", (method)dllcounter_new, (method)NULL, sizeof(t_dllcounter), (method)NULL, A_GIMME, 0);
+	c = class_new("dllcounter", (method)dllcounter_new, (method)dllcounter_free, sizeof(t_dllcounter), (method)NULL, A_GIMME, 0);
 	class_addmethod(c, (method)dllcounter_bang,	"bang",			0);
+	class_addmethod(c, (method)dllcounter_add,		"add",			A_SYM, A_DEFLONG, 0);
+	class_addmethod(c, (method)dllcounter_set,		"set",			A_GIMME, 0);
+	class_addmethod(c, (method)dllcounter_share,	"share",		A_GIMME, 0);
+	class_addmethod(c, (method)dllcounter_bench,	"bench",		A_DEFLONG, A_DEFLONG, 0);
 	class_addmethod(c, (method)dllcounter_assist,	"assist",		A_CANT, 0);
 	class_addmethod(c, (method)stdinletinfo,	"inletinfo",	A_CANT, 0);
 
@@ -49,7 +60,16 @@ void ext_main(void *r)
 
 void *dllcounter_new(t_symbol *s, long argc, t_atom *argv)
 {
-	return object_alloc(s_dllcounter_class);
+	t_dllcounter *x = (t_dllcounter *)object_alloc(s_dllcounter_class);
+	x->d_segment = NULL;
+	x->d_segname = NULL;
+	return x;
+}
+
+
+void dllcounter_free(t_dllcounter *x)
+{
+	mydll_segment_close(x->d_segment);
 }
 
 
@@ -58,7 +78,7 @@ void *dllcounter_new(t_symbol *s, long argc, t_atom *argv)
 
 void dllcounter_assist(t_dllcounter *x, void *b, long msg, long arg, char *dst)
 {
-	strcpy(dst, "bang to increase the count by 1");
+	strcpy(dst, "bang to increase the count by 1, add, set, share, bench");
 }
 
 
@@ -66,3 +86,93 @@ void dllcounter_bang(t_dllcounter *x)
 {
 	mydll_inc();	// call the function in our dll to increase the count
 }
+
+
+// add <name> [n]: add n (default 1) to a named counter, which may be added to from any thread at once
+void dllcounter_add(t_dllcounter *x, t_symbol *name, long n)
+{
+	t_mydll_counter *c = mydll_counter_get(name);
+
+	if (!c) {
+		object_error((t_object *)x, "add: too many counters");
+		return;
+	}
+	mydll_counter_add(c, n ? n : 1);
+}
+
+
+// the numbers in argv as doubles, or NULL if out of memory; free with sysmem_freeptr()
+static double *dllcounter_values(long argc, t_atom *argv)
+{
+	double *values = (double *)sysmem_newptr((argc ? argc : 1) * sizeof(double));
+
+	if (values) {
+		for (long i = 0; i < argc; i++)
+			values[i] = atom_getfloat(argv + i);
+	}
+	return values;
+}
+
+
+// set <key> <numbers...>: replace the key's table in the registry
+void dllcounter_set(t_dllcounter *x, t_symbol *s, long argc, t_atom *argv)
+{
+	double *values;
+
+	if (!argc || atom_gettype(argv) != A_SYM) {
+		object_error((t_object *)x, "set: needs a key and then numbers");
+		return;
+	}
+	values = dllcounter_values(argc - 1, argv + 1);
+	if (!values || mydll_blob_set(atom_getsym(argv), values, (argc - 1) * sizeof(double)))
+		object_error((t_object *)x, "set: out of memory or keys");
+	if (values)
+		sysmem_freeptr(values);
+}
+
+
+// share <segment> <numbers...>: write a table to shared memory, for every Max process on this machine
+void dllcounter_share(t_dllcounter *x, t_symbol *s, long argc, t_atom *argv)
+{
+	double *values;
+	t_ptr_size size;
+
+	if (!argc || atom_gettype(argv) != A_SYM) {
+		object_error((t_object *)x, "share: needs a segment name and then numbers");
+		return;
+	}
+	size = (argc - 1) * sizeof(double);
+	if (atom_getsym(argv) != x->d_segname) {
+		mydll_segment_close(x->d_segment);
+		x->d_segname = atom_getsym(argv);
+		x->d_segment = mydll_segment_open(x->d_segname->s_name, size, true);
+	}
+	if (!x->d_segment) {
+		object_error((t_object *)x, "share: can't open segment %s", x->d_segname->s_name);
+		x->d_segname = NULL;
+		return;
+	}
+	values = dllcounter_values(argc - 1, argv + 1);
+	if (!values) {
+		object_error((t_object *)x, "share: out of memory");
+		return;
+	}
+	switch (mydll_segment_write(x->d_segment, values, size)) {
+	case -1:
+		object_error((t_object *)x, "share: segment %s only holds %ld values", x->d_segname->s_name, (long)(mydll_segment_capacity(x->d_segment) / sizeof(double)));
+		break;
+	case -2:
+		object_error((t_object *)x, "share: segment %s is held by another writer, which may have quit part way", x->d_segname->s_name);
+		break;
+	}
+	sysmem_freeptr(values);
+}
+
+
+// bench [maxthreads] [iterations]: time the shared count against the sharded counters and registry reads,
+// posting the results. It runs on the thread that sent it and holds that thread up until it is done,
+// so the defaults keep it to a blink: raise them for figures worth quoting.
+void dllcounter_bench(t_dllcounter *x, long maxthreads, long iterations)
+{
+	mydll_bench((t_object *)x, maxthreads > 0 ? maxthreads : 8, iterations > 0 ? iterations : 100000);
+}
@@ -13,15 +13,21 @@
 
 // max object instance data
 typedef struct _dllreport {
-	t_object	d_obj;
-	void		*d_outlet;
+	t_object		d_obj;
+	void			*d_outlet;
+	t_mydll_segment	*d_segment;		// the segment last fetched from
+	t_symbol		*d_segname;
 } t_dllreport;
 
 
 // prototypes
 void	*dllreport_new(t_symbol *s, long argc, t_atom *argv);
+void	dllreport_free(t_dllreport *x);
 void	dllreport_assist(t_dllreport *x, void *b, long m, long a, char *s);
 void	dllreport_bang(t_dllreport *x);
+void	dllreport_get(t_dllreport *x, t_symbol *name);
+void	dllreport_lookup(t_dllreport *x, t_symbol *s, long argc, t_atom *argv);
+void	dllreport_fetch(t_dllreport *x, t_symbol *name);
 
 
 // globals
@@ -35,8 +41,11 @@ void ext_main(void *r)
 
 	mydll_init(); // call the init function in our dll -- will post to the Max window the first time only (for all objects linked to our dll)
 
-	c = class_new("dllreport", (method)dllreport_new, (method)NULL, sizeof(t_dllreport), (method)NULL, A_GIMME, 0);
+	c = class_new("dllreport", (method)dllreport_new, (method)dllreport_free, sizeof(t_dllreport), (method)NULL, A_GIMME, 0);
 	class_addmethod(c, (method)dllreport_bang,		"bang",			0);
+	class_addmethod(c, (method)dllreport_get,		"get",			A_SYM, 0);
+	class_addmethod(c, (method)dllreport_lookup,	"lookup",		A_GIMME, 0);
+	class_addmethod(c, (method)dllreport_fetch,		"fetch",		A_SYM, 0);
 	class_addmethod(c, (method)dllreport_assist,	"assist",		A_CANT, 0);
 	class_addmethod(c, (method)stdinletinfo,		"inletinfo",	A_CANT, 0);
 
@@ -52,19 +61,27 @@ void *dllreport_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_dllreport *x = (t_dllreport *)object_alloc(s_dllreport_class);
 	x->d_outlet = outlet_new((t_object *)x, NULL);
+	x->d_segment = NULL;
+	x->d_segname = NULL;
 	return x;
 }
 
 
+void dllreport_free(t_dllreport *x)
+{
+	mydll_segment_close(x->d_segment);
+}
+
+
 /************************************************************************************/
 // Methods bound to input/inlets
 
 void dllreport_assist(t_dllreport *x, void *b, long msg, long arg, char *dst)
 {
 	if (msg == 1)
-		strcpy(dst, "bang to get the current count");
+		strcpy(dst, "bang to get the current count, get, lookup, fetch");
 	else
-		strcpy(dst, "(int) the count");
+		strcpy(dst, "(int) the count, (float/list) table values");
 }
 
 
@@ -74,3 +91,95 @@ void dllreport_bang(t_dllreport *x)
 
 	outlet_int(x->d_outlet, count);
 }
+
+
+// get <name>: the total of a named counter
+void dllreport_get(t_dllreport *x, t_symbol *name)
+{
+	t_mydll_counter *c = mydll_counter_get(name);
+
+	if (c)
+		outlet_int(x->d_outlet, mydll_counter_read(c));
+}
+
+
+// lookup <key> [index]: one value of the key's table in the registry, or all of them without an index.
+// Nothing is locked: the table stays put until mydll_read_end(), however often it is set meanwhile,
+// so we copy out what we need and end the read before anything goes out of the outlet.
+void dllreport_lookup(t_dllreport *x, t_symbol *s, long argc, t_atom *argv)
+{
+	const t_mydll_blob *blob;
+	const double *values;
+	t_atom *av = NULL;
+	long ticket, count, index, i;
+	double value = 0;
+
+	if (!argc || atom_gettype(argv) != A_SYM) {
+		object_error((t_object *)x, "lookup: needs a key");
+		return;
+	}
+	index = argc > 1 ? (long)atom_getlong(argv + 1) : -1;
+
+	ticket = mydll_read_begin();
+	blob = mydll_blob_get(atom_getsym(argv));
+	values = blob ? (const double *)blob->data : NULL;
+	count = blob ? (long)(blob->size / sizeof(double)) : 0;
+	if (index >= 0)
+		value = index < count ? values[index] : 0;
+	else if (count) {
+		count = MIN(count, 32767);
+		av = (t_atom *)sysmem_newptr(count * sizeof(t_atom));
+		for (i = 0; av && i < count; i++)
+			atom_setfloat(av + i, values[i]);
+	}
+	mydll_read_end(ticket);
+
+	if (!blob)
+		object_error((t_object *)x, "lookup: no table %s", atom_getsym(argv)->s_name);
+	else if (index >= 0)
+		outlet_float(x->d_outlet, value);
+	else if (av)
+		outlet_list(x->d_outlet, NULL, (short)count, av);
+	if (av)
+		sysmem_freeptr(av);
+}
+
+
+// fetch <segment>: the table last shared to the segment, from this or another Max process
+void dllreport_fetch(t_dllreport *x, t_symbol *name)
+{
+	double *values;
+	t_ptr_size capacity, size;
+	t_atom *av;
+	long count, i;
+
+	if (name != x->d_segname) {
+		mydll_segment_close(x->d_segment);
+		x->d_segname = name;
+		x->d_segment = mydll_segment_open(name->s_name, 0, false);
+	}
+	if (!x->d_segment) {
+		object_error((t_object *)x, "fetch: no segment %s", name->s_name);
+		x->d_segname = NULL;
+		return;
+	}
+	capacity = mydll_segment_capacity(x->d_segment);
+	values = (double *)sysmem_newptr(capacity);
+	if (!values)
+		return;
+	size = mydll_segment_read(x->d_segment, values, capacity);
+	if (size == MYDLL_SEGMENT_BUSY) {
+		object_error((t_object *)x, "fetch: segment %s is held by a writer, which may have quit part way", name->s_name);
+		sysmem_freeptr(values);
+		return;
+	}
+	count = MIN((long)(size / sizeof(double)), 32767);
+	av = count ? (t_atom *)sysmem_newptr(count * sizeof(t_atom)) : NULL;
+	if (av) {
+		for (i = 0; i < count; i++)
+			atom_setfloat(av + i, values[i]);
+		outlet_list(x->d_outlet, NULL, (short)count, av);
+		sysmem_freeptr(av);
+	}
+	sysmem_freeptr(values);
+}
@@ -8,30 +8,650 @@
 	Timothy Place, tim@cycling74.com
 */
 
+// the DLL only links against object_post() from Max, so it keeps its state with the C++ library
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+
 #include "mydll.h"
 
+#ifdef WIN_VERSION
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+#define MYDLL_LINE		64			// bytes per cache line
+#define MYDLL_SHARDS	16			// per named counter
+#define MYDLL_KEYS		1024		// counters, and keys in the registry, each
+#define MYDLL_READERS	64			// read sections open at once
+#define MYDLL_MAGIC		0x6D79646C	// 'mydl', in a segment's header once it is ready
 
-static int s_initialized = false;
-static int s_count = 0;
+
+static std::atomic<int> s_initialized(0);
+static std::atomic<int> s_count(0);
 
 
 void mydll_init(void)
 {
-	if (!s_initialized) {
+	if (!s_initialized.exchange(1)) {
 		object_post(NULL, "initialized mydll");
-		s_initialized = true;
 	}
 }
 
 
 void mydll_inc(void)
 {
-	s_count++;
+	s_count.fetch_add(1, std::memory_order_relaxed);
 }
 
 
 int mydll_getcount(void)
 {
-	return s_count;
+	return s_count.load(std::memory_order_relaxed);
 }
 
+
+/************************************************************************************/
+// Tables keyed by symbol: added to under a lock, looked up without one, never removed from
+
+template <typename T>
+struct t_mydll_table {
+	std::atomic<t_symbol *>	keys[MYDLL_KEYS];
+	std::atomic<T *>		values[MYDLL_KEYS];
+	std::mutex				lock;
+
+	t_mydll_table()
+	{
+		for (long i = 0; i < MYDLL_KEYS; i++) {
+			keys[i].store(NULL, std::memory_order_relaxed);
+			values[i].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+	static size_t start(t_symbol *key)
+	{
+		size_t h = (size_t)key;
+		return ((h >> 4) ^ (h >> 14)) & (MYDLL_KEYS - 1);
+	}
+
+	// the key's slot, or -1
+	long find(t_symbol *key)
+	{
+		size_t i = start(key);
+		t_symbol *k;
+
+		for (long n = 0; n < MYDLL_KEYS; n++, i = (i + 1) & (MYDLL_KEYS - 1)) {
+			k = keys[i].load(std::memory_order_acquire);
+			if (k == key)
+				return (long)i;
+			if (!k)
+				break;
+		}
+		return -1;
+	}
+
+	// the key's slot, added with value if it is new (call with the lock held), or -1 if the table is full
+	long add(t_symbol *key, T *value)
+	{
+		long i = find(key);
+
+		if (i < 0) {
+			size_t j = start(key);
+
+			for (long n = 0; n < MYDLL_KEYS; n++, j = (j + 1) & (MYDLL_KEYS - 1)) {
+				if (!keys[j].load(std::memory_order_relaxed)) {
+					values[j].store(value, std::memory_order_relaxed);
+					keys[j].store(key, std::memory_order_release);		// the value is in before the key can be found
+					return (long)j;
+				}
+			}
+		}
+		return i;
+	}
+};
+
+
+/************************************************************************************/
+// Sharded counters
+
+struct t_mydll_shard {
+	std::atomic<t_atom_long>	value;
+	char						pad[MYDLL_LINE - sizeof(std::atomic<t_atom_long>)];
+};
+
+struct _mydll_counter {
+	t_mydll_shard	shards[MYDLL_SHARDS];
+};
+
+static t_mydll_table<t_mydll_counter> s_counters;
+static std::atomic<unsigned> s_nextshard(0);
+
+
+// each thread sticks to one shard, so its adds stay in its own core's cache
+static unsigned mydll_shard(void)
+{
+	static thread_local unsigned shard = s_nextshard.fetch_add(1, std::memory_order_relaxed) % MYDLL_SHARDS;
+	return shard;
+}
+
+
+static t_mydll_counter *mydll_counter_new(void)
+{
+	t_mydll_counter *c = new t_mydll_counter;
+
+	for (long i = 0; i < MYDLL_SHARDS; i++)
+		c->shards[i].value.store(0, std::memory_order_relaxed);
+	return c;
+}
+
+
+t_mydll_counter *mydll_counter_get(t_symbol *name)
+{
+	long i = s_counters.find(name);
+	t_mydll_counter *c;
+
+	if (i >= 0)
+		return s_counters.values[i].load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> guard(s_counters.lock);
+	c = mydll_counter_new();
+	i = s_counters.add(name, c);
+	if (i < 0 || s_counters.values[i].load(std::memory_order_relaxed) != c) {
+		delete c;			// beaten to it, or out of room
+		return i < 0 ? NULL : s_counters.values[i].load(std::memory_order_relaxed);
+	}
+	return c;
+}
+
+
+void mydll_counter_add(t_mydll_counter *c, t_atom_long n)
+{
+	c->shards[mydll_shard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+// adds happening meanwhile may or may not be counted
+t_atom_long mydll_counter_read(t_mydll_counter *c)
+{
+	t_atom_long total = 0;
+
+	for (long i = 0; i < MYDLL_SHARDS; i++)
+		total += c->shards[i].value.load(std::memory_order_relaxed);
+	return total;
+}
+
+
+/************************************************************************************/
+// The registry
+//
+// A read section claims a reader slot and writes the current epoch into it. A replaced blob is
+// tagged with the epoch at the time and freed once no slot holds an epoch at or before the tag:
+// any section opened later already sees the new blob. The writer's swap and scan and the reader's
+// claim and load are all sequentially consistent, so one of them always sees the other.
+
+struct t_mydll_reader {
+	std::atomic<t_uint64>	epoch;		// 0 when free
+	char					pad[MYDLL_LINE - sizeof(std::atomic<t_uint64>)];
+};
+
+struct t_mydll_retired {
+	t_mydll_blob	*blob;
+	t_uint64		epoch;
+};
+
+static t_mydll_table<t_mydll_blob> s_blobs;
+static t_mydll_reader s_readers[MYDLL_READERS];
+static std::atomic<t_uint64> s_epoch(1);
+static std::vector<t_mydll_retired> s_retired;		// under s_blobs.lock
+
+
+long mydll_read_begin(void)
+{
+	static thread_local unsigned hint = mydll_shard() * (MYDLL_READERS / MYDLL_SHARDS);
+	t_uint64 none;
+
+	while (1) {
+		for (unsigned n = 0; n < MYDLL_READERS; n++) {
+			unsigned i = (hint + n) % MYDLL_READERS;
+
+			none = 0;
+			if (!s_readers[i].epoch.load(std::memory_order_relaxed)
+				&& s_readers[i].epoch.compare_exchange_strong(none, s_epoch.load())) {
+				hint = i;
+				return (long)i;
+			}
+		}
+		std::this_thread::yield();		// every slot is taken: wait for a section to end
+	}
+}
+
+
+const t_mydll_blob *mydll_blob_get(t_symbol *key)
+{
+	long i = s_blobs.find(key);
+
+	return i < 0 ? NULL : s_blobs.values[i].load();
+}
+
+
+void mydll_read_end(long ticket)
+{
+	s_readers[ticket].epoch.store(0, std::memory_order_release);
+}
+
+
+// free what no read section can still see (call with s_blobs.lock held)
+static void mydll_reclaim(void)
+{
+	t_uint64 oldest = s_epoch.load();
+	t_uint64 e;
+	size_t i, kept = 0;
+
+	for (i = 0; i < MYDLL_READERS; i++) {
+		e = s_readers[i].epoch.load();
+		if (e && e < oldest)
+			oldest = e;
+	}
+	for (i = 0; i < s_retired.size(); i++) {
+		if (s_retired[i].epoch < oldest)
+			free(s_retired[i].blob);
+		else
+			s_retired[kept++] = s_retired[i];
+	}
+	s_retired.resize(kept);
+}
+
+
+// copy data in as the key's new blob; 0, or -1 if out of memory or keys
+long mydll_blob_set(t_symbol *key, const void *data, t_ptr_size size)
+{
+	t_mydll_blob *blob = (t_mydll_blob *)malloc(offsetof(t_mydll_blob, data) + (size ? size : 1));
+	t_mydll_blob *old;
+	t_mydll_retired r;
+	long i;
+
+	if (!blob)
+		return -1;
+	blob->size = size;
+	memcpy(blob->data, data, size);
+
+	std::lock_guard<std::mutex> guard(s_blobs.lock);
+	i = s_blobs.find(key);
+	if (i < 0) {
+		blob->version = 1;
+		if (s_blobs.add(key, blob) < 0) {
+			free(blob);
+			return -1;
+		}
+		return 0;
+	}
+	old = s_blobs.values[i].load(std::memory_order_relaxed);
+	blob->version = old->version + 1;
+	s_blobs.values[i].exchange(blob);
+	r.blob = old;
+	r.epoch = s_epoch.fetch_add(1);
+	s_retired.push_back(r);
+	mydll_reclaim();
+	return 0;
+}
+
+
+/************************************************************************************/
+// Shared memory segments
+//
+// A segment starts with this header. A writer makes seq odd while it copies, and even again once
+// the data is whole; a reader copies and then checks that seq was even and didn't move meanwhile.
+// Writers in different processes take turns through the same counter. A process that dies while
+// it writes leaves seq odd for good, so both sides stop waiting after MYDLL_SEGMENT_WAIT ms.
+
+struct t_mydll_segheader {
+	std::atomic<t_uint32>	magic;
+	t_uint32				reserved;
+	std::atomic<t_uint64>	seq;
+	t_uint64				capacity;		// bytes of data the segment holds
+	std::atomic<t_uint64>	size;			// bytes written last
+	char					pad[MYDLL_LINE - 32];
+};
+
+struct _mydll_segment {
+	t_mydll_segheader	*header;
+	char				*data;
+	t_ptr_size			mapped;
+	long				refs;
+	std::string			name;
+#ifdef WIN_VERSION
+	HANDLE				handle;
+#endif
+};
+
+static std::map<std::string, t_mydll_segment *> s_segments;		// each mapped once per process
+static std::mutex s_segmentlock;
+
+
+static std::string mydll_segment_osname(const char *name)
+{
+#ifdef WIN_VERSION
+	return std::string("Local\\mydll.") + name;
+#else
+	return std::string("/mydll.") + name;
+#endif
+}
+
+
+// map the named memory, making it size bytes long if we are the one to create it; NULL if we can't
+static t_mydll_segheader *mydll_segment_map(t_mydll_segment *seg, t_ptr_size size, long create, bool *created)
+{
+	std::string osname = mydll_segment_osname(seg->name.c_str());
+	t_ptr_size total = sizeof(t_mydll_segheader) + size;
+	void *p;
+
+	*created = false;
+#ifdef WIN_VERSION
+	if (create) {
+		seg->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((t_uint64)total >> 32), (DWORD)total, osname.c_str());
+		*created = seg->handle && GetLastError() != ERROR_ALREADY_EXISTS;
+	}
+	else
+		seg->handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, osname.c_str());
+	if (!seg->handle)
+		return NULL;
+	p = MapViewOfFile(seg->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!p) {
+		CloseHandle(seg->handle);
+		return NULL;
+	}
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(p, &info, sizeof(info));
+	seg->mapped = (t_ptr_size)info.RegionSize;
+#else
+	struct stat st;
+	int fd = -1;
+
+	if (create) {
+		fd = shm_open(osname.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+		if (fd >= 0) {
+			if (ftruncate(fd, (off_t)total)) {
+				close(fd);
+				shm_unlink(osname.c_str());
+				return NULL;
+			}
+			*created = true;
+		}
+		else if (errno != EEXIST)
+			return NULL;
+	}
+	if (fd < 0)
+		fd = shm_open(osname.c_str(), O_RDWR, 0666);
+	if (fd < 0)
+		return NULL;
+	// someone else may have only just created it: give them a moment to size it
+	for (long i = 0; !fstat(fd, &st) && (t_ptr_size)st.st_size < sizeof(t_mydll_segheader) && i < 100; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	if ((t_ptr_size)st.st_size < sizeof(t_mydll_segheader)) {
+		close(fd);
+		return NULL;
+	}
+	seg->mapped = (t_ptr_size)st.st_size;
+	p = mmap(NULL, seg->mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+#endif
+	return (t_mydll_segheader *)p;
+}
+
+
+static void mydll_segment_unmap(t_mydll_segment *seg)
+{
+#ifdef WIN_VERSION
+	UnmapViewOfFile(seg->header);
+	CloseHandle(seg->handle);
+#else
+	munmap(seg->header, seg->mapped);
+#endif
+}
+
+
+t_mydll_segment *mydll_segment_open(const char *name, t_ptr_size size, long create)
+{
+	std::lock_guard<std::mutex> guard(s_segmentlock);
+	std::map<std::string, t_mydll_segment *>::iterator it = s_segments.find(name);
+	t_mydll_segment *seg;
+	t_mydll_segheader *h;
+	bool created;
+	long i;
+
+	if (it != s_segments.end()) {
+		it->second->refs++;
+		return it->second;
+	}
+	if (size < MYDLL_SEGMENT_SIZE)
+		size = MYDLL_SEGMENT_SIZE;
+
+	seg = new t_mydll_segment;
+	seg->name = name;
+	seg->refs = 1;
+	h = mydll_segment_map(seg, size, create, &created);
+	if (!h) {
+		delete seg;
+		return NULL;
+	}
+	if (created) {
+		h->seq.store(0, std::memory_order_relaxed);
+		h->capacity = size;
+		h->size.store(0, std::memory_order_relaxed);
+		h->magic.store(MYDLL_MAGIC, std::memory_order_release);
+	}
+	else {
+		for (i = 0; h->magic.load(std::memory_order_acquire) != MYDLL_MAGIC && i < 100; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if (h->magic.load(std::memory_order_acquire) != MYDLL_MAGIC || sizeof(t_mydll_segheader) + h->capacity > seg->mapped) {
+		seg->header = h;
+		mydll_segment_unmap(seg);
+		delete seg;
+		return NULL;
+	}
+	seg->header = h;
+	seg->data = (char *)(h + 1);
+	s_segments[seg->name] = seg;
+	return seg;
+}
+
+
+void mydll_segment_close(t_mydll_segment *seg)
+{
+	std::lock_guard<std::mutex> guard(s_segmentlock);
+
+	if (!seg || --seg->refs)
+		return;
+	s_segments.erase(seg->name);
+	mydll_segment_unmap(seg);
+	delete seg;
+}
+
+
+// drop the name so the memory goes once the last process closes it; on windows that happens anyway
+long mydll_segment_remove(const char *name)
+{
+#ifdef WIN_VERSION
+	return 0;
+#else
+	return shm_unlink(mydll_segment_osname(name).c_str()) ? -1 : 0;
+#endif
+}
+
+
+t_ptr_size mydll_segment_capacity(t_mydll_segment *seg)
+{
+	return (t_ptr_size)seg->header->capacity;
+}
+
+
+// whether another writer has had the segment for longer than we wait; the first call starts the clock
+static bool mydll_segment_waited(std::chrono::steady_clock::time_point *start, long *tries)
+{
+	if ((*tries)++ == 0)
+		*start = std::chrono::steady_clock::now();
+	else if (std::chrono::steady_clock::now() - *start > std::chrono::milliseconds(MYDLL_SEGMENT_WAIT))
+		return true;
+	std::this_thread::yield();
+	return false;
+}
+
+
+// replace the segment's contents; 0, -1 if they don't fit, or -2 if another writer kept it too long
+long mydll_segment_write(t_mydll_segment *seg, const void *data, t_ptr_size size)
+{
+	t_mydll_segheader *h = seg->header;
+	std::chrono::steady_clock::time_point start;
+	long tries = 0;
+	t_uint64 seq;
+
+	if (size > h->capacity)
+		return -1;
+	while (1) {
+		seq = h->seq.load(std::memory_order_relaxed);
+		if (!(seq & 1) && h->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire))
+			break;
+		if (mydll_segment_waited(&start, &tries))		// another writer is at it
+			return -2;
+	}
+	std::atomic_thread_fence(std::memory_order_release);		// odd seq is out before the data changes
+	memcpy(seg->data, data, size);
+	h->size.store(size, std::memory_order_relaxed);
+	h->seq.store(seq + 2, std::memory_order_release);
+	return 0;
+}
+
+
+// copy out up to size bytes of what was last written, as written; returns its full size, or
+// MYDLL_SEGMENT_BUSY if a writer kept it too long
+t_ptr_size mydll_segment_read(t_mydll_segment *seg, void *data, t_ptr_size size)
+{
+	t_mydll_segheader *h = seg->header;
+	std::chrono::steady_clock::time_point start;
+	long tries = 0;
+	t_uint64 seq;
+	t_ptr_size n;
+
+	while (1) {
+		seq = h->seq.load(std::memory_order_acquire);
+		if (!(seq & 1)) {
+			n = (t_ptr_size)h->size.load(std::memory_order_relaxed);
+			if (n > h->capacity)
+				n = 0;			// torn: the check below fails
+			memcpy(data, seg->data, n < size ? n : size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (h->seq.load(std::memory_order_relaxed) == seq)
+				return n;
+		}
+		if (mydll_segment_waited(&start, &tries))
+			return MYDLL_SEGMENT_BUSY;
+	}
+}
+
+
+/************************************************************************************/
+// Contention benchmark
+
+typedef void (*t_mydll_benchfn)(long iterations);
+
+static std::atomic<int> s_benchshared(0);
+static t_mydll_counter *s_benchcounter = NULL;
+static t_symbol s_benchkey;			// only its address matters, as a key
+static volatile long s_benchsink;		// keeps the reads from being optimised away
+
+
+static void mydll_bench_shared(long iterations)
+{
+	for (long i = 0; i < iterations; i++)
+		s_benchshared.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+static void mydll_bench_sharded(long iterations)
+{
+	for (long i = 0; i < iterations; i++)
+		mydll_counter_add(s_benchcounter, 1);
+}
+
+
+static void mydll_bench_read(long iterations)
+{
+	const t_mydll_blob *blob;
+	long ticket, sum = 0;
+
+	for (long i = 0; i < iterations; i++) {
+		ticket = mydll_read_begin();
+		blob = mydll_blob_get(&s_benchkey);
+		sum += blob->data[i % blob->size];
+		mydll_read_end(ticket);
+	}
+	s_benchsink = sum;
+}
+
+
+// millions of operations per second with all threads running fn at once
+static double mydll_bench_run(t_mydll_benchfn fn, long threads, long iterations)
+{
+	std::vector<std::thread> team;
+	std::atomic<long> ready(0);
+	std::atomic<bool> go(false);
+	std::chrono::steady_clock::time_point start;
+	double seconds;
+
+	for (long i = 0; i < threads; i++) {
+		team.push_back(std::thread([&]() {
+			ready.fetch_add(1);
+			while (!go.load())
+				std::this_thread::yield();
+			fn(iterations);
+		}));
+	}
+	while (ready.load() < threads)
+		std::this_thread::yield();
+	start = std::chrono::steady_clock::now();
+	go.store(true);
+	for (long i = 0; i < threads; i++)
+		team[i].join();
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return seconds > 0 ? threads * (double)iterations / seconds / 1e6 : 0;
+}
+
+
+void mydll_bench(t_object *x, long maxthreads, long iterations)
+{
+	char table[256];
+	long threads;
+
+	if (!s_benchcounter)
+		s_benchcounter = mydll_counter_new();		// not in the table: nobody else can see it
+	for (long i = 0; i < (long)sizeof(table); i++)
+		table[i] = (char)i;
+	mydll_blob_set(&s_benchkey, table, sizeof(table));
+
+	object_post(x, "Mops/s: one shared atomic, sharded counter, registry reads");
+	for (threads = 1; ; threads = threads * 2 < maxthreads ? threads * 2 : maxthreads) {
+		double shared = mydll_bench_run(mydll_bench_shared, threads, iterations);
+		double sharded = mydll_bench_run(mydll_bench_sharded, threads, iterations);
+		double reads = mydll_bench_run(mydll_bench_read, threads, iterations);
+
+		object_post(x, "%ld threads: %.1f, %.1f, %.1f", threads, shared, sharded, reads);
+		if (threads >= maxthreads)
+			break;
+	}
+}
@@ -6,6 +6,21 @@
 
 	Copyright 2013 - Cycling '74
 	Timothy Place, tim@cycling74.com
+
+	Everything here may be called from any thread: the main thread, the scheduler (in overdrive)
+	and the audio thread all reach the same state.
+
+	- counters: the plain count is a single atomic, fine for the odd bang. Named counters are
+	  split into shards, one cache line each, so threads adding at once don't fight over a line;
+	  reading one adds up its shards.
+	- the registry maps a key to a blob: bytes written once and then read by many. Readers don't
+	  lock. A read section (mydll_read_begin() ... mydll_read_end()) pins the blobs it gets, and a
+	  blob that mydll_blob_set() replaced is only freed once every read section that could have
+	  seen it has ended (epoch reclamation).
+	- segments are named blocks of shared memory, so several Max processes on one machine can
+	  share a table without copying it. A write is seen whole or not at all by readers
+	  (a sequence lock in the segment's header). Nobody waits on another writer for more than
+	  MYDLL_SEGMENT_WAIT ms, as that writer may be in a process that has gone.
 */
 
 #include "ext.h"
@@ -21,9 +36,47 @@
 #endif
 
 
+#define MYDLL_SEGMENT_SIZE		65536		// bytes a new segment holds unless more are asked for
+#define MYDLL_SEGMENT_WAIT		100			// ms a read or write waits for another writer to finish
+#define MYDLL_SEGMENT_BUSY		((t_ptr_size)-1)	// mydll_segment_read() gave up waiting
+
+
+typedef struct _mydll_counter t_mydll_counter;
+typedef struct _mydll_segment t_mydll_segment;
+
+typedef struct _mydll_blob {
+	t_ptr_size	size;			// bytes of data
+	t_atom_long	version;		// goes up by one each time the key is set
+	char		data[1];
+} t_mydll_blob;
+
+
 // prototypes
 BEGIN_USING_C_LINKAGE
 void T_EXPORT mydll_init(void);
 void T_EXPORT mydll_inc(void);
 int  T_EXPORT mydll_getcount(void);
+
+// named counters, made on first use and kept for the life of the DLL
+t_mydll_counter T_EXPORT *mydll_counter_get(t_symbol *name);
+void T_EXPORT mydll_counter_add(t_mydll_counter *c, t_atom_long n);
+t_atom_long T_EXPORT mydll_counter_read(t_mydll_counter *c);
+
+// the registry: mydll_blob_get() only inside a read section, and the blob only until it ends
+long T_EXPORT mydll_blob_set(t_symbol *key, const void *data, t_ptr_size size);
+long T_EXPORT mydll_read_begin(void);
+const t_mydll_blob T_EXPORT *mydll_blob_get(t_symbol *key);
+void T_EXPORT mydll_read_end(long ticket);
+
+// shared memory, by name across processes: open with create to make it if it isn't there yet
+t_mydll_segment T_EXPORT *mydll_segment_open(const char *name, t_ptr_size size, long create);
+void T_EXPORT mydll_segment_close(t_mydll_segment *seg);
+long T_EXPORT mydll_segment_remove(const char *name);
+t_ptr_size T_EXPORT mydll_segment_capacity(t_mydll_segment *seg);
+// a writer that takes longer than MYDLL_SEGMENT_WAIT, or died part way, makes these give up rather than hang
+long T_EXPORT mydll_segment_write(t_mydll_segment *seg, const void *data, t_ptr_size size);
+t_ptr_size T_EXPORT mydll_segment_read(t_mydll_segment *seg, void *data, t_ptr_size size);
+
+// time the counters and the registry on 1, 2, 4 ... maxthreads threads and post the results
+void T_EXPORT mydll_bench(t_object *x, long maxthreads, long iterations);
 END_USING_C_LINKAGE
@@ -1,8 +1,11 @@
 /**
  @file
  filebyte - similar to filein.
- Accesses a file on disk and outputs a given byte of the file's data.
+ Accesses a file on disk and outputs the values at given offsets in the file's data.
  Note that we use the "open" message, not "read", because we're not loading the file into memory.
+ The file is memory-mapped, or read through a cache of blocks (see filereader.h), so a read doesn't
+ cost a seek and a read call of its own. A list of offsets comes back as one list of values, of the
+ type and byte order set by the type and bigendian attributes.
 
  updated 3/22/09 ajm: new API
 
@@ -12,111 +15,175 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_path.h"
+#include "ext_atomic.h"
+#include "filereader.h"
 
 #ifdef MAC_VERSION
 #include "ext_strings.h"
 #endif
 
-#ifndef MAC_VERSION
-// if defined, use windows calls, otherwise use max's cross platform "sysfile" API
-#define FILEBYTE_WINDOWS_SPECIFIC
-#endif
-
-#ifdef WIN_VERSION
-typedef char Byte;
-#endif
+#define FILEBYTE_STACKATOMS	64		// values output without allocating
 
 void *filebyte_class;
 
 typedef struct filebyte {
 	t_object f_ob;
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-	HANDLE f_fh;
-#else // cross platform sysfile calls
-	t_filehandle f_fh;
-#endif
+	t_filereader f_reader;
 	short f_open;
+	t_int32_atomic f_pending;		// reads deferred to the main thread and not yet done
+	t_symbol *f_type;
+	long f_typeindex;
+	char f_bigendian;
+	char f_map;						// memory-map files (takes effect on open)
+	long f_blocks;					// cached blocks when not mapped (takes effect on open)
+	long f_readahead;				// blocks read ahead of forward reads (takes effect on open)
 	void *f_out;
 } t_filebyte;
 
-t_symbol *ps_nothing;
+t_symbol *ps_nothing, *ps_report;
 
-void filebyte_doint(t_filebyte *x, long n);
+void filebyte_read(t_filebyte *x, long ac, t_atom *av, t_bool locked);
+void filebyte_dolist(t_filebyte *x, t_symbol *s, long ac, t_atom *av);
+void filebyte_list(t_filebyte *x, t_symbol *s, long ac, t_atom *av);
 void filebyte_int(t_filebyte *x, long n);
+void filebyte_report(t_filebyte *x);
 void filebyte_close(t_filebyte *x);
 void filebyte_doopen(t_filebyte *x, t_symbol *s);
 void filebyte_open(t_filebyte *x, t_symbol *s);
 void filebyte_free(t_filebyte *x);
 void filebyte_assist(t_filebyte *x, void *b, long m, long a, char *s);
-void *filebyte_new(t_symbol *fn);
+t_max_err filebyte_attr_settype(t_filebyte *x, void *attr, long argc, t_atom *argv);
+void *filebyte_new(t_symbol *s, long argc, t_atom *argv);
 
 void ext_main(void *r)
 {
 	t_class *c;
 
-	c = class_new("filebyte", (method)filebyte_new, (method)filebyte_free, (short)sizeof(t_filebyte), 0L, A_DEFSYM, 0);
+	c = class_new("filebyte", (method)filebyte_new, (method)filebyte_free, (short)sizeof(t_filebyte), 0L, A_GIMME, 0);
 	class_addmethod(c, (method)filebyte_int,	"int",		A_LONG, 0);
+	class_addmethod(c, (method)filebyte_list,	"list",		A_GIMME, 0);
+	class_addmethod(c, (method)filebyte_report,	"report",	0);
 	class_addmethod(c, (method)filebyte_close,	"fclose",	0);
 	class_addmethod(c, (method)filebyte_open,	"open",		A_DEFSYM,0);
 	class_addmethod(c, (method)filebyte_assist,	"assist",	A_CANT,0);
+
+	CLASS_ATTR_SYM(c, "type", 0, t_filebyte, f_type);
+	CLASS_ATTR_ENUM(c, "type", 0, FILEREADER_TYPENAMES);
+	CLASS_ATTR_LABEL(c, "type", 0, "Value Type");
+	CLASS_ATTR_ACCESSORS(c, "type", NULL, filebyte_attr_settype);
+
+	CLASS_ATTR_CHAR(c, "bigendian", 0, t_filebyte, f_bigendian);
+	CLASS_ATTR_STYLE_LABEL(c, "bigendian", 0, "onoff", "Big Endian Values");
+
+	CLASS_ATTR_CHAR(c, "map", 0, t_filebyte, f_map);
+	CLASS_ATTR_STYLE_LABEL(c, "map", 0, "onoff", "Memory-Map the File (takes effect on open)");
+
+	CLASS_ATTR_LONG(c, "blocks", 0, t_filebyte, f_blocks);
+	CLASS_ATTR_FILTER_CLIP(c, "blocks", 1, 65536);
+	CLASS_ATTR_LABEL(c, "blocks", 0, "Cached Blocks (takes effect on open)");
+
+	CLASS_ATTR_LONG(c, "readahead", 0, t_filebyte, f_readahead);
+	CLASS_ATTR_FILTER_CLIP(c, "readahead", 0, FILEREADER_MAXRUN - 1);
+	CLASS_ATTR_LABEL(c, "readahead", 0, "Blocks Read Ahead (takes effect on open)");
+
 	class_register(CLASS_BOX, c);
 	filebyte_class = c;
 
 	ps_nothing = gensym("");
+	ps_report = gensym("report");
 }
 
-void filebyte_doint(t_filebyte *x, long n)		// byte access
+// read the values at the offsets in av and output them: one value on its own, more as a list
+void filebyte_read(t_filebyte *x, long ac, t_atom *av, t_bool locked)
 {
-	Byte		data;
-	t_ptr_size	count;
-	long		err;
+	t_atom		stack[FILEBYTE_STACKATOMS];
+	t_atom		*out = stack;
+	long		n;
 
-	if (x->f_open) {
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-		if (INVALID_SET_FILE_POINTER!=SetFilePointer(x->f_fh,n,NULL,FILE_BEGIN))
-			err = 0;
+	if (!locked)
+		systhread_mutex_lock(x->f_reader.lock);
+	if (ac > FILEBYTE_STACKATOMS && !(out = (t_atom *)sysmem_newptr(ac * sizeof(t_atom)))) {
+		systhread_mutex_unlock(x->f_reader.lock);
+		object_error((t_object *)x, "filebyte: out of memory");
+		return;
+	}
+	n = filereader_getv(&x->f_reader, ac, av, x->f_typeindex, x->f_bigendian, out);
+	systhread_mutex_unlock(x->f_reader.lock);
+
+	if (n < ac)
+		object_error((t_object *)x, "filebyte: read err at %lld", (long long)atom_getlong(av + n));
+	if (n == 1) {
+		if (atom_gettype(out) == A_FLOAT)
+			outlet_float(x->f_out, atom_getfloat(out));
 		else
-			err = GetLastError();
-#else // cross platform sysfile calls
-		err = sysfile_setpos(x->f_fh,SYSFILE_FROMSTART,n);
-#endif
-		if (err)
-			object_error((t_object *)x, "seek err %d",err);
-		else {
-			count = 1;
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-			if (ReadFile(x->f_fh,&data,count,(LPDWORD)&count,NULL))
-				err = 0;
-			else
-				err = GetLastError();
-#else // cross platform sysfile calls
-			err = sysfile_read(x->f_fh,&count,&data);
-#endif
-			if (err)
-				object_error((t_object *)x, "filebyte: read err %d",err);
-			else {
-				outlet_int(x->f_out,data);
+			outlet_int(x->f_out, atom_getlong(out));
+	} else if (n > 1)
+		outlet_list(x->f_out, NULL, (short)n, out);
+	if (out != stack)
+		sysmem_freeptr(out);
+}
+
+void filebyte_dolist(t_filebyte *x, t_symbol *s, long ac, t_atom *av)
+{
+	if (x->f_open)
+		filebyte_read(x, ac, av, false);
+	ATOMIC_DECREMENT(&x->f_pending);
+}
+
+void filebyte_list(t_filebyte *x, t_symbol *s, long ac, t_atom *av)
+{
+	t_filereader *r = &x->f_reader;
+
+	if (!x->f_open) {
+		object_error((t_object *)x, "filebyte: no open file");
+		return;
+	}
+	if (!ac)
+		return;
+	// reads that have to wait go to the main thread, and so does everything after them, to keep the order
+	if (!x->f_pending) {
+		if (systhread_ismainthread()) {
+			filebyte_read(x, ac, av, false);
+			return;
+		}
+		if (!systhread_mutex_trylock(r->lock)) {
+			if (!filereader_needsio(r, ac, av, x->f_typeindex)) {
+				filebyte_read(x, ac, av, true);		// unlocks
+				return;
 			}
+			systhread_mutex_unlock(r->lock);
 		}
-	} else {
-		object_error((t_object *)x, "filebyte: no open file");
 	}
+	ATOMIC_INCREMENT(&x->f_pending);
+	defer_low(x, (method)filebyte_dolist, NULL, (short)ac, av);
 }
 
 void filebyte_int(t_filebyte *x, long n)
 {
-	defer_low(x,(method)filebyte_doint,(t_symbol *)n,0,0L); // trick. passing int as symbol
+	t_atom a;
+
+	atom_setlong(&a, n);
+	filebyte_list(x, NULL, 1, &a);
+}
+
+// report mapped size reads hits misses hit% blocks syscalls
+void filebyte_report(t_filebyte *x)
+{
+	t_atom av[8];
+	long ac;
+
+	systhread_mutex_lock(x->f_reader.lock);
+	ac = filereader_report(&x->f_reader, av);
+	systhread_mutex_unlock(x->f_reader.lock);
+	outlet_anything(x->f_out, ps_report, (short)ac, av);
 }
 
 void filebyte_close(t_filebyte *x)
 {
 	if (x->f_open) {
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-		CloseHandle(x->f_fh);
-#else // cross platform sysfile calls
-		sysfile_close(x->f_fh);
-#endif
-		x->f_fh = 0;
+		systhread_mutex_lock(x->f_reader.lock);
+		filereader_close(&x->f_reader);
+		systhread_mutex_unlock(x->f_reader.lock);
 		x->f_open = FALSE;
 	}
 }
@@ -125,9 +192,6 @@ void filebyte_doopen(t_filebyte *x, t_symbol *s)
 {
 	short		path;
 	char		ps[MAX_PATH_CHARS];
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-	char	 	ps2[MAX_PATH_CHARS];
-#endif
 	t_fourcc	type;
 	t_max_err	err;
 
@@ -142,24 +206,10 @@ void filebyte_doopen(t_filebyte *x, t_symbol *s)
 			return;
 		}
 	}
-#ifdef FILEBYTE_WINDOWS_SPECIFIC
-	// convert path + name to pathname
-	path_topathname(path,ps,ps2);
-	// convert max style pathname to native pathname
-	path_nameconform(ps2,ps,PATH_STYLE_NATIVE,PATH_TYPE_ABSOLUTE);
-	// open file
-	x->f_fh = CreateFile(ps,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,0,NULL);
-	if (x->f_fh==INVALID_HANDLE_VALUE) {
-		x->f_fh = 0;
-		err = GetLastError();
-	} else {
-		err = 0;
-	}
-#else // cross platform sysfile calls
-	err = path_opensysfile(ps,path,&x->f_fh,READ_PERM);
-#endif
+	systhread_mutex_lock(x->f_reader.lock);
+	err = filereader_open(&x->f_reader, ps, path, x->f_map, x->f_blocks, x->f_readahead);
+	systhread_mutex_unlock(x->f_reader.lock);
 	if (err) {
-		x->f_fh = 0;
 		object_error((t_object *)x, "%s: error %d opening file",ps,err);
 		return;
 	}
@@ -174,24 +224,46 @@ void filebyte_open(t_filebyte *x, t_symbol *s)
 void filebyte_free(t_filebyte *x)
 {
 	filebyte_close(x);
+	filereader_free(&x->f_reader);
 }
 
 void filebyte_assist(t_filebyte *x, void *b, long m, long a, char *s)
 {
 	if (m == ASSIST_INLET)	// inlet
-		sprintf(s,"(int) byte in file");
+		sprintf(s,"(int/list) offsets in file, report");
 	else	// outlet
-		sprintf(s,"(int) byte in file output");
+		sprintf(s,"(int/float/list) values in file output");
+}
+
+t_max_err filebyte_attr_settype(t_filebyte *x, void *attr, long argc, t_atom *argv)
+{
+	long type = argc ? filereader_type(atom_getsym(argv)) : -1;
+
+	if (type < 0) {
+		object_error((t_object *)x, "type must be one of " FILEREADER_TYPENAMES);
+		return MAX_ERR_GENERIC;
+	}
+	x->f_type = atom_getsym(argv);
+	x->f_typeindex = type;
+	return MAX_ERR_NONE;
 }
 
-void *filebyte_new(t_symbol *fn)
+void *filebyte_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_filebyte *x;
+	long attrstart = attr_args_offset((short)argc, argv);
+	t_symbol *fn = attrstart && atom_gettype(argv) == A_SYM ? atom_getsym(argv) : ps_nothing;
 
 	x = object_alloc(filebyte_class);
-	x->f_out = intout(x);
+	x->f_out = outlet_new(x, NULL);
 	x->f_open = FALSE;
-	x->f_fh = 0;
+	filereader_init(&x->f_reader);
+	x->f_type = gensym("uint8");
+	x->f_typeindex = FILEREADER_UINT8;
+	x->f_map = 1;
+	x->f_blocks = FILEREADER_BLOCKS;
+	x->f_readahead = 4;
+	attr_args_process(x, (short)argc, argv);
 	if (fn != ps_nothing) {
 		filebyte_doopen(x,fn);
 	}
@@ -0,0 +1,560 @@
+/**
+	@file
+	filereader.h - random access to the values in a file, for filebyte and filein
+
+	A reader memory-maps the file when it can, so a read is a copy out of
+	the mapping. Where that fails (or is turned off) it falls back to a
+	cache of FILEREADER_BLOCKSIZE blocks read with sysfile, evicting the
+	least recently used. A hash index from block to slot finds a block and
+	a list threaded through the slots, most recently used first, names
+	the one to evict, so neither looks at every slot. A miss reads the
+	block together with the ones after it when reads have been moving
+	forward through the file, and a list of offsets first works out the
+	blocks it needs and reads the missing ones in runs, one seek and one
+	read per run, before it decodes anything. A list needing more blocks
+	than the cache holds is taken in batches that fit.
+
+	Values are decoded from the bytes, so any type can be read in either
+	byte order at any offset. The reader counts the values it was asked
+	for, those it had to go to the file for and the calls it made, which
+	filebyte and filein hand out in answer to "report".
+
+	Nothing here locks: callers hold the reader's lock around anything
+	that can happen on more than one thread at a time.
+*/
+
+#ifndef _FILEREADER_H_
+#define _FILEREADER_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_path.h"
+#include "ext_systhread.h"
+
+#ifdef WIN_VERSION
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FILEREADER_BLOCKSIZE	4096	// bytes per cached block
+#define FILEREADER_MAXRUN		16		// most blocks read with one call
+#define FILEREADER_BLOCKS		64		// default cache size
+
+enum {
+	FILEREADER_INT8 = 0,
+	FILEREADER_UINT8,
+	FILEREADER_INT16,
+	FILEREADER_UINT16,
+	FILEREADER_INT32,
+	FILEREADER_UINT32,
+	FILEREADER_INT64,
+	FILEREADER_FLOAT32,
+	FILEREADER_FLOAT64,
+	FILEREADER_NUMTYPES
+};
+
+#define FILEREADER_TYPENAMES	"int8 uint8 int16 uint16 int32 uint32 int64 float32 float64"
+
+typedef struct _filereader
+{
+	const unsigned char	*map;			// the whole file, or NULL when reading through the cache
+	size_t				maplen;
+#ifdef WIN_VERSION
+	HANDLE				file;
+	HANDLE				mapping;
+#endif
+	t_filehandle		fh;				// when not mapped
+	t_int64				size;			// bytes in the file
+	t_bool				open;
+
+	long				nblocks;		// cache slots
+	t_int64				*tags;			// block held by each slot, -1 if none
+	long				*index;			// slot + 1 by hash of its block, 0 if empty; linear probing
+	long				indexbits;		// log2 of the index size, at least twice nblocks
+	long				*newer;			// the slots in the order they were used, -1 at the ends
+	long				*older;
+	long				newest;
+	long				oldest;			// the next to be evicted
+	unsigned char		*data;			// nblocks * FILEREADER_BLOCKSIZE
+	unsigned char		*stage;			// FILEREADER_MAXRUN blocks, for runs read in one call
+	t_int64				*want;			// missing blocks of a batch of offsets
+	long				last;			// slot of the last hit
+	t_int64				next;			// block after the last run read, to spot forward reads
+	long				readahead;		// blocks read after a forward miss
+
+	t_systhread_mutex	lock;
+
+	t_atom_long			reads;			// values asked for
+	t_atom_long			hits;			// values found mapped or cached
+	t_atom_long			misses;			// values that had to be read from the file
+	t_atom_long			fetched;		// blocks read
+	t_atom_long			syscalls;		// seeks and reads
+} t_filereader;
+
+
+static const long s_filereader_sizes[FILEREADER_NUMTYPES] = { 1, 1, 2, 2, 4, 4, 8, 4, 8 };
+
+// the type called s, or -1
+static inline long filereader_type(t_symbol *s)
+{
+	static const char *names[FILEREADER_NUMTYPES] = { "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "float32", "float64" };
+	long i;
+
+	for (i = 0; i < FILEREADER_NUMTYPES; i++) {
+		if (!strcmp(s->s_name, names[i]))
+			return i;
+	}
+	return -1;
+}
+
+static inline long filereader_typesize(long type)
+{
+	return s_filereader_sizes[type];
+}
+
+// the value of type at p, in either byte order
+static inline void filereader_decode(const unsigned char *p, long type, long bigendian, t_atom *a)
+{
+	long i, n = s_filereader_sizes[type];
+	t_uint64 u = 0;
+	union { t_uint32 u; float f; } v32;
+	union { t_uint64 u; double f; } v64;
+
+	if (bigendian) {
+		for (i = 0; i < n; i++)
+			u = (u << 8) | p[i];
+	}
+	else {
+		for (i = n - 1; i >= 0; i--)
+			u = (u << 8) | p[i];
+	}
+	switch (type) {
+	case FILEREADER_INT8:		atom_setlong(a, (t_int8)u); break;
+	case FILEREADER_UINT8:		atom_setlong(a, (t_uint8)u); break;
+	case FILEREADER_INT16:		atom_setlong(a, (t_int16)u); break;
+	case FILEREADER_UINT16:		atom_setlong(a, (t_uint16)u); break;
+	case FILEREADER_INT32:		atom_setlong(a, (t_int32)u); break;
+	case FILEREADER_UINT32:		atom_setlong(a, (t_atom_long)(t_uint32)u); break;
+	case FILEREADER_INT64:		atom_setlong(a, (t_atom_long)(t_int64)u); break;
+	case FILEREADER_FLOAT32:	v32.u = (t_uint32)u; atom_setfloat(a, v32.f); break;
+	case FILEREADER_FLOAT64:	v64.u = u; atom_setfloat(a, v64.f); break;
+	}
+}
+
+
+//***********************************************************************************************
+// opening and closing
+
+static inline void filereader_init(t_filereader *r)
+{
+	memset(r, 0, sizeof(t_filereader));
+	systhread_mutex_new(&r->lock, 0);
+}
+
+static inline t_bool filereader_map(t_filereader *r, const char *path)
+{
+#ifdef WIN_VERSION
+	LARGE_INTEGER size;
+
+	r->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (r->file == INVALID_HANDLE_VALUE)
+		return false;
+	if (!GetFileSizeEx(r->file, &size) || size.QuadPart == 0) {
+		CloseHandle(r->file);
+		return false;
+	}
+	r->mapping = CreateFileMapping(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!r->mapping) {
+		CloseHandle(r->file);
+		return false;
+	}
+	r->map = (const unsigned char *)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!r->map) {
+		CloseHandle(r->mapping);
+		CloseHandle(r->file);
+		return false;
+	}
+	r->maplen = (size_t)size.QuadPart;
+#else
+	struct stat st;
+	void *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size == 0) {		// an empty file can't be mapped; the cache copes
+		close(fd);
+		return false;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);		// the mapping keeps the file open
+	if (map == MAP_FAILED)
+		return false;
+	r->map = (const unsigned char *)map;
+	r->maplen = (size_t)st.st_size;
+	madvise(map, r->maplen, MADV_RANDOM);
+#endif
+	r->size = (t_int64)r->maplen;
+	return true;
+}
+
+static inline void filereader_close(t_filereader *r)
+{
+	if (r->map) {
+#ifdef WIN_VERSION
+		UnmapViewOfFile((void *)r->map);
+		CloseHandle(r->mapping);
+		CloseHandle(r->file);
+#else
+		munmap((void *)r->map, r->maplen);
+#endif
+		r->map = NULL;
+		r->maplen = 0;
+	}
+	if (r->fh) {
+		sysfile_close(r->fh);
+		r->fh = 0;
+	}
+	if (r->tags)
+		sysmem_freeptr(r->tags);
+	if (r->index)
+		sysmem_freeptr(r->index);
+	if (r->newer)
+		sysmem_freeptr(r->newer);
+	if (r->older)
+		sysmem_freeptr(r->older);
+	if (r->data)
+		sysmem_freeptr(r->data);
+	if (r->stage)
+		sysmem_freeptr(r->stage);
+	if (r->want)
+		sysmem_freeptr(r->want);
+	r->tags = r->want = NULL;
+	r->index = r->newer = r->older = NULL;
+	r->data = r->stage = NULL;
+	r->size = 0;
+	r->open = false;
+}
+
+static inline void filereader_free(t_filereader *r)
+{
+	filereader_close(r);
+	systhread_mutex_free(r->lock);
+}
+
+// open name in path, mapped if map is set and the file can be, else through a cache of nblocks blocks
+static inline t_max_err filereader_open(t_filereader *r, const char *name, short path, t_bool map, long nblocks, long readahead)
+{
+	char fullpath[MAX_PATH_CHARS];
+	t_ptr_size size;
+	t_max_err err;
+	long i;
+
+	filereader_close(r);
+	r->reads = r->hits = r->misses = r->fetched = r->syscalls = 0;
+	if (map && !path_toabsolutesystempath(path, name, fullpath) && filereader_map(r, fullpath)) {
+		r->open = true;
+		return MAX_ERR_NONE;
+	}
+
+	err = path_opensysfile(name, path, &r->fh, READ_PERM);
+	if (err) {
+		r->fh = 0;
+		return err;
+	}
+	sysfile_geteof(r->fh, &size);
+	r->size = (t_int64)size;
+	r->nblocks = CLAMP(nblocks, 1, 65536);
+	r->readahead = CLAMP(readahead, 0, FILEREADER_MAXRUN - 1);
+	for (r->indexbits = 1; (1L << r->indexbits) < r->nblocks * 2; r->indexbits++)
+		;
+	r->tags = (t_int64 *)sysmem_newptr(r->nblocks * sizeof(t_int64));
+	r->index = (long *)sysmem_newptrclear((1L << r->indexbits) * sizeof(long));
+	r->newer = (long *)sysmem_newptr(r->nblocks * sizeof(long));
+	r->older = (long *)sysmem_newptr(r->nblocks * sizeof(long));
+	r->want = (t_int64 *)sysmem_newptr((r->nblocks + 2) * sizeof(t_int64));	// a value takes two blocks at most
+	r->data = (unsigned char *)sysmem_newptr(r->nblocks * FILEREADER_BLOCKSIZE);
+	r->stage = (unsigned char *)sysmem_newptr(FILEREADER_MAXRUN * FILEREADER_BLOCKSIZE);
+	if (!r->tags || !r->index || !r->newer || !r->older || !r->want || !r->data || !r->stage) {
+		filereader_close(r);
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	// the empty slots in order, slot 0 the first to be filled
+	for (i = 0; i < r->nblocks; i++) {
+		r->tags[i] = -1;
+		r->older[i] = i - 1;
+		r->newer[i] = i + 1 < r->nblocks ? i + 1 : -1;
+	}
+	r->oldest = 0;
+	r->newest = r->nblocks - 1;
+	r->last = 0;
+	r->next = -1;
+	r->open = true;
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// the cache
+
+static inline long filereader_hash(t_filereader *r, t_int64 b)
+{
+	return (long)(((t_uint64)b * 11400714819323198485ULL) >> (64 - r->indexbits));
+}
+
+// make slot the most recently used
+static inline void filereader_touch(t_filereader *r, long slot)
+{
+	if (slot == r->newest)
+		return;
+	if (r->older[slot] >= 0)
+		r->newer[r->older[slot]] = r->newer[slot];
+	else
+		r->oldest = r->newer[slot];
+	r->older[r->newer[slot]] = r->older[slot];		// not the newest, so there is one
+	r->older[slot] = r->newest;
+	r->newer[slot] = -1;
+	r->newer[r->newest] = slot;
+	r->newest = slot;
+}
+
+// the slot holding block b, marked as just used, or -1
+static inline long filereader_find(t_filereader *r, t_int64 b)
+{
+	long mask = (1L << r->indexbits) - 1;
+	long h, slot;
+
+	if (r->tags[r->last] == b) {
+		filereader_touch(r, r->last);
+		return r->last;
+	}
+	for (h = filereader_hash(r, b); (slot = r->index[h]); h = (h + 1) & mask) {
+		if (r->tags[slot - 1] == b) {
+			filereader_touch(r, slot - 1);
+			r->last = slot - 1;
+			return slot - 1;
+		}
+	}
+	return -1;
+}
+
+// take the least recently used slot for block b, dropping the block it held from the index
+static inline long filereader_victim(t_filereader *r, t_int64 b)
+{
+	long mask = (1L << r->indexbits) - 1;
+	long slot = r->oldest, h, j, home;
+
+	if (r->tags[slot] >= 0) {
+		for (h = filereader_hash(r, r->tags[slot]); r->index[h] != slot + 1; h = (h + 1) & mask)
+			;
+		// close the gap, moving back any entry after it that would no longer be found
+		for (j = (h + 1) & mask; r->index[j]; j = (j + 1) & mask) {
+			home = filereader_hash(r, r->tags[r->index[j] - 1]);
+			if (((j - home) & mask) >= ((j - h) & mask)) {
+				r->index[h] = r->index[j];
+				h = j;
+			}
+		}
+		r->index[h] = 0;
+	}
+	r->tags[slot] = b;
+	for (h = filereader_hash(r, b); r->index[h]; h = (h + 1) & mask)
+		;
+	r->index[h] = slot + 1;
+	filereader_touch(r, slot);
+	r->last = slot;
+	return slot;
+}
+
+// read count blocks from first with one seek and one read, and cache the ones not already there
+static inline t_bool filereader_fetch(t_filereader *r, t_int64 first, long count)
+{
+	t_int64 start = first * FILEREADER_BLOCKSIZE;
+	t_ptr_size len;
+	long i, slot;
+
+	if (start >= r->size)
+		return false;
+	count = MIN(count, MIN(FILEREADER_MAXRUN, r->nblocks));
+	len = (t_ptr_size)MIN((t_int64)count * FILEREADER_BLOCKSIZE, r->size - start);
+	r->syscalls += 2;
+	if (sysfile_setpos(r->fh, SYSFILE_FROMSTART, (t_ptr_int)start) || sysfile_read(r->fh, &len, r->stage) || !len)
+		return false;
+	count = (long)((len + FILEREADER_BLOCKSIZE - 1) / FILEREADER_BLOCKSIZE);
+	for (i = 0; i < count; i++) {
+		if (filereader_find(r, first + i) >= 0)
+			continue;
+		slot = filereader_victim(r, first + i);
+		memcpy(r->data + (size_t)slot * FILEREADER_BLOCKSIZE, r->stage + (size_t)i * FILEREADER_BLOCKSIZE,
+			   MIN(FILEREADER_BLOCKSIZE, len - (t_ptr_size)i * FILEREADER_BLOCKSIZE));
+	}
+	r->fetched += count;
+	r->next = first + count;
+	return true;
+}
+
+// whether the len bytes at offset are mapped or cached
+static inline t_bool filereader_resident(t_filereader *r, t_int64 offset, long len)
+{
+	t_int64 b;
+
+	if (r->map)
+		return true;
+	for (b = offset / FILEREADER_BLOCKSIZE; b <= (offset + len - 1) / FILEREADER_BLOCKSIZE; b++) {
+		if (filereader_find(r, b) < 0)
+			return false;
+	}
+	return true;
+}
+
+// copy len bytes at offset, which must be inside the file, reading the blocks that aren't cached
+static inline t_bool filereader_copy(t_filereader *r, t_int64 offset, long len, unsigned char *dst)
+{
+	t_int64 b;
+	long slot, at, n;
+
+	if (r->map) {
+		memcpy(dst, r->map + offset, len);
+		return true;
+	}
+	while (len > 0) {
+		b = offset / FILEREADER_BLOCKSIZE;
+		slot = filereader_find(r, b);
+		if (slot < 0) {
+			if (!filereader_fetch(r, b, b == r->next ? 1 + r->readahead : 1))
+				return false;
+			slot = filereader_find(r, b);
+			if (slot < 0)
+				return false;
+		}
+		at = (long)(offset - b * FILEREADER_BLOCKSIZE);
+		n = MIN(len, FILEREADER_BLOCKSIZE - at);
+		memcpy(dst, r->data + (size_t)slot * FILEREADER_BLOCKSIZE + at, n);
+		dst += n;
+		offset += n;
+		len -= n;
+	}
+	return true;
+}
+
+static inline int filereader_compare(const void *a, const void *b)
+{
+	t_int64 x = *(const t_int64 *)a, y = *(const t_int64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+//***********************************************************************************************
+// reading values
+
+static inline t_bool filereader_inside(t_filereader *r, t_int64 offset, long len)
+{
+	return offset >= 0 && offset + len <= r->size;
+}
+
+// whether reading the values of type at n offsets would go to the file (for callers on the scheduler)
+static inline t_bool filereader_needsio(t_filereader *r, long n, const t_atom *offsets, long type)
+{
+	long i, len = s_filereader_sizes[type];
+	t_int64 offset;
+
+	if (r->map)
+		return false;
+	for (i = 0; i < n; i++) {
+		offset = atom_getlong(offsets + i);
+		if (!filereader_inside(r, offset, len))
+			break;		// the read stops here
+		if (!filereader_resident(r, offset, len))
+			return true;
+	}
+	return false;
+}
+
+// decode the values of type at n offsets into out, returning how many were read: a
+// shorter count means offsets[count] is outside the file or couldn't be read
+static inline long filereader_getv(t_filereader *r, long n, const t_atom *offsets, long type, long bigendian, t_atom *out)
+{
+	long i, m, start, need, used, nwant, len = s_filereader_sizes[type];
+	unsigned char buf[8];
+	t_int64 offset, b, b0, b1, first, prev;
+	t_bool outside = false;
+
+	if (!r->open)
+		return 0;
+
+	for (m = 0; m < n && !outside; ) {
+		// a batch: count, and find the blocks to read, as long as they fit in the cache
+		// together with the ones the batch hits. A run may read a block of gap for each
+		// one wanted, so a missing block counts twice.
+		start = m;
+		nwant = used = 0;
+		prev = -1;
+		for ( ; m < n; m++) {
+			offset = atom_getlong(offsets + m);
+			if (!filereader_inside(r, offset, len)) {
+				outside = true;
+				break;
+			}
+			b0 = offset / FILEREADER_BLOCKSIZE;
+			b1 = (offset + len - 1) / FILEREADER_BLOCKSIZE;
+			if (r->map || filereader_resident(r, offset, len)) {
+				need = (r->map || b0 == prev) ? 0 : (long)(b1 - b0 + 1);
+				if (m > start && used + need > r->nblocks)
+					break;
+				r->hits++;
+			}
+			else {
+				need = (long)(b1 - b0 + 1) * 2;
+				if (m > start && used + need > r->nblocks)
+					break;
+				r->misses++;
+				for (b = b0; b <= b1; b++) {
+					if (filereader_find(r, b) < 0)
+						r->want[nwant++] = b;
+				}
+			}
+			used += need;
+			prev = b1;
+		}
+		r->reads += m - start;
+
+		// read them in runs, reading through gaps of a block
+		if (nwant) {
+			qsort(r->want, nwant, sizeof(t_int64), filereader_compare);
+			for (i = 0; i < nwant; ) {
+				first = r->want[i];
+				while (++i < nwant && r->want[i] - r->want[i - 1] <= 2 && r->want[i] - first < FILEREADER_MAXRUN)
+					;
+				filereader_fetch(r, first, (long)(r->want[i - 1] - first + 1));
+			}
+		}
+
+		for (i = start; i < m; i++) {
+			if (!filereader_copy(r, atom_getlong(offsets + i), len, buf))
+				return i;
+			filereader_decode(buf, type, bigendian, out + i);
+		}
+	}
+	return m;
+}
+
+// the counts since the file was opened: mapped, size, reads, hits, misses, hit rate %, blocks read, calls
+static inline long filereader_report(t_filereader *r, t_atom *av)
+{
+	atom_setlong(av + 0, r->map != NULL);
+	atom_setlong(av + 1, (t_atom_long)r->size);
+	atom_setlong(av + 2, r->reads);
+	atom_setlong(av + 3, r->hits);
+	atom_setlong(av + 4, r->misses);
+	atom_setfloat(av + 5, r->reads ? 100. * r->hits / r->reads : 0.);
+	atom_setlong(av + 6, r->fetched);
+	atom_setlong(av + 7, r->syscalls);
+	return 8;
+}
+
+#endif // _FILEREADER_H_
@@ -0,0 +1,188 @@
+/**
+	@file
+	numlist.h - a list of numbers kept as plain arrays, for objects that work on long lists
+
+	Going through a list atom by atom costs a type check and a union read for
+	every element, which for long lists outweighs the comparisons themselves.
+	numlist_set() converts a list once, into an array of doubles and, while
+	every element is an int, an exact array of t_atom_longs too. The loops
+	over those arrays have no branches in them, so the compiler can
+	vectorize them.
+
+	The arrays belong to the object and only ever grow, so a stream of lists
+	doesn't allocate once they have reached their longest.
+*/
+
+#ifndef _NUMLIST_H_
+#define _NUMLIST_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+
+typedef struct _numlist
+{
+	double			*values;		// every element as a double
+	t_atom_long		*longs;			// and as an int: floats are truncated
+	char			*isfloat;
+	long			count;
+	long			floats;			// elements that are floats; 0 means longs is exact
+	long			size;			// elements allocated
+} t_numlist;
+
+
+static inline void numlist_init(t_numlist *nl)
+{
+	nl->values = NULL;
+	nl->longs = NULL;
+	nl->isfloat = NULL;
+	nl->count = nl->floats = nl->size = 0;
+}
+
+static inline void numlist_free(t_numlist *nl)
+{
+	if (nl->values)
+		sysmem_freeptr(nl->values);
+	if (nl->longs)
+		sysmem_freeptr(nl->longs);
+	if (nl->isfloat)
+		sysmem_freeptr(nl->isfloat);
+	numlist_init(nl);
+}
+
+// room for n elements, keeping the ones there are; false if out of memory
+static inline t_bool numlist_reserve(t_numlist *nl, long n)
+{
+	double *values;
+	t_atom_long *longs;
+	char *isfloat;
+	long size;
+
+	if (n <= nl->size)
+		return true;
+	for (size = nl->size ? nl->size : 16; size < n; size *= 2)
+		;
+	values = (double *)sysmem_newptr(size * sizeof(double));
+	longs = (t_atom_long *)sysmem_newptr(size * sizeof(t_atom_long));
+	isfloat = (char *)sysmem_newptr(size);
+	if (!values || !longs || !isfloat) {
+		if (values)
+			sysmem_freeptr(values);
+		if (longs)
+			sysmem_freeptr(longs);
+		if (isfloat)
+			sysmem_freeptr(isfloat);
+		return false;
+	}
+	if (nl->count) {
+		sysmem_copyptr(nl->values, values, nl->count * sizeof(double));
+		sysmem_copyptr(nl->longs, longs, nl->count * sizeof(t_atom_long));
+		sysmem_copyptr(nl->isfloat, isfloat, nl->count);
+	}
+	if (nl->values) {
+		sysmem_freeptr(nl->values);
+		sysmem_freeptr(nl->longs);
+		sysmem_freeptr(nl->isfloat);
+	}
+	nl->values = values;
+	nl->longs = longs;
+	nl->isfloat = isfloat;
+	nl->size = size;
+	return true;
+}
+
+// the numbers in av; anything else counts as the int 0. False if out of memory.
+static inline t_bool numlist_set(t_numlist *nl, long ac, t_atom *av)
+{
+	long i, floats = 0;
+
+	if (!numlist_reserve(nl, ac))
+		return false;
+	for (i = 0; i < ac; i++, av++) {
+		if (atom_gettype(av) == A_FLOAT) {
+			nl->values[i] = atom_getfloat(av);
+			nl->longs[i] = (t_atom_long)nl->values[i];
+			nl->isfloat[i] = 1;
+			floats++;
+		}
+		else {
+			nl->longs[i] = atom_gettype(av) == A_LONG ? atom_getlong(av) : 0;
+			nl->values[i] = (double)nl->longs[i];
+			nl->isfloat[i] = 0;
+		}
+	}
+	nl->count = ac;
+	nl->floats = floats;
+	return true;
+}
+
+// replace element i, which must be there
+static inline void numlist_setlong(t_numlist *nl, long i, t_atom_long n)
+{
+	nl->floats -= nl->isfloat[i];
+	nl->longs[i] = n;
+	nl->values[i] = (double)n;
+	nl->isfloat[i] = 0;
+}
+
+static inline void numlist_setfloat(t_numlist *nl, long i, double f)
+{
+	nl->floats += !nl->isfloat[i];
+	nl->values[i] = f;
+	nl->longs[i] = (t_atom_long)f;
+	nl->isfloat[i] = 1;
+}
+
+// keep the first n elements, which must be reserved: any past count are undefined until set
+static inline void numlist_setcount(t_numlist *nl, long n)
+{
+	long i;
+
+	for (i = n; i < nl->count; i++)
+		nl->floats -= nl->isfloat[i];
+	for (i = nl->count; i < n; i++)
+		nl->isfloat[i] = 0;
+	nl->count = n;
+}
+
+// the index of the first of the smallest elements, or -1 if there are none. Ints are
+// compared exactly while there are no floats, and as doubles once there are.
+static inline long numlist_argmin(t_numlist *nl)
+{
+	long i, n = nl->count;
+
+	if (!n)
+		return -1;
+	if (!nl->floats) {
+		const t_atom_long *l = nl->longs;
+		t_atom_long min = l[0];
+
+		for (i = 1; i < n; i++)
+			min = l[i] < min ? l[i] : min;
+		for (i = 0; l[i] != min; i++)
+			;
+		return i;
+	}
+	else {
+		const double *v = nl->values;
+		double min = v[0];
+
+		for (i = 1; i < n; i++)
+			min = v[i] < min ? v[i] : min;
+		for (i = 0; i < n && v[i] != min; i++)		// bounded in case min is a NaN
+			;
+		return i < n ? i : 0;
+	}
+}
+
+// the index of the first element at or after start that equals value, or count if there is none
+static inline long numlist_find(t_numlist *nl, long start, double value)
+{
+	const double *v = nl->values;
+	long i, n = nl->count;
+
+	for (i = start; i < n && v[i] != value; i++)
+		;
+	return i;
+}
+
+#endif // _NUMLIST_H_
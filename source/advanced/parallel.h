@@ -0,0 +1,350 @@
+/**
+	@file
+	parallel.h - a persistent team of worker threads that splits ranges of items between them
+
+	parallel_for() cuts the range [begin, end) into chunks of grain items
+	and calls fn on each chunk from every worker of the team, including
+	the thread that called it, which takes part as worker 0 and returns
+	once every chunk is done. parallel_reduce() does the same with a map
+	function that folds a chunk into the worker's own accumulator, then
+	combines the accumulators in worker order.
+
+	Each worker owns a contiguous slice of the chunks, the same one every
+	time the same range is split between the same number of workers, so a
+	thread keeps working on the memory it touched last time. Once its slice
+	is done it takes chunks from the others' slices, so a slow worker
+	doesn't hold the rest up. (Max has no call to place a thread on a core
+	or a memory node, so this is as close to NUMA placement as we get.)
+
+	The team is started by the first object to retain it and stopped when
+	the last one releases it. Its threads sleep between dispatches, which
+	can come from any thread, the scheduler included. The team runs one
+	dispatch at a time; one that finds it busy (another thread's, or a
+	nested call from inside fn) runs on its calling thread alone.
+
+	Like sysparallel, the team has at most SYSPARALLEL_MAX_WORKERS workers,
+	one per processor.
+*/
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+#include "ext_systhread.h"
+#include "ext_sysparallel.h"
+
+#define PARALLEL_MAGIC			0x70617274	// 'part', in case something else owns the symbol
+#define PARALLEL_MAX_WORKERS	SYSPARALLEL_MAX_WORKERS
+#define PARALLEL_LINE			64			// bytes per cache line, to keep workers' counters apart
+#define PARALLEL_MAX_CHUNKS		0x40000000	// so chunk numbers fit an atomic counter
+
+typedef void (*t_parallel_forfn)(void *data, t_atom_long begin, t_atom_long end, long worker);
+typedef void (*t_parallel_mapfn)(void *data, t_atom_long begin, t_atom_long end, void *acc);
+typedef void (*t_parallel_combinefn)(void *data, void *acc, const void *other);
+
+typedef struct _parallel_timing
+{
+	double				elapsed;						// ms from dispatch to return
+	long				workers;						// that took part, the caller included
+	long				chunks;
+	long				done[PARALLEL_MAX_WORKERS];		// chunks each worker ran
+	double				busy[PARALLEL_MAX_WORKERS];		// ms each worker spent running them
+} t_parallel_timing;
+
+typedef struct _parallel_slice
+{
+	volatile t_int32_atomic	next;		// next chunk to claim
+	t_int32					end;
+	char					pad[PARALLEL_LINE - 2 * sizeof(t_int32)];
+} t_parallel_slice;
+
+typedef struct _parallel_job
+{
+	t_atom_long			begin;
+	t_atom_long			end;
+	t_atom_long			grain;
+	long				nworkers;
+	t_parallel_forfn	fn;
+	t_parallel_mapfn	map;			// instead of fn, for a reduction
+	void				*data;
+	const void			*identity;		// a reduction's starting value, size bytes
+	long				size;
+	char				*accs;			// the workers' accumulators, stride bytes apart
+	long				stride;
+	long				pending;		// helpers still at work (under the team's lock)
+	t_parallel_timing	timing;
+	t_parallel_slice	slices[PARALLEL_MAX_WORKERS];
+} t_parallel_job;
+
+typedef struct _parallel_team		t_parallel_team;
+
+typedef struct _parallel_helper
+{
+	t_parallel_team		*team;
+	long				id;				// 1 and up; the dispatching thread is worker 0
+	t_systhread			thread;
+} t_parallel_helper;
+
+struct _parallel_team
+{
+	long					magic;
+	long					refs;			// objects using the team (main thread)
+	long					nhelpers;
+	t_parallel_helper		helpers[PARALLEL_MAX_WORKERS - 1];
+	t_systhread_mutex		lock;			// for the job, generation, pending and quit
+	t_systhread_cond		wake;
+	t_systhread_cond		done;
+	t_parallel_job			*job;			// NULL once the dispatch is over
+	long					nworkers;		// the job's, for helpers that wake after it is gone
+	long					generation;		// bumped for every dispatch
+	long					quit;
+	volatile t_int32_atomic	busy;			// a dispatch is running
+};
+
+
+//***********************************************************************************************
+// the workers
+
+// any worker: run the chunks of our own slice, then whatever is left in the others
+static inline void parallel_work(t_parallel_job *job, long w)
+{
+	double start = systimer_gettime();
+	t_parallel_slice *slice;
+	t_atom_long b;
+	long i, chunk, done = 0;
+
+	for (i = 0; i < job->nworkers; i++) {
+		slice = job->slices + (w + i) % job->nworkers;
+		while (slice->next < slice->end && (chunk = ATOMIC_INCREMENT(&slice->next) - 1) < slice->end) {
+			b = job->begin + (t_atom_long)chunk * job->grain;
+			if (job->map)
+				job->map(job->data, b, MIN(b + job->grain, job->end), job->accs + w * job->stride);
+			else
+				job->fn(job->data, b, MIN(b + job->grain, job->end), w);
+			done++;
+		}
+	}
+	job->timing.done[w] = done;
+	job->timing.busy[w] = systimer_gettime() - start;
+}
+
+static inline void *parallel_threadproc(t_parallel_helper *h)
+{
+	t_parallel_team *t = h->team;
+	t_parallel_job *job;
+	long seen = 0, nworkers;
+
+	while (1) {
+		systhread_mutex_lock(t->lock);
+		while (!t->quit && t->generation == seen)
+			systhread_cond_wait(t->wake, t->lock);
+		if (t->quit) {
+			systhread_mutex_unlock(t->lock);
+			break;
+		}
+		seen = t->generation;
+		job = t->job;
+		nworkers = t->nworkers;
+		systhread_mutex_unlock(t->lock);
+
+		if (job && h->id < nworkers) {
+			parallel_work(job, h->id);
+			systhread_mutex_lock(t->lock);
+			if (--job->pending == 0)
+				systhread_cond_signal(t->done);
+			systhread_mutex_unlock(t->lock);
+		}
+	}
+	systhread_exit(0);
+	return NULL;
+}
+
+
+//***********************************************************************************************
+// the team
+
+static inline void parallel_team_stop(t_parallel_team *t)
+{
+	unsigned int ret;
+	long i;
+
+	systhread_mutex_lock(t->lock);
+	t->quit = 1;
+	systhread_cond_broadcast(t->wake);
+	systhread_mutex_unlock(t->lock);
+	for (i = 0; i < t->nhelpers; i++)
+		systhread_join(t->helpers[i].thread, &ret);
+	systhread_cond_free(t->done);
+	systhread_cond_free(t->wake);
+	systhread_mutex_free(t->lock);
+	sysmem_freeptr(t);
+}
+
+// main thread: the session's team, started if need be, or NULL
+static inline t_parallel_team *parallel_team_retain(void)
+{
+	t_symbol *s = gensym("__parallel_team__");
+	t_parallel_team *t = (t_parallel_team *)s->s_thing;
+	long i, n;
+
+	if (t) {
+		if (t->magic != PARALLEL_MAGIC)
+			return NULL;
+		t->refs++;
+		return t;
+	}
+	t = (t_parallel_team *)sysmem_newptrclear(sizeof(t_parallel_team));
+	if (!t)
+		return NULL;
+	t->magic = PARALLEL_MAGIC;
+	t->refs = 1;
+	systhread_mutex_new(&t->lock, 0);
+	systhread_cond_new(&t->wake, 0);
+	systhread_cond_new(&t->done, 0);
+	n = CLAMP(sysparallel_processorcount(), 1, PARALLEL_MAX_WORKERS) - 1;
+	for (i = 0; i < n; i++) {
+		t->helpers[i].team = t;
+		t->helpers[i].id = i + 1;
+		if (systhread_create((method)parallel_threadproc, t->helpers + i, 0, 0, 0, &t->helpers[i].thread))
+			break;		// make do with the ones we have
+	}
+	t->nhelpers = i;
+	s->s_thing = (t_object *)t;
+	return t;
+}
+
+// main thread
+static inline void parallel_team_release(t_parallel_team *t)
+{
+	if (t && --t->refs == 0) {
+		gensym("__parallel_team__")->s_thing = NULL;
+		parallel_team_stop(t);
+	}
+}
+
+// workers in the team, the dispatching thread included
+static inline long parallel_team_size(t_parallel_team *t)
+{
+	return t ? t->nhelpers + 1 : 1;
+}
+
+
+//***********************************************************************************************
+// dispatch
+
+// any thread: split the range into chunks and slices, run it, and wait for it
+static inline void parallel_dispatch(t_parallel_team *t, t_parallel_job *job, long nworkers, t_parallel_timing *timing)
+{
+	double start = systimer_gettime();
+	t_atom_long n = job->end - job->begin;
+	long w, nchunks, first;
+	t_bool shared;
+
+	if (nworkers <= 0 || nworkers > parallel_team_size(t))
+		nworkers = parallel_team_size(t);
+	if (job->grain <= 0)
+		job->grain = MAX(n / (nworkers * 8), 1);		// a few chunks per worker to even out the load
+	if ((n + job->grain - 1) / job->grain > PARALLEL_MAX_CHUNKS)
+		job->grain = (n + PARALLEL_MAX_CHUNKS - 1) / PARALLEL_MAX_CHUNKS;
+	nchunks = (long)((n + job->grain - 1) / job->grain);
+	nworkers = MIN(nworkers, MAX(nchunks, 1));
+	shared = nworkers > 1 && ATOMIC_COMPARE_SWAP32(0, 1, &t->busy);
+	if (!shared)
+		nworkers = 1;
+
+	job->nworkers = nworkers;
+	for (w = 0, first = 0; w < nworkers; w++) {
+		job->slices[w].next = first;
+		job->slices[w].end = first = (long)((t_int64)nchunks * (w + 1) / nworkers);
+		if (job->map)
+			memcpy(job->accs + w * job->stride, job->identity, job->size);
+	}
+
+	if (shared) {
+		systhread_mutex_lock(t->lock);
+		t->job = job;
+		t->nworkers = nworkers;
+		job->pending = nworkers - 1;
+		t->generation++;
+		systhread_cond_broadcast(t->wake);
+		systhread_mutex_unlock(t->lock);
+	}
+	parallel_work(job, 0);
+	if (shared) {
+		systhread_mutex_lock(t->lock);
+		while (job->pending)
+			systhread_cond_wait(t->done, t->lock);
+		t->job = NULL;
+		systhread_mutex_unlock(t->lock);
+		ATOMIC_COMPARE_SWAP32(1, 0, &t->busy);
+	}
+
+	if (timing) {
+		*timing = job->timing;
+		timing->elapsed = systimer_gettime() - start;
+		timing->workers = nworkers;
+		timing->chunks = nchunks;
+	}
+}
+
+// any thread: call fn(data, b, e, worker) on every chunk of up to grain items in [begin, end),
+// on up to nworkers workers (0 for the whole team), and return when they are all done.
+// A grain of 0 picks one. timing, if not NULL, gets how long it took and who did what.
+static inline t_max_err parallel_for(t_parallel_team *t, t_atom_long begin, t_atom_long end, t_atom_long grain, long nworkers,
+									 t_parallel_forfn fn, void *data, t_parallel_timing *timing)
+{
+	t_parallel_job job;
+
+	if (!fn || end < begin)
+		return MAX_ERR_GENERIC;
+	memset(&job, 0, sizeof(t_parallel_job));
+	job.begin = begin;
+	job.end = end;
+	job.grain = grain;
+	job.fn = fn;
+	job.data = data;
+	parallel_dispatch(t, &job, nworkers, timing);
+	return MAX_ERR_NONE;
+}
+
+// any thread: reduce [begin, end) into result. Every worker starts with a copy of the size bytes at
+// identity and folds its chunks into it with map(data, b, e, acc); the workers' accumulators are then
+// folded into result, itself starting from identity, with combine(data, result, acc) in worker order.
+// Which worker gets which chunk varies, so combine should not care how the range was grouped.
+static inline t_max_err parallel_reduce(t_parallel_team *t, t_atom_long begin, t_atom_long end, t_atom_long grain, long nworkers,
+										const void *identity, long size, t_parallel_mapfn map, t_parallel_combinefn combine,
+										void *data, void *result, t_parallel_timing *timing)
+{
+	char local[(PARALLEL_MAX_WORKERS + 1) * PARALLEL_LINE], *block = local;
+	t_parallel_job job;
+	long w;
+
+	if (!map || !combine || end < begin || size <= 0)
+		return MAX_ERR_GENERIC;
+	memset(&job, 0, sizeof(t_parallel_job));
+	job.begin = begin;
+	job.end = end;
+	job.grain = grain;
+	job.map = map;
+	job.data = data;
+	job.identity = identity;
+	job.size = size;
+	job.stride = (size + PARALLEL_LINE - 1) / PARALLEL_LINE * PARALLEL_LINE;
+	if (job.stride > PARALLEL_LINE && !(block = (char *)sysmem_newptr(PARALLEL_MAX_WORKERS * job.stride + PARALLEL_LINE)))
+		return MAX_ERR_OUT_OF_MEM;
+	// start the accumulators on a line of their own, which also suits whatever type they hold
+	job.accs = block + (PARALLEL_LINE - (t_ptr_uint)block % PARALLEL_LINE) % PARALLEL_LINE;
+
+	parallel_dispatch(t, &job, nworkers, timing);
+
+	memcpy(result, identity, size);
+	for (w = 0; w < job.nworkers; w++)
+		combine(data, result, job.accs + w * job.stride);
+	if (block != local)
+		sysmem_freeptr(block);
+	return MAX_ERR_NONE;
+}
+
+#endif // _PARALLEL_H_
@@ -1,28 +1,39 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_systhread.h"
-#include "ext_sysparallel.h"
+#include "parallel.h"
 
 
+typedef struct _simpleparallel_acc {
+	t_atom_long			count;								// items counted
+	t_uint32			check;								// xor of their hashes, the same however the range is split
+} t_simpleparallel_acc;
+
 typedef struct _simpleparallel {
 	t_object			x_ob;							// standard max object
-	t_sysparallel_task	*x_sysparallel_task;						// thread reference
+	t_parallel_team		*x_team;						// the session's worker team
 	t_systhread_mutex	x_mutex;						// mutual exclusion lock for threadsafety
 	void				*x_outlet;						// our outlet
 	int				x_foo;								// value
 	int				x_iterations;								// number of iterations
+	long				x_workers;						// workers to use, 0 for all of them
+	long				x_grain;						// iterations per chunk, 0 to let the team pick
+	t_parallel_timing	x_timing;						// of the last bang
 } t_simpleparallel;
 
 void simpleparallel_bang(t_simpleparallel *x);
-void simpleparallel_dobang(t_simpleparallel *x);
+void simpleparallel_timing(t_simpleparallel *x);
+void simpleparallel_bench(t_simpleparallel *x);
 void simpleparallel_foo(t_simpleparallel *x, long foo);
 t_max_err simpleparallel_setattr_iterations(t_simpleparallel *x, void *attr, long ac, t_atom *av);
-void *simpleparallel_threadproc(t_sysparallel_worker *w);
+void simpleparallel_map(t_simpleparallel *x, t_atom_long begin, t_atom_long end, t_simpleparallel_acc *acc);
+void simpleparallel_combine(t_simpleparallel *x, t_simpleparallel_acc *acc, const t_simpleparallel_acc *other);
 void simpleparallel_assist(t_simpleparallel *x, void *b, long m, long a, char *s);
 void simpleparallel_free(t_simpleparallel *x);
 void *simpleparallel_new(t_symbol *s, long ac, t_atom *av);
 
 t_class *simpleparallel_class;
+static t_symbol *ps_timing;
 
 void ext_main(void *r)
 {
@@ -32,41 +43,99 @@ void ext_main(void *r)
 
 	class_addmethod(c, (method)simpleparallel_bang,			"bang",			0);
 	class_addmethod(c, (method)simpleparallel_foo,			"foo",			A_DEFLONG, 0);
+	class_addmethod(c, (method)simpleparallel_timing,		"timing",		0);
+	class_addmethod(c, (method)simpleparallel_bench,		"bench",		0);
 	class_addmethod(c, (method)simpleparallel_assist,		"assist",		A_CANT, 0);
 
 	CLASS_ATTR_LONG(c, "iterations", 0, t_simpleparallel, x_iterations);
+	CLASS_ATTR_ACCESSORS(c, "iterations", NULL, simpleparallel_setattr_iterations);
+
+	CLASS_ATTR_LONG(c, "workers", 0, t_simpleparallel, x_workers);
+	CLASS_ATTR_FILTER_CLIP(c, "workers", 0, PARALLEL_MAX_WORKERS);
+	CLASS_ATTR_LABEL(c, "workers", 0, "Workers (0 for all)");
+
+	CLASS_ATTR_LONG(c, "grain", 0, t_simpleparallel, x_grain);
+	CLASS_ATTR_FILTER_MIN(c, "grain", 0);
+	CLASS_ATTR_LABEL(c, "grain", 0, "Iterations per Chunk (0 for automatic)");
 
 	class_register(CLASS_BOX,c);
 	simpleparallel_class = c;
-}
 
-void simpleparallel_bang(t_simpleparallel *x)
-{
-	// always force to execute from one thread so we don't mess with our thread pools.
-	defer(x,(method)simpleparallel_dobang,NULL,0,NULL);
+	ps_timing = gensym("timing");
 }
 
-void simpleparallel_dobang(t_simpleparallel *x)
+// the team can be used from any thread, so there's no need to defer to the main thread any more
+void simpleparallel_bang(t_simpleparallel *x)
 {
+	t_simpleparallel_acc identity = { 0, 0 };
+	t_simpleparallel_acc result;
+	t_parallel_timing timing;
 	int myfoo;
 
-	// create new task and execute it
-	if (x->x_sysparallel_task == NULL) {
-		post("creating a new parallel task");
-		x->x_sysparallel_task = sysparallel_task_new(x,(method) simpleparallel_threadproc, 0);
-		x->x_sysparallel_task->flags = SYSPARALLEL_PRIORITY_TASK_LOCAL;
-	}
-
-	sysparallel_task_execute(x->x_sysparallel_task);
+	parallel_reduce(x->x_team, 0, x->x_iterations, x->x_grain, x->x_workers, &identity, sizeof(identity),
+					(t_parallel_mapfn)simpleparallel_map, (t_parallel_combinefn)simpleparallel_combine, x, &result, &timing);
 
 	systhread_mutex_lock(x->x_mutex);
+	x->x_foo += (int)result.count;													// fiddle with shared data
 	myfoo = x->x_foo;
+	x->x_timing = timing;
 	systhread_mutex_unlock(x->x_mutex);
 
 	// *never* wrap outlet calls with systhread_mutex_lock()
 	outlet_int(x->x_outlet, myfoo);
 }
 
+// timing <ms> <workers> <chunks> followed by <chunks> <ms> for each worker, for the last bang
+void simpleparallel_timing(t_simpleparallel *x)
+{
+	t_atom av[3 + 2 * PARALLEL_MAX_WORKERS];
+	t_parallel_timing timing;
+	long i;
+
+	systhread_mutex_lock(x->x_mutex);
+	timing = x->x_timing;
+	systhread_mutex_unlock(x->x_mutex);
+
+	atom_setfloat(av, timing.elapsed);
+	atom_setlong(av + 1, timing.workers);
+	atom_setlong(av + 2, timing.chunks);
+	for (i = 0; i < timing.workers; i++) {
+		atom_setlong(av + 3 + 2 * i, timing.done[i]);
+		atom_setfloat(av + 4 + 2 * i, timing.busy[i]);
+	}
+	outlet_anything(x->x_outlet, ps_timing, (short)(3 + 2 * timing.workers), av);
+}
+
+// time the same reduction on 1, 2, 4 ... workers, up to as many as the team has
+void simpleparallel_bench(t_simpleparallel *x)
+{
+	t_simpleparallel_acc identity = { 0, 0 };
+	t_simpleparallel_acc result;
+	t_parallel_timing timing;
+	long size = parallel_team_size(x->x_team);
+	long workers, i;
+	double best, one = 0;
+	t_uint32 check = 0;
+
+	for (workers = 1; ; workers = MIN(workers * 2, size)) {
+		for (i = 0, best = 0; i < 5; i++) {			// best of five
+			parallel_reduce(x->x_team, 0, x->x_iterations, x->x_grain, workers, &identity, sizeof(identity),
+							(t_parallel_mapfn)simpleparallel_map, (t_parallel_combinefn)simpleparallel_combine, x, &result, &timing);
+			if (!i || timing.elapsed < best)
+				best = timing.elapsed;
+		}
+		if (workers == 1) {
+			one = best;
+			check = result.check;
+		}
+		else if (result.check != check)
+			object_error((t_object *)x, "%ld workers got a different result", timing.workers);
+		object_post((t_object *)x, "%ld of %ld workers: %f ms, %.2fx", timing.workers, size, best, best > 0 ? one / best : 0.);
+		if (workers == size)
+			break;
+	}
+}
+
 void simpleparallel_foo(t_simpleparallel *x, long foo)
 {
 	systhread_mutex_lock(x->x_mutex);
@@ -88,43 +157,39 @@ t_max_err simpleparallel_setattr_iterations(t_simpleparallel *x, void *attr, lon
 	return MAX_ERR_NONE;
 }
 
-void *simpleparallel_threadproc(t_sysparallel_worker *w)
+// any worker: do some work for each iteration in [begin, end)
+void simpleparallel_map(t_simpleparallel *x, t_atom_long begin, t_atom_long end, t_simpleparallel_acc *acc)
 {
-	t_simpleparallel *x = (t_simpleparallel *)w->data;
-	int i,myfoo=0,iterations;
-	double time = systimer_gettime();
-
-	object_post((t_object *)x,"worker %ld of %ld started",w->id,w->task->workercount);
-
-	// do some work
-	iterations = x->x_iterations;
-	for (i=0; i<iterations; i++) {
-		myfoo++;
+	t_atom_long i;
+	t_uint32 h, check = acc->check;
+
+	for (i = begin; i < end; i++) {
+		h = (t_uint32)i * 0x9E3779B1;
+		h ^= h >> 15;
+		h *= 0x85EBCA77;
+		check ^= h ^ (h >> 13);
 	}
+	acc->count += end - begin;
+	acc->check = check;
+}
 
-	// increment our main value
-	systhread_mutex_lock(x->x_mutex);
-	x->x_foo += myfoo;																// fiddle with shared data
-	systhread_mutex_unlock(x->x_mutex);
-
-	object_post((t_object *)x,"worker %ld of %ld ended (%fms)",w->id,w->task->workercount,systimer_gettime()-time);
-
-	return NULL;
+void simpleparallel_combine(t_simpleparallel *x, t_simpleparallel_acc *acc, const t_simpleparallel_acc *other)
+{
+	acc->count += other->count;
+	acc->check ^= other->check;
 }
 
 void simpleparallel_assist(t_simpleparallel *x, void *b, long m, long a, char *s)
 {
 	if (m==1)
-		sprintf(s,"bang spawns a parallel process");
+		sprintf(s,"bang spawns a parallel process, timing, bench");
 	else if (m==2)
 		sprintf(s,"report when done");
 }
 
 void simpleparallel_free(t_simpleparallel *x)
 {
-
-	if (x->x_sysparallel_task)
-		object_free((t_object *)x->x_sysparallel_task);
+	parallel_team_release(x->x_team);
 
 	// free our mutex
 	if (x->x_mutex)
@@ -137,15 +202,13 @@ void *simpleparallel_new(t_symbol *s, long ac, t_atom *av)
 
 	x = (t_simpleparallel *)object_alloc(simpleparallel_class);
 	x->x_outlet = outlet_new(x,NULL);
-	x->x_sysparallel_task = NULL;
+	x->x_team = parallel_team_retain();
 	systhread_mutex_new(&x->x_mutex,0);
 	x->x_foo = 0;
 	x->x_iterations = 5000000;
+	x->x_workers = 0;
+	x->x_grain = 0;
 	attr_args_process(x, ac, av);
 
 	return(x);
 }
-
-
-
-
@@ -1,52 +1,105 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_systhread.h"
+#include "channel.h"
 
 
+#define SIMPLETHREAD_BATCH		256			// values output per run of the qelem before it yields
+
+typedef struct _simplethread_item {
+	t_atom_long			value;
+	double				stamp;								// when the worker made it, to measure latency
+} t_simplethread_item;
+
 typedef struct _simplethread {
 	t_object			x_ob;								// standard max object
 	t_systhread		x_systhread;						// thread reference
-	t_systhread_mutex	x_mutex;							// mutual exclusion lock for threadsafety
+	t_systhread_mutex	x_mutex;							// mutual exclusion lock for threadsafety (poll mode)
 	int				x_systhread_cancel;					// thread cancel flag
 	void				*x_qelem;							// for message passing between threads
 	void				*x_outlet;							// our outlet
-	int				x_foo;							// simple data to pass between threads
+	int				x_foo;							// simple data to pass between threads (poll mode)
 	int				x_sleeptime;						// how many milliseconds to sleep
+	t_channel			*x_values;							// worker -> main thread
+	t_channel			*x_commands;						// main thread -> worker: new values for foo
+	t_symbol			*x_mode;							// channel or poll (the old way, for comparison)
+	char				x_polling;							// the mode the thread was started in
+	long				x_capacity;							// values the channel holds (takes effect on bang)
+	char				x_block;							// wait for room instead of dropping values (takes effect on bang)
+	double				x_pollstamp;						// when the worker last changed x_foo (poll mode)
+	double				x_start;							// when the thread was started
+	t_atom_long			x_received;							// values output since then
+	double				x_latency;							// total of their latencies, ms
+	double				x_maxlatency;
 } t_simplethread;
 
 void simplethread_bang(t_simplethread *x);
 void simplethread_foo(t_simplethread *x, long foo);
+void simplethread_dofoo(t_simplethread *x, t_symbol *s, long argc, t_atom *argv);
 void simplethread_sleeptime(t_simplethread *x, long sleeptime);
+void simplethread_report(t_simplethread *x);
 void simplethread_stop(t_simplethread *x);
 void simplethread_cancel(t_simplethread *x);
 void *simplethread_threadproc(t_simplethread *x);
 void simplethread_qfn(t_simplethread *x);
 void simplethread_assist(t_simplethread *x, void *b, long m, long a, char *s);
 void simplethread_free(t_simplethread *x);
-void *simplethread_new(void);
+void *simplethread_new(t_symbol *s, long argc, t_atom *argv);
 
 t_class *simplethread_class;
+static t_symbol *ps_channel, *ps_poll, *ps_report;
 
 void ext_main(void *r)
 {
 	t_class *c;
 
-	c = class_new("simplethread", (method)simplethread_new, (method)simplethread_free, sizeof(t_simplethread), 0L, 0);
+	c = class_new("simplethread", (method)simplethread_new, (method)simplethread_free, sizeof(t_simplethread), 0L, A_GIMME, 0);
 
 	class_addmethod(c, (method)simplethread_bang,		"bang",			0);
 	class_addmethod(c, (method)simplethread_foo,		"foo",			A_DEFLONG, 0);
 	class_addmethod(c, (method)simplethread_sleeptime,	"sleeptime",	A_DEFLONG, 0);
+	class_addmethod(c, (method)simplethread_report,		"report",		0);
 	class_addmethod(c, (method)simplethread_cancel,		"cancel",		0);
 	class_addmethod(c, (method)simplethread_assist,		"assist",		A_CANT, 0);
 
+	CLASS_ATTR_SYM(c, "mode", 0, t_simplethread, x_mode);
+	CLASS_ATTR_ENUM(c, "mode", 0, "channel poll");
+	CLASS_ATTR_LABEL(c, "mode", 0, "Pass Values Through a Channel or Poll a Shared Value (takes effect on bang)");
+
+	CLASS_ATTR_LONG(c, "capacity", 0, t_simplethread, x_capacity);
+	CLASS_ATTR_FILTER_CLIP(c, "capacity", 2, 1048576);
+	CLASS_ATTR_LABEL(c, "capacity", 0, "Values the Channel Holds (takes effect on bang)");
+
+	CLASS_ATTR_CHAR(c, "block", 0, t_simplethread, x_block);
+	CLASS_ATTR_STYLE_LABEL(c, "block", 0, "onoff", "Wait for Room Instead of Dropping Values (takes effect on bang)");
+
 	class_register(CLASS_BOX,c);
 	simplethread_class = c;
+
+	ps_channel = gensym("channel");
+	ps_poll = gensym("poll");
+	ps_report = gensym("report");
 }
 
 void simplethread_bang(t_simplethread *x)
 {
 	simplethread_stop(x);								// kill thread if, any
 
+	// a new channel in case the capacity or blocking changed; values left in the old one are dropped
+	x->x_polling = x->x_mode == ps_poll;
+	if (!x->x_polling) {
+		if (x->x_values)
+			channel_free(x->x_values);
+		x->x_values = channel_new(sizeof(t_simplethread_item), x->x_capacity, x->x_block ? CHANNEL_BLOCK : 0, x->x_qelem);
+		if (!x->x_values) {
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+	}
+	x->x_start = systimer_gettime();
+	x->x_received = 0;
+	x->x_latency = x->x_maxlatency = 0;
+
 	// create new thread + begin execution
 	if (x->x_systhread == NULL) {
 		post("starting a new thread");
@@ -56,18 +109,53 @@ void simplethread_bang(t_simplethread *x)
 
 void simplethread_foo(t_simplethread *x, long foo)
 {
+	t_atom_long value = foo;
+	t_atom a;
+
+	if (x->x_systhread && !x->x_polling) {
+		if (!systhread_ismainthread()) {								// the channel takes one writer: the main thread
+			atom_setlong(&a, foo);
+			defer(x, (method)simplethread_dofoo, NULL, 1, &a);
+			return;
+		}
+		if (channel_write(x->x_commands, &value) != CHANNEL_OK)
+			object_error((t_object *)x, "foo: the thread has %ld values still to pick up", channel_count(x->x_commands));
+		return;
+	}
 	systhread_mutex_lock(x->x_mutex);
 	x->x_foo = foo;																// override our current value
 	systhread_mutex_unlock(x->x_mutex);
 }
 
+void simplethread_dofoo(t_simplethread *x, t_symbol *s, long argc, t_atom *argv)
+{
+	simplethread_foo(x, (long)atom_getlong(argv));
+}
+
 void simplethread_sleeptime(t_simplethread *x, long sleeptime)
 {
-	if (sleeptime<10)
-		sleeptime = 10;
+	if (sleeptime<0)
+		sleeptime = 0;														// 0 runs flat out (with block, as fast as we drain)
 	x->x_sleeptime = sleeptime;														// no need to lock since we are readonly in worker thread
 }
 
+// report <values> <overruns> <waits for room> <most queued> <mean latency ms> <max latency ms> <values per second>
+void simplethread_report(t_simplethread *x)
+{
+	t_channel *ch = !x->x_polling ? x->x_values : NULL;
+	double elapsed = (systimer_gettime() - x->x_start) * 0.001;
+	t_atom av[7];
+
+	atom_setlong(av, x->x_received);
+	atom_setlong(av + 1, ch ? ch->overruns : 0);
+	atom_setlong(av + 2, ch ? ch->blocked : 0);
+	atom_setlong(av + 3, ch ? ch->highwater : 0);
+	atom_setfloat(av + 4, x->x_received ? x->x_latency / x->x_received : 0.);
+	atom_setfloat(av + 5, x->x_maxlatency);
+	atom_setfloat(av + 6, elapsed > 0 ? x->x_received / elapsed : 0.);
+	outlet_anything(x->x_outlet, ps_report, 7, av);
+}
+
 
 void simplethread_stop(t_simplethread *x)
 {
@@ -76,8 +164,13 @@ void simplethread_stop(t_simplethread *x)
 	if (x->x_systhread) {
 		post("stopping our thread");
 		x->x_systhread_cancel = true;						// tell the thread to stop
+		if (x->x_values)
+			channel_close(x->x_values);						// and wake it if it is waiting for room
 		systhread_join(x->x_systhread, &ret);					// wait for the thread to stop
 		x->x_systhread = NULL;
+		qelem_unset(x->x_qelem);
+		if (!x->x_polling && x->x_values)
+			simplethread_qfn(x);							// a batch of whatever it made before it stopped
 	}
 }
 
@@ -90,6 +183,14 @@ void simplethread_cancel(t_simplethread *x)
 
 void *simplethread_threadproc(t_simplethread *x)
 {
+	t_simplethread_item item;
+	t_atom_long foo;
+	t_bool poll = x->x_polling;
+
+	systhread_mutex_lock(x->x_mutex);
+	foo = x->x_foo;
+	systhread_mutex_unlock(x->x_mutex);
+
 	// loop until told to stop
 	while (1) {
 
@@ -97,40 +198,75 @@ void *simplethread_threadproc(t_simplethread *x)
 		if (x->x_systhread_cancel)
 			break;
 
-		systhread_mutex_lock(x->x_mutex);
-		x->x_foo++;																// fiddle with shared data
-		systhread_mutex_unlock(x->x_mutex);
-
-		qelem_set(x->x_qelem);													// notify main thread using qelem mechanism
-
-
-		systhread_sleep(x->x_sleeptime);						// sleep a bit
+		if (poll) {
+			systhread_mutex_lock(x->x_mutex);
+			x->x_foo++;															// fiddle with shared data
+			x->x_pollstamp = systimer_gettime();
+			systhread_mutex_unlock(x->x_mutex);
+
+			qelem_set(x->x_qelem);												// notify main thread using qelem mechanism
+		}
+		else {
+			while (channel_read(x->x_commands, &item.value, false) == CHANNEL_OK)
+				foo = item.value;												// overridden from the main thread
+			item.value = ++foo;
+			item.stamp = systimer_gettime();
+			channel_write(x->x_values, &item);									// sets the qelem, or waits for room with block on
+		}
+
+		if (x->x_sleeptime)
+			systhread_sleep(x->x_sleeptime);					// sleep a bit
 	}
 
 	x->x_systhread_cancel = false;							// reset cancel flag for next time, in case
 	// the thread is created again
 
+	if (!poll) {
+		systhread_mutex_lock(x->x_mutex);
+		x->x_foo = (int)foo;									// so the next thread carries on from here
+		systhread_mutex_unlock(x->x_mutex);
+	}
+
 	systhread_exit(0);															// this can return a value to systhread_join();
 	return NULL;
 }
 
+// called by channel_drain() for each value
+static void simplethread_output(t_simplethread *x, t_simplethread_item *item)
+{
+	double latency = systimer_gettime() - item->stamp;
+
+	x->x_received++;
+	x->x_latency += latency;
+	if (latency > x->x_maxlatency)
+		x->x_maxlatency = latency;
+	outlet_int(x->x_outlet, item->value);
+}
+
 // triggered by the helper thread
 void simplethread_qfn(t_simplethread *x)
 {
-	int myfoo;
+	t_simplethread_item item;
+
+	if (!x->x_polling) {
+		if (x->x_values)
+			channel_drain(x->x_values, SIMPLETHREAD_BATCH, (t_channel_fn)simplethread_output, x);
+		return;
+	}
 
 	systhread_mutex_lock(x->x_mutex);
-	myfoo = x->x_foo;															// access shared data
+	item.value = x->x_foo;														// access shared data
+	item.stamp = x->x_pollstamp;
 	systhread_mutex_unlock(x->x_mutex);
 
 	// *never* wrap outlet calls with systhread_mutex_lock()
-	outlet_int(x->x_outlet, myfoo);
+	simplethread_output(x, &item);
 }
 
 void simplethread_assist(t_simplethread *x, void *b, long m, long a, char *s)
 {
 	if (m==1)
-		sprintf(s,"bang starts a new thread");
+		sprintf(s,"bang starts a new thread, report");
 	else if (m==2)
 		sprintf(s,"report when done/cancelled");
 }
@@ -144,12 +280,15 @@ void simplethread_free(t_simplethread *x)
 	if (x->x_qelem)
 		qelem_free(x->x_qelem);
 
+	channel_free(x->x_values);
+	channel_free(x->x_commands);
+
 	// free out mutex
 	if (x->x_mutex)
 		systhread_mutex_free(x->x_mutex);
 }
 
-void *simplethread_new(void)
+void *simplethread_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_simplethread *x;
 
@@ -160,10 +299,13 @@ void *simplethread_new(void)
 	systhread_mutex_new(&x->x_mutex,0);
 	x->x_foo = 0;
 	x->x_sleeptime = 1000;
+	x->x_commands = channel_new(sizeof(t_atom_long), 16, 0, NULL);
+	x->x_values = NULL;
+	x->x_mode = ps_channel;
+	x->x_polling = false;
+	x->x_capacity = 1024;
+	x->x_block = 0;
+	attr_args_process(x, (short)argc, argv);
 
 	return(x);
 }
-
-
-
-
@@ -4,6 +4,7 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_systhread.h"
+#include "arraylist.h"
 #include "threadpooltask.h"
 
 
@@ -52,9 +53,8 @@ void threadpooltask_method_caller_free(t_threadpooltask_method_caller *x);
 
 static t_systhread			s_threadpooltask_thread_pool[THREADPOOLTASK_THREAD_COUNT];
 static t_systhread_mutex	s_threadpooltask_mutex = NULL;
-static t_linklist			*s_threadpooltask_requestlist = NULL;
-static t_linklist			*s_threadpooltask_executelist = NULL;
-static long					s_threadpooltask_numrequests = 0;
+static t_arraylist			*s_threadpooltask_requestlist = NULL;		// waiting, first come first served
+static t_arraylist			*s_threadpooltask_executelist = NULL;		// running
 static long					s_threadpooltask_init = 0;
 static long					s_threadpooltask_exit = 0;
 static long					s_threadpooltask_id = 0;
@@ -68,10 +68,9 @@ void threadpooltask_init(void)
 		return;
 
 	THREADPOOLTASK_MUTEX_NEW;
-	s_threadpooltask_numrequests = 0;
 	s_threadpooltask_init = 1;
-	s_threadpooltask_requestlist = linklist_new();
-	s_threadpooltask_executelist = linklist_new();
+	s_threadpooltask_requestlist = arraylist_new();
+	s_threadpooltask_executelist = arraylist_new();
 
 	for (i=0; i<THREADPOOLTASK_THREAD_COUNT; i++) {
 		if ((err=systhread_create((method)threadpooltask_threadproc,NULL,0,0,0,s_threadpooltask_thread_pool+i))) {
@@ -121,12 +120,11 @@ long threadpooltask_makerequest(t_threadpooltask *task)
 		return -1;
 
 	THREADPOOLTASK_MUTEX_LOCK;
-	linklist_append(s_threadpooltask_requestlist,task);
-	s_threadpooltask_numrequests++;
+	task->handle = arraylist_pushback(s_threadpooltask_requestlist,task);
+	if (task->handle)
+		rv = 0;
 	THREADPOOLTASK_MUTEX_UNLOCK;
 
-	rv = 0;
-
 	return rv;
 }
 
@@ -135,14 +133,10 @@ long threadpooltask_getrequest(t_threadpooltask **task)
 	long  rv=-1;
 
 	THREADPOOLTASK_MUTEX_LOCK;
-	if (s_threadpooltask_numrequests>0) {
-		*task = (t_threadpooltask *)linklist_getindex(s_threadpooltask_requestlist,0);
-		linklist_chuckindex(s_threadpooltask_requestlist,0);
-		linklist_append(s_threadpooltask_executelist,*task);
-		s_threadpooltask_numrequests--;
+	*task = (t_threadpooltask *)arraylist_popfront(s_threadpooltask_requestlist);
+	if (*task) {
+		(*task)->handle = arraylist_pushback(s_threadpooltask_executelist,*task);
 		rv = 0;
-	} else {
-		*task = NULL;
 	}
 	THREADPOOLTASK_MUTEX_UNLOCK;
 	return rv;
@@ -159,7 +153,7 @@ void threadpooltask_completerequest(t_threadpooltask *task)
 	}
 
 	THREADPOOLTASK_MUTEX_LOCK;
-	linklist_chuckobject(s_threadpooltask_executelist,task);
+	arraylist_chuckhandle(s_threadpooltask_executelist,task->handle);
 	THREADPOOLTASK_MUTEX_UNLOCK;
 
 	sysmem_freeptr(task);
@@ -168,7 +162,7 @@ void threadpooltask_completerequest(t_threadpooltask *task)
 typedef struct _threadpooltask_requestmatch
 {
 	t_object	*owner;
-	t_linklist	*list;
+	t_arraylist	*list;
 } t_threadpooltask_requestmatch;
 
 void threadpooltask_requestmatch_fn(t_threadpooltask *task, t_threadpooltask_requestmatch *match);
@@ -178,29 +172,31 @@ void threadpooltask_requestmatch_fn(t_threadpooltask *task, t_threadpooltask_req
 
 	if (task&&match) {
 		if (task->owner==match->owner)
-			linklist_append(match->list,task);
+			arraylist_pushback(match->list,task);
 		if ((void *)task->cbtask==(void *)threadpooltask_method_caller_task) {
 			caller = (t_threadpooltask_method_caller *)task->owner;
 			if (caller->obtask==match->owner || caller->obcomp==match->owner)
-				linklist_append(match->list,task);
+				arraylist_pushback(match->list,task);
 		}
 	}
 }
 
-t_linklist *threadpooltask_object_requestlist(t_object *owner);
-t_linklist *threadpooltask_object_requestlist(t_object *owner)
+t_arraylist *threadpooltask_object_requestlist(t_object *owner);
+t_arraylist *threadpooltask_object_requestlist(t_object *owner)
 {
-	t_linklist *list=NULL;
+	t_arraylist *list=NULL;
 	t_threadpooltask_requestmatch match;
 
-	list = linklist_new();
-	linklist_flags(list,OBJ_FLAG_REF);
+	list = arraylist_new();
+	if (!list)
+		return NULL;
+	arraylist_flags(list,OBJ_FLAG_REF);
 	match.owner = owner;
 	match.list = list;
 
 	THREADPOOLTASK_MUTEX_LOCK;
-	linklist_funall(s_threadpooltask_requestlist,(method)threadpooltask_requestmatch_fn,(void *)&match);
-	linklist_funall(s_threadpooltask_executelist,(method)threadpooltask_requestmatch_fn,(void *)&match);
+	arraylist_funall(s_threadpooltask_requestlist,(method)threadpooltask_requestmatch_fn,(void *)&match);
+	arraylist_funall(s_threadpooltask_executelist,(method)threadpooltask_requestmatch_fn,(void *)&match);
 	THREADPOOLTASK_MUTEX_UNLOCK;
 
 	return list;
@@ -208,51 +204,52 @@ t_linklist *threadpooltask_object_requestlist(t_object *owner)
 
 void threadpooltask_purge_object(t_object *owner)
 {
-	t_linklist *list;
+	t_arraylist *list;
 	t_threadpooltask *task;
 
-	// build linklist of requests whose owner pointer matches
+	// build list of requests whose owner pointer matches
 	list = threadpooltask_object_requestlist(owner);
+	if (!list)
+		return;
 	// call threadpooltask_cancel on each one
-	while ((task = (t_threadpooltask *)linklist_getindex(list,0))) {
+	while ((task = (t_threadpooltask *)arraylist_popfront(list)))
 		threadpooltask_cancel(task);
-		linklist_chuckindex(list,0);
-	}
-	linklist_chuck(list);
+	arraylist_chuck(list);
 }
 
 void threadpooltask_join_object(t_object *owner)
 {
-	t_linklist *list;
+	t_arraylist *list;
 	t_threadpooltask *task;
 
-	// build linklist of requests whose owner pointer matches
+	// build list of requests whose owner pointer matches
 	list = threadpooltask_object_requestlist(owner);
+	if (!list)
+		return;
 	// call threadpooltask_join on each one
-	while ((task = (t_threadpooltask *)linklist_getindex(list,0))) {
+	while ((task = (t_threadpooltask *)arraylist_popfront(list)))
 		threadpooltask_join(task);
-		linklist_chuckindex(list,0);
-	}
-	linklist_chuck(list);
+	arraylist_chuck(list);
 }
 
+// task may have finished and been freed already, so it is only compared, never read, until it is found
 long threadpooltask_cancel(t_threadpooltask *task)
 {
-	long i,wait=FALSE;
+	t_arraylist_handle h;
+	long wait=FALSE;
 	long rv = -1;
 
 	THREADPOOLTASK_MUTEX_LOCK;
-	i = linklist_objptr2index(s_threadpooltask_requestlist,task);
-	if (i>=0) {
-		linklist_chuckindex(s_threadpooltask_requestlist,i);
+	h = arraylist_objptr2handle(s_threadpooltask_requestlist,task);
+	if (h) {
+		arraylist_chuckhandle(s_threadpooltask_requestlist,h);
 		if ((void *)task->cbtask==(void *)threadpooltask_method_caller_task) {
 			threadpooltask_method_caller_free((t_threadpooltask_method_caller *)task->owner);
 		}
 		sysmem_freeptr(task);
 		rv = 0; // found and cancelled
 	} else {
-		i = linklist_objptr2index(s_threadpooltask_executelist,task);
-		wait = (i>=0);
+		wait = (arraylist_objptr2handle(s_threadpooltask_executelist,task)!=0);
 		rv = 1; // found and joined
 	}
 	THREADPOOLTASK_MUTEX_UNLOCK;
@@ -260,8 +257,9 @@ long threadpooltask_cancel(t_threadpooltask *task)
 	// if the task is executing, stall
 	while (wait) {
 		systhread_sleep(THREADPOOLTASK_SLEEPTIME);
-		i = linklist_objptr2index(s_threadpooltask_executelist,task);
-		wait = (i>=0);
+		THREADPOOLTASK_MUTEX_LOCK;		// the list's ring may be reallocated under us otherwise
+		wait = (arraylist_objptr2handle(s_threadpooltask_executelist,task)!=0);
+		THREADPOOLTASK_MUTEX_UNLOCK;
 	}
 	return rv;
 }
@@ -269,14 +267,12 @@ long threadpooltask_cancel(t_threadpooltask *task)
 
 long threadpooltask_join(t_threadpooltask *task)
 {
-	long i,j,wait=TRUE;
+	long wait=TRUE;
 	long rv = -1;
 
 	while (wait) {
 		THREADPOOLTASK_MUTEX_LOCK;
-		i = linklist_objptr2index(s_threadpooltask_requestlist,task);
-		j = linklist_objptr2index(s_threadpooltask_executelist,task);
-		if (i>=0 || j>=0) {
+		if (arraylist_objptr2handle(s_threadpooltask_requestlist,task) || arraylist_objptr2handle(s_threadpooltask_executelist,task)) {
 			wait = TRUE;
 			rv = 0; // found and joined
 		} else {
@@ -21,6 +21,7 @@ typedef struct _threadpooltask
 	void				*args;
 	method				cbtask;
 	method				cbcomplete;
+	t_uint64			handle;		// on the request or execute list, see arraylist.h
 } t_threadpooltask;
 
 void threadpooltask_init(void);
@@ -0,0 +1,472 @@
+/**
+	@file
+	bufreader.h - an interpolating buffer~ reader, shared by index~, simpwave~ and jw_vindex~
+
+	The frame count, channel count and sample rate of the buffer are cached
+	and only asked for again after the buffer~ notifies us that it was
+	modified (or the reference is pointed somewhere else), so a perform
+	routine pays for one buffer_locksamples() per vector and nothing more.
+	The read kernels take a whole vector of positions, work out the frame
+	indices and weights once per sample and then apply them to every
+	requested channel, so several channels of the same buffer~ come out of
+	a single pass over the interleaved sample data.
+
+	A name that belongs to a sampstream~ (and not to a buffer~) is read
+	through the stream instead: each run of positions that fits in a small
+	window is fetched from the stream's ring and then interpolated exactly
+	as if it were a piece of a buffer~.
+
+	The lock state (the stream in use and the busy count that resolve waits
+	on) belongs to the one thread that calls bufreader_lock(), normally the
+	audio thread. An object that also reads on the main thread keeps a
+	second reader for that.
+*/
+
+#ifndef _BUFREADER_H_
+#define _BUFREADER_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+#include "z_dsp.h"
+#include "ext_buffer.h"
+#include "ext_systhread.h"
+#include "sampstream.h"
+#include <math.h>
+
+#define BUFREADER_SINC_TAPS		8		// taps of the windowed sinc, half on each side
+#define BUFREADER_SINC_PHASES	512		// fractional positions the sinc table is computed for
+#define BUFREADER_WINDOW		4096	// frames fetched from a sampstream~ at a time
+#define BUFREADER_MARGIN		12		// room around a run of positions for the kernels' taps (4 before, 5 after) and rounding
+
+enum {
+	BUFREADER_INTERP_NONE = 0,	// nearest frame
+	BUFREADER_INTERP_LINEAR,
+	BUFREADER_INTERP_CUBIC,		// 4-point Hermite
+	BUFREADER_INTERP_SINC		// 8-point Blackman windowed sinc
+};
+
+// everything the audio thread needs from a sampstream~, swapped in as one pointer
+typedef struct _bufreader_stream
+{
+	t_sampstream_core	*core;
+	long				voice;		// our playhead in the core
+	float				*window;	// BUFREADER_WINDOW interleaved frames
+} t_bufreader_stream;
+
+typedef struct _bufreader
+{
+	t_buffer_ref	*ref;
+	t_buffer_obj	*obj;			// buffer the cached values belong to
+	t_symbol		*name;
+	t_object		*owner;
+	t_bufreader_stream * volatile stream;	// set when name is a sampstream~ rather than a buffer~
+	t_bufreader_stream	*active;	// stream locked by the current bufreader_lock()
+	t_bufreader_stream	*seenstream;	// stream the cached values belong to
+	t_int32_atomic	busy;			// the audio thread is inside a stream lock
+	t_int32_atomic	modcount;		// bumped by bufreader_notify() on the main thread
+	long			seen;			// modcount when the cache was filled
+	t_int64			frames;			// cached buffer_getframecount()
+	long			nchans;			// cached buffer_getchannelcount()
+	double			sr;				// cached buffer_getsamplerate()
+	t_bool			changed;		// the last bufreader_lock() refreshed the cache
+} t_bufreader;
+
+static double s_bufreader_sinc[(BUFREADER_SINC_PHASES + 1) * BUFREADER_SINC_TAPS];
+static t_symbol *ps_bufreader_modified;
+static t_symbol *ps_bufreader_sampstream;
+static t_symbol *ps_bufreader_sampstream_class;
+static t_symbol *ps_bufreader_getcore;
+static t_symbol *ps_bufreader_changed;
+static t_symbol *ps_bufreader_attach;
+static t_symbol *ps_bufreader_free;
+static t_symbol *ps_bufreader_binding;
+static t_symbol *ps_bufreader_unbinding;
+
+
+// call once from ext_main
+static inline void bufreader_tables_init(void)
+{
+	long p, k;
+	double f, d, h, sum, *row;
+
+	ps_bufreader_modified = gensym("buffer_modified");
+	ps_bufreader_sampstream = gensym("sampstream");
+	ps_bufreader_sampstream_class = gensym("sampstream~");
+	ps_bufreader_getcore = gensym("getcore");
+	ps_bufreader_changed = gensym("sampstream_changed");
+	ps_bufreader_attach = gensym("subscribe_attach");
+	ps_bufreader_free = gensym("free");
+	ps_bufreader_binding = gensym("globalsymbol_binding");
+	ps_bufreader_unbinding = gensym("globalsymbol_unbinding");
+	for (p = 0; p <= BUFREADER_SINC_PHASES; p++) {
+		row = s_bufreader_sinc + p * BUFREADER_SINC_TAPS;
+		f = (double)p / BUFREADER_SINC_PHASES;
+		sum = 0.;
+		for (k = 0; k < BUFREADER_SINC_TAPS; k++) {
+			d = (k - (BUFREADER_SINC_TAPS / 2 - 1)) - f;	// distance of the tap from the read position
+			h = (d == 0.) ? 1. : sin(PI * d) / (PI * d);
+			h *= 0.42 + 0.5 * cos(PI * d / (BUFREADER_SINC_TAPS / 2)) + 0.08 * cos(TWOPI * d / (BUFREADER_SINC_TAPS / 2));
+			row[k] = h;
+			sum += h;
+		}
+		for (k = 0; k < BUFREADER_SINC_TAPS; k++)	// unity gain at DC for every phase
+			row[k] /= sum;
+	}
+}
+
+// main thread: point the reader at the sampstream~ called r->name, if
+// there is one and no buffer~ has that name, and wait for the audio thread
+// to be done with the stream it was using before
+static inline void bufreader_resolve(t_bufreader *r)
+{
+	t_object *src = NULL;
+	t_sampstream_core *core = NULL;
+	t_bufreader_stream *st = NULL, *old = r->stream;
+
+	if (r->name && !buffer_ref_exists(r->ref))
+		src = (t_object *)object_findregistered(ps_bufreader_sampstream, r->name);
+	if (src)
+		core = (t_sampstream_core *)object_method(src, ps_bufreader_getcore);	// comes back retained
+	if (old && core == old->core) {
+		sampstream_core_release(core);
+		return;
+	}
+	if (core) {
+		st = (t_bufreader_stream *)sysmem_newptr(sizeof(t_bufreader_stream));
+		if (st)
+			st->window = (float *)sysmem_newptr(BUFREADER_WINDOW * core->nchans * sizeof(float));
+		if (!st || !st->window) {
+			if (st)
+				sysmem_freeptr(st);
+			sampstream_core_release(core);
+			st = NULL;
+		}
+		else {
+			st->core = core;
+			st->voice = sampstream_core_voice(core);
+		}
+	}
+
+	r->stream = st;
+	SAMPSTREAM_FENCE();
+	while (r->busy)
+		systhread_sleep(1);
+	if (old) {
+		sampstream_core_unvoice(old->core, old->voice);
+		sampstream_core_release(old->core);
+		sysmem_freeptr(old->window);
+		sysmem_freeptr(old);
+	}
+	ATOMIC_INCREMENT(&r->modcount);
+}
+
+static inline void bufreader_init(t_bufreader *r, t_object *owner, t_symbol *name)
+{
+	r->ref = buffer_ref_new(owner, name);
+	r->obj = NULL;
+	r->name = name;
+	r->owner = owner;
+	r->stream = r->active = r->seenstream = NULL;
+	r->busy = 0;
+	r->modcount = 0;
+	r->seen = -1;
+	r->frames = r->nchans = 0;
+	r->sr = sys_getsr();
+	r->changed = false;
+	// we are attached (and told with subscribe_attach) if the sampstream~ turns up later
+	if (name && name->s_name[0])
+		object_subscribe(ps_bufreader_sampstream, name, ps_bufreader_sampstream_class, owner);
+	bufreader_resolve(r);
+}
+
+static inline void bufreader_free(t_bufreader *r)
+{
+	if (r->name && r->name->s_name[0])
+		object_unsubscribe(ps_bufreader_sampstream, r->name, ps_bufreader_sampstream_class, r->owner);
+	r->name = NULL;
+	if (r->ref) {
+		bufreader_resolve(r);	// with no name, drops the stream
+		object_free(r->ref);
+	}
+	r->ref = NULL;
+}
+
+// main thread only
+static inline void bufreader_set(t_bufreader *r, t_symbol *name)
+{
+	if (r->name && r->name->s_name[0])
+		object_unsubscribe(ps_bufreader_sampstream, r->name, ps_bufreader_sampstream_class, r->owner);
+	buffer_ref_set(r->ref, name);
+	r->name = name;
+	if (name && name->s_name[0])
+		object_subscribe(ps_bufreader_sampstream, name, ps_bufreader_sampstream_class, r->owner);
+	bufreader_resolve(r);
+	ATOMIC_INCREMENT(&r->modcount);
+}
+
+// to be called from the owner's notify method
+static inline t_max_err bufreader_notify(t_bufreader *r, t_symbol *s, t_symbol *msg, void *sender, void *data)
+{
+	t_max_err err = buffer_ref_notify(r->ref, s, msg, sender, data);
+
+	// buffer~ sends buffer_modified after anything that changes its size;
+	// binding and unbinding also come through here and are caught by the
+	// object comparison in bufreader_lock()
+	if (msg == ps_bufreader_modified)
+		ATOMIC_INCREMENT(&r->modcount);
+	// a sampstream~ opened or closed a file, came or went, or a buffer~ took the name
+	else if (msg == ps_bufreader_changed || msg == ps_bufreader_attach || msg == ps_bufreader_free
+			 || msg == ps_bufreader_binding || msg == ps_bufreader_unbinding)
+		bufreader_resolve(r);
+	return err;
+}
+
+static inline t_buffer_obj *bufreader_getobject(t_bufreader *r)
+{
+	return r->ref ? buffer_ref_getobject(r->ref) : NULL;
+}
+
+// lock the samples for a perform routine, refreshing the cached metadata if
+// the buffer changed. Returns NULL (and leaves nothing locked) if there is
+// nothing to read.
+static inline float *bufreader_lock(t_bufreader *r)
+{
+	t_buffer_obj *b;
+	t_bufreader_stream *st;
+	float *tab;
+	long stamp;
+
+	r->changed = false;
+	r->active = NULL;
+
+	ATOMIC_INCREMENT(&r->busy);
+	st = r->stream;
+	if (st) {
+		if (!sampstream_core_enter(st->core)) {
+			ATOMIC_DECREMENT(&r->busy);
+			return NULL;
+		}
+		if (st != r->seenstream) {
+			r->seenstream = st;
+			r->obj = NULL;
+			r->frames = st->core->frames;
+			r->nchans = st->core->nchans;
+			r->sr = st->core->sr;
+			r->changed = true;
+		}
+		r->active = st;
+		return st->window;		// not the samples, but the read functions know that
+	}
+	ATOMIC_DECREMENT(&r->busy);
+
+	b = bufreader_getobject(r);
+	if (!b)
+		return NULL;
+	tab = buffer_locksamples(b);
+	if (!tab)
+		return NULL;
+
+	stamp = r->modcount;
+	if (b != r->obj || stamp != r->seen) {
+		r->obj = b;
+		r->seenstream = NULL;
+		r->seen = stamp;
+		r->frames = (t_int64)buffer_getframecount(b);
+		r->nchans = (long)buffer_getchannelcount(b);
+		r->sr = buffer_getsamplerate(b);
+		r->changed = true;
+	}
+	if (r->frames < 1 || r->nchans < 1) {
+		buffer_unlocksamples(b);
+		return NULL;
+	}
+	return tab;
+}
+
+static inline void bufreader_unlock(t_bufreader *r)
+{
+	if (r->active) {
+		sampstream_core_leave(r->active->core);
+		r->active = NULL;
+		ATOMIC_DECREMENT(&r->busy);
+	}
+	else
+		buffer_unlocksamples(r->obj);
+}
+
+static inline long bufreader_clampframe(long i, long frames)
+{
+	return i < 0 ? 0 : (i >= frames ? frames - 1 : i);
+}
+
+static inline long bufreader_clampchan(long c, long nchans)
+{
+	return c < 0 ? 0 : (c >= nchans ? nchans - 1 : c);
+}
+
+// copy n consecutive frames of one channel starting at frame start, padding with zeros past either end
+static inline void bufreader_copy(t_bufreader *r, const float *tab, t_int64 start, long chan, double *out, long n)
+{
+	t_bufreader_stream *st = r->active;
+	t_int64 f, lo;
+	long i, count, nc = r->nchans;
+
+	chan = bufreader_clampchan(chan, nc);
+	if (!st) {
+		for (i = 0; i < n; i++) {
+			f = start + i;
+			out[i] = (f >= 0 && f < r->frames) ? tab[f * nc + chan] : 0.;
+		}
+		return;
+	}
+	for (i = 0; i < n; i++)
+		out[i] = 0.;
+	lo = MAX(start, 0);
+	while (lo < MIN(start + n, r->frames)) {
+		count = (long)MIN(MIN(start + n, r->frames) - lo, BUFREADER_WINDOW);
+		sampstream_fetch(st->core, st->voice, lo, count, st->window);
+		for (i = 0; i < count; i++)
+			out[lo - start + i] = st->window[i * nc + chan];
+		lo += count;
+	}
+}
+
+// clamp a read position to the buffer; NaN goes to the start
+static inline double bufreader_clamppos(double p, double last)
+{
+	if (!(p >= 0.))
+		return 0.;
+	return p > last ? last : p;
+}
+
+// the kernels behind bufreader_gather(), for positions start to end - 1 of in,
+// reading frames of nc interleaved channels at tab
+static inline void bufreader_kernel(long nc, long frames, const float *tab, const double *in, double offset, double scale,
+							 double **outs, const long *chans, long nouts, long start, long end, long interp)
+{
+	const long taps = BUFREADER_SINC_TAPS;
+	const double last = (double)(frames - 1);
+	const float *s;
+	const double *row0, *row1;
+	double p, f, w[BUFREADER_SINC_TAPS], ym1, y0, y1, y2, acc;
+	long o[BUFREADER_SINC_TAPS];
+	long i, c, k, ch, i0;
+
+	switch (interp) {
+	default:
+	case BUFREADER_INTERP_NONE:
+		for (i = start; i < end; i++) {
+			p = bufreader_clamppos(offset + scale * in[i], last);
+			s = tab + (long)(p + 0.5) * nc;
+			for (c = 0; c < nouts; c++)
+				outs[c][i] = s[bufreader_clampchan(chans[c], nc)];
+		}
+		break;
+
+	case BUFREADER_INTERP_LINEAR:
+		for (i = start; i < end; i++) {
+			p = bufreader_clamppos(offset + scale * in[i], last);
+			i0 = (long)p;
+			f = p - i0;
+			o[0] = i0 * nc;
+			o[1] = (i0 + 1 < frames ? i0 + 1 : i0) * nc;
+			for (c = 0; c < nouts; c++) {
+				ch = bufreader_clampchan(chans[c], nc);
+				y0 = tab[o[0] + ch];
+				y1 = tab[o[1] + ch];
+				outs[c][i] = y0 + f * (y1 - y0);
+			}
+		}
+		break;
+
+	case BUFREADER_INTERP_CUBIC:
+		for (i = start; i < end; i++) {
+			p = bufreader_clamppos(offset + scale * in[i], last);
+			i0 = (long)p;
+			f = p - i0;
+			for (k = 0; k < 4; k++)
+				o[k] = bufreader_clampframe(i0 - 1 + k, frames) * nc;
+			for (c = 0; c < nouts; c++) {
+				ch = bufreader_clampchan(chans[c], nc);
+				ym1 = tab[o[0] + ch];
+				y0 = tab[o[1] + ch];
+				y1 = tab[o[2] + ch];
+				y2 = tab[o[3] + ch];
+				outs[c][i] = (((0.5 * (y2 - ym1) + 1.5 * (y0 - y1)) * f
+							   + (ym1 - 2.5 * y0 + 2. * y1 - 0.5 * y2)) * f
+							  + 0.5 * (y1 - ym1)) * f + y0;
+			}
+		}
+		break;
+
+	case BUFREADER_INTERP_SINC:
+		for (i = start; i < end; i++) {
+			p = bufreader_clamppos(offset + scale * in[i], last);
+			i0 = (long)p;
+			f = (p - i0) * BUFREADER_SINC_PHASES;
+			k = (long)f;
+			f -= k;
+			row0 = s_bufreader_sinc + k * taps;
+			row1 = row0 + (k < BUFREADER_SINC_PHASES ? taps : 0);
+			for (k = 0; k < taps; k++) {
+				w[k] = row0[k] + f * (row1[k] - row0[k]);
+				o[k] = bufreader_clampframe(i0 - (taps / 2 - 1) + k, frames) * nc;
+			}
+			for (c = 0; c < nouts; c++) {
+				ch = bufreader_clampchan(chans[c], nc);
+				acc = 0.;
+				for (k = 0; k < taps; k++)
+					acc += w[k] * tab[o[k] + ch];
+				outs[c][i] = acc;
+			}
+		}
+		break;
+	}
+}
+
+// a sampstream~: fetch each run of positions that fits in the window and interpolate within it
+static inline void bufreader_gather_stream(t_bufreader *r, const double *in, double offset, double scale,
+									double **outs, const long *chans, long nouts, long n, long interp)
+{
+	t_bufreader_stream *st = r->active;
+	const double last = (double)(r->frames - 1);
+	double p, lo, hi;
+	t_int64 wlo, whi;
+	long start, end;
+
+	for (start = 0; start < n; start = end) {
+		lo = hi = bufreader_clamppos(offset + scale * in[start], last);
+		for (end = start + 1; end < n; end++) {
+			p = bufreader_clamppos(offset + scale * in[end], last);
+			if (MAX(hi, p) - MIN(lo, p) + BUFREADER_MARGIN > BUFREADER_WINDOW)
+				break;
+			lo = MIN(lo, p);
+			hi = MAX(hi, p);
+		}
+		wlo = MAX((t_int64)lo - 4, 0);
+		whi = MIN((t_int64)hi + 5, r->frames - 1);
+		sampstream_fetch(st->core, st->voice, wlo, (long)(whi - wlo + 1), st->window);
+		bufreader_kernel(r->nchans, (long)(whi - wlo + 1), st->window, in, offset - wlo, scale, outs, chans, nouts, start, end, interp);
+	}
+}
+
+// read nouts channels at the frame positions offset + scale * in[i], writing
+// channel chans[c] to outs[c]. Positions are clamped to the buffer.
+static inline void bufreader_gather(t_bufreader *r, const float *tab, const double *in, double offset, double scale,
+							 double **outs, const long *chans, long nouts, long n, long interp)
+{
+	if (r->active)
+		bufreader_gather_stream(r, in, offset, scale, outs, chans, nouts, n, interp);
+	else
+		bufreader_kernel(r->nchans, (long)r->frames, tab, in, offset, scale, outs, chans, nouts, 0, n, interp);
+}
+
+// single channel convenience wrapper around bufreader_gather()
+static inline void bufreader_read(t_bufreader *r, const float *tab, const double *in, double offset, double scale,
+						   double *out, long chan, long n, long interp)
+{
+	bufreader_gather(r, tab, in, offset, scale, &out, &chan, 1, n, interp);
+}
+
+#endif // _BUFREADER_H_
@@ -0,0 +1,345 @@
+/**
+	@file
+	denorm.h - flush-to-zero, vector scrubbing and per-object denormal counts for the signal objects
+
+	Denormals and NaNs are dealt with once per perform routine rather than
+	once per sample. denorm_enter() turns on flush-to-zero and
+	denormals-are-zero (MXCSR on x86, FPCR.FZ on arm64) until
+	denorm_exit(), and denorm_scrub() zeroes every denormal, NaN and inf in
+	a vector with a few vector compares, counting what it found.
+
+	denorm_add64() puts both around a perform routine, the way
+	dspprobe_add64() puts a probe around one: the routine runs with FTZ on
+	and its outlets are scrubbed after it, so a feedback object never hands
+	a denormal or NaN on to the rest of the chain. Each wrapped object has
+	a counter in a table shared by the whole Max session (hung off a
+	symbol's s_thing, like the probes), which dspprobe~ reports.
+
+	With FTZ on the hardware flushes denormals where they are made, so the
+	counters only ever see NaNs and infs. Turning audit on runs wrapped
+	routines with FTZ off instead: every denormal they produce reaches the
+	scrub and is counted against them. That is slower, and meant for
+	finding out which objects need attention.
+*/
+
+#ifndef _DENORM_H_
+#define _DENORM_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DENORM_SSE 1
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+#include <arm_neon.h>
+#define DENORM_FPCR 1
+#endif
+
+#define DENORM_MAX		1024		// counters per session
+#define DENORM_MAGIC	0x646E726D	// 'dnrm', in case something else owns the symbol
+
+typedef unsigned long long t_denorm_fpstate;
+
+typedef struct _denorm_counter
+{
+	t_object		*owner;			// NULL once the object is gone and the slot is free
+	t_symbol		*name;			// class of the owner
+	long			id;				// serial number, so objects of one class can be told apart
+	t_uint64		denormals;		// written by the audio thread only
+	t_uint64		nonfinite;		// NaNs and infs
+} t_denorm_counter;
+
+typedef struct _denorm_registry
+{
+	long				magic;
+	volatile long		audit;		// run wrapped routines without FTZ, to count their denormals
+	long				count;		// slots ever used
+	long				serial;
+	t_denorm_counter	counters[DENORM_MAX];
+} t_denorm_registry;
+
+#ifndef DENORM_PERFORM32
+// the wrapper denorm_add64() puts around a perform routine; keep one per routine in the object
+typedef struct _denorm_wrap
+{
+	t_perfroutine64		perform;
+	void				*userparam;
+	t_denorm_counter	*counter;
+} t_denorm_wrap;
+#endif
+
+static t_denorm_registry *s_denorm;	// this external's pointer to the session table, from denorm_init()
+
+
+static inline t_denorm_registry *denorm_registry(void)
+{
+	t_symbol *s = gensym("__denorm_registry__");
+	t_denorm_registry *reg = (t_denorm_registry *)s->s_thing;
+
+	if (!reg) {
+		reg = (t_denorm_registry *)sysmem_newptrclear(sizeof(t_denorm_registry));
+		if (!reg)
+			return NULL;
+		reg->magic = DENORM_MAGIC;
+		s->s_thing = (t_object *)reg;		// never freed: wrappers keep pointers into it
+	}
+	return reg->magic == DENORM_MAGIC ? reg : NULL;
+}
+
+// call once from ext_main
+static inline void denorm_init(void)
+{
+	s_denorm = denorm_registry();
+}
+
+
+//***********************************************************************************************
+// the FPU
+
+// FTZ and DAZ on (or both off), returning the previous state for denorm_restore()
+static inline t_denorm_fpstate denorm_setftz(int on)
+{
+#if DENORM_SSE
+	unsigned int csr = _mm_getcsr();
+
+	_mm_setcsr(on ? (csr | 0x8040) : (csr & ~0x8040u));
+	return csr;
+#elif DENORM_FPCR
+	t_uint64 fpcr;
+
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(on ? (fpcr | (1ULL << 24)) : (fpcr & ~(1ULL << 24))));
+	return fpcr;
+#else
+	return 0;
+#endif
+}
+
+static inline void denorm_restore(t_denorm_fpstate state)
+{
+#if DENORM_SSE
+	_mm_setcsr((unsigned int)state);
+#elif DENORM_FPCR
+	__asm__ __volatile__("msr fpcr, %0" : : "r"((t_uint64)state));
+#endif
+}
+
+// around a perform routine: FTZ on, unless the session is auditing
+static inline t_denorm_fpstate denorm_enter(void)
+{
+	return denorm_setftz(!(s_denorm && s_denorm->audit));
+}
+
+static inline void denorm_exit(t_denorm_fpstate state)
+{
+	denorm_restore(state);
+}
+
+
+//***********************************************************************************************
+// scrubbing: denormals, NaN and inf to 0, counted. DAZ would make denormals look like 0 to the
+// compares, so it is turned off while they run.
+
+static inline long denorm_scrub(double *io, long n, t_uint64 *nonfinite)
+{
+	t_denorm_fpstate state = denorm_setftz(0);
+	long i = 0, den = 0, bad = 0;
+
+#if DENORM_SSE
+	const __m128d absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+	const __m128d tiny = _mm_set1_pd(DBL_MIN), huge = _mm_set1_pd(DBL_MAX), zero = _mm_setzero_pd();
+
+	for (; i + 2 <= n; i += 2) {
+		__m128d v = _mm_loadu_pd(io + i), a = _mm_and_pd(v, absmask);
+		__m128d d = _mm_and_pd(_mm_cmplt_pd(a, tiny), _mm_cmpneq_pd(a, zero));
+		__m128d b = _mm_cmpnle_pd(a, huge);		// true for inf and NaN alike
+		int dm = _mm_movemask_pd(d), bm = _mm_movemask_pd(b);
+
+		if (dm | bm) {
+			_mm_storeu_pd(io + i, _mm_andnot_pd(_mm_or_pd(d, b), v));
+			den += (dm & 1) + (dm >> 1);
+			bad += (bm & 1) + (bm >> 1);
+		}
+	}
+#elif DENORM_FPCR
+	const float64x2_t tiny = vdupq_n_f64(DBL_MIN), huge = vdupq_n_f64(DBL_MAX);
+
+	for (; i + 2 <= n; i += 2) {
+		float64x2_t v = vld1q_f64(io + i), a = vabsq_f64(v);
+		uint64x2_t d = vbicq_u64(vcltq_f64(a, tiny), vceqzq_f64(a));
+		uint64x2_t b = vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(vcleq_f64(a, huge))));
+		uint64x2_t z = vorrq_u64(d, b);
+
+		if (vgetq_lane_u64(z, 0) | vgetq_lane_u64(z, 1)) {
+			vst1q_f64(io + i, vreinterpretq_f64_u64(vbicq_u64(vreinterpretq_u64_f64(v), z)));
+			den += (long)(vgetq_lane_u64(d, 0) & 1) + (long)(vgetq_lane_u64(d, 1) & 1);
+			bad += (long)(vgetq_lane_u64(b, 0) & 1) + (long)(vgetq_lane_u64(b, 1) & 1);
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		double a = fabs(io[i]);
+
+		if (!(a <= DBL_MAX)) {
+			io[i] = 0.;
+			bad++;
+		}
+		else if (a < DBL_MIN && a != 0.) {
+			io[i] = 0.;
+			den++;
+		}
+	}
+	denorm_restore(state);
+	if (nonfinite)
+		*nonfinite += bad;
+	return den;
+}
+
+// the same for the float vectors of 32-bit perform routines
+static inline long denorm_scrubf(float *io, long n, t_uint64 *nonfinite)
+{
+	t_denorm_fpstate state = denorm_setftz(0);
+	long i = 0, den = 0, bad = 0;
+
+#if DENORM_SSE
+	static const char bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 tiny = _mm_set1_ps(FLT_MIN), huge = _mm_set1_ps(FLT_MAX), zero = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(io + i), a = _mm_and_ps(v, absmask);
+		__m128 d = _mm_and_ps(_mm_cmplt_ps(a, tiny), _mm_cmpneq_ps(a, zero));
+		__m128 b = _mm_cmpnle_ps(a, huge);
+		int dm = _mm_movemask_ps(d), bm = _mm_movemask_ps(b);
+
+		if (dm | bm) {
+			_mm_storeu_ps(io + i, _mm_andnot_ps(_mm_or_ps(d, b), v));
+			den += bits[dm];
+			bad += bits[bm];
+		}
+	}
+#elif DENORM_FPCR
+	const float32x4_t tiny = vdupq_n_f32(FLT_MIN), huge = vdupq_n_f32(FLT_MAX);
+
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vld1q_f32(io + i), a = vabsq_f32(v);
+		uint32x4_t d = vbicq_u32(vcltq_f32(a, tiny), vceqzq_f32(a));
+		uint32x4_t b = vmvnq_u32(vcleq_f32(a, huge));
+		uint32x4_t z = vorrq_u32(d, b);
+
+		if (vmaxvq_u32(z)) {
+			vst1q_f32(io + i, vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(v), z)));
+			den += (long)vaddvq_u32(vshrq_n_u32(d, 31));
+			bad += (long)vaddvq_u32(vshrq_n_u32(b, 31));
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		float a = fabsf(io[i]);
+
+		if (!(a <= FLT_MAX)) {
+			io[i] = 0.f;
+			bad++;
+		}
+		else if (a < FLT_MIN && a != 0.f) {
+			io[i] = 0.f;
+			den++;
+		}
+	}
+	denorm_restore(state);
+	if (nonfinite)
+		*nonfinite += bad;
+	return den;
+}
+
+
+//***********************************************************************************************
+// counters
+
+// main thread: a counter for x, or NULL if the table is full (or denorm_init() wasn't called)
+static inline t_denorm_counter *denorm_counter_new(t_object *x)
+{
+	t_denorm_registry *reg = s_denorm;
+	t_denorm_counter *c = NULL;
+	long i;
+
+	if (!reg)
+		return NULL;
+	for (i = 0; i < reg->count; i++) {
+		if (!reg->counters[i].owner) {
+			c = reg->counters + i;
+			break;
+		}
+	}
+	if (!c) {
+		if (reg->count >= DENORM_MAX)
+			return NULL;
+		c = reg->counters + reg->count++;
+	}
+	c->name = object_classname(x);
+	c->id = ++reg->serial;
+	c->denormals = c->nonfinite = 0;
+	c->owner = x;
+	return c;
+}
+
+static inline void denorm_counter_free(t_denorm_counter *c)
+{
+	if (c)
+		c->owner = NULL;
+}
+
+// audio thread: scrub a vector on behalf of c
+static inline void denorm_count(t_denorm_counter *c, double *io, long n)
+{
+	t_uint64 bad = 0;
+	long den = denorm_scrub(io, n, &bad);
+
+	if (c) {
+		c->denormals += den;
+		c->nonfinite += bad;
+	}
+}
+
+static inline void denorm_countf(t_denorm_counter *c, float *io, long n)
+{
+	t_uint64 bad = 0;
+	long den = denorm_scrubf(io, n, &bad);
+
+	if (c) {
+		c->denormals += den;
+		c->nonfinite += bad;
+	}
+}
+
+// objects built against an SDK without 64-bit perform routines define DENORM_PERFORM32
+#ifndef DENORM_PERFORM32
+
+static inline void denorm_wrap_perform64(t_object *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	t_denorm_wrap *w = (t_denorm_wrap *)userparam;
+	t_denorm_fpstate state = denorm_enter();
+	long i;
+
+	w->perform(x, dsp64, ins, numins, outs, numouts, sampleframes, flags, w->userparam);
+	denorm_exit(state);
+	for (i = 0; i < numouts; i++)
+		denorm_count(w->counter, outs[i], sampleframes);
+}
+
+// dsp_add64() that runs perform with FTZ on and scrubs its outlets after it, counting against c
+static inline void denorm_add64(t_object *dsp64, t_object *x, t_denorm_wrap *w, t_denorm_counter *c, t_perfroutine64 perform,
+						 long flags, void *userparam)
+{
+	w->perform = perform;
+	w->userparam = userparam;
+	w->counter = c;
+	dsp_add64(dsp64, x, denorm_wrap_perform64, flags, w);
+}
+#endif // DENORM_PERFORM32
+
+#endif // _DENORM_H_
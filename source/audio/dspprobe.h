@@ -0,0 +1,224 @@
+/**
+	@file
+	dspprobe.h - per-vector timing probes shared by dspprobe~ and dspstress~
+
+	A probe is a named pair of lock-free histograms: the time spent between
+	dspprobe_begin() and dspprobe_end() each vector, and the jitter of the
+	start times against the signal vector period. The audio thread is the
+	only writer of a probe; the main thread reads the counts for a report
+	and asks for a reset through a request counter the writer acknowledges.
+
+	Probes live in one table per Max session, hung off a symbol's s_thing,
+	so a probe named in dspprobe~ and one named in another external that
+	wraps its perform routine with dspprobe_add64() are the same probe.
+*/
+
+#ifndef _DSPPROBE_H_
+#define _DSPPROBE_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include <math.h>
+
+#define DSPPROBE_MAX		256			// probes per session
+#define DSPPROBE_SUBBINS	8			// histogram bins per octave
+#define DSPPROBE_OCTAVES	24			// 0.5 us to about 8 s
+#define DSPPROBE_BINS		(DSPPROBE_SUBBINS * DSPPROBE_OCTAVES)
+#define DSPPROBE_MINTIME	0.0005		// ms at the bottom of the first bin
+#define DSPPROBE_MAGIC		0x70726F62	// 'prob', in case something else owns the symbol
+
+typedef struct _dspprobe_hist
+{
+	t_uint32	bins[DSPPROBE_BINS];
+	t_uint32	count;
+	double		sum;			// ms
+	double		max;			// ms
+} t_dspprobe_hist;
+
+typedef struct _dspprobe
+{
+	t_symbol		*name;
+	double			svtime_ms;		// one signal vector, the budget and the expected start interval
+	double			start;			// begin timestamp of the vector being measured
+	double			last;			// previous begin timestamp, 0 if none
+	t_dspprobe_hist	time;
+	t_dspprobe_hist	jitter;			// |start interval - svtime_ms|
+	t_uint32		overloads;		// vectors that took longer than svtime_ms
+	volatile long	resetreq;		// bumped by the main thread
+	long			resetack;		// resetreq the audio thread last cleared for
+} t_dspprobe;
+
+typedef struct _dspprobe_registry
+{
+	long			magic;
+	long			count;
+	t_dspprobe		probes[DSPPROBE_MAX];
+} t_dspprobe_registry;
+
+// the wrapper dspprobe_add64() puts around another perform routine; keep one per routine in the object
+typedef struct _dspprobe_wrap
+{
+	t_perfroutine64	perform;
+	void			*userparam;
+	t_dspprobe		*probe;
+} t_dspprobe_wrap;
+
+
+static t_dspprobe_registry *dspprobe_registry(void)
+{
+	t_symbol *s = gensym("__dspprobe_registry__");
+	t_dspprobe_registry *reg = (t_dspprobe_registry *)s->s_thing;
+
+	if (!reg) {
+		reg = (t_dspprobe_registry *)sysmem_newptrclear(sizeof(t_dspprobe_registry));
+		if (!reg)
+			return NULL;
+		reg->magic = DSPPROBE_MAGIC;
+		s->s_thing = (t_object *)reg;		// never freed: probes outlive the objects that named them
+	}
+	return reg->magic == DSPPROBE_MAGIC ? reg : NULL;
+}
+
+// main thread: the probe called name, created if need be. NULL if the table is full.
+static t_dspprobe *dspprobe_get(t_symbol *name)
+{
+	t_dspprobe_registry *reg = dspprobe_registry();
+	long i;
+
+	if (!reg)
+		return NULL;
+	for (i = 0; i < reg->count; i++) {
+		if (reg->probes[i].name == name)
+			return reg->probes + i;
+	}
+	if (reg->count >= DSPPROBE_MAX)
+		return NULL;
+	reg->probes[reg->count].name = name;
+	return reg->probes + reg->count++;
+}
+
+// main thread: iterate over every probe
+static long dspprobe_count(void)
+{
+	t_dspprobe_registry *reg = dspprobe_registry();
+
+	return reg ? reg->count : 0;
+}
+
+static t_dspprobe *dspprobe_index(long i)
+{
+	return dspprobe_registry()->probes + i;
+}
+
+static void dspprobe_clear(t_dspprobe *p)
+{
+	memset(&p->time, 0, sizeof(t_dspprobe_hist));
+	memset(&p->jitter, 0, sizeof(t_dspprobe_hist));
+	p->overloads = 0;
+	p->last = 0.;
+}
+
+// main thread: clear now if the audio thread can't be writing, otherwise at its next vector
+static void dspprobe_reset(t_dspprobe *p)
+{
+	if (!sys_getdspstate()) {
+		dspprobe_clear(p);
+		p->resetack = p->resetreq;
+	}
+	else
+		p->resetreq++;
+}
+
+static inline void dspprobe_record(t_dspprobe_hist *h, double ms)
+{
+	long b = 0;
+
+	if (ms > DSPPROBE_MINTIME) {
+		b = (long)(log2(ms * (1. / DSPPROBE_MINTIME)) * DSPPROBE_SUBBINS);
+		if (b >= DSPPROBE_BINS)
+			b = DSPPROBE_BINS - 1;
+	}
+	h->bins[b]++;
+	h->count++;
+	h->sum += ms;
+	if (ms > h->max)
+		h->max = ms;
+}
+
+// main thread: the q (0-1) quantile in ms, to the resolution of a bin
+static double dspprobe_quantile(const t_dspprobe_hist *h, double q)
+{
+	double want = q * h->count, seen = 0.;
+	long b;
+
+	if (!h->count)
+		return 0.;
+	for (b = 0; b < DSPPROBE_BINS; b++) {
+		seen += h->bins[b];
+		if (seen >= want && h->bins[b])
+			return MIN(DSPPROBE_MINTIME * pow(2., (b + 0.5) / DSPPROBE_SUBBINS), h->max);
+	}
+	return h->max;
+}
+
+// audio thread
+static inline void dspprobe_begin(t_dspprobe *p)
+{
+	double now = systimer_gettime();
+
+	if (p->resetreq != p->resetack) {
+		dspprobe_clear(p);
+		p->resetack = p->resetreq;
+	}
+	if (p->last > 0.)
+		dspprobe_record(&p->jitter, fabs(now - p->last - p->svtime_ms));
+	p->last = now;
+	p->start = now;
+}
+
+static inline void dspprobe_end(t_dspprobe *p)
+{
+	double elapsed;
+
+	if (p->start <= 0.)		// no begin this vector
+		return;
+	elapsed = systimer_gettime() - p->start;
+	p->start = 0.;
+	dspprobe_record(&p->time, elapsed);
+	if (elapsed > p->svtime_ms)
+		p->overloads++;
+}
+
+// called from dsp64
+static void dspprobe_setsvtime(t_dspprobe *p, long maxvectorsize, double samplerate)
+{
+	p->svtime_ms = maxvectorsize / samplerate * 1000.;
+	p->last = 0.;
+}
+
+static void dspprobe_wrap_perform64(t_object *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	t_dspprobe_wrap *w = (t_dspprobe_wrap *)userparam;
+
+	dspprobe_begin(w->probe);
+	w->perform(x, dsp64, ins, numins, outs, numouts, sampleframes, flags, w->userparam);
+	dspprobe_end(w->probe);
+}
+
+// dsp_add64() that times perform under probe, or adds it untouched if probe is NULL
+static void dspprobe_add64(t_object *dsp64, t_object *x, t_dspprobe_wrap *w, t_dspprobe *probe, t_perfroutine64 perform,
+						   long flags, void *userparam, long maxvectorsize, double samplerate)
+{
+	if (!probe) {
+		dsp_add64(dsp64, x, perform, flags, userparam);
+		return;
+	}
+	w->perform = perform;
+	w->userparam = userparam;
+	w->probe = probe;
+	dspprobe_setsvtime(probe, maxvectorsize, samplerate);
+	dsp_add64(dsp64, x, dspprobe_wrap_perform64, flags, w);
+}
+
+#endif // _DSPPROBE_H_
@@ -0,0 +1,189 @@
+/**
+	@file
+	dspprobe~ - time a section of a signal chain
+
+	Put a [dspprobe~ start name] before the objects to measure and a
+	[dspprobe~ stop name] after them. Both pass their signal through, which
+	is what keeps them on either side of the section in the DSP chain. Each
+	vector the time between the two goes into the probe's histogram, along
+	with how far the start drifted from the signal vector period.
+	report sends out name count p50 p99 max mean overloads jitter-p50
+	jitter-p99 jitter-max (times in ms); reportall does it for every probe
+	in the session, including ones other externals add with dspprobe_add64().
+
+	denormals sends out denormals class id denormals nan-or-inf for every
+	object that scrubs its outlets with denorm.h; those only count
+	denormals while denormaudit 1 is in force, since FTZ hides them.
+
+	@ingroup	examples
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include "dspprobe.h"
+#include "denorm.h"
+
+
+typedef struct _dspprobe_obj {
+	t_pxobject	p_obj;
+	t_dspprobe	*p_probe;
+	char		p_stop;			// 0 for the start of the section, 1 for the end
+	void		*p_outlet;		// reports
+} t_dspprobe_obj;
+
+
+void *dspprobe_new(t_symbol *s, long argc, t_atom *argv);
+void dspprobe_assist(t_dspprobe_obj *x, void *b, long m, long a, char *s);
+void dspprobe_report(t_dspprobe_obj *x);
+void dspprobe_reportall(t_dspprobe_obj *x);
+void dspprobe_doreset(t_dspprobe_obj *x);
+void dspprobe_denormals(t_dspprobe_obj *x);
+void dspprobe_denormaudit(t_dspprobe_obj *x, long on);
+void dspprobe_perform64(t_dspprobe_obj *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void dspprobe_dsp64(t_dspprobe_obj *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+
+
+static t_class *s_dspprobe_class;
+static t_symbol *ps_stop;
+
+
+void ext_main(void *r)
+{
+	t_class *c = class_new("dspprobe~", (method)dspprobe_new, (method)dsp_free, sizeof(t_dspprobe_obj), NULL, A_GIMME, 0);
+
+	class_addmethod(c, (method)dspprobe_dsp64,		"dsp64",		A_CANT, 0);
+	class_addmethod(c, (method)dspprobe_report,		"report",		0);
+	class_addmethod(c, (method)dspprobe_reportall,	"reportall",	0);
+	class_addmethod(c, (method)dspprobe_doreset,	"reset",		0);
+	class_addmethod(c, (method)dspprobe_denormals,	"denormals",	0);
+	class_addmethod(c, (method)dspprobe_denormaudit,	"denormaudit",	A_LONG, 0);
+	class_addmethod(c, (method)dspprobe_assist,		"assist",		A_CANT, 0);
+	class_dspinit(c);
+
+	class_register(CLASS_BOX, c);
+	s_dspprobe_class = c;
+
+	ps_stop = gensym("stop");
+	denorm_init();
+}
+
+
+void *dspprobe_new(t_symbol *s, long argc, t_atom *argv)
+{
+	t_dspprobe_obj *x = (t_dspprobe_obj *)object_alloc(s_dspprobe_class);
+	t_symbol *name;
+
+	dsp_setup((t_pxobject *)x, 1);
+	x->p_outlet = outlet_new((t_object *)x, NULL);
+	outlet_new((t_object *)x, "signal");
+
+	x->p_stop = atom_getsymarg(0, argc, argv) == ps_stop;
+	name = atom_getsymarg(1, argc, argv);
+	if (name == gensym(""))
+		name = gensym("default");
+	x->p_probe = dspprobe_get(name);
+	if (!x->p_probe)
+		object_error((t_object *)x, "too many probes, %s won't be timed", name->s_name);
+	return x;
+}
+
+
+void dspprobe_assist(t_dspprobe_obj *x, void *b, long m, long a, char *s)
+{
+	if (m == ASSIST_INLET)
+		snprintf_zero(s, 256, "(signal) Input, report, reportall, reset, denormals, denormaudit");
+	else if (a == 0)
+		snprintf_zero(s, 256, "(signal) Input, Passed Through");
+	else
+		snprintf_zero(s, 256, "name count p50 p99 max mean overloads jitter-p50 jitter-p99 jitter-max (ms), denormals");
+}
+
+
+static void dspprobe_output(t_dspprobe_obj *x, t_dspprobe *p)
+{
+	t_atom av[9];
+
+	atom_setlong(av + 0, p->time.count);
+	atom_setfloat(av + 1, dspprobe_quantile(&p->time, 0.5));
+	atom_setfloat(av + 2, dspprobe_quantile(&p->time, 0.99));
+	atom_setfloat(av + 3, p->time.max);
+	atom_setfloat(av + 4, p->time.count ? p->time.sum / p->time.count : 0.);
+	atom_setlong(av + 5, p->overloads);
+	atom_setfloat(av + 6, dspprobe_quantile(&p->jitter, 0.5));
+	atom_setfloat(av + 7, dspprobe_quantile(&p->jitter, 0.99));
+	atom_setfloat(av + 8, p->jitter.max);
+	outlet_anything(x->p_outlet, p->name, 9, av);
+}
+
+
+void dspprobe_report(t_dspprobe_obj *x)
+{
+	if (x->p_probe)
+		dspprobe_output(x, x->p_probe);
+}
+
+
+void dspprobe_reportall(t_dspprobe_obj *x)
+{
+	long i, n = dspprobe_count();
+
+	for (i = 0; i < n; i++)
+		dspprobe_output(x, dspprobe_index(i));
+}
+
+
+void dspprobe_doreset(t_dspprobe_obj *x)
+{
+	if (x->p_probe)
+		dspprobe_reset(x->p_probe);
+}
+
+
+void dspprobe_denormals(t_dspprobe_obj *x)
+{
+	t_denorm_counter *c;
+	t_atom av[4];
+	long i;
+
+	if (!s_denorm)
+		return;
+	for (i = 0; i < s_denorm->count; i++) {
+		c = s_denorm->counters + i;
+		if (!c->owner)
+			continue;
+		atom_setsym(av + 0, c->name);
+		atom_setlong(av + 1, c->id);
+		atom_setlong(av + 2, (t_atom_long)c->denormals);
+		atom_setlong(av + 3, (t_atom_long)c->nonfinite);
+		outlet_anything(x->p_outlet, gensym("denormals"), 4, av);
+	}
+}
+
+
+void dspprobe_denormaudit(t_dspprobe_obj *x, long on)
+{
+	if (s_denorm)
+		s_denorm->audit = on != 0;
+}
+
+
+void dspprobe_perform64(t_dspprobe_obj *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	t_dspprobe *p = x->p_probe;
+
+	if (p && !x->p_stop)
+		dspprobe_begin(p);
+	if (outs[0] != ins[0])
+		memcpy(outs[0], ins[0], sampleframes * sizeof(double));
+	if (p && x->p_stop)
+		dspprobe_end(p);
+}
+
+
+void dspprobe_dsp64(t_dspprobe_obj *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	if (x->p_probe && !x->p_stop)
+		dspprobe_setsvtime(x->p_probe, maxvectorsize, samplerate);
+	object_method(dsp64, gensym("dsp_add64"), x, dspprobe_perform64, 0, NULL);
+}
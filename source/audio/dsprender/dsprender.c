@@ -0,0 +1,740 @@
+/**
+	@file
+	dsprender - run the perform routine of a signal object offline, as fast as it will go
+
+	dsprender builds the projects listed in s_dsprender_classes against a
+	stand-in for Max (maxstub.c), makes one of their objects, compiles it
+	into a dsp chain and renders a given number of frames through it from
+	generated signals or sound files, without Max or an audio driver. It
+	reports how fast that went, how many allocations the perform routine
+	made and how many denormal samples came out (and, for objects that
+	scrub their outlets, how many they caught), and can write the output
+	or compare it against a golden file.
+
+	usage: dsprender [options] <class> [arguments] [@attribute value ...]
+
+	-sr <rate>			sample rate (44100)
+	-vs <frames>		signal vector size (64)
+	-n <frames>			frames to render (10 seconds)
+	-d <seconds>		seconds to render
+	-i <inlet>=<source>	drive a signal inlet; the others count as unconnected
+	-b <name>=<source>[,<frames>]	make a buffer~ (4096 frames)
+	-m "[<inlet>:]<message>"	send a message before the dsp chain is compiled
+	-o <file>			write the output: interleaved doubles, or 64-bit float WAV for a .wav name
+	-g <file>			compare the output with a golden file, written with -o
+	-tol <difference>	largest difference from the golden file that still passes (1e-9)
+	-r <repeats>		render that many times from a new object, report the fastest (1)
+	-ftz				flush denormals to zero while rendering, as Max's audio thread does
+	-audit				run objects that scrub their outlets (denorm.h) without FTZ, counting what they scrub
+	-l					list the classes dsprender has built in
+
+	sources: sine:<hz>[:<amp>], saw:<hz>[:<amp>], ramp:<hz> (0 to 1),
+	noise[:<amp>], burst:<seconds> (noise, then silence), impulse[:<period in frames>],
+	dc:<value>, or a sound file (WAV, or raw doubles), with #<channel> to pick a
+	channel other than the first. For a buffer~, hz means cycles per buffer.
+
+	The exit code is 0 if everything went through, 1 if the output differed
+	from the golden file and 2 if the render couldn't be set up.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include "dsprender.h"
+#include "denorm.h"
+#include <float.h>
+
+#define DSPRENDER_MAXSIGNALS	64		// signal inlets or outlets
+#define DSPRENDER_MAXMESSAGES	64
+#define DSPRENDER_MAXATOMS		256
+
+typedef struct _dsprender_class
+{
+	const char	*name;
+	void		(*main)(void *r);
+} t_dsprender_class;
+
+enum {
+	DSPRENDER_SILENCE = 0,
+	DSPRENDER_SINE,
+	DSPRENDER_SAW,
+	DSPRENDER_RAMP,
+	DSPRENDER_NOISE,
+	DSPRENDER_BURST,
+	DSPRENDER_IMPULSE,
+	DSPRENDER_DC,
+	DSPRENDER_FILE
+};
+
+typedef struct _dsprender_source
+{
+	long		kind;
+	double		a;				// frequency, amplitude, seconds, period or value, by kind
+	double		b;
+	double		*data;			// a file's samples, interleaved
+	long		frames;
+	long		nchans;
+	long		chan;
+	double		sr;
+} t_dsprender_source;
+
+
+// the projects built into dsprender, each with its ext_main renamed (see CMakeLists.txt)
+void dsprender_lores_main(void *r);
+void dsprender_times_main(void *r);
+void dsprender_split_main(void *r);
+void dsprender_simpwave_main(void *r);
+void dsprender_spectral_main(void *r);
+#ifdef DSPRENDER_CPP
+void dsprender_limi_main(void *r);
+int dsprender_combsyn_main(void);
+
+static void dsprender_combsyn(void *r)
+{
+	dsprender_combsyn_main();
+}
+#endif
+
+static const t_dsprender_class s_dsprender_classes[] = {
+	{ "lores~",		dsprender_lores_main },
+	{ "times~",		dsprender_times_main },
+	{ "split~",		dsprender_split_main },
+	{ "simpwave~",	dsprender_simpwave_main },
+	{ "spectral~",	dsprender_spectral_main },
+#ifdef DSPRENDER_CPP
+	{ "limi~",		dsprender_limi_main },
+	{ "combsyn~",	dsprender_combsyn },
+#endif
+	{ NULL, NULL }
+};
+
+
+//***********************************************************************************************
+// files
+
+static long dsprender_u16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static t_uint32 dsprender_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((t_uint32)p[3] << 24);
+}
+
+// a WAV file (16, 24 or 32-bit integer, 32 or 64-bit float), or raw native doubles with nchans channels
+static double *dsprender_readfile(const char *path, long *frames, long *nchans, double *sr)
+{
+	FILE *f = fopen(path, "rb");
+	unsigned char *file = NULL, *p, *end, *data = NULL;
+	long size, i, n, tag = 0, bits = 0, datasize = 0;
+	double *out = NULL;
+
+	if (!f) {
+		error("can't open %s", path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	file = (unsigned char *)malloc(size > 0 ? size : 1);
+	if (fread(file, 1, size, f) != (size_t)size) {
+		error("can't read %s", path);
+		goto out;
+	}
+
+	if (size < 12 || memcmp(file, "RIFF", 4) || memcmp(file + 8, "WAVE", 4)) {
+		*frames = size / sizeof(double) / *nchans;
+		out = (double *)malloc(*frames * *nchans * sizeof(double) + 1);
+		memcpy(out, file, *frames * *nchans * sizeof(double));
+		goto out;
+	}
+
+	for (p = file + 12, end = file + size; p + 8 <= end; p += 8 + ((dsprender_u32(p + 4) + 1) & ~1)) {
+		t_uint32 len = dsprender_u32(p + 4);
+
+		if (p + 8 + len > end)
+			break;
+		if (!memcmp(p, "fmt ", 4) && len >= 16) {
+			tag = dsprender_u16(p + 8);
+			*nchans = dsprender_u16(p + 10);
+			*sr = dsprender_u32(p + 12);
+			bits = dsprender_u16(p + 22);
+			if (tag == 0xFFFE && len >= 26)
+				tag = dsprender_u16(p + 32);
+		}
+		else if (!memcmp(p, "data", 4)) {
+			data = p + 8;
+			datasize = len;
+		}
+	}
+	if (!data || *nchans < 1 || (tag != 1 && tag != 3) || (tag == 1 && bits != 16 && bits != 24 && bits != 32) || (tag == 3 && bits != 32 && bits != 64)) {
+		error("%s isn't a WAV file dsprender can read", path);
+		goto out;
+	}
+	*frames = datasize / (bits / 8) / *nchans;
+	n = *frames * *nchans;
+	out = (double *)malloc(n * sizeof(double) + 1);
+	for (i = 0, p = data; i < n; i++, p += bits / 8) {
+		if (tag == 3 && bits == 64) {
+			union { t_uint64 u; double d; } v;
+
+			v.u = dsprender_u32(p) | ((t_uint64)dsprender_u32(p + 4) << 32);
+			out[i] = v.d;
+		}
+		else if (tag == 3) {
+			union { t_uint32 u; float f; } v;
+
+			v.u = dsprender_u32(p);
+			out[i] = v.f;
+		}
+		else if (bits == 16)
+			out[i] = (t_int32)(dsprender_u16(p) << 16) * (1. / 2147483648.);
+		else if (bits == 24)
+			out[i] = (t_int32)((p[0] << 8) | (p[1] << 16) | ((t_uint32)p[2] << 24)) * (1. / 2147483648.);
+		else
+			out[i] = (t_int32)dsprender_u32(p) * (1. / 2147483648.);
+	}
+out:
+	free(file);
+	fclose(f);
+	return out;
+}
+
+static void dsprender_put32(FILE *f, t_uint32 v)
+{
+	unsigned char b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24 };
+
+	fwrite(b, 1, 4, f);
+}
+
+static void dsprender_put16(FILE *f, long v)
+{
+	unsigned char b[2] = { v & 0xFF, (v >> 8) & 0xFF };
+
+	fwrite(b, 1, 2, f);
+}
+
+// planar in, interleaved out
+static long dsprender_writefile(const char *path, double *planar, long frames, long nchans, double sr)
+{
+	FILE *f = fopen(path, "wb");
+	size_t len = strlen(path);
+	long i, c;
+
+	if (!f) {
+		error("can't write %s", path);
+		return 1;
+	}
+	if (len > 4 && !strcmp(path + len - 4, ".wav")) {
+		// doubles, so a golden file holds exactly what was rendered and -tol can stay tight
+		t_uint32 bytes = (t_uint32)(frames * nchans * sizeof(double));
+
+		fwrite("RIFF", 1, 4, f);
+		dsprender_put32(f, 36 + bytes);
+		fwrite("WAVEfmt ", 1, 8, f);
+		dsprender_put32(f, 16);
+		dsprender_put16(f, 3);
+		dsprender_put16(f, nchans);
+		dsprender_put32(f, (t_uint32)sr);
+		dsprender_put32(f, (t_uint32)sr * nchans * 8);
+		dsprender_put16(f, nchans * 8);
+		dsprender_put16(f, 64);
+		fwrite("data", 1, 4, f);
+		dsprender_put32(f, bytes);
+		for (i = 0; i < frames; i++) {
+			for (c = 0; c < nchans; c++) {
+				union { t_uint64 u; double d; } v;
+
+				v.d = planar[c * frames + i];
+				dsprender_put32(f, (t_uint32)(v.u & 0xFFFFFFFF));
+				dsprender_put32(f, (t_uint32)(v.u >> 32));
+			}
+		}
+	}
+	else {
+		for (i = 0; i < frames; i++) {
+			for (c = 0; c < nchans; c++)
+				fwrite(planar + c * frames + i, sizeof(double), 1, f);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+
+//***********************************************************************************************
+// signals
+
+static long dsprender_parsesource(t_dsprender_source *src, const char *spec)
+{
+	const char *arg = strchr(spec, ':');
+	const char *hash;
+	double a = arg ? atof(arg + 1) : 0., b = 0.;
+	size_t len = arg ? (size_t)(arg - spec) : strlen(spec);
+
+	memset(src, 0, sizeof(t_dsprender_source));
+	if (arg && strchr(arg + 1, ':'))
+		b = atof(strchr(arg + 1, ':') + 1);
+	if (len == 4 && !strncmp(spec, "sine", 4)) {
+		src->kind = DSPRENDER_SINE;
+		src->a = a;
+		src->b = b ? b : 1.;
+	}
+	else if (len == 3 && !strncmp(spec, "saw", 3)) {
+		src->kind = DSPRENDER_SAW;
+		src->a = a;
+		src->b = b ? b : 1.;
+	}
+	else if (len == 4 && !strncmp(spec, "ramp", 4)) {
+		src->kind = DSPRENDER_RAMP;
+		src->a = a;
+	}
+	else if (len == 5 && !strncmp(spec, "noise", 5)) {
+		src->kind = DSPRENDER_NOISE;
+		src->a = arg ? a : 1.;
+	}
+	else if (len == 5 && !strncmp(spec, "burst", 5)) {
+		src->kind = DSPRENDER_BURST;
+		src->a = arg ? a : 0.1;
+	}
+	else if (len == 7 && !strncmp(spec, "impulse", 7)) {
+		src->kind = DSPRENDER_IMPULSE;
+		src->a = a;
+	}
+	else if (len == 2 && !strncmp(spec, "dc", 2)) {
+		src->kind = DSPRENDER_DC;
+		src->a = a;
+	}
+	else {
+		char path[1024];
+
+		hash = strrchr(spec, '#');
+		len = hash ? (size_t)(hash - spec) : strlen(spec);
+		if (len >= sizeof(path))
+			return 1;
+		memcpy(path, spec, len);
+		path[len] = 0;
+		src->kind = DSPRENDER_FILE;
+		src->nchans = 1;
+		src->sr = sys_getsr();
+		src->data = dsprender_readfile(path, &src->frames, &src->nchans, &src->sr);
+		if (!src->data)
+			return 1;
+		src->chan = hash ? atol(hash + 1) - 1 : 0;
+		if (src->chan < 0 || src->chan >= src->nchans) {
+			error("%s has no channel %ld", path, src->chan + 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// the same signal every time for the same source, so renders can be compared
+static void dsprender_generate(t_dsprender_source *src, double *out, long n, double sr)
+{
+	t_uint32 seed = 22222;
+	double phase = 0., inc = src->a / sr;
+	long i, burst = (long)(src->a * sr), period = (long)src->a;
+
+	for (i = 0; i < n; i++) {
+		switch (src->kind) {
+		case DSPRENDER_SINE:
+			out[i] = src->b * sin(TWOPI * phase);
+			break;
+		case DSPRENDER_SAW:
+			out[i] = src->b * (2. * phase - 1.);
+			break;
+		case DSPRENDER_RAMP:
+			out[i] = phase;
+			break;
+		case DSPRENDER_NOISE:
+		case DSPRENDER_BURST:
+			seed = seed * 1664525 + 1013904223;
+			out[i] = (src->kind == DSPRENDER_NOISE ? src->a : (i < burst ? 1. : 0.)) * ((t_int32)seed * (1. / 2147483648.));
+			break;
+		case DSPRENDER_IMPULSE:
+			out[i] = (period > 0 ? i % period == 0 : i == 0) ? 1. : 0.;
+			break;
+		case DSPRENDER_DC:
+			out[i] = src->a;
+			break;
+		case DSPRENDER_FILE:
+			out[i] = i < src->frames ? src->data[i * src->nchans + src->chan] : 0.;
+			break;
+		default:
+			out[i] = 0.;
+			break;
+		}
+		phase += inc;
+		phase -= floor(phase);
+	}
+}
+
+// name=<source>[,<frames>]
+static long dsprender_makebuffer(const char *spec, double sr)
+{
+	char name[256], source[1024];
+	const char *eq = strchr(spec, '='), *comma;
+	t_dsprender_source src;
+	long frames = 4096, nchans = 1, i, n;
+	double *samples;
+	float *f;
+	t_max_err err;
+
+	if (!eq || eq == spec || (size_t)(eq - spec) >= sizeof(name))
+		return 1;
+	memcpy(name, spec, eq - spec);
+	name[eq - spec] = 0;
+	comma = strrchr(eq + 1, ',');
+	n = comma ? (long)(comma - eq - 1) : (long)strlen(eq + 1);
+	if (n >= (long)sizeof(source))
+		return 1;
+	memcpy(source, eq + 1, n);
+	source[n] = 0;
+	if (comma)
+		frames = atol(comma + 1);
+	if (dsprender_parsesource(&src, source) || frames < 1)
+		return 1;
+
+	if (src.kind == DSPRENDER_FILE) {
+		// the whole file, every channel
+		frames = src.frames;
+		nchans = src.nchans;
+		n = frames * nchans;
+		f = (float *)malloc(n * sizeof(float) + 1);
+		for (i = 0; i < n; i++)
+			f[i] = (float)src.data[i];
+		sr = src.sr;
+		free(src.data);
+	}
+	else {
+		if (src.kind == DSPRENDER_SINE || src.kind == DSPRENDER_SAW || src.kind == DSPRENDER_RAMP)
+			src.a *= sr / frames;		// cycles per buffer
+		samples = (double *)malloc(frames * sizeof(double));
+		dsprender_generate(&src, samples, frames, sr);
+		f = (float *)malloc(frames * sizeof(float));
+		for (i = 0; i < frames; i++)
+			f[i] = (float)samples[i];
+		free(samples);
+	}
+	err = maxstub_buffer_new(gensym(name), f, frames, nchans, sr);
+	free(f);
+	if (err)
+		error("can't make buffer~ %s", name);
+	return err ? 1 : 0;
+}
+
+
+//***********************************************************************************************
+// messages
+
+static long dsprender_atoms(const char *s, t_atom *av, long max)
+{
+	char word[256], *e;
+	long ac = 0, len;
+	double f;
+	long l;
+
+	while (*s && ac < max) {
+		while (*s == ' ')
+			s++;
+		if (!*s)
+			break;
+		for (len = 0; s[len] && s[len] != ' '; len++)
+			;
+		if (len >= (long)sizeof(word))
+			len = sizeof(word) - 1;
+		memcpy(word, s, len);
+		word[len] = 0;
+		s += len;
+
+		l = strtol(word, &e, 10);
+		if (!*e) {
+			atom_setlong(av + ac++, l);
+			continue;
+		}
+		f = strtod(word, &e);
+		if (!*e)
+			atom_setfloat(av + ac++, f);
+		else
+			atom_setsym(av + ac++, gensym(word));
+	}
+	return ac;
+}
+
+// "[<inlet>:]<selector> args", or numbers for int, float or list
+static void dsprender_send(t_object *x, const char *msg)
+{
+	t_atom av[DSPRENDER_MAXATOMS];
+	const char *colon = strchr(msg, ':');
+	long inlet = 0, ac;
+	char *e;
+
+	if (colon) {
+		inlet = strtol(msg, &e, 10);
+		if (e == colon)
+			msg = colon + 1;
+		else
+			inlet = 0;
+	}
+	ac = dsprender_atoms(msg, av, DSPRENDER_MAXATOMS);
+	if (!ac)
+		return;
+	if (av[0].a_type == A_SYM)
+		maxstub_message(x, inlet, av[0].a_w.w_sym, ac - 1, av + 1);
+	else if (ac > 1)
+		maxstub_message(x, inlet, gensym("list"), ac, av);
+	else
+		maxstub_message(x, inlet, av[0].a_type == A_FLOAT ? gensym("float") : gensym("int"), 1, av);
+}
+
+
+//***********************************************************************************************
+
+static int dsprender_usage(void)
+{
+	fprintf(stderr, "usage: dsprender [-sr rate] [-vs frames] [-n frames | -d seconds] [-i inlet=source ...]\n"
+					"                 [-b name=source[,frames] ...] [-m \"[inlet:]message\" ...] [-o file] [-g file]\n"
+					"                 [-tol difference] [-r repeats] [-ftz] [-audit] [-l] class [arguments] [@attribute value ...]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const t_dsprender_class *cls = NULL;
+	const char *messages[DSPRENDER_MAXMESSAGES], *outpath = NULL, *goldpath = NULL;
+	const char *inspecs[DSPRENDER_MAXSIGNALS], *bufspecs[DSPRENDER_MAXMESSAGES];
+	t_dsprender_source src;
+	t_atom args[DSPRENDER_MAXATOMS];
+	char argline[4096];
+	double sr = 44100., seconds = 10., tol = 1e-9, best = -1., elapsed;
+	double *inputs[DSPRENDER_MAXSIGNALS], *outputs = NULL, *ins[DSPRENDER_MAXSIGNALS], *outs[DSPRENDER_MAXSIGNALS];
+	double *zero = NULL;
+	long vs = 64, frames = -1, repeats = 1, nmessages = 0, nbuffers = 0, nargs, nins = 0, nouts = 0;
+	long i, j, k, pos, n, blocks, denormals = 0, nonfinite = 0, scrubbed = -1, scrubbedbad = -1;
+	t_int64 allocs = 0, before;
+	short count[DSPRENDER_MAXSIGNALS * 2];
+	int ftz = 0, audit = 0, result = 0, is32 = 0;
+	t_denorm_fpstate fpstate;
+	t_object *x;
+
+	memset(inspecs, 0, sizeof(inspecs));
+	memset(inputs, 0, sizeof(inputs));
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+		const char *opt = argv[i], *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(opt, "-l")) {
+			for (cls = s_dsprender_classes; cls->name; cls++)
+				printf("%s\n", cls->name);
+			return 0;
+		}
+		if (!strcmp(opt, "-ftz")) {
+			ftz = 1;
+			continue;
+		}
+		if (!strcmp(opt, "-audit")) {
+			audit = 1;
+			continue;
+		}
+		if (!val)
+			return dsprender_usage();
+		i++;
+		if (!strcmp(opt, "-sr"))
+			sr = atof(val);
+		else if (!strcmp(opt, "-vs"))
+			vs = atol(val);
+		else if (!strcmp(opt, "-n"))
+			frames = atol(val);
+		else if (!strcmp(opt, "-d"))
+			seconds = atof(val);
+		else if (!strcmp(opt, "-r"))
+			repeats = atol(val);
+		else if (!strcmp(opt, "-o"))
+			outpath = val;
+		else if (!strcmp(opt, "-g"))
+			goldpath = val;
+		else if (!strcmp(opt, "-tol"))
+			tol = atof(val);
+		else if (!strcmp(opt, "-m") && nmessages < DSPRENDER_MAXMESSAGES)
+			messages[nmessages++] = val;
+		else if (!strcmp(opt, "-i")) {
+			k = atol(val);
+			if (!strchr(val, '=') || k < 0 || k >= DSPRENDER_MAXSIGNALS)
+				return dsprender_usage();
+			inspecs[k] = strchr(val, '=') + 1;
+		}
+		else if (!strcmp(opt, "-b") && nbuffers < DSPRENDER_MAXMESSAGES)
+			bufspecs[nbuffers++] = val;
+		else
+			return dsprender_usage();
+	}
+	if (i >= argc || sr <= 0. || vs < 1 || repeats < 1)
+		return dsprender_usage();
+	for (cls = s_dsprender_classes; cls->name; cls++) {
+		if (!strcmp(cls->name, argv[i]))
+			break;
+	}
+	if (!cls->name) {
+		error("dsprender has no class %s (-l lists them)", argv[i]);
+		return 2;
+	}
+	if (frames < 0)
+		frames = (long)(seconds * sr);
+
+	// the rest of the command line is the object box
+	argline[0] = 0;
+	for (j = i + 1; j < argc; j++) {
+		strncat(argline, argv[j], sizeof(argline) - strlen(argline) - 2);
+		strcat(argline, " ");
+	}
+	nargs = dsprender_atoms(argline, args, DSPRENDER_MAXATOMS);
+
+	maxstub_setaudio(sr, vs);
+	for (k = 0; k < nbuffers; k++) {
+		if (dsprender_makebuffer(bufspecs[k], sr))
+			return 2;
+	}
+	cls->main(NULL);
+	denorm_init();
+	if (s_denorm)
+		s_denorm->audit = audit;
+
+	// every inlet's signal, generated before the clock starts
+	for (k = 0; k < DSPRENDER_MAXSIGNALS; k++) {
+		if (!inspecs[k])
+			continue;
+		if (dsprender_parsesource(&src, inspecs[k])) {
+			error("can't make a signal from %s", inspecs[k]);
+			return 2;
+		}
+		inputs[k] = (double *)malloc(frames * sizeof(double) + 1);
+		dsprender_generate(&src, inputs[k], frames, sr);
+		free(src.data);
+	}
+	zero = (double *)calloc(vs, sizeof(double));
+
+	for (j = 0; j < repeats; j++) {
+		x = maxstub_newobject(gensym(cls->name), nargs, args);
+		if (!x) {
+			error("couldn't make %s", cls->name);
+			return 2;
+		}
+		for (k = 0; k < nmessages; k++)
+			dsprender_send(x, messages[k]);
+
+		nins = maxstub_siginlets(x);
+		nouts = maxstub_sigoutlets(x);
+		if (nins > DSPRENDER_MAXSIGNALS || nouts > DSPRENDER_MAXSIGNALS) {
+			error("%s has too many signal inlets or outlets", cls->name);
+			return 2;
+		}
+		for (k = 0; k < nins; k++)
+			count[k] = inputs[k] != NULL;
+		for (k = 0; k < nouts; k++)
+			count[nins + k] = 1;
+		if (maxstub_compile(x, count) != MAX_ERR_NONE) {
+			error("%s didn't add itself to the dsp chain", cls->name);
+			return 2;
+		}
+		is32 = maxstub_is32(x);
+		if (!outputs)
+			outputs = (double *)calloc(frames * (nouts ? nouts : 1) + 1, sizeof(double));
+		for (k = 0; k < nins; k++)
+			ins[k] = (double *)calloc(vs, sizeof(double));
+		for (k = 0; k < nouts; k++)
+			outs[k] = (double *)calloc(vs, sizeof(double));
+
+		// vectors are copied in and out around each perform as the dsp chain would, and that is timed too
+		maxstub_setdspstate(1);
+		fpstate = denorm_setftz(ftz);
+		before = maxstub_allocs;
+		elapsed = systimer_gettime();
+		for (pos = 0; pos < frames; pos += vs) {
+			n = MIN(vs, frames - pos);
+			for (k = 0; k < nins; k++)
+				memcpy(ins[k], inputs[k] ? inputs[k] + pos : zero, n * sizeof(double));
+			maxstub_perform(x, ins, outs, n);
+			for (k = 0; k < nouts; k++)
+				memcpy(outputs + k * frames + pos, outs[k], n * sizeof(double));
+		}
+		elapsed = (systimer_gettime() - elapsed) * 0.001;
+		allocs = maxstub_allocs - before;
+		denorm_restore(fpstate);
+		maxstub_setdspstate(0);
+		if (best < 0. || elapsed < best)
+			best = elapsed;
+
+		for (k = 0; k < nins; k++)
+			free(ins[k]);
+		for (k = 0; k < nouts; k++)
+			free(outs[k]);
+
+		// what the object's own scrubbing caught, before its counter goes
+		scrubbed = scrubbedbad = -1;
+		for (k = 0; s_denorm && k < s_denorm->count; k++) {
+			if (s_denorm->counters[k].owner == x) {
+				scrubbed = (long)s_denorm->counters[k].denormals;
+				scrubbedbad = (long)s_denorm->counters[k].nonfinite;
+			}
+		}
+		maxstub_freeobject(x);
+	}
+
+	blocks = (frames + vs - 1) / vs;
+	for (i = 0; i < frames * nouts; i++) {
+		int c = fpclassify(outputs[i]);
+
+		if (c == FP_SUBNORMAL || (is32 && c == FP_NORMAL && fabs(outputs[i]) < FLT_MIN))
+			denormals++;
+		else if (c == FP_NAN || c == FP_INFINITE)
+			nonfinite++;
+	}
+
+	printf("class: %s\n", cls->name);
+	printf("frames: %ld at %g Hz, vector size %ld, %ld signal inlets, %ld signal outlets\n", frames, sr, vs, nins, nouts);
+	printf("time: %.6f s%s\n", best, repeats > 1 ? " (fastest)" : "");
+	printf("speed: %.0f frames/s, %.1f x realtime\n", best > 0. ? frames / best : 0., best > 0. ? frames / sr / best : 0.);
+	printf("allocations: %lld in %ld blocks, %.3f per block\n", (long long)allocs, blocks, blocks ? (double)allocs / blocks : 0.);
+	printf("denormals: %ld of %ld output samples, %ld nan or inf\n", denormals, frames * nouts, nonfinite);
+	if (scrubbed >= 0)
+		printf("scrubbed: %ld denormals, %ld nan or inf%s\n", scrubbed, scrubbedbad, audit ? "" : " (-audit to count denormals)");
+
+	if (outpath && dsprender_writefile(outpath, outputs, frames, nouts, sr))
+		result = 2;
+	if (goldpath) {
+		long gframes = 0, gchans = nouts, worstframe = 0, worstchan = 0;
+		double gsr = sr, worst = 0., d, *gold = dsprender_readfile(goldpath, &gframes, &gchans, &gsr);
+
+		if (!gold)
+			return 2;
+		if (gframes != frames || gchans != nouts) {
+			printf("golden: %s has %ld frames of %ld channels, not %ld of %ld: fail\n", goldpath, gframes, gchans, frames, nouts);
+			result = 1;
+		}
+		else {
+			for (i = 0; i < frames; i++) {
+				for (k = 0; k < nouts; k++) {
+					d = fabs(outputs[k * frames + i] - gold[i * nouts + k]);
+					if (d != d)
+						d = HUGE_VAL;
+					if (d > worst) {
+						worst = d;
+						worstframe = i;
+						worstchan = k;
+					}
+				}
+			}
+			printf("golden: largest difference %g at frame %ld of outlet %ld: %s\n", worst, worstframe, worstchan, worst <= tol ? "pass" : "fail");
+			if (worst > tol)
+				result = 1;
+		}
+		free(gold);
+	}
+
+	for (k = 0; k < DSPRENDER_MAXSIGNALS; k++)
+		free(inputs[k]);
+	free(outputs);
+	free(zero);
+	return result;
+}
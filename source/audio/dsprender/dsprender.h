@@ -0,0 +1,46 @@
+/**
+	@file
+	dsprender.h - what the dsprender driver asks of the stand-in Max in maxstub.c
+
+	maxstub.c keeps the classes the built-in projects register, makes their
+	objects, sends them messages and compiles a one-object dsp chain the
+	driver can run as fast as it likes. It also counts every allocation the
+	objects make, so the driver can tell if one happens in a perform routine.
+*/
+
+#ifndef _DSPRENDER_H_
+#define _DSPRENDER_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+
+BEGIN_USING_C_LINKAGE
+
+// audio settings the objects see through sys_getsr() and friends
+void maxstub_setaudio(double sr, long vs);
+void maxstub_setdspstate(int on);
+
+// objects
+t_object *maxstub_newobject(t_symbol *classname, long argc, t_atom *argv);
+void maxstub_freeobject(t_object *x);
+long maxstub_siginlets(t_object *x);
+long maxstub_sigoutlets(t_object *x);
+t_max_err maxstub_message(t_object *x, long inlet, t_symbol *s, long argc, t_atom *argv);
+
+// the dsp chain: compile calls the object's dsp64 (or 32-bit dsp) method,
+// perform runs what it added for n frames, at most the vector size
+t_max_err maxstub_compile(t_object *x, short *count);
+void maxstub_perform(t_object *x, double **ins, double **outs, long n);
+void maxstub_release(t_object *x);
+long maxstub_is32(t_object *x);		// compiled into the 32-bit chain, so its samples were floats
+
+// buffer~s, copied from interleaved samples
+t_max_err maxstub_buffer_new(t_symbol *name, const float *samples, long frames, long nchans, double sr);
+
+// sysmem_newptr(), object_alloc(), getbytes() and C++ new all count here
+extern volatile t_int64 maxstub_allocs;
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_H_
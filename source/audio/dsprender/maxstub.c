@@ -0,0 +1,1642 @@
+/**
+	@file
+	maxstub.c - a stand-in for the Max application, for dsprender
+
+	Just enough of Max for a signal object to be made, sent messages,
+	compiled into a dsp chain and run: symbols, classes with their methods
+	and attributes, inlets and outlets, the 64-bit and 32-bit dsp chain,
+	named buffer~s and the registry the shared readers look sampstream~s up
+	in, and a t_linklist and files for the benches to measure against and
+	read. Messages to outlets are printed. Everything happens on one thread.
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_buffer.h"
+#include "ext_systhread.h"
+#include "ext_linklist.h"
+#include "ext_path.h"
+#include "commonsyms.h"
+#include "z_dsp.h"
+#include "dsprender.h"
+#include <stdarg.h>
+
+#ifdef WIN_VERSION
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define MAXSTUB_SYMBOLS		4096		// hash table size
+#define MAXSTUB_MAXARGS		4			// typed arguments a method may take
+#define MAXSTUB_MAXPERFORMS	8			// dsp_add64() calls one object may make
+#define MAXSTUB_MAXREGISTERED	256
+
+typedef struct _maxstub_method
+{
+	t_symbol	*name;
+	method		fn;
+	short		argc;
+	short		types[MAXSTUB_MAXARGS + 1];
+} t_maxstub_method;
+
+typedef struct _maxstub_attr
+{
+	t_object	ob;				// so object_method(attr, gensym("getname")) works
+	t_symbol	*name;
+	t_symbol	*alias;
+	t_symbol	*type;			// char long float32 float64 symbol
+	long		offset;
+	long		size;
+	method		get;
+	method		set;
+	char		clipmin;
+	char		clipmax;
+	double		min;
+	double		max;
+} t_maxstub_attr;
+
+struct maxclass
+{
+	t_symbol		*name;
+	method			mnew;
+	method			mfree;
+	long			size;
+	short			newargc;
+	short			newtypes[MAXSTUB_MAXARGS + 1];
+	t_maxstub_method	*methods;
+	long			nmethods;
+	t_maxstub_attr	**attrs;
+	long			nattrs;
+	char			dsp;
+	char			registered;
+	struct maxclass	*next;
+};
+
+typedef struct _maxstub_perform
+{
+	t_perfroutine64	perform64;
+	long			flags;
+	void			*userparam;
+	t_perfroutine	perform;		// the 32-bit chain
+	t_int			*w;
+} t_maxstub_perform;
+
+// what maxstub keeps for each object, hung off o_extra
+typedef struct _maxstub_objinfo
+{
+	long			inlet;			// inlet of the message being sent, for proxy_getinlet()
+	long			siginlets;
+	long			sigoutlets;
+	long			outlets;		// all outlets, signal or not
+	void			**outletlist;
+	t_maxstub_perform	performs[MAXSTUB_MAXPERFORMS];
+	long			nperforms;
+	t_signal		*signals;		// the 32-bit chain's vectors, inlets then outlets
+	t_signal		**sp;
+} t_maxstub_objinfo;
+
+typedef struct _maxstub_outlet
+{
+	t_object	*owner;
+	long		index;			// counted from the right, as outlet_new() makes them
+} t_maxstub_outlet;
+
+struct _buffer_ref
+{
+	t_object	ob;
+	t_symbol	*name;
+	t_object	*owner;
+};
+
+typedef struct _maxstub_buffer
+{
+	t_object	ob;
+	t_symbol	*name;
+	float		*samples;
+	long		frames;
+	long		nchans;
+	double		sr;
+	struct _maxstub_buffer	*next;
+} t_maxstub_buffer;
+
+typedef struct _maxstub_llelem
+{
+	void		*thing;
+	struct _maxstub_llelem	*prev;
+	struct _maxstub_llelem	*next;
+} t_maxstub_llelem;
+
+struct _linklist
+{
+	t_object	ob;
+	t_maxstub_llelem	*head;
+	t_maxstub_llelem	*tail;
+	t_atom_long	count;
+	long		flags;
+};
+
+typedef struct _maxstub_registered
+{
+	t_symbol	*name_space;
+	t_symbol	*name;
+	void		*x;
+} t_maxstub_registered;
+
+
+volatile t_int64 maxstub_allocs = 0;
+
+static t_symbol *s_symbols[MAXSTUB_SYMBOLS];
+static t_class *s_classes;
+static t_class *s_attr_class;
+static t_class *s_buffer_class;
+static t_class *s_buffer_ref_class;
+static t_class *s_chain_class;
+static t_class *s_linklist_class;
+static t_maxstub_buffer *s_buffers;
+static t_maxstub_registered s_registered[MAXSTUB_MAXREGISTERED];
+static long s_nregistered;
+static t_object *s_compiling;		// object whose dsp method is running, for dsp_add()
+static double s_sr = 44100.;
+static long s_vs = 64;
+static int s_dspstate;
+
+
+//***********************************************************************************************
+// symbols, atoms, memory and the console
+
+typedef struct _maxstub_symbol
+{
+	t_symbol	sym;
+	struct _maxstub_symbol	*next;
+} t_maxstub_symbol;
+
+t_symbol *gensym(const char *s)
+{
+	unsigned long h = 5381;
+	const unsigned char *p;
+	t_maxstub_symbol *e;
+
+	if (!s)
+		s = "";
+	for (p = (const unsigned char *)s; *p; p++)
+		h = h * 33 + *p;
+	h &= MAXSTUB_SYMBOLS - 1;
+	for (e = (t_maxstub_symbol *)s_symbols[h]; e; e = e->next) {
+		if (!strcmp(e->sym.s_name, s))
+			return &e->sym;
+	}
+	e = (t_maxstub_symbol *)calloc(1, sizeof(t_maxstub_symbol));
+	e->sym.s_name = strdup(s);
+	e->next = (t_maxstub_symbol *)s_symbols[h];
+	s_symbols[h] = &e->sym;
+	return &e->sym;
+}
+
+void common_symbols_init(void)
+{
+}
+
+t_max_err atom_setlong(t_atom *a, t_atom_long b)
+{
+	a->a_type = A_LONG;
+	a->a_w.w_long = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setfloat(t_atom *a, double b)
+{
+	a->a_type = A_FLOAT;
+	a->a_w.w_float = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setsym(t_atom *a, t_symbol *b)
+{
+	a->a_type = A_SYM;
+	a->a_w.w_sym = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setobj(t_atom *a, void *b)
+{
+	a->a_type = A_OBJ;
+	a->a_w.w_obj = (t_object *)b;
+	return MAX_ERR_NONE;
+}
+
+long atom_gettype(const t_atom *a)
+{
+	return a ? a->a_type : A_NOTHING;
+}
+
+t_atom_long atom_getlong(const t_atom *a)
+{
+	if (!a)
+		return 0;
+	if (a->a_type == A_LONG)
+		return a->a_w.w_long;
+	if (a->a_type == A_FLOAT)
+		return (t_atom_long)a->a_w.w_float;
+	return 0;
+}
+
+t_atom_float atom_getfloat(const t_atom *a)
+{
+	if (!a)
+		return 0.;
+	if (a->a_type == A_FLOAT)
+		return a->a_w.w_float;
+	if (a->a_type == A_LONG)
+		return (t_atom_float)a->a_w.w_long;
+	return 0.;
+}
+
+t_symbol *atom_getsym(const t_atom *a)
+{
+	return (a && a->a_type == A_SYM) ? a->a_w.w_sym : gensym("");
+}
+
+void *atom_getobj(const t_atom *a)
+{
+	return (a && a->a_type == A_OBJ) ? a->a_w.w_obj : NULL;
+}
+
+long atom_getcharfix(const t_atom *a)
+{
+	return CLAMP(atom_getlong(a), 0, 255);
+}
+
+t_atom_long atom_getlongarg(long which, long ac, const t_atom *av)
+{
+	return which < ac ? atom_getlong(av + which) : 0;
+}
+
+t_atom_float atom_getfloatarg(long which, long ac, const t_atom *av)
+{
+	return which < ac ? atom_getfloat(av + which) : 0.;
+}
+
+t_symbol *atom_getsymarg(long which, long ac, const t_atom *av)
+{
+	return which < ac ? atom_getsym(av + which) : gensym("");
+}
+
+t_max_err atom_arg_getlong(t_atom_long *c, long idx, long ac, const t_atom *av)
+{
+	if (idx >= ac || av[idx].a_type == A_SYM)
+		return MAX_ERR_GENERIC;
+	*c = atom_getlong(av + idx);
+	return MAX_ERR_NONE;
+}
+
+long atom_arg_getfloat(float *c, long idx, long ac, const t_atom *av)
+{
+	if (idx >= ac || av[idx].a_type == A_SYM)
+		return MAX_ERR_GENERIC;
+	*c = (float)atom_getfloat(av + idx);
+	return MAX_ERR_NONE;
+}
+
+long atom_arg_getdouble(double *c, long idx, long ac, const t_atom *av)
+{
+	if (idx >= ac || av[idx].a_type == A_SYM)
+		return MAX_ERR_GENERIC;
+	*c = atom_getfloat(av + idx);
+	return MAX_ERR_NONE;
+}
+
+long atom_arg_getsym(t_symbol **c, long idx, long ac, const t_atom *av)
+{
+	if (idx >= ac || av[idx].a_type != A_SYM)
+		return MAX_ERR_GENERIC;
+	*c = av[idx].a_w.w_sym;
+	return MAX_ERR_NONE;
+}
+
+t_ptr sysmem_newptr(long size)
+{
+	maxstub_allocs++;
+	return malloc(size > 0 ? size : 1);
+}
+
+t_ptr sysmem_newptrclear(long size)
+{
+	maxstub_allocs++;
+	return calloc(1, size > 0 ? size : 1);
+}
+
+t_ptr sysmem_resizeptr(void *ptr, long newsize)
+{
+	maxstub_allocs++;
+	return realloc(ptr, newsize > 0 ? newsize : 1);
+}
+
+t_ptr sysmem_resizeptrclear(void *ptr, long newsize)
+{
+	// there is no telling how big ptr was, so this clears nothing; none of the built-in projects need it to
+	return sysmem_resizeptr(ptr, newsize);
+}
+
+void sysmem_freeptr(void *ptr)
+{
+	free(ptr);
+}
+
+void sysmem_copyptr(const void *src, void *dst, long bytes)
+{
+	memmove(dst, src, bytes);
+}
+
+char *getbytes(t_ptr_uint size)
+{
+	return (char *)sysmem_newptr((long)size);
+}
+
+void freebytes(void *b, t_ptr_uint size)
+{
+	free(b);
+}
+
+static void maxstub_vpost(const char *prefix, const char *fmt, va_list ap)
+{
+	if (prefix)
+		fprintf(stderr, "%s: ", prefix);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+}
+
+void post(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	maxstub_vpost(NULL, fmt, ap);
+	va_end(ap);
+}
+
+void cpost(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+void error(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	maxstub_vpost("error", fmt, ap);
+	va_end(ap);
+}
+
+static const char *maxstub_name(t_object *x)
+{
+	return (x && x->o_class) ? x->o_class->name->s_name : "?";
+}
+
+void object_post(t_object *x, const char *s, ...)
+{
+	va_list ap;
+
+	va_start(ap, s);
+	maxstub_vpost(maxstub_name(x), s, ap);
+	va_end(ap);
+}
+
+void object_warn(t_object *x, const char *s, ...)
+{
+	va_list ap;
+
+	va_start(ap, s);
+	fprintf(stderr, "warning: ");
+	maxstub_vpost(maxstub_name(x), s, ap);
+	va_end(ap);
+}
+
+void object_error(t_object *x, const char *s, ...)
+{
+	va_list ap;
+
+	va_start(ap, s);
+	fprintf(stderr, "error: ");
+	maxstub_vpost(maxstub_name(x), s, ap);
+	va_end(ap);
+}
+
+char *snprintf_zero(char *buffer, size_t count, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(buffer, count, format, ap);
+	va_end(ap);
+	return buffer;
+}
+
+
+//***********************************************************************************************
+// time and audio settings
+
+double systimer_gettime(void)
+{
+#ifdef WIN_VERSION
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return now.QuadPart * 1000. / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000. + ts.tv_nsec * 1e-6;
+#endif
+}
+
+long gettime(void)
+{
+	return (long)systimer_gettime();
+}
+
+void systhread_sleep(long milliseconds)
+{
+#ifdef WIN_VERSION
+	Sleep(milliseconds);
+#else
+	usleep(milliseconds * 1000);
+#endif
+}
+
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags)
+{
+	*pmutex = sysmem_newptrclear(sizeof(long));
+	return *pmutex ? MAX_ERR_NONE : MAX_ERR_OUT_OF_MEM;
+}
+
+long systhread_mutex_free(t_systhread_mutex pmutex)
+{
+	assert(*(long *)pmutex == 0);		// freed while locked
+	sysmem_freeptr(pmutex);
+	return MAX_ERR_NONE;
+}
+
+long systhread_mutex_lock(t_systhread_mutex pmutex)
+{
+	assert(*(long *)pmutex == 0);		// there is no other thread to let it go
+	(*(long *)pmutex)++;
+	return MAX_ERR_NONE;
+}
+
+long systhread_mutex_unlock(t_systhread_mutex pmutex)
+{
+	assert(*(long *)pmutex == 1);
+	(*(long *)pmutex)--;
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// files
+
+short path_toabsolutesystempath(const short in_path, const char *in_filename, char *out_filename)
+{
+	if (strlen(in_filename) >= MAX_PATH_CHARS)
+		return MAX_ERR_GENERIC;
+	strcpy(out_filename, in_filename);
+	return MAX_ERR_NONE;
+}
+
+short path_opensysfile(const char *name, const short path, t_filehandle *ref, short perm)
+{
+	FILE *f = fopen(name, perm == READ_PERM ? "rb" : perm == WRITE_PERM ? "wb" : "r+b");
+
+	*ref = (t_filehandle)f;
+	return f ? MAX_ERR_NONE : MAX_ERR_GENERIC;
+}
+
+t_max_err sysfile_close(t_filehandle f)
+{
+	return fclose((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_read(t_filehandle f, t_ptr_size *count, void *bufptr)
+{
+	*count = fread(bufptr, 1, *count, (FILE *)f);
+	return ferror((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_write(t_filehandle f, t_ptr_size *count, const void *bufptr)
+{
+	*count = fwrite(bufptr, 1, *count, (FILE *)f);
+	return ferror((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_geteof(t_filehandle f, t_ptr_size *logeof)
+{
+	long at = ftell((FILE *)f);
+
+	if (at < 0 || fseek((FILE *)f, 0, SEEK_END))
+		return MAX_ERR_GENERIC;
+	*logeof = (t_ptr_size)ftell((FILE *)f);
+	fseek((FILE *)f, at, SEEK_SET);
+	return MAX_ERR_NONE;
+}
+
+t_max_err sysfile_setpos(t_filehandle f, t_sysfile_pos_mode mode, t_ptr_int offset)
+{
+	int whence = mode == SYSFILE_FROMSTART ? SEEK_SET : mode == SYSFILE_FROMLEOF ? SEEK_END : SEEK_CUR;
+
+	return fseek((FILE *)f, (long)offset, whence) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+void maxstub_setaudio(double sr, long vs)
+{
+	s_sr = sr;
+	s_vs = vs;
+}
+
+void maxstub_setdspstate(int on)
+{
+	s_dspstate = on;
+}
+
+double sys_getsr(void)
+{
+	return s_sr;
+}
+
+int sys_getblksize(void)
+{
+	return (int)s_vs;
+}
+
+int sys_getmaxblksize(void)
+{
+	return (int)s_vs;
+}
+
+int sys_getdspstate(void)
+{
+	return s_dspstate;
+}
+
+
+//***********************************************************************************************
+// classes and objects
+
+static void maxstub_gettypes(va_list ap, short *types, short *argc)
+{
+	short t;
+
+	*argc = 0;
+	while ((t = (short)va_arg(ap, int)) != A_NOTHING) {
+		if (*argc < MAXSTUB_MAXARGS)
+			types[(*argc)++] = t;
+	}
+	types[*argc] = A_NOTHING;
+}
+
+t_class *class_new(const char *name, const method mnew, const method mfree, long size, const method mmenu, short type, ...)
+{
+	t_class *c = (t_class *)calloc(1, sizeof(t_class));
+	va_list ap;
+
+	c->name = gensym(name);
+	c->mnew = mnew;
+	c->mfree = mfree;
+	c->size = size;
+	if (type != A_NOTHING) {
+		c->newtypes[0] = type;
+		va_start(ap, type);
+		maxstub_gettypes(ap, c->newtypes + 1, &c->newargc);
+		va_end(ap);
+		c->newargc++;
+	}
+	return c;
+}
+
+t_max_err class_addmethod(t_class *c, const method m, const char *name, ...)
+{
+	t_maxstub_method *e;
+	va_list ap;
+
+	c->methods = (t_maxstub_method *)realloc(c->methods, (c->nmethods + 1) * sizeof(t_maxstub_method));
+	e = c->methods + c->nmethods++;
+	e->name = gensym(name);
+	e->fn = m;
+	va_start(ap, name);
+	maxstub_gettypes(ap, e->types, &e->argc);
+	va_end(ap);
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_register(t_symbol *name_space, t_class *c)
+{
+	if (!c->registered) {
+		c->registered = 1;
+		c->next = s_classes;
+		s_classes = c;
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_setname(const char *obname, const char *filename)
+{
+	return MAX_ERR_NONE;
+}
+
+t_class *class_findbyname(t_symbol *name_space, const t_symbol *classname)
+{
+	t_class *c;
+
+	for (c = s_classes; c; c = c->next) {
+		if (c->name == classname)
+			return c;
+	}
+	return NULL;
+}
+
+void class_dspinit(t_class *c)
+{
+	c->dsp = 1;
+}
+
+static t_maxstub_method *maxstub_findmethod(t_class *c, t_symbol *s)
+{
+	long i;
+
+	for (i = 0; c && i < c->nmethods; i++) {
+		if (c->methods[i].name == s)
+			return c->methods + i;
+	}
+	return NULL;
+}
+
+void *object_alloc(t_class *c)
+{
+	t_object *x = (t_object *)calloc(1, c->size > (long)sizeof(t_object) ? c->size : sizeof(t_object));
+
+	maxstub_allocs++;
+	x->o_class = c;
+	x->o_magic = 1758379419;
+	x->o_extra = calloc(1, sizeof(t_maxstub_objinfo));
+	return x;
+}
+
+t_max_err object_free(void *x)
+{
+	t_object *o = (t_object *)x;
+
+	if (!o)
+		return MAX_ERR_INVALID_PTR;
+	if (o->o_class && o->o_class->mfree)
+		((void (*)(void *))o->o_class->mfree)(o);
+	if (o->o_extra) {
+		t_maxstub_objinfo *info = (t_maxstub_objinfo *)o->o_extra;
+
+		maxstub_release(o);
+		while (info->outlets)
+			free(info->outletlist[--info->outlets]);
+		free(info->outletlist);
+		free(info);
+	}
+	free(o);
+	return MAX_ERR_NONE;
+}
+
+t_symbol *object_classname(void *x)
+{
+	return ((t_object *)x)->o_class->name;
+}
+
+#define MAXSTUB_L(i)	atom_getlong(av + (i))
+#define MAXSTUB_F(i)	atom_getfloat(av + (i))
+#define MAXSTUB_S(i)	atom_getsym(av + (i))
+
+// call fn with the atoms converted to its typed arguments: one to MAXSTUB_MAXARGS of the same kind, or a single symbol.
+// self is NULL for a new method, which has no object argument. *result gets what fn returns.
+static t_max_err maxstub_calltyped(method fn, void *self, const short *types, short argc, t_symbol *s, long ac, t_atom *av, void **result)
+{
+	t_atom pad[MAXSTUB_MAXARGS];
+	short i, kind;
+	void *r = NULL;
+
+	if (argc == 0) {
+		r = self ? ((void *(*)(void *))fn)(self) : ((void *(*)(void))fn)();
+		goto done;
+	}
+	if (types[0] == A_GIMME) {
+		r = self ? ((void *(*)(void *, t_symbol *, long, t_atom *))fn)(self, s, ac, av)
+				 : ((void *(*)(t_symbol *, long, t_atom *))fn)(s, ac, av);
+		goto done;
+	}
+
+	// typed: pad missing A_DEF arguments with zeros
+	memset(pad, 0, sizeof(pad));
+	for (i = 0; i < argc; i++) {
+		if (i < ac)
+			pad[i] = av[i];
+		else if (types[i] == A_DEFSYM || types[i] == A_SYM)
+			atom_setsym(pad + i, gensym(""));
+		else
+			atom_setlong(pad + i, 0);
+	}
+	av = pad;
+	kind = (types[0] == A_DEFLONG) ? A_LONG : (types[0] == A_DEFFLOAT) ? A_FLOAT : (types[0] == A_DEFSYM) ? A_SYM : types[0];
+	for (i = 1; i < argc; i++) {
+		short k = (types[i] == A_DEFLONG) ? A_LONG : (types[i] == A_DEFFLOAT) ? A_FLOAT : (types[i] == A_DEFSYM) ? A_SYM : types[i];
+		if (k != kind)
+			return MAX_ERR_GENERIC;
+	}
+
+	if (kind == A_LONG) {
+		switch (argc) {
+		case 1: r = self ? ((void *(*)(void *, t_atom_long))fn)(self, MAXSTUB_L(0)) : ((void *(*)(t_atom_long))fn)(MAXSTUB_L(0)); break;
+		case 2: r = self ? ((void *(*)(void *, t_atom_long, t_atom_long))fn)(self, MAXSTUB_L(0), MAXSTUB_L(1)) : ((void *(*)(t_atom_long, t_atom_long))fn)(MAXSTUB_L(0), MAXSTUB_L(1)); break;
+		case 3: r = self ? ((void *(*)(void *, t_atom_long, t_atom_long, t_atom_long))fn)(self, MAXSTUB_L(0), MAXSTUB_L(1), MAXSTUB_L(2)) : ((void *(*)(t_atom_long, t_atom_long, t_atom_long))fn)(MAXSTUB_L(0), MAXSTUB_L(1), MAXSTUB_L(2)); break;
+		default: r = self ? ((void *(*)(void *, t_atom_long, t_atom_long, t_atom_long, t_atom_long))fn)(self, MAXSTUB_L(0), MAXSTUB_L(1), MAXSTUB_L(2), MAXSTUB_L(3)) : ((void *(*)(t_atom_long, t_atom_long, t_atom_long, t_atom_long))fn)(MAXSTUB_L(0), MAXSTUB_L(1), MAXSTUB_L(2), MAXSTUB_L(3)); break;
+		}
+	}
+	else if (kind == A_FLOAT) {
+		switch (argc) {
+		case 1: r = self ? ((void *(*)(void *, double))fn)(self, MAXSTUB_F(0)) : ((void *(*)(double))fn)(MAXSTUB_F(0)); break;
+		case 2: r = self ? ((void *(*)(void *, double, double))fn)(self, MAXSTUB_F(0), MAXSTUB_F(1)) : ((void *(*)(double, double))fn)(MAXSTUB_F(0), MAXSTUB_F(1)); break;
+		case 3: r = self ? ((void *(*)(void *, double, double, double))fn)(self, MAXSTUB_F(0), MAXSTUB_F(1), MAXSTUB_F(2)) : ((void *(*)(double, double, double))fn)(MAXSTUB_F(0), MAXSTUB_F(1), MAXSTUB_F(2)); break;
+		default: r = self ? ((void *(*)(void *, double, double, double, double))fn)(self, MAXSTUB_F(0), MAXSTUB_F(1), MAXSTUB_F(2), MAXSTUB_F(3)) : ((void *(*)(double, double, double, double))fn)(MAXSTUB_F(0), MAXSTUB_F(1), MAXSTUB_F(2), MAXSTUB_F(3)); break;
+		}
+	}
+	else if (kind == A_SYM && argc == 1)
+		r = self ? ((void *(*)(void *, t_symbol *))fn)(self, MAXSTUB_S(0)) : ((void *(*)(t_symbol *))fn)(MAXSTUB_S(0));
+	else
+		return MAX_ERR_GENERIC;
+done:
+	if (result)
+		*result = r;
+	return MAX_ERR_NONE;
+}
+
+void *object_method(void *x, t_symbol *s, ...)
+{
+	t_object *o = (t_object *)x;
+	t_maxstub_method *m;
+	void *a[4];
+	va_list ap;
+	int i;
+
+	if (!o || !o->o_class)
+		return NULL;
+	va_start(ap, s);
+	if (o->o_class == s_chain_class && s == gensym("dsp_add64")) {
+		t_object *obj = va_arg(ap, t_object *);
+		t_perfroutine64 f = va_arg(ap, t_perfroutine64);
+		long flags = va_arg(ap, long);
+		void *userparam = va_arg(ap, void *);
+
+		va_end(ap);
+		dsp_add64(o, obj, f, flags, userparam);
+		return NULL;
+	}
+	m = maxstub_findmethod(o->o_class, s);
+	if (!m) {
+		va_end(ap);
+		return NULL;
+	}
+	// A_CANT methods get up to four pointer sized arguments, as object_method() gives them in Max
+	for (i = 0; i < 4; i++)
+		a[i] = va_arg(ap, void *);
+	va_end(ap);
+	return ((void *(*)(void *, void *, void *, void *, void *))m->fn)(o, a[0], a[1], a[2], a[3]);
+}
+
+void *object_new(t_symbol *name_space, t_symbol *classname, ...)
+{
+	return NULL;
+}
+
+void *object_new_typed(t_symbol *name_space, t_symbol *classname, long ac, t_atom *av)
+{
+	return maxstub_newobject(classname, ac, av);
+}
+
+t_object *maxstub_newobject(t_symbol *classname, long argc, t_atom *argv)
+{
+	t_class *c = class_findbyname(CLASS_BOX, classname);
+	void *x = NULL;
+
+	if (!c || !c->mnew)
+		return NULL;
+	if (maxstub_calltyped(c->mnew, NULL, c->newtypes, c->newargc, classname, argc, argv, &x) != MAX_ERR_NONE) {
+		error("%s: can't call a new method with these argument types", classname->s_name);
+		return NULL;
+	}
+	return (t_object *)x;
+}
+
+void maxstub_freeobject(t_object *x)
+{
+	object_free(x);
+}
+
+long maxstub_siginlets(t_object *x)
+{
+	return ((t_maxstub_objinfo *)x->o_extra)->siginlets;
+}
+
+long maxstub_sigoutlets(t_object *x)
+{
+	return ((t_maxstub_objinfo *)x->o_extra)->sigoutlets;
+}
+
+// int, float and list as the inlets of a Max object would take them
+t_max_err maxstub_message(t_object *x, long inlet, t_symbol *s, long argc, t_atom *argv)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)x->o_extra;
+	t_maxstub_method *m;
+	t_max_err err;
+
+	info->inlet = inlet;
+	m = maxstub_findmethod(x->o_class, s);
+	if (!m && s == gensym("int"))			// an int to an object with only a float method
+		m = maxstub_findmethod(x->o_class, gensym("float"));
+	if (!m && s == gensym("float"))
+		m = maxstub_findmethod(x->o_class, gensym("int"));
+	if (!m && argc && s->s_name[0] != '@' && object_attr_setvalueof(x, s, argc, argv) == MAX_ERR_NONE) {
+		info->inlet = 0;
+		return MAX_ERR_NONE;
+	}
+	if (!m && s == gensym("list") && argc)	// a list's first atom to the left inlet
+		return maxstub_message(x, inlet, argv[0].a_type == A_FLOAT ? gensym("float") : gensym("int"), 1, argv);
+	if (!m || (m->argc && m->types[0] == A_CANT)) {
+		object_error(x, "doesn't understand \"%s\"", s->s_name);
+		info->inlet = 0;
+		return MAX_ERR_GENERIC;
+	}
+	err = maxstub_calltyped(m->fn, x, m->types, m->argc, s, argc, argv, NULL);
+	if (err)
+		object_error(x, "can't send \"%s\" with these argument types", s->s_name);
+	info->inlet = 0;
+	return err;
+}
+
+
+//***********************************************************************************************
+// attributes
+
+static t_maxstub_attr *maxstub_findattr(t_class *c, t_symbol *s)
+{
+	long i;
+
+	for (i = 0; c && i < c->nattrs; i++) {
+		if (c->attrs[i]->name == s || c->attrs[i]->alias == s)
+			return c->attrs[i];
+	}
+	return NULL;
+}
+
+static t_symbol *maxstub_attr_getname(t_maxstub_attr *a)
+{
+	return a->name;
+}
+
+t_max_err class_addattr_offset(t_class *c, const char *name, const char *type, long flags, long offset, long size)
+{
+	t_maxstub_attr *a;
+
+	if (!s_attr_class) {
+		s_attr_class = class_new("attr_offset", NULL, NULL, sizeof(t_maxstub_attr), NULL, 0);
+		class_addmethod(s_attr_class, (method)maxstub_attr_getname, "getname", A_CANT, 0);
+	}
+	a = (t_maxstub_attr *)calloc(1, sizeof(t_maxstub_attr));
+	a->ob.o_class = s_attr_class;
+	a->name = gensym(name);
+	a->type = gensym(type);
+	a->offset = offset;
+	a->size = size;
+	c->attrs = (t_maxstub_attr **)realloc(c->attrs, (c->nattrs + 1) * sizeof(t_maxstub_attr *));
+	c->attrs[c->nattrs++] = a;
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_attr_setaccessors(t_class *c, const char *name, method get, method set)
+{
+	t_maxstub_attr *a = maxstub_findattr(c, gensym(name));
+
+	if (!a)
+		return MAX_ERR_GENERIC;
+	a->get = get;
+	a->set = set;
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_attr_setfilter(t_class *c, const char *name, long clipmin, double min, long clipmax, double max)
+{
+	t_maxstub_attr *a = maxstub_findattr(c, gensym(name));
+
+	if (!a)
+		return MAX_ERR_GENERIC;
+	if (clipmin) {
+		a->clipmin = 1;
+		a->min = min;
+	}
+	if (clipmax) {
+		a->clipmax = 1;
+		a->max = max;
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_attr_setalias(t_class *c, const char *name, const char *alias)
+{
+	t_maxstub_attr *a = maxstub_findattr(c, gensym(name));
+
+	if (!a)
+		return MAX_ERR_GENERIC;
+	a->alias = gensym(alias);
+	return MAX_ERR_NONE;
+}
+
+long attr_args_offset(short ac, t_atom *av)
+{
+	long i;
+
+	for (i = 0; i < ac; i++) {
+		if (av[i].a_type == A_SYM && av[i].a_w.w_sym->s_name[0] == '@')
+			return i;
+	}
+	return ac;
+}
+
+void attr_args_process(void *x, short ac, t_atom *av)
+{
+	long i = attr_args_offset(ac, av), j;
+
+	while (i < ac) {
+		for (j = i + 1; j < ac; j++) {
+			if (av[j].a_type == A_SYM && av[j].a_w.w_sym->s_name[0] == '@')
+				break;
+		}
+		if (object_attr_setvalueof(x, gensym(av[i].a_w.w_sym->s_name + 1), j - i - 1, av + i + 1) != MAX_ERR_NONE)
+			object_error((t_object *)x, "no attribute %s", av[i].a_w.w_sym->s_name + 1);
+		i = j;
+	}
+}
+
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv)
+{
+	t_maxstub_attr *a = maxstub_findattr(((t_object *)x)->o_class, s);
+	char *p;
+	t_atom v;
+	double f;
+
+	if (!a || argc < 1)
+		return MAX_ERR_GENERIC;
+	v = argv[0];
+	if (v.a_type != A_SYM && (a->clipmin || a->clipmax)) {
+		f = atom_getfloat(&v);
+		if (a->clipmin && f < a->min)
+			f = a->min;
+		if (a->clipmax && f > a->max)
+			f = a->max;
+		if (v.a_type == A_LONG)
+			atom_setlong(&v, (t_atom_long)f);
+		else
+			atom_setfloat(&v, f);
+	}
+	if (a->set)	// a list (a varsize attribute) goes to the setter as it is
+		return ((t_max_err (*)(void *, void *, long, t_atom *))a->set)(x, a, argc > 1 ? argc : 1, argc > 1 ? argv : &v);
+
+	p = (char *)x + a->offset;
+	if (a->type == gensym("char"))
+		*(char *)p = (char)atom_getlong(&v);
+	else if (a->type == gensym("long")) {
+		if (a->size == sizeof(t_int32))
+			*(t_int32 *)p = (t_int32)atom_getlong(&v);
+		else
+			*(t_int64 *)p = atom_getlong(&v);
+	}
+	else if (a->type == gensym("float32"))
+		*(float *)p = (float)atom_getfloat(&v);
+	else if (a->type == gensym("float64"))
+		*(double *)p = atom_getfloat(&v);
+	else if (a->type == gensym("symbol"))
+		*(t_symbol **)p = atom_getsym(&v);
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_attr_getvalueof(void *x, t_symbol *s, long *argc, t_atom **argv)
+{
+	t_maxstub_attr *a = maxstub_findattr(((t_object *)x)->o_class, s);
+	char *p;
+
+	if (!a)
+		return MAX_ERR_GENERIC;
+	if (a->get)
+		return ((t_max_err (*)(void *, void *, long *, t_atom **))a->get)(x, a, argc, argv);
+	if (!*argc || !*argv) {
+		*argc = 1;
+		*argv = (t_atom *)sysmem_newptr(sizeof(t_atom));
+	}
+	p = (char *)x + a->offset;
+	if (a->type == gensym("char"))
+		atom_setlong(*argv, *(char *)p);
+	else if (a->type == gensym("long"))
+		atom_setlong(*argv, a->size == sizeof(t_int32) ? *(t_int32 *)p : *(t_int64 *)p);
+	else if (a->type == gensym("float32"))
+		atom_setfloat(*argv, *(float *)p);
+	else if (a->type == gensym("float64"))
+		atom_setfloat(*argv, *(double *)p);
+	else
+		atom_setsym(*argv, *(t_symbol **)p);
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_attr_touch(t_object *x, t_symbol *attrname)
+{
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// registration; nothing is ever notified, since nothing changes while dsprender runs
+
+void *object_register(t_symbol *name_space, t_symbol *s, void *x)
+{
+	if (s_nregistered >= MAXSTUB_MAXREGISTERED || object_findregistered(name_space, s))
+		return NULL;
+	s_registered[s_nregistered].name_space = name_space;
+	s_registered[s_nregistered].name = s;
+	s_registered[s_nregistered].x = x;
+	s_nregistered++;
+	return x;
+}
+
+t_max_err object_unregister(void *x)
+{
+	long i;
+
+	for (i = 0; i < s_nregistered; i++) {
+		if (s_registered[i].x == x) {
+			s_registered[i] = s_registered[--s_nregistered];
+			return MAX_ERR_NONE;
+		}
+	}
+	return MAX_ERR_GENERIC;
+}
+
+void *object_findregistered(t_symbol *name_space, t_symbol *s)
+{
+	long i;
+
+	for (i = 0; i < s_nregistered; i++) {
+		if (s_registered[i].name_space == name_space && s_registered[i].name == s)
+			return s_registered[i].x;
+	}
+	return NULL;
+}
+
+void *object_subscribe(t_symbol *name_space, t_symbol *s, t_symbol *classname, void *x)
+{
+	return NULL;
+}
+
+t_max_err object_unsubscribe(t_symbol *name_space, t_symbol *s, t_symbol *classname, void *x)
+{
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_attach(t_symbol *name_space, t_symbol *s, void *x)
+{
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_detach(t_symbol *name_space, t_symbol *s, void *x)
+{
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_notify(void *x, t_symbol *s, void *data)
+{
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// inlets, outlets and the scheduler
+
+void *outlet_new(void *x, const char *s)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)((t_object *)x)->o_extra;
+	t_maxstub_outlet *o = (t_maxstub_outlet *)calloc(1, sizeof(t_maxstub_outlet));
+
+	o->owner = (t_object *)x;
+	o->index = info->outlets;
+	info->outletlist = (void **)realloc(info->outletlist, (info->outlets + 1) * sizeof(void *));
+	info->outletlist[info->outlets++] = o;
+	if (s && !strcmp(s, "signal"))
+		info->sigoutlets++;
+	return o;
+}
+
+static void maxstub_outlet_post(void *o, const char *sel, short ac, const t_atom *av)
+{
+	t_maxstub_outlet *out = (t_maxstub_outlet *)o;
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)out->owner->o_extra;
+	short i;
+
+	printf("%s outlet %ld: %s", maxstub_name(out->owner), info->outlets - 1 - out->index, sel);
+	for (i = 0; i < ac; i++) {
+		if (av[i].a_type == A_LONG)
+			printf(" %lld", (long long)av[i].a_w.w_long);
+		else if (av[i].a_type == A_FLOAT)
+			printf(" %g", av[i].a_w.w_float);
+		else if (av[i].a_type == A_SYM)
+			printf(" %s", av[i].a_w.w_sym->s_name);
+	}
+	printf("\n");
+}
+
+void *outlet_bang(void *o)
+{
+	maxstub_outlet_post(o, "bang", 0, NULL);
+	return NULL;
+}
+
+void *outlet_int(void *o, t_atom_long n)
+{
+	t_atom a;
+
+	atom_setlong(&a, n);
+	maxstub_outlet_post(o, "int", 1, &a);
+	return NULL;
+}
+
+void *outlet_float(void *o, double f)
+{
+	t_atom a;
+
+	atom_setfloat(&a, f);
+	maxstub_outlet_post(o, "float", 1, &a);
+	return NULL;
+}
+
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av)
+{
+	maxstub_outlet_post(o, "list", ac, av);
+	return NULL;
+}
+
+void *outlet_anything(void *o, const t_symbol *s, short ac, const t_atom *av)
+{
+	maxstub_outlet_post(o, s->s_name, ac, av);
+	return NULL;
+}
+
+void *proxy_new(void *x, long id, long *stuffloc)
+{
+	return x;
+}
+
+long proxy_getinlet(t_object *master)
+{
+	return master->o_extra ? ((t_maxstub_objinfo *)master->o_extra)->inlet : 0;
+}
+
+void *intin(void *x, short n)
+{
+	return x;
+}
+
+void *floatin(void *x, short n)
+{
+	return x;
+}
+
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv)
+{
+	((void (*)(void *, t_symbol *, long, t_atom *))fn)(ob, sym, argc, argv);
+	return NULL;
+}
+
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv)
+{
+	return defer(ob, fn, sym, argc, argv);
+}
+
+
+//***********************************************************************************************
+// the dsp chain
+
+void dsp_setup(t_pxobject *x, long nsignals)
+{
+	((t_maxstub_objinfo *)x->z_ob.o_extra)->siginlets = nsignals;
+	x->z_in = nsignals;
+}
+
+void z_dsp_setup(t_pxobject *x, long nsignals)
+{
+	dsp_setup(x, nsignals);
+}
+
+void dsp_resize(t_pxobject *x, long nsignals)
+{
+	dsp_setup(x, nsignals);
+}
+
+void dsp_free(t_pxobject *x)
+{
+}
+
+void z_dsp_free(t_pxobject *x)
+{
+}
+
+void dsp_add64(t_object *chain, t_object *x, t_perfroutine64 f, long flags, void *userparam)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)x->o_extra;
+	t_maxstub_perform *p;
+
+	if (info->nperforms >= MAXSTUB_MAXPERFORMS)
+		return;
+	p = info->performs + info->nperforms++;
+	p->perform64 = f;
+	p->flags = flags;
+	p->userparam = userparam;
+}
+
+void dsp_addv(t_perfroutine f, int n, void **vector)
+{
+	t_maxstub_objinfo *info;
+	t_maxstub_perform *p;
+
+	if (!s_compiling)
+		return;
+	info = (t_maxstub_objinfo *)s_compiling->o_extra;
+	if (info->nperforms >= MAXSTUB_MAXPERFORMS)
+		return;
+	p = info->performs + info->nperforms++;
+	p->perform = f;
+	p->w = (t_int *)calloc(n + 1, sizeof(t_int));
+	p->w[0] = (t_int)f;
+	memcpy(p->w + 1, vector, n * sizeof(t_int));
+}
+
+void dsp_add(t_perfroutine f, int n, ...)
+{
+	void *args[64];
+	va_list ap;
+	int i;
+
+	va_start(ap, n);
+	for (i = 0; i < n && i < 64; i++)
+		args[i] = va_arg(ap, void *);
+	va_end(ap);
+	dsp_addv(f, i, args);
+}
+
+void maxstub_release(t_object *x)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)x->o_extra;
+	long i;
+
+	for (i = 0; i < info->nperforms; i++)
+		free(info->performs[i].w);
+	info->nperforms = 0;
+	if (info->signals) {
+		for (i = 0; i < info->siginlets + info->sigoutlets; i++)
+			free(info->signals[i].s_vec);
+		free(info->signals);
+		free(info->sp);
+		info->signals = NULL;
+		info->sp = NULL;
+	}
+}
+
+t_max_err maxstub_compile(t_object *x, short *count)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)x->o_extra;
+	t_maxstub_method *m;
+	long i, nsigs = info->siginlets + info->sigoutlets;
+
+	if (!s_chain_class)
+		s_chain_class = class_new("dspchain", NULL, NULL, sizeof(t_object), NULL, 0);
+	maxstub_release(x);
+
+	if ((m = maxstub_findmethod(x->o_class, gensym("dsp64")))) {
+		t_object chain;
+
+		memset(&chain, 0, sizeof(chain));
+		chain.o_class = s_chain_class;
+		((void (*)(t_object *, t_object *, short *, double, long, long))m->fn)(x, &chain, count, s_sr, s_vs, 0);
+	}
+	else if ((m = maxstub_findmethod(x->o_class, gensym("dsp")))) {
+		info->signals = (t_signal *)calloc(nsigs, sizeof(t_signal));
+		info->sp = (t_signal **)calloc(nsigs, sizeof(t_signal *));
+		for (i = 0; i < nsigs; i++) {
+			info->signals[i].s_n = s_vs;
+			info->signals[i].s_sr = s_sr;
+			info->signals[i].s_vec = (t_sample *)calloc(s_vs, sizeof(float));	// 32-bit MSP, whatever t_sample is here
+			info->sp[i] = info->signals + i;
+		}
+		s_compiling = x;
+		((void (*)(t_object *, t_signal **, short *))m->fn)(x, info->sp, count);
+		s_compiling = NULL;
+	}
+	else
+		return MAX_ERR_GENERIC;
+	return info->nperforms ? MAX_ERR_NONE : MAX_ERR_GENERIC;
+}
+
+long maxstub_is32(t_object *x)
+{
+	return ((t_maxstub_objinfo *)x->o_extra)->signals != NULL;
+}
+
+void maxstub_perform(t_object *x, double **ins, double **outs, long n)
+{
+	t_maxstub_objinfo *info = (t_maxstub_objinfo *)x->o_extra;
+	t_maxstub_perform *p;
+	long i, j;
+
+	for (i = 0; i < info->nperforms; i++) {
+		p = info->performs + i;
+		if (p->perform64) {
+			p->perform64(x, NULL, ins, info->siginlets, outs, info->sigoutlets, n, p->flags, p->userparam);
+			continue;
+		}
+		// the 32-bit chain always runs whole vectors: the tail of a short one is silence in and ignored out
+		for (j = 0; j < info->siginlets; j++) {
+			float *v = (float *)info->signals[j].s_vec;
+			long k;
+
+			for (k = 0; k < n; k++)
+				v[k] = (float)ins[j][k];
+			for (; k < s_vs; k++)
+				v[k] = 0;
+		}
+		p->perform(p->w);
+		for (j = 0; j < info->sigoutlets; j++) {
+			float *v = (float *)info->signals[info->siginlets + j].s_vec;
+			long k;
+
+			for (k = 0; k < n; k++)
+				outs[j][k] = v[k];
+		}
+	}
+}
+
+
+//***********************************************************************************************
+// buffer~
+
+static t_maxstub_buffer *maxstub_findbuffer(t_symbol *name)
+{
+	t_maxstub_buffer *b;
+
+	for (b = s_buffers; b; b = b->next) {
+		if (b->name == name)
+			return b;
+	}
+	return NULL;
+}
+
+t_max_err maxstub_buffer_new(t_symbol *name, const float *samples, long frames, long nchans, double sr)
+{
+	t_maxstub_buffer *b;
+
+	if (maxstub_findbuffer(name) || frames < 1 || nchans < 1)
+		return MAX_ERR_GENERIC;
+	if (!s_buffer_class)
+		s_buffer_class = class_new("buffer~", NULL, NULL, sizeof(t_maxstub_buffer), NULL, 0);
+	b = (t_maxstub_buffer *)calloc(1, sizeof(t_maxstub_buffer));
+	b->ob.o_class = s_buffer_class;
+	b->name = name;
+	b->samples = (float *)malloc(frames * nchans * sizeof(float));
+	memcpy(b->samples, samples, frames * nchans * sizeof(float));
+	b->frames = frames;
+	b->nchans = nchans;
+	b->sr = sr;
+	b->next = s_buffers;
+	s_buffers = b;
+	return MAX_ERR_NONE;
+}
+
+t_buffer_ref *buffer_ref_new(t_object *self, t_symbol *name)
+{
+	t_buffer_ref *r;
+
+	if (!s_buffer_ref_class)
+		s_buffer_ref_class = class_new("buffer_ref", NULL, NULL, sizeof(t_buffer_ref), NULL, 0);
+	r = (t_buffer_ref *)object_alloc(s_buffer_ref_class);
+	r->name = name;
+	r->owner = self;
+	return r;
+}
+
+void buffer_ref_set(t_buffer_ref *x, t_symbol *name)
+{
+	x->name = name;
+}
+
+t_atom_long buffer_ref_exists(t_buffer_ref *x)
+{
+	return x && maxstub_findbuffer(x->name) != NULL;
+}
+
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *x)
+{
+	return x ? (t_buffer_obj *)maxstub_findbuffer(x->name) : NULL;
+}
+
+t_max_err buffer_ref_notify(t_buffer_ref *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
+{
+	return MAX_ERR_NONE;
+}
+
+float *buffer_locksamples(t_buffer_obj *buffer_object)
+{
+	return buffer_object ? ((t_maxstub_buffer *)buffer_object)->samples : NULL;
+}
+
+void buffer_unlocksamples(t_buffer_obj *buffer_object)
+{
+}
+
+t_atom_long buffer_getchannelcount(t_buffer_obj *buffer_object)
+{
+	return buffer_object ? ((t_maxstub_buffer *)buffer_object)->nchans : 0;
+}
+
+t_atom_long buffer_getframecount(t_buffer_obj *buffer_object)
+{
+	return buffer_object ? ((t_maxstub_buffer *)buffer_object)->frames : 0;
+}
+
+t_atom_float buffer_getsamplerate(t_buffer_obj *buffer_object)
+{
+	return buffer_object ? ((t_maxstub_buffer *)buffer_object)->sr : s_sr;
+}
+
+t_max_err buffer_setdirty(t_buffer_obj *buffer_object)
+{
+	return MAX_ERR_NONE;
+}
+
+t_max_err buffer_view(t_buffer_obj *buffer_object)
+{
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// t_linklist
+
+static void maxstub_linklist_free(t_linklist *x)
+{
+	linklist_clear(x);
+}
+
+t_linklist *linklist_new(void)
+{
+	if (!s_linklist_class)
+		s_linklist_class = class_new("linklist", NULL, (method)maxstub_linklist_free, sizeof(t_linklist), NULL, 0);
+	return (t_linklist *)object_alloc(s_linklist_class);
+}
+
+void linklist_flags(t_linklist *x, long flags)
+{
+	x->flags = flags;
+}
+
+t_atom_long linklist_getsize(t_linklist *x)
+{
+	return x->count;
+}
+
+static t_maxstub_llelem *maxstub_linklist_elem(t_linklist *x, long index)
+{
+	t_maxstub_llelem *e;
+	long i;
+
+	if (index < 0 || index >= x->count)
+		return NULL;
+	if (index < x->count / 2) {
+		for (e = x->head, i = 0; i < index; i++)
+			e = e->next;
+	}
+	else {
+		for (e = x->tail, i = (long)x->count - 1; i > index; i--)
+			e = e->prev;
+	}
+	return e;
+}
+
+void *linklist_getindex(t_linklist *x, long index)
+{
+	t_maxstub_llelem *e = maxstub_linklist_elem(x, index);
+
+	return e ? e->thing : NULL;
+}
+
+t_atom_long linklist_insertindex(t_linklist *x, void *o, long index)
+{
+	t_maxstub_llelem *e = (t_maxstub_llelem *)sysmem_newptr(sizeof(t_maxstub_llelem));
+	t_maxstub_llelem *at = index < 0 || index >= x->count ? NULL : maxstub_linklist_elem(x, index);
+
+	e->thing = o;
+	e->next = at;
+	e->prev = at ? at->prev : x->tail;
+	if (e->prev)
+		e->prev->next = e;
+	else
+		x->head = e;
+	if (at)
+		at->prev = e;
+	else
+		x->tail = e;
+	return x->count++;
+}
+
+t_atom_long linklist_append(t_linklist *x, void *o)
+{
+	return linklist_insertindex(x, o, -1);
+}
+
+long linklist_chuckindex(t_linklist *x, long index)
+{
+	t_maxstub_llelem *e = maxstub_linklist_elem(x, index);
+
+	if (!e)
+		return MAX_ERR_GENERIC;
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		x->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		x->tail = e->prev;
+	x->count--;
+	sysmem_freeptr(e);
+	return MAX_ERR_NONE;
+}
+
+static void maxstub_linklist_freething(t_linklist *x, void *o)
+{
+	if (!o || (x->flags & (OBJ_FLAG_REF | OBJ_FLAG_DATA)))
+		return;
+	if (x->flags & OBJ_FLAG_MEMORY)
+		sysmem_freeptr(o);
+	else
+		object_free(o);
+}
+
+t_atom_long linklist_deleteindex(t_linklist *x, long index)
+{
+	void *o = linklist_getindex(x, index);
+
+	if (linklist_chuckindex(x, index))
+		return -1;
+	maxstub_linklist_freething(x, o);
+	return index;
+}
+
+void linklist_chuck(t_linklist *x)
+{
+	while (x->count)
+		linklist_chuckindex(x, 0);
+}
+
+void linklist_clear(t_linklist *x)
+{
+	while (x->count)
+		linklist_deleteindex(x, 0);
+}
+
+void linklist_reverse(t_linklist *x)
+{
+	t_maxstub_llelem *e = x->head, *t;
+
+	x->head = x->tail;
+	x->tail = e;
+	while (e) {
+		t = e->next;
+		e->next = e->prev;
+		e->prev = t;
+		e = t;
+	}
+}
+
+void linklist_funall(t_linklist *x, method fun, void *arg)
+{
+	t_maxstub_llelem *e;
+
+	for (e = x->head; e; e = e->next)
+		fun(e->thing, arg);
+}
@@ -0,0 +1,17 @@
+/**
+	@file
+	commonsyms.h - common_symbols_init(), for the projects that call it
+*/
+
+#ifndef _DSPRENDER_COMMONSYMS_H_
+#define _DSPRENDER_COMMONSYMS_H_
+
+#include "ext.h"
+
+BEGIN_USING_C_LINKAGE
+
+void common_symbols_init(void);
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_COMMONSYMS_H_
@@ -0,0 +1,230 @@
+/**
+	@file
+	ext.h - the part of the Max API that dsprender stands in for
+
+	These headers take the place of the max-sdk-base ones when the perform
+	routines of the examples are built into dsprender. They declare just
+	what those examples use, with the same names and signatures, and
+	maxstub.c implements it without the Max application behind it.
+*/
+
+#ifndef _DSPRENDER_EXT_H_
+#define _DSPRENDER_EXT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#define BEGIN_USING_C_LINKAGE	extern "C" {
+#define END_USING_C_LINKAGE		}
+#else
+#define BEGIN_USING_C_LINKAGE
+#define END_USING_C_LINKAGE
+#endif
+
+#ifdef _WIN32
+#define WIN_VERSION 1
+#define C74_EXPORT __declspec(dllexport)
+#else
+#ifdef __APPLE__
+#define MAC_VERSION 1
+#endif
+#define C74_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifndef MIN
+#define MIN(a,b)	((a)<(b)?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b)	((a)>(b)?(a):(b))
+#endif
+#define CLAMP(a, lo, hi)	((a)>(lo)?((a)<(hi)?(a):(hi)):(lo))
+
+#ifndef PI
+#define PI		3.14159265358979323846
+#endif
+#ifndef TWOPI
+#define TWOPI	6.28318530717958647692
+#endif
+#ifndef PIOVERTWO
+#define PIOVERTWO	1.57079632679489661923
+#endif
+
+BEGIN_USING_C_LINKAGE
+
+typedef int8_t		t_int8;
+typedef uint8_t		t_uint8;
+typedef int16_t		t_int16;
+typedef uint16_t	t_uint16;
+typedef int32_t		t_int32;
+typedef uint32_t	t_uint32;
+typedef int64_t		t_int64;
+typedef uint64_t	t_uint64;
+typedef intptr_t	t_ptr_int;
+typedef uintptr_t	t_ptr_uint;
+typedef uintptr_t	t_ptr_size;
+typedef intptr_t	t_int;
+typedef uintptr_t	t_uint;
+typedef intptr_t	t_atom_long;
+typedef double		t_atom_float;
+typedef long		t_max_err;
+typedef unsigned char	t_bool;
+typedef void		*t_ptr;
+typedef char		*t_handle;
+typedef void *(*method)(void *, ...);
+typedef long		t_filepath;
+
+enum {
+	MAX_ERR_NONE = 0,
+	MAX_ERR_GENERIC = -1,
+	MAX_ERR_INVALID_PTR = -2,
+	MAX_ERR_DUPLICATE = -3,
+	MAX_ERR_OUT_OF_MEM = -4
+};
+
+typedef enum {
+	A_NOTHING = 0,
+	A_LONG,
+	A_FLOAT,
+	A_SYM,
+	A_OBJ,
+	A_DEFLONG,
+	A_DEFFLOAT,
+	A_DEFSYM,
+	A_GIMME,
+	A_CANT,
+	A_SEMI,
+	A_COMMA,
+	A_DOLLAR,
+	A_DOLLSYM,
+	A_GIMMEBACK,
+	A_DEFER = 0x41,
+	A_USURP = 0x42,
+	A_DEFER_LOW = 0x43,
+	A_USURP_LOW = 0x44
+} e_max_atomtypes;
+
+enum {
+	ASSIST_INLET = 1,
+	ASSIST_OUTLET
+};
+
+struct object;
+
+typedef struct symbol
+{
+	char			*s_name;
+	struct object	*s_thing;
+} t_symbol;
+
+union word
+{
+	t_atom_long		w_long;
+	t_atom_float	w_float;
+	t_symbol		*w_sym;
+	struct object	*w_obj;
+};
+
+typedef struct atom
+{
+	short			a_type;
+	union word		a_w;
+} t_atom;
+
+struct maxclass;
+
+// every object starts with one of these; o_extra is where maxstub.c keeps its inlets and outlets
+typedef struct object
+{
+	struct maxclass	*o_class;
+	long			o_magic;
+	void			*o_extra;
+} t_object;
+
+typedef struct maxclass t_class;
+
+#define CLASS_BOX		gensym("box")
+#define CLASS_NOBOX		gensym("nobox")
+
+#define calcoffset(x,y)	((t_ptr_int)(&(((x *)0L)->y)))
+
+// symbols and atoms
+t_symbol *gensym(const char *s);
+t_max_err atom_setlong(t_atom *a, t_atom_long b);
+t_max_err atom_setfloat(t_atom *a, double b);
+t_max_err atom_setsym(t_atom *a, t_symbol *b);
+t_max_err atom_setobj(t_atom *a, void *b);
+long atom_gettype(const t_atom *a);
+t_atom_long atom_getlong(const t_atom *a);
+t_atom_float atom_getfloat(const t_atom *a);
+t_symbol *atom_getsym(const t_atom *a);
+void *atom_getobj(const t_atom *a);
+long atom_getcharfix(const t_atom *a);
+t_atom_long atom_getlongarg(long which, long ac, const t_atom *av);
+t_atom_float atom_getfloatarg(long which, long ac, const t_atom *av);
+t_symbol *atom_getsymarg(long which, long ac, const t_atom *av);
+t_max_err atom_arg_getlong(t_atom_long *c, long idx, long ac, const t_atom *av);
+long atom_arg_getfloat(float *c, long idx, long ac, const t_atom *av);
+long atom_arg_getdouble(double *c, long idx, long ac, const t_atom *av);
+long atom_arg_getsym(t_symbol **c, long idx, long ac, const t_atom *av);
+
+// memory
+t_ptr sysmem_newptr(long size);
+t_ptr sysmem_newptrclear(long size);
+t_ptr sysmem_resizeptr(void *ptr, long newsize);
+t_ptr sysmem_resizeptrclear(void *ptr, long newsize);
+void sysmem_freeptr(void *ptr);
+void sysmem_copyptr(const void *src, void *dst, long bytes);
+char *getbytes(t_ptr_uint size);
+void freebytes(void *b, t_ptr_uint size);
+
+// console
+void post(const char *fmt, ...);
+void error(const char *fmt, ...);
+void cpost(const char *fmt, ...);
+void object_post(t_object *x, const char *s, ...);
+void object_warn(t_object *x, const char *s, ...);
+void object_error(t_object *x, const char *s, ...);
+char *snprintf_zero(char *buffer, size_t count, const char *format, ...);
+
+// inlets and outlets
+void *outlet_new(void *x, const char *s);
+void *outlet_bang(void *o);
+void *outlet_int(void *o, t_atom_long n);
+void *outlet_float(void *o, double f);
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av);
+void *outlet_anything(void *o, const t_symbol *s, short ac, const t_atom *av);
+void *proxy_new(void *x, long id, long *stuffloc);
+long proxy_getinlet(t_object *master);
+void *intin(void *x, short n);
+void *floatin(void *x, short n);
+
+// scheduler
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+double systimer_gettime(void);
+long gettime(void);
+
+// audio settings
+double sys_getsr(void);
+int sys_getblksize(void);
+int sys_getmaxblksize(void);
+int sys_getdspstate(void);
+
+// each object's entry point; a project is built into dsprender with ext_main renamed
+C74_EXPORT void ext_main(void *r);
+
+END_USING_C_LINKAGE
+
+#include "ext_obex.h"
+
+#endif // _DSPRENDER_EXT_H_
@@ -0,0 +1,28 @@
+/**
+	@file
+	ext_atomic.h - the atomic counters of ext_atomic.h, on the compiler's builtins
+*/
+
+#ifndef _DSPRENDER_EXT_ATOMIC_H_
+#define _DSPRENDER_EXT_ATOMIC_H_
+
+#include "ext.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+typedef volatile long t_int32_atomic;
+#define ATOMIC_INCREMENT(p)			_InterlockedIncrement((volatile long *)(p))
+#define ATOMIC_DECREMENT(p)			_InterlockedDecrement((volatile long *)(p))
+#define ATOMIC_INCREMENT_BARRIER(p)	_InterlockedIncrement((volatile long *)(p))
+#define ATOMIC_DECREMENT_BARRIER(p)	_InterlockedDecrement((volatile long *)(p))
+#define ATOMIC_COMPARE_SWAP32(oldvalue, newvalue, atomicptr)	(_InterlockedCompareExchange((volatile long *)(atomicptr), (newvalue), (oldvalue)) == (oldvalue))
+#else
+typedef volatile int32_t t_int32_atomic;
+#define ATOMIC_INCREMENT(p)			__sync_add_and_fetch((p), 1)
+#define ATOMIC_DECREMENT(p)			__sync_sub_and_fetch((p), 1)
+#define ATOMIC_INCREMENT_BARRIER(p)	__sync_add_and_fetch((p), 1)
+#define ATOMIC_DECREMENT_BARRIER(p)	__sync_sub_and_fetch((p), 1)
+#define ATOMIC_COMPARE_SWAP32(oldvalue, newvalue, atomicptr)	__sync_bool_compare_and_swap((atomicptr), (oldvalue), (newvalue))
+#endif
+
+#endif // _DSPRENDER_EXT_ATOMIC_H_
@@ -0,0 +1,11 @@
+/**
+	@file
+	ext_common.h - dsprender's ext.h already has everything this would
+*/
+
+#ifndef _DSPRENDER_EXT_COMMON_H_
+#define _DSPRENDER_EXT_COMMON_H_
+
+#include "ext.h"
+
+#endif // _DSPRENDER_EXT_COMMON_H_
@@ -0,0 +1,34 @@
+/**
+	@file
+	ext_linklist.h - a t_linklist for the benches that compare against one
+
+	A doubly linked list with a node allocated per item, as Max's is.
+	Reaching an index walks from the nearer end.
+*/
+
+#ifndef _DSPRENDER_EXT_LINKLIST_H_
+#define _DSPRENDER_EXT_LINKLIST_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+
+BEGIN_USING_C_LINKAGE
+
+typedef struct _linklist t_linklist;
+
+t_linklist *linklist_new(void);
+void linklist_flags(t_linklist *x, long flags);
+t_atom_long linklist_getsize(t_linklist *x);
+void *linklist_getindex(t_linklist *x, long index);
+t_atom_long linklist_append(t_linklist *x, void *o);
+t_atom_long linklist_insertindex(t_linklist *x, void *o, long index);
+long linklist_chuckindex(t_linklist *x, long index);
+t_atom_long linklist_deleteindex(t_linklist *x, long index);
+void linklist_clear(t_linklist *x);
+void linklist_chuck(t_linklist *x);
+void linklist_reverse(t_linklist *x);
+void linklist_funall(t_linklist *x, method fun, void *arg);
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_EXT_LINKLIST_H_
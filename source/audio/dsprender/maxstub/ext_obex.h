@@ -0,0 +1,108 @@
+/**
+	@file
+	ext_obex.h - classes, messages and attributes, as far as dsprender needs them
+
+	The attribute macros keep their Max names and arguments. The ones that
+	only matter to the inspector (labels, styles, categories ...) expand
+	to nothing.
+*/
+
+#ifndef _DSPRENDER_EXT_OBEX_H_
+#define _DSPRENDER_EXT_OBEX_H_
+
+#include "ext.h"
+
+BEGIN_USING_C_LINKAGE
+
+#define ATTR_FLAGS_NONE		0x0000
+#define ATTR_GET_OPAQUE		0x0001
+#define ATTR_SET_OPAQUE		0x0002
+#define ATTR_GET_OPAQUE_USER	0x0100
+#define ATTR_SET_OPAQUE_USER	0x0200
+
+// how a container (t_linklist ...) frees what it holds
+enum {
+	OBJ_FLAG_OBJ =		0x00000000,	// free using object_free()
+	OBJ_FLAG_REF =		0x00000001,	// don't free
+	OBJ_FLAG_DATA =		0x00000002,	// don't free data or call method
+	OBJ_FLAG_MEMORY =	0x00000004,	// don't call method, and free with sysmem_freeptr()
+	OBJ_FLAG_SILENT =	0x00000100
+};
+
+t_class *class_new(const char *name, const method mnew, const method mfree, long size, const method mmenu, short type, ...);
+t_max_err class_addmethod(t_class *c, const method m, const char *name, ...);
+t_max_err class_register(t_symbol *name_space, t_class *c);
+t_max_err class_setname(const char *obname, const char *filename);
+t_class *class_findbyname(t_symbol *name_space, const t_symbol *classname);
+void *object_alloc(t_class *c);
+t_max_err object_free(void *x);
+void *object_method(void *x, t_symbol *s, ...);
+t_symbol *object_classname(void *x);
+void *object_new(t_symbol *name_space, t_symbol *classname, ...);
+void *object_new_typed(t_symbol *name_space, t_symbol *classname, long ac, t_atom *av);
+
+// attributes: s_type is _sym_long, _sym_float64 ... by name
+t_max_err class_addattr_offset(t_class *c, const char *name, const char *type, long flags, long offset, long size);
+t_max_err class_attr_setaccessors(t_class *c, const char *name, method get, method set);
+t_max_err class_attr_setfilter(t_class *c, const char *name, long clipmin, double min, long clipmax, double max);
+t_max_err class_attr_setalias(t_class *c, const char *name, const char *alias);
+long attr_args_offset(short ac, t_atom *av);
+void attr_args_process(void *x, short ac, t_atom *av);
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv);
+t_max_err object_attr_getvalueof(void *x, t_symbol *s, long *argc, t_atom **argv);
+t_max_err object_attr_touch(t_object *x, t_symbol *attrname);
+
+// registration and notification
+void *object_register(t_symbol *name_space, t_symbol *s, void *x);
+t_max_err object_unregister(void *x);
+void *object_findregistered(t_symbol *name_space, t_symbol *s);
+void *object_subscribe(t_symbol *name_space, t_symbol *s, t_symbol *classname, void *x);
+t_max_err object_unsubscribe(t_symbol *name_space, t_symbol *s, t_symbol *classname, void *x);
+t_max_err object_attach(t_symbol *name_space, t_symbol *s, void *x);
+t_max_err object_detach(t_symbol *name_space, t_symbol *s, void *x);
+t_max_err object_notify(void *x, t_symbol *s, void *data);
+
+END_USING_C_LINKAGE
+
+#define CLASS_ATTR_CHAR(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "char", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_LONG(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "long", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_ATOM_LONG(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "long", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_FLOAT(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "float32", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_DOUBLE(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "float64", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_SYM(c,attrname,flags,structname,structmember) \
+	class_addattr_offset((c), (attrname), "symbol", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+
+#define CLASS_ATTR_SYM_VARSIZE(c,attrname,flags,structname,structmember,sizemember,maxsize) \
+	class_addattr_offset((c), (attrname), "symbol", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_ATOM_VARSIZE(c,attrname,flags,structname,structmember,sizemember,maxsize) \
+	class_addattr_offset((c), (attrname), "atom", (flags), calcoffset(structname,structmember), sizeof(((structname *)0)->structmember))
+#define CLASS_ATTR_ACCESSORS(c,attrname,getter,setter) \
+	class_attr_setaccessors((c), (attrname), (method)(getter), (method)(setter))
+#define CLASS_ATTR_FILTER_MIN(c,attrname,minval)		class_attr_setfilter((c), (attrname), 1, (minval), 0, 0.)
+#define CLASS_ATTR_FILTER_MAX(c,attrname,maxval)		class_attr_setfilter((c), (attrname), 0, 0., 1, (maxval))
+#define CLASS_ATTR_FILTER_CLIP(c,attrname,minval,maxval)	class_attr_setfilter((c), (attrname), 1, (minval), 1, (maxval))
+#define CLASS_ATTR_ALIAS(c,attrname,aliasname)			class_attr_setalias((c), (attrname), (aliasname))
+
+#define CLASS_ATTR_LABEL(c,attrname,flags,labelstr)
+#define CLASS_ATTR_STYLE(c,attrname,flags,stylestr)
+#define CLASS_ATTR_STYLE_LABEL(c,attrname,flags,stylestr,labelstr)
+#define CLASS_ATTR_CATEGORY(c,attrname,flags,parsestr)
+#define CLASS_ATTR_ORDER(c,attrname,flags,parsestr)
+#define CLASS_ATTR_SAVE(c,attrname,flags)
+#define CLASS_ATTR_SELFSAVE(c,attrname,flags)
+#define CLASS_ATTR_BASIC(c,attrname,flags)
+#define CLASS_ATTR_DEFAULT(c,attrname,flags,parsestr)
+#define CLASS_ATTR_DEFAULT_SAVE(c,attrname,flags,parsestr)
+#define CLASS_ATTR_ENUM(c,attrname,flags,parsestr)
+#define CLASS_ATTR_ENUMINDEX(c,attrname,flags,parsestr)
+#define CLASS_ATTR_ENUMINDEX2(c,attrname,flags,a,b)
+#define CLASS_ATTR_ENUMINDEX3(c,attrname,flags,a,b,cc)
+#define CLASS_ATTR_ENUMINDEX4(c,attrname,flags,a,b,cc,d)
+#define CLASS_ATTR_INVISIBLE(c,attrname,flags)
+
+#endif // _DSPRENDER_EXT_OBEX_H_
@@ -0,0 +1,46 @@
+/**
+	@file
+	ext_path.h - files for the shared readers, with a path of 0 meaning a system path
+
+	A name is looked up as it is given, relative to the working directory
+	unless it is absolute, whatever the path says. A t_filehandle is a
+	stdio FILE.
+*/
+
+#ifndef _DSPRENDER_EXT_PATH_H_
+#define _DSPRENDER_EXT_PATH_H_
+
+#include "ext.h"
+
+BEGIN_USING_C_LINKAGE
+
+#define MAX_PATH_CHARS		2048
+#define MAX_FILENAME_CHARS	512
+
+typedef struct _maxstub_file *t_filehandle;
+
+typedef enum {
+	SYSFILE_ATMARK = 0,
+	SYSFILE_FROMSTART = 1,
+	SYSFILE_FROMLEOF = 2,
+	SYSFILE_FROMMARK = 3
+} t_sysfile_pos_mode;
+
+enum {
+	READ_PERM = 1,
+	WRITE_PERM = 2,
+	RW_PERM = 3
+};
+
+short path_toabsolutesystempath(const short in_path, const char *in_filename, char *out_filename);
+short path_opensysfile(const char *name, const short path, t_filehandle *ref, short perm);
+
+t_max_err sysfile_close(t_filehandle f);
+t_max_err sysfile_read(t_filehandle f, t_ptr_size *count, void *bufptr);
+t_max_err sysfile_write(t_filehandle f, t_ptr_size *count, const void *bufptr);
+t_max_err sysfile_geteof(t_filehandle f, t_ptr_size *logeof);
+t_max_err sysfile_setpos(t_filehandle f, t_sysfile_pos_mode mode, t_ptr_int offset);
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_EXT_PATH_H_
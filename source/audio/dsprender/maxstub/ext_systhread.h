@@ -0,0 +1,25 @@
+/**
+	@file
+	ext_systhread.h - the thread calls the shared readers make, on the main thread only
+*/
+
+#ifndef _DSPRENDER_EXT_SYSTHREAD_H_
+#define _DSPRENDER_EXT_SYSTHREAD_H_
+
+#include "ext.h"
+
+BEGIN_USING_C_LINKAGE
+
+typedef void *t_systhread_mutex;
+
+void systhread_sleep(long milliseconds);
+
+// with one thread there is nothing to wait for: these only keep the count of locks even
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags);
+long systhread_mutex_free(t_systhread_mutex pmutex);
+long systhread_mutex_lock(t_systhread_mutex pmutex);
+long systhread_mutex_unlock(t_systhread_mutex pmutex);
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_EXT_SYSTHREAD_H_
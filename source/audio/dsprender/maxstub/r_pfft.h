@@ -0,0 +1,26 @@
+/**
+	@file
+	r_pfft.h - the public pfft~ struct, for the objects that look for their owning pfft~
+
+	dsprender never makes a pfft~, so __pfft~__ is never bound and these
+	objects always see themselves outside one.
+*/
+
+#ifndef _DSPRENDER_R_PFFT_H_
+#define _DSPRENDER_R_PFFT_H_
+
+#include "z_dsp.h"
+
+typedef struct _pfftpub {
+	t_pxobject			x_obj;
+	t_object			*x_parent;
+	t_object			*x_patcher;
+	struct _dspchain	*x_chain;
+	long				x_fftsize;
+	long				x_ffthop;
+	long				x_fftoffset;
+	long				x_fftindex;
+	short				x_fullspect;
+} t_pfftpub;
+
+#endif // _DSPRENDER_R_PFFT_H_
@@ -0,0 +1,65 @@
+/**
+	@file
+	z_dsp.h - signal objects and the dsp chain, as far as dsprender needs them
+
+	t_sample is double, as it is for 64-bit MSP. Projects written for the
+	32-bit perform interface (combsyn~) are built with DSPRENDER_SAMPLE32
+	defined and get float, which is what they were written against.
+*/
+
+#ifndef _DSPRENDER_Z_DSP_H_
+#define _DSPRENDER_Z_DSP_H_
+
+#include "ext.h"
+
+BEGIN_USING_C_LINKAGE
+
+#ifdef DSPRENDER_SAMPLE32
+typedef float	t_sample;
+#else
+typedef double	t_sample;
+#endif
+typedef float	t_float;
+typedef double	t_double;
+
+#define Z_NO_INPLACE	1
+#define Z_PUT_LAST		2
+#define Z_PUT_FIRST		4
+#define Z_IGNORE_DISABLE	8
+#define Z_MC_INLETS		16
+
+#define MC_MAX_CHANS	1024
+
+typedef struct t_pxobject
+{
+	t_object	z_ob;
+	long		z_in;
+	void		*z_proxy;
+	long		z_disabled;
+	short		z_count;
+	short		z_misc;
+} t_pxobject;
+
+typedef struct _signal
+{
+	long		s_n;
+	t_sample	*s_vec;
+	double		s_sr;
+} t_signal;
+
+typedef t_int *(*t_perfroutine)(t_int *args);
+typedef void (*t_perfroutine64)(t_object *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+void class_dspinit(t_class *c);
+void dsp_setup(t_pxobject *x, long nsignals);
+void dsp_free(t_pxobject *x);
+void dsp_resize(t_pxobject *x, long nsignals);
+void dsp_add64(t_object *chain, t_object *x, t_perfroutine64 f, long flags, void *userparam);
+void dsp_add(t_perfroutine f, int n, ...);
+void dsp_addv(t_perfroutine f, int n, void **vector);
+void z_dsp_setup(t_pxobject *x, long nsignals);
+void z_dsp_free(t_pxobject *x);
+
+END_USING_C_LINKAGE
+
+#endif // _DSPRENDER_Z_DSP_H_
@@ -0,0 +1,43 @@
+/**
+	@file
+	maxstub_new.cpp - counts the C++ projects' allocations along with sysmem_newptr()'s
+*/
+
+#include "dsprender.h"
+#include <new>
+
+void *operator new(std::size_t size)
+{
+	void *p;
+
+	maxstub_allocs++;
+	p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	free(p);
+}
@@ -4,24 +4,52 @@
 
  updated 6/5/09 rbs: initial
 
+ Besides spinning, it can spend the time the way real DSP code does: chasing
+ pointers through a working set bigger than the caches (@mode cache), or
+ streaming through one as fast as memory allows (@mode bandwidth). @probe
+ names a dspprobe~ probe to time the object's own perform routine under.
+
  @ingroup	examples
  */
 
 #include "ext.h"
 #include "ext_obex.h"
 #include "z_dsp.h"
+#include "dspprobe.h"
 
 void *dspstress_class;
 
+enum {
+	DSPSTRESS_SPIN = 0,
+	DSPSTRESS_CACHE,
+	DSPSTRESS_BANDWIDTH
+};
+
+#define DSPSTRESS_LINE		64		// bytes per pointer-chase node, one cache line
+#define DSPSTRESS_CHUNK		4096	// doubles streamed between clock reads
+
 
 typedef struct _dspstress {
 	t_pxobject	x_obj;
 	double		x_cpuusagetarget;	// how much cpu to burn (0 - 100)
 	double		x_svtime_ms;		// how long one signal vector takes in ms
+	long		x_mode;				// DSPSTRESS_SPIN ...
+	long		x_kbytes;			// working set for the memory modes
+	char		*x_mem;				// the working set
+	t_ptr_size	x_memsize;			// bytes allocated
+	void		**x_chase;			// where the pointer chase got to
+	t_ptr_size	x_cursor;			// where the streaming got to, in doubles
+	t_symbol	*x_probename;
+	t_dspprobe	*x_probe;
+	t_dspprobe_wrap x_wrap;
 } t_dspstress;
 
 
-void *dspstress_new(double val);
+void *dspstress_new(t_symbol *s, long argc, t_atom *argv);
+void dspstress_free(t_dspstress *x);
+t_max_err dspstress_attr_setprobe(t_dspstress *x, void *attr, long argc, t_atom *argv);
+void dspstress_makechase(t_dspstress *x);
+void dspstress_makemem(t_dspstress *x);
 void dspstress_perform64(t_dspstress *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
 void dspstress_float(t_dspstress *x, double f);
 void dspstress_int(t_dspstress *x, long n);
@@ -32,13 +60,27 @@ void ext_main(void *r)
 {
 	t_class *c;
 
-	c = class_new("dspstress~", (method)dspstress_new, (method)dsp_free, (short)sizeof(t_dspstress), 0L, A_DEFFLOAT, 0);
+	c = class_new("dspstress~", (method)dspstress_new, (method)dspstress_free, (short)sizeof(t_dspstress), 0L, A_GIMME, 0);
 
 	class_addmethod(c, (method)dspstress_dsp64, "dsp64", A_CANT, 0); 	// respond to the dsp message
 	// (sent to MSP objects when audio is turned on/off)
 	class_addmethod(c, (method)dspstress_float, "float", A_FLOAT, 0);
 	class_addmethod(c, (method)dspstress_int, "int", A_LONG, 0);
 	class_addmethod(c, (method)dspstress_assist,"assist",A_CANT,0);
+
+	CLASS_ATTR_LONG(c, "mode", 0, t_dspstress, x_mode);
+	CLASS_ATTR_ENUMINDEX3(c, "mode", 0, "Spin", "Cache Thrash", "Memory Bandwidth");
+	CLASS_ATTR_FILTER_CLIP(c, "mode", DSPSTRESS_SPIN, DSPSTRESS_BANDWIDTH);
+	CLASS_ATTR_LABEL(c, "mode", 0, "Load Profile");
+
+	CLASS_ATTR_LONG(c, "kbytes", 0, t_dspstress, x_kbytes);
+	CLASS_ATTR_FILTER_CLIP(c, "kbytes", 1, 4194304);
+	CLASS_ATTR_LABEL(c, "kbytes", 0, "Working Set in KB (takes effect when audio starts)");
+
+	CLASS_ATTR_SYM(c, "probe", 0, t_dspstress, x_probename);
+	CLASS_ATTR_LABEL(c, "probe", 0, "Probe to Time the Perform Routine Under");
+	CLASS_ATTR_ACCESSORS(c, "probe", NULL, dspstress_attr_setprobe);
+
 	class_dspinit(c);													// must call this function for MSP object classes
 
 	class_register(CLASS_BOX, c);
@@ -56,14 +98,37 @@ void dspstress_assist(t_dspstress *x, void *b, long m, long a, char *s)
 	}
 }
 
-void *dspstress_new(double val)
+void *dspstress_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_dspstress *x = object_alloc(dspstress_class);
+	long offset = attr_args_offset((short)argc, argv);
+
 	dsp_setup((t_pxobject *)x,1);					// set up DSP for the instance and create signal inlet
-	dspstress_float(x, val);
+	dspstress_float(x, offset ? atom_getfloat(argv) : 0.);
+	x->x_mode = DSPSTRESS_SPIN;
+	x->x_kbytes = 32768;
+	x->x_mem = NULL;
+	x->x_memsize = 0;
+	x->x_probename = gensym("");
+	x->x_probe = NULL;
+	attr_args_process(x, (short)argc, argv);
 	return x;
 }
 
+void dspstress_free(t_dspstress *x)
+{
+	dsp_free((t_pxobject *)x);
+	if (x->x_mem)
+		sysmem_freeptr(x->x_mem);
+}
+
+t_max_err dspstress_attr_setprobe(t_dspstress *x, void *attr, long argc, t_atom *argv)
+{
+	x->x_probename = atom_getsym(argv);
+	x->x_probe = x->x_probename == gensym("") ? NULL : dspprobe_get(x->x_probename);	// used from the next dsp64
+	return MAX_ERR_NONE;
+}
+
 void dspstress_float(t_dspstress *x, double f)				// the float and int routines cover both inlets.
 {	// It doesn't matter which one is involved
 	x->x_cpuusagetarget = f;
@@ -85,15 +150,90 @@ void dspstress_perform64(t_dspstress *x, t_object *dsp64, double **ins, long num
 	intime = systimer_gettime();
 	outtime = intime + spintime;
 
-	while (systimer_gettime() < outtime) {
-		// tra la la
-		spincounter++;  // how high can we count?
+	if (x->x_mode == DSPSTRESS_CACHE && x->x_mem) {
+		void **p = x->x_chase;
+		long i;
+
+		while (systimer_gettime() < outtime) {
+			for (i = 0; i < 256; i++)	// each step most likely a cache miss
+				p = (void **)*p;
+		}
+		x->x_chase = p;
+	}
+	else if (x->x_mode == DSPSTRESS_BANDWIDTH && x->x_mem) {
+		double *a = (double *)x->x_mem;
+		t_ptr_size half = x->x_memsize / sizeof(double) / 2;
+		t_ptr_size i, n;
+
+		// stream a chunk of the first half into the second, like a big delay line or convolution would
+		while (systimer_gettime() < outtime) {
+			n = MIN((t_ptr_size)DSPSTRESS_CHUNK, half - x->x_cursor);
+			for (i = 0; i < n; i++)
+				a[half + x->x_cursor + i] = a[x->x_cursor + i] * 0.5 + 1.;
+			x->x_cursor += n;
+			if (x->x_cursor >= half)
+				x->x_cursor = 0;
+		}
+	}
+	else {
+		while (systimer_gettime() < outtime) {
+			// tra la la
+			spincounter++;  // how high can we count?
+		}
+	}
+}
+
+
+// link the working set into one random cycle of cache lines (Sattolo's shuffle), so every
+// step of the chase is a dependent load the prefetcher can't guess
+void dspstress_makechase(t_dspstress *x)
+{
+	t_ptr_size i, j, n = x->x_memsize / DSPSTRESS_LINE;
+	t_ptr_size *order = (t_ptr_size *)sysmem_newptr(n * sizeof(t_ptr_size));
+	t_uint32 seed = 2463534242u;
+
+	if (!order)
+		return;
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = n - 1; i > 0; i--) {
+		t_ptr_size t;
+
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		j = seed % i;
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
 	}
+	for (i = 0; i < n; i++)
+		*(void **)(x->x_mem + order[i] * DSPSTRESS_LINE) = x->x_mem + order[(i + 1) % n] * DSPSTRESS_LINE;
+	sysmem_freeptr(order);
+	x->x_chase = (void **)x->x_mem;
+}
+
+// called from dsp64, so never while our perform routine runs
+void dspstress_makemem(t_dspstress *x)
+{
+	t_ptr_size size = (t_ptr_size)x->x_kbytes * 1024;	// up to 4 GB, past what a 32-bit long holds
+
+	if (x->x_mem && x->x_memsize == size)
+		return;
+	if (x->x_mem)
+		sysmem_freeptr(x->x_mem);
+	x->x_mem = (char *)sysmem_newptrclear(size);
+	x->x_memsize = x->x_mem ? size : 0;
+	x->x_cursor = 0;
+	if (x->x_mem)
+		dspstress_makechase(x);
 }
 
 
 void dspstress_dsp64(t_dspstress *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
 {
 	x->x_svtime_ms = maxvectorsize / samplerate * 1000.0;
-	object_method(dsp64, gensym("dsp_add64"), x, dspstress_perform64, 0, NULL);
+	if (x->x_mode != DSPSTRESS_SPIN)
+		dspstress_makemem(x);
+	dspprobe_add64(dsp64, (t_object *)x, &x->x_wrap, x->x_probe, (t_perfroutine64)dspstress_perform64, 0, NULL, maxvectorsize, samplerate);
 }
@@ -10,19 +10,21 @@
 #include "ext_common.h" // contains CLAMP macro
 #include "z_dsp.h"
 #include "ext_buffer.h"
+#include "bufreader.h"
 
 
 typedef struct _index {
 	t_pxobject l_obj;
-	t_buffer_ref *l_buffer_reference;
+	t_bufreader l_reader;
 	long l_chan;
+	long l_interp;
 } t_index;
 
 
 void index_perform64(t_index *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
 void index_dsp64(t_index *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void index_set(t_index *x, t_symbol *s);
-void *index_new(t_symbol *s, long chan);
+void *index_new(t_symbol *s, long argc, t_atom *argv);
 void index_free(t_index *x);
 t_max_err index_notify(t_index *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 void index_in1(t_index *x, long n);
@@ -35,7 +37,7 @@ static t_class *index_class;
 
 C74_EXPORT void ext_main(void *r)
 {
-	t_class *c = class_new("index~", (method)index_new, (method)index_free, sizeof(t_index), 0L, A_SYM, A_DEFLONG, 0);
+	t_class *c = class_new("index~", (method)index_new, (method)index_free, sizeof(t_index), 0L, A_GIMME, 0);
 
 	class_addmethod(c, (method)index_dsp64, "dsp64", A_CANT, 0);
 	class_addmethod(c, (method)index_set, "set", A_SYM, 0);
@@ -43,6 +45,13 @@ C74_EXPORT void ext_main(void *r)
 	class_addmethod(c, (method)index_assist, "assist", A_CANT, 0);
 	class_addmethod(c, (method)index_dblclick, "dblclick", A_CANT, 0);
 	class_addmethod(c, (method)index_notify, "notify", A_CANT, 0);
+
+	CLASS_ATTR_LONG(c, "interp", 0, t_index, l_interp);
+	CLASS_ATTR_ENUMINDEX4(c, "interp", 0, "None", "Linear", "Cubic", "Sinc");
+	CLASS_ATTR_FILTER_CLIP(c, "interp", BUFREADER_INTERP_NONE, BUFREADER_INTERP_SINC);
+	CLASS_ATTR_LABEL(c, "interp", 0, "Interpolation");
+
+	bufreader_tables_init();
 	class_dspinit(c);
 	class_register(CLASS_BOX, c);
 	index_class = c;
@@ -53,33 +62,16 @@ void index_perform64(t_index *x, t_object *dsp64, double **ins, long numins, dou
 {
 	t_double	*in = ins[0];
 	t_double	*out = outs[0];
-	int			n = sampleframes;
+	long		n = sampleframes;
 	t_float		*tab;
-	double		temp;
-	double		f;
-	long		index, chan, frames, nc;
-	t_buffer_obj	*buffer = buffer_ref_getobject(x->l_buffer_reference);
 
-	tab = buffer_locksamples(buffer);
+	// the reader caches the frame and channel counts until the buffer~ changes
+	tab = bufreader_lock(&x->l_reader);
 	if (!tab)
 		goto zero;
 
-	frames = buffer_getframecount(buffer);
-	nc = buffer_getchannelcount(buffer);
-	chan = MIN(x->l_chan, nc);
-	while (n--) {
-		temp = *in++;
-		f = temp + 0.5;
-		index = f;
-		if (index < 0)
-			index = 0;
-		else if (index >= frames)
-			index = frames - 1;
-		if (nc > 1)
-			index = index * nc + chan;
-		*out++ = tab[index];
-	}
-	buffer_unlocksamples(buffer);
+	bufreader_read(&x->l_reader, tab, in, 0., 1., out, x->l_chan, n, x->l_interp);
+	bufreader_unlock(&x->l_reader);
 	return;
 zero:
 	while (n--)
@@ -88,10 +80,10 @@ zero:
 
 void index_set(t_index *x, t_symbol *s)
 {
-	if (!x->l_buffer_reference)
-		x->l_buffer_reference = buffer_ref_new((t_object *)x, s);
+	if (!x->l_reader.ref)
+		bufreader_init(&x->l_reader, (t_object *)x, s);
 	else
-		buffer_ref_set(x->l_buffer_reference, s);
+		bufreader_set(&x->l_reader, s);
 }
 
 void index_in1(t_index *x, long n)
@@ -112,7 +104,7 @@ void index_dsp64(t_index *x, t_object *dsp64, short *count, double samplerate, l
 // this lets us double-click on index~ to open up the buffer~ it references
 void index_dblclick(t_index *x)
 {
-	buffer_view(buffer_ref_getobject(x->l_buffer_reference));
+	buffer_view(bufreader_getobject(&x->l_reader));
 }
 
 void index_assist(t_index *x, void *b, long m, long a, char *s)
@@ -127,14 +119,18 @@ void index_assist(t_index *x, void *b, long m, long a, char *s)
 	}
 }
 
-void *index_new(t_symbol *s, long chan)
+void *index_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_index *x = object_alloc(index_class);
+	long offset = attr_args_offset((short)argc, argv);
+
 	dsp_setup((t_pxobject *)x, 1);
 	intin((t_object *)x,1);
 	outlet_new((t_object *)x, "signal");
-	index_set(x, s);
-	index_in1(x,chan);
+	index_set(x, atom_getsymarg(0, offset, argv));
+	index_in1(x, atom_getintarg(1, offset, argv));
+	x->l_interp = BUFREADER_INTERP_NONE;
+	attr_args_process(x, (short)argc, argv);
 	return (x);
 }
 
@@ -142,11 +138,11 @@ void *index_new(t_symbol *s, long chan)
 void index_free(t_index *x)
 {
 	dsp_free((t_pxobject *)x);
-	object_free(x->l_buffer_reference);
+	bufreader_free(&x->l_reader);
 }
 
 
 t_max_err index_notify(t_index *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
 {
-	return buffer_ref_notify(x->l_buffer_reference, s, msg, sender, data);
+	return bufreader_notify(&x->l_reader, s, msg, sender, data);
 }
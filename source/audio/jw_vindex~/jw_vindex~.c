@@ -42,6 +42,7 @@ University of California, Berkeley.
 #include "ext_common.h" // contains CLAMP macro
 #include "z_dsp.h"
 #include "ext_buffer.h"
+#include "bufreader.h"
 #include "fftw3.h"
 #include "time.h"
 
@@ -59,8 +60,10 @@ typedef struct _slice {
 typedef struct _jw_vindex {
     t_pxobject l_obj;
     long l_vector;
-    t_buffer_ref *l_buffer_reference;
+    t_bufreader l_reader;       //buffer reference plus cached frame/channel counts, locked by the perform routine
+    t_bufreader l_fftreader;    //the same buffer for the fft analysis on the main thread; a reader's lock belongs to one thread
     long l_chan;
+    long l_interp;
     //t_buffer_ref *o_buffer_reference;
     //long o_chan;
     long sample_vector_size;    //length of vector we will pull from the buffer
@@ -100,6 +103,7 @@ typedef struct _jw_vindex {
 void jw_vindex_perform64(t_jw_vindex *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
 void jw_vindex_dsp64(t_jw_vindex *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void jw_vindex_int(t_jw_vindex *x, long n);
+void jw_vindex_doint(t_jw_vindex *x, t_symbol *s, long argc, t_atom *argv);
 void jw_vindex_set(t_jw_vindex *x, t_symbol *s);
 void jw_vindex_setvsize(t_jw_vindex *x, long n);
 void jw_vindex_getvsize(t_jw_vindex *x);
@@ -138,7 +142,13 @@ C74_EXPORT void ext_main(void *r)
     class_addmethod(c, (method)jw_vindex_set_thresh, "set_thresh", A_FLOAT, 0);
     class_addmethod(c, (method)jw_vindex_bang, "bang", A_CANT, 0);                  //for experimental purposes
     class_addmethod(c, (method)jw_vindex_list, "list", A_CANT, 0);
-    
+
+    CLASS_ATTR_LONG(c, "interp", 0, t_jw_vindex, l_interp);
+    CLASS_ATTR_ENUMINDEX4(c, "interp", 0, "None", "Linear", "Cubic", "Sinc");
+    CLASS_ATTR_FILTER_CLIP(c, "interp", BUFREADER_INTERP_NONE, BUFREADER_INTERP_SINC);
+    CLASS_ATTR_LABEL(c, "interp", 0, "Interpolation");
+
+    bufreader_tables_init();
     class_dspinit(c);
     class_register(CLASS_BOX, c);
     jw_vindex_class = c;
@@ -148,34 +158,16 @@ void jw_vindex_perform64(t_jw_vindex *x, t_object *dsp64, double **ins, long num
 {
     t_double    *in = ins[0];
     t_double    *out = outs[0];
-    int            n = sampleframes;
-    t_float        *tab;
-    double        temp;
-    double        f;
-    long        index, chan, frames, nc;
-    t_buffer_obj    *buffer = buffer_ref_getobject(x->l_buffer_reference);
-
-    tab = buffer_locksamples(buffer);
+    long        n = sampleframes;
+    t_float     *tab;
+
+    //the reader only asks the buffer for its size and sample rate after it has been modified
+    tab = bufreader_lock(&x->l_reader);
     if (!tab)
         goto zero;
 
-    frames = buffer_getframecount(buffer);
-    nc = buffer_getchannelcount(buffer);
-    x->sr = buffer_getsamplerate(buffer);
-    chan = MIN(x->l_chan, nc);
-    while (n--) {
-        temp = *in++;
-        f = temp + 0.5;
-        index = f;
-        if (index < 0)
-            index = 0;
-        else if (index >= frames)
-            index = frames - 1;
-        if (nc > 1)
-            index = index * nc + chan;
-        *out++ = tab[index];
-    }
-    buffer_unlocksamples(buffer);
+    bufreader_read(&x->l_reader, tab, in, 0., 1., out, x->l_chan, n, x->l_interp);
+    bufreader_unlock(&x->l_reader);
     return;
 zero:
     while (n--)
@@ -194,36 +186,36 @@ static void print_result(float bw, t_jw_vindex *x) {
              );
 }
 
+//the analysis runs on the main thread, where l_fftreader is locked; an int from the scheduler thread is deferred
+void jw_vindex_int(t_jw_vindex *x, long n)
+{
+    t_atom a;
+
+    atom_setlong(&a, n);
+    defer(x, (method)jw_vindex_doint, NULL, 1, &a);
+}
+
 //when we get an int, set the cursor and print the fft input at that point in the target buffer, then the fft of that window
 //needs to be refactored
-void jw_vindex_int(t_jw_vindex *x, long n)
+void jw_vindex_doint(t_jw_vindex *x, t_symbol *s, long argc, t_atom *argv)
 {
+    long n = atom_getlong(argv);
+
     if(n>=0)
     {
         x->cursor = n;
         
         t_float *tab;
-        t_buffer_obj    *buffer = buffer_ref_getobject(x->l_buffer_reference);
-        x->sr = buffer_getsamplerate(buffer);
-        tab = buffer_locksamples(buffer);
+        tab = bufreader_lock(&x->l_fftreader);
         if(!tab)
             goto zero;
+        x->sr = x->l_fftreader.sr;
         //get buffer length. If window at cursor exceeds buffer length, truncate window.
-        long frames = buffer_getframecount(buffer);
-        long i = x->cursor + x->fft_size;
-        i = MIN(x->cursor, frames - x->fft_size);
-        
-        //get channels
-        long nc = buffer_getchannelcount(buffer);
-        long chan = MIN(x->l_chan, nc);
+        t_int64 frames = x->l_fftreader.frames;
+        t_int64 i = MAX(0, MIN(x->cursor, frames - x->fft_size));
         
-        //load window into fft input
-        for(int j=0; j< x->fft_size;j++){
-            x->in[j] = tab[(j+i)*nc+chan];
-            //x->in[2*j+1] = 0;  //no imaginary component
-            //post("%d: %f", j, x->in[j]);
-            
-        }
+        //load window into fft input (zero padded if the buffer is shorter than the fft)
+        bufreader_copy(&x->l_fftreader, tab, i, x->l_chan, x->in, x->fft_size);
         
         //perform fft
         hann_window(x);
@@ -293,7 +285,7 @@ void jw_vindex_int(t_jw_vindex *x, long n)
             
         }
         jw_vindex_list_out(x, x->cooked, x->num_peaks * 2);     //list the cooked (frequency, amplitude) pairs out the outlet
-        buffer_unlocksamples(buffer); //maybe move this earlier
+        bufreader_unlock(&x->l_fftreader); //maybe move this earlier
         return;
         
         
@@ -307,12 +299,18 @@ void jw_vindex_int(t_jw_vindex *x, long n)
 }
 
 void jw_vindex_list(t_jw_vindex *x, t_symbol *msg, long argc, t_atom *argv){
+    //like int, the analysis runs on the main thread
+    if(!systhread_ismainthread()){
+        defer(x, (method)jw_vindex_list, msg, argc, argv);
+        return;
+    }
     if(argc != 2){
         error("jw_vindex: only supports list length of 2: (cursor1, cursor2)");
         return;
     }
     
-    long buffer_len = buffer_getframecount(buffer_ref_getobject(x->l_buffer_reference));
+    t_buffer_obj *buffer = bufreader_getobject(&x->l_fftreader);
+    long buffer_len = buffer ? buffer_getframecount(buffer) : 0;
     //error("jw_vindex: buffer framecount: %ld", buffer_len);
 
     long c1 = atom_getlong(argv);
@@ -357,25 +355,16 @@ void jw_vindex_list(t_jw_vindex *x, t_symbol *msg, long argc, t_atom *argv){
     
         
         t_float *tab;
-        t_buffer_obj    *buffer = buffer_ref_getobject(x->l_buffer_reference);
-        x->sr = buffer_getsamplerate(buffer);
-        tab = buffer_locksamples(buffer);
+        tab = bufreader_lock(&x->l_fftreader);
         if(!tab)
             goto zero;
+        x->sr = x->l_fftreader.sr;
         //get buffer length. If window at cursor exceeds buffer length, truncate window.
-        long frames = buffer_getframecount(buffer);
-        long i = x->cursor + x->fft_size;
-        i = MIN(x->cursor, frames - x->fft_size);
-        
-        //get channels
-        long nc = buffer_getchannelcount(buffer);
-        long chan = MIN(x->l_chan, nc);
-        
+        t_int64 frames = x->l_fftreader.frames;
+        t_int64 i = MAX(0, MIN(x->cursor, frames - x->fft_size));
         
-        //load window into fft input
-        for(int j=0; j< x->fft_size;j++){
-            x->in[j] = tab[(j+1)*nc+chan];
-        }
+        //load window into fft input (zero padded if the buffer is shorter than the fft)
+        bufreader_copy(&x->l_fftreader, tab, i, x->l_chan, x->in, x->fft_size);
         
         //perform fft
         hann_window(x);
@@ -439,7 +428,7 @@ void jw_vindex_list(t_jw_vindex *x, t_symbol *msg, long argc, t_atom *argv){
             
         }
         jw_vindex_list_out(x, x->cooked, x->num_peaks * 2);     //list the cooked (frequency, amplitude) pairs out the outlet
-        buffer_unlocksamples(buffer); //maybe move this earlier
+        bufreader_unlock(&x->l_fftreader); //maybe move this earlier
         return;
         
         
@@ -463,14 +452,18 @@ void jw_vindex_list(t_jw_vindex *x, t_symbol *msg, long argc, t_atom *argv){
 
 void jw_vindex_set(t_jw_vindex *x, t_symbol *s)
 {
-    if (!x->l_buffer_reference)
-        x->l_buffer_reference = buffer_ref_new((t_object *)x, s);
-    else
-        buffer_ref_set(x->l_buffer_reference, s);
+    if (!x->l_reader.ref) {
+        bufreader_init(&x->l_reader, (t_object *)x, s);
+        bufreader_init(&x->l_fftreader, (t_object *)x, s);
+    } else {
+        bufreader_set(&x->l_reader, s);
+        bufreader_set(&x->l_fftreader, s);
+    }
     
     //the buffer may have a different sample rate.  Let's find out what it is and reset our SR to match.
-    t_buffer_obj    *buffer = buffer_ref_getobject(x->l_buffer_reference);
-    x->sr = buffer_getsamplerate(buffer);
+    t_buffer_obj    *buffer = bufreader_getobject(&x->l_reader);
+    if (buffer)
+        x->sr = buffer_getsamplerate(buffer);
     
 }
 
@@ -566,7 +559,7 @@ void jw_vindex_dsp64(t_jw_vindex *x, t_object *dsp64, short *count, double sampl
 // this lets us double-click on index~ to open up the buffer~ it references
 void jw_vindex_dblclick(t_jw_vindex *x)
 {
-    buffer_view(buffer_ref_getobject(x->l_buffer_reference));
+    buffer_view(bufreader_getobject(&x->l_reader));
 }
 
 void jw_vindex_assist(t_jw_vindex *x, void *b, long m, long a, char *s)
@@ -629,9 +622,10 @@ void *jw_vindex_new(t_symbol *s, long chan)
     x->f_out = outlet_new((t_object *)x, "float");
     x->d_out = outlet_new((t_object *)x, NULL);
     outlet_new((t_object *)x, "signal");        //left outlet
+    x->sr = sys_getsr();                        //initially, adopt the system sample rate. We will reset later.
     jw_vindex_set(x, s);
     jw_vindex_in1(x,chan);
-    x->sr = sys_getsr();                        //initially, adopt the system sample rate. We will reset later.
+    x->l_interp = BUFREADER_INTERP_NONE;
     post("jw_vindex: SR = %f", x->sr);
     x->fft_size = 1024;
     x->in = (double *) fftw_malloc(sizeof(double) * (x->fft_size));
@@ -691,14 +685,16 @@ void jw_vindex_free(t_jw_vindex *x)
     if(x->ap2 !=NULL) free(x->ap2);
     if(x->ap3 !=NULL) free(x->ap3);
     if(x->ap4 !=NULL) free(x->ap4);
-    object_free(x->l_buffer_reference);
+    bufreader_free(&x->l_reader);
+    bufreader_free(&x->l_fftreader);
     
 }
 
 
 t_max_err jw_vindex_notify(t_jw_vindex *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
 {
-    return buffer_ref_notify(x->l_buffer_reference, s, msg, sender, data);
+    bufreader_notify(&x->l_fftreader, s, msg, sender, data);
+    return bufreader_notify(&x->l_reader, s, msg, sender, data);
 }
 
 //hann_window function
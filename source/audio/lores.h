@@ -0,0 +1,270 @@
+/**
+	@file
+	lores.h - a bank of two-pole resonant lowpass filters, shared by lores~ and mc.lores~
+
+	Channels are run in groups of LORES_LANES so the recursion for a group
+	is a handful of straight-line multiply-adds the compiler can keep in
+	vector registers. Coefficients are computed once per vector (or per
+	sample when sample accurate modulation is asked for) using a cosine
+	table and a short exp series, and denormals are flushed by the FPU for
+	the duration of the perform routine (see denorm.h) rather than tested
+	per sample.
+*/
+
+#ifndef _LORES_H_
+#define _LORES_H_
+
+#include "ext.h"
+#include "z_dsp.h"
+#include <math.h>
+#include "denorm.h"
+
+#define LORES_LANES			4		// channels per lane group
+#define LORES_COSTAB_SIZE	4096	// table entries over [0, pi]
+
+typedef struct _lores_bank
+{
+	long	chans;			// channels in use
+	long	alloc;			// channels allocated
+	long	vs;				// vector size the scratch buffers hold
+	double	twopidsr;		// 2 pi over the sampling rate
+	double	*ym1;			// previous output sample, per channel
+	double	*ym2;			// previous to previous output sample
+	double	*a1;			// computed coefficients
+	double	*a2;
+	double	*scale;
+	double	*freq;			// frequency and resonance the coefficients were computed for
+	double	*res;
+	double	*zero;			// silent input for unused lanes
+	double	*scratch;		// output for unused lanes
+} t_lores_bank;
+
+typedef struct _lores_mod
+{
+	const double *const *fins;	// frequency signals, or NULL to use freq
+	long	fchans;
+	double	freq;
+	const double *const *rins;	// resonance signals, or NULL to use res
+	long	rchans;
+	double	res;
+	char	accurate;		// recompute coefficients every sample
+} t_lores_mod;
+
+static double s_lores_costab[LORES_COSTAB_SIZE + 2];
+
+
+static inline void lores_tables_init(void)
+{
+	long i;
+
+	for (i = 0; i < LORES_COSTAB_SIZE + 2; i++)
+		s_lores_costab[i] = cos(PI * i / LORES_COSTAB_SIZE);
+}
+
+static inline double lores_fastcos(double w)
+{
+	double f;
+	long i;
+
+	w = fabs(w);
+	if (w >= TWOPI)
+		w = fmod(w, TWOPI);
+	if (w > PI)
+		w = TWOPI - w;
+	f = w * (LORES_COSTAB_SIZE / PI);
+	i = (long)f;
+	f -= i;
+	return s_lores_costab[i] + f * (s_lores_costab[i + 1] - s_lores_costab[i]);
+}
+
+// exp(r * 0.125) for r in [0, 1]: four terms of the series are good to 3e-7
+static inline double lores_fastexp8(double r)
+{
+	double t = r * 0.125;
+
+	return 1. + t * (1. + t * (0.5 + t * (1. / 6. + t * (1. / 24.))));
+}
+
+static inline void lores_coefs(double twopidsr, double freq, double res, double *a1, double *a2, double *scale)
+{
+	double resterm;
+
+	// constrain resonance value
+	res = (res >= 1.) ? 1. - 1E-20 : (res < 0.) ? 0. : res;
+	resterm = lores_fastexp8(res) * 0.882497;
+	*a1 = -2. * resterm * lores_fastcos(twopidsr * freq);
+	*a2 = resterm * resterm;
+	*scale = 1. + *a1 + *a2;
+}
+
+static inline void lores_bank_init(t_lores_bank *b)
+{
+	b->chans = b->alloc = b->vs = 0;
+	b->twopidsr = TWOPI / sys_getsr();
+	b->ym1 = b->ym2 = b->a1 = b->a2 = b->scale = b->freq = b->res = NULL;
+	b->zero = b->scratch = NULL;
+}
+
+static inline void lores_bank_free(t_lores_bank *b)
+{
+	if (b->ym1)
+		sysmem_freeptr(b->ym1);
+	if (b->zero)
+		sysmem_freeptr(b->zero);
+	lores_bank_init(b);
+}
+
+static inline void lores_bank_clear(t_lores_bank *b)
+{
+	long i;
+
+	// clear sample memory to recover from blowup
+	for (i = 0; i < b->alloc; i++)
+		b->ym1[i] = b->ym2[i] = 0.;
+}
+
+// called from dsp64: size the bank for chans channels of vs samples
+static inline t_max_err lores_bank_resize(t_lores_bank *b, long chans, long vs, double samplerate)
+{
+	long i;
+
+	if (chans > b->alloc) {
+		double *mem = (double *)sysmem_newptrclear(chans * 7 * sizeof(double));
+
+		if (!mem)
+			return MAX_ERR_OUT_OF_MEM;
+		if (b->ym1)
+			sysmem_freeptr(b->ym1);
+		b->alloc = chans;
+		b->ym1 = mem;
+		b->ym2 = b->ym1 + chans;
+		b->a1 = b->ym2 + chans;
+		b->a2 = b->a1 + chans;
+		b->scale = b->a2 + chans;
+		b->freq = b->scale + chans;
+		b->res = b->freq + chans;
+	}
+	if (vs > b->vs) {
+		double *mem = (double *)sysmem_newptrclear(vs * 2 * sizeof(double));
+
+		if (!mem)
+			return MAX_ERR_OUT_OF_MEM;
+		if (b->zero)
+			sysmem_freeptr(b->zero);
+		b->vs = vs;
+		b->zero = mem;
+		b->scratch = mem + vs;
+	}
+	b->chans = chans;
+	b->twopidsr = TWOPI / samplerate;
+	for (i = 0; i < b->alloc; i++) {
+		b->freq[i] = b->res[i] = -1.; // force a coefficient update
+		b->ym1[i] = b->ym2[i] = 0.;
+	}
+	return MAX_ERR_NONE;
+}
+
+static inline void lores_bank_group(t_lores_bank *b, long c, long lanes, double **ins, double **outs, t_lores_mod *mod, long n)
+{
+	double a1[LORES_LANES], a2[LORES_LANES], sc[LORES_LANES];
+	double y1[LORES_LANES], y2[LORES_LANES], in[LORES_LANES];
+	double *ip[LORES_LANES], *op[LORES_LANES];
+	const double *fp[LORES_LANES], *rp[LORES_LANES];
+	double f, r, y;
+	long i, l, ch;
+
+	for (l = 0; l < LORES_LANES; l++) {
+		if (l < lanes) {
+			ch = c + l;
+			ip[l] = ins[ch];
+			op[l] = outs[ch];
+			fp[l] = mod->fins ? mod->fins[ch % mod->fchans] : NULL;
+			rp[l] = mod->rins ? mod->rins[ch % mod->rchans] : NULL;
+			f = fp[l] ? *fp[l] : mod->freq;
+			r = rp[l] ? *rp[l] : mod->res;
+			// do we need to recompute coefficients?
+			if (f != b->freq[ch] || r != b->res[ch]) {
+				lores_coefs(b->twopidsr, f, r, &b->a1[ch], &b->a2[ch], &b->scale[ch]);
+				b->freq[ch] = f;
+				b->res[ch] = r;
+			}
+			a1[l] = b->a1[ch];
+			a2[l] = b->a2[ch];
+			sc[l] = b->scale[ch];
+			y1[l] = b->ym1[ch];
+			y2[l] = b->ym2[ch];
+		}
+		else {
+			ip[l] = b->zero;
+			op[l] = b->scratch;
+			fp[l] = rp[l] = NULL;
+			a1[l] = a2[l] = 0.;
+			sc[l] = 1.;
+			y1[l] = y2[l] = 0.;
+		}
+	}
+
+	if (mod->accurate && (mod->fins || mod->rins)) {
+		for (i = 0; i < n; i++) {
+			for (l = 0; l < LORES_LANES; l++)
+				in[l] = ip[l][i];
+			for (l = 0; l < lanes; l++) {
+				f = fp[l] ? fp[l][i] : mod->freq;
+				r = rp[l] ? rp[l][i] : mod->res;
+				lores_coefs(b->twopidsr, f, r, &a1[l], &a2[l], &sc[l]);
+			}
+			for (l = 0; l < LORES_LANES; l++) {
+				y = sc[l] * in[l] - a1[l] * y1[l] - a2[l] * y2[l];
+				y2[l] = y1[l];
+				y1[l] = y;
+			}
+			for (l = 0; l < LORES_LANES; l++)
+				op[l][i] = y1[l];
+		}
+		for (l = 0; l < lanes; l++) {
+			b->a1[c + l] = a1[l];
+			b->a2[c + l] = a2[l];
+			b->scale[c + l] = sc[l];
+			b->freq[c + l] = b->res[c + l] = -1.;
+		}
+	}
+	else {
+		// inputs are read for every lane before any output is written, so
+		// in-place buffers shared between channels are safe
+		for (i = 0; i < n; i++) {
+			for (l = 0; l < LORES_LANES; l++)
+				in[l] = ip[l][i];
+			for (l = 0; l < LORES_LANES; l++) {
+				y = sc[l] * in[l] - a1[l] * y1[l] - a2[l] * y2[l];
+				y2[l] = y1[l];
+				y1[l] = y;
+			}
+			for (l = 0; l < LORES_LANES; l++)
+				op[l][i] = y1[l];
+		}
+	}
+
+	for (l = 0; l < lanes; l++) {
+		// FTZ takes care of denormals; a NaN or inf can only be cleared
+		if (!isfinite(y1[l]) || !isfinite(y2[l]))
+			y1[l] = y2[l] = 0.;
+		b->ym1[c + l] = y1[l];
+		b->ym2[c + l] = y2[l];
+	}
+}
+
+static inline void lores_bank_process(t_lores_bank *b, double **ins, double **outs, t_lores_mod *mod, long n)
+{
+	t_denorm_fpstate fpstate;
+	long c;
+
+	if (n > b->vs)
+		return;
+
+	fpstate = denorm_enter();
+	for (c = 0; c < b->chans; c += LORES_LANES)
+		lores_bank_group(b, c, MIN(LORES_LANES, b->chans - c), ins, outs, mod, n);
+	denorm_exit(fpstate);
+}
+
+#endif // _LORES_H_
@@ -0,0 +1,190 @@
+/**
+	@file
+	modbus.h - named audio-rate modulation buses, written by modbus~ and read by lores~, split~ and simpwave~
+
+	A bus is a named set of MODBUS_CHANS signal channels. modbus~ copies
+	its inlets into a bus once per vector; any number of objects read a
+	channel straight out of the bus, with no patch cord and no copy. A
+	reader resolves its bus and channel in dsp64, and each vector only
+	looks up which of the channel's two slots was written last.
+
+	Writers fill the slot readers are not looking at and then publish it,
+	so a reader always gets a whole vector. MSP orders the writer and its
+	readers however it likes, since nothing connects them: a reader that
+	runs first gets the previous vector. Keep one writer per channel.
+
+	Buses live in one table per Max session, hung off a symbol's s_thing
+	as dspprobe.h does, so every external that includes this file sees the
+	same buses. Slots are aligned to cache lines.
+
+	A bus only ever grows, and never frees a block of slots once readers
+	may have seen it: another chain (a poly~, say) can recompile while this
+	one runs, so a bigger vector size gets a new block and the old ones
+	are kept, linked from the new one, for the life of the session.
+*/
+
+#ifndef _MODBUS_H_
+#define _MODBUS_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+#include "z_dsp.h"
+
+#define MODBUS_MAX		64			// buses per session
+#define MODBUS_CHANS	16			// channels per bus
+#define MODBUS_ALIGN	64			// bytes
+#define MODBUS_MAGIC	0x6D627573	// 'mbus', in case something else owns the symbol
+
+typedef struct _modbus_chan
+{
+	double			*slot[2];		// vectors written alternately
+	t_int32_atomic	gen;			// bumped after each write: slot[gen & 1] is the latest
+	long			frames;			// frames in the latest vector
+	long			writers;		// modbus~ objects writing here (main thread)
+} t_modbus_chan;
+
+typedef struct _modbus
+{
+	t_symbol		*name;
+	long			vs;				// frames each slot has room for
+	char			*mem;			// where the slots come from, before alignment; starts with the previous block
+	t_modbus_chan	chans[MODBUS_CHANS];
+} t_modbus;
+
+typedef struct _modbus_registry
+{
+	long			magic;
+	long			count;
+	t_modbus		buses[MODBUS_MAX];
+} t_modbus_registry;
+
+// a reader's end: the attribute's atoms (name and channel), resolved in dsp64
+typedef struct _modbus_ref
+{
+	t_atom			atoms[2];
+	long			natoms;
+	t_modbus_chan	*chan;
+} t_modbus_ref;
+
+
+static inline t_modbus_registry *modbus_registry(void)
+{
+	t_symbol *s = gensym("__modbus_registry__");
+	t_modbus_registry *reg = (t_modbus_registry *)s->s_thing;
+
+	if (!reg) {
+		reg = (t_modbus_registry *)sysmem_newptrclear(sizeof(t_modbus_registry));
+		if (!reg)
+			return NULL;
+		reg->magic = MODBUS_MAGIC;
+		s->s_thing = (t_object *)reg;		// never freed: readers keep pointers into it
+	}
+	return reg->magic == MODBUS_MAGIC ? reg : NULL;
+}
+
+// main thread: the bus called name, created if need be. NULL if the table is full.
+static inline t_modbus *modbus_get(t_symbol *name)
+{
+	t_modbus_registry *reg = modbus_registry();
+	long i;
+
+	if (!reg || !name || !name->s_name[0])
+		return NULL;
+	for (i = 0; i < reg->count; i++) {
+		if (reg->buses[i].name == name)
+			return reg->buses + i;
+	}
+	if (reg->count >= MODBUS_MAX)
+		return NULL;
+	reg->buses[reg->count].name = name;
+	return reg->buses + reg->count++;
+}
+
+// dsp64: make room for vectors of vs frames. Other chains may be running and reading the bus,
+// so the old slots stay where they are: readers and writers move to the new ones on their next vector.
+static inline t_max_err modbus_prepare(t_modbus *b, long vs)
+{
+	long stride, i;
+	char *mem, *p;
+
+	if (vs <= b->vs)
+		return MAX_ERR_NONE;
+	stride = (vs * sizeof(double) + MODBUS_ALIGN - 1) & ~(long)(MODBUS_ALIGN - 1);
+	mem = (char *)sysmem_newptrclear(2 * MODBUS_CHANS * stride + 2 * MODBUS_ALIGN);
+	if (!mem)
+		return MAX_ERR_OUT_OF_MEM;
+	*(char **)mem = b->mem;		// kept, never freed
+	p = (char *)(((t_ptr_uint)mem + MODBUS_ALIGN + MODBUS_ALIGN - 1) & ~(t_ptr_uint)(MODBUS_ALIGN - 1));
+	for (i = 0; i < MODBUS_CHANS; i++) {
+		b->chans[i].frames = 0;		// a reader between these stores finds a short vector and reads nothing
+		b->chans[i].slot[0] = (double *)(p + 2 * i * stride);
+		b->chans[i].slot[1] = (double *)(p + (2 * i + 1) * stride);
+	}
+	b->mem = mem;
+	b->vs = vs;
+	return MAX_ERR_NONE;
+}
+
+// audio thread: publish n frames on a channel of a prepared bus
+static inline void modbus_write(t_modbus_chan *c, const double *in, long n)
+{
+	double *slot = c->slot[(c->gen + 1) & 1];
+
+	memcpy(slot, in, n * sizeof(double));
+	c->frames = n;
+	ATOMIC_INCREMENT_BARRIER(&c->gen);
+}
+
+
+//***********************************************************************************************
+// readers
+
+static inline void modbus_ref_init(t_modbus_ref *r)
+{
+	r->natoms = 0;
+	r->chan = NULL;
+}
+
+// attribute setter: a bus name and a channel (0 if left out); no atoms, or an empty name, disconnects
+static inline t_max_err modbus_ref_set(t_modbus_ref *r, long argc, t_atom *argv)
+{
+	t_symbol *name = argc ? atom_getsym(argv) : gensym("");
+	long chan = argc > 1 ? (long)atom_getlong(argv + 1) : 0;
+
+	if (!name->s_name[0]) {
+		r->natoms = 0;
+		return MAX_ERR_NONE;
+	}
+	atom_setsym(r->atoms, name);
+	atom_setlong(r->atoms + 1, CLAMP(chan, 0, MODBUS_CHANS - 1));
+	r->natoms = 2;
+	return MAX_ERR_NONE;
+}
+
+// dsp64: find the channel, true if there is one to read
+static inline t_bool modbus_ref_resolve(t_modbus_ref *r, long vs)
+{
+	t_modbus *b = r->natoms ? modbus_get(atom_getsym(r->atoms)) : NULL;
+
+	r->chan = NULL;
+	if (b && modbus_prepare(b, vs) == MAX_ERR_NONE)
+		r->chan = b->chans + atom_getlong(r->atoms + 1);
+	return r->chan != NULL;
+}
+
+// perform: the latest vector on the channel, or NULL if nothing writes it (or it is shorter than n)
+static inline const double *modbus_ref_read(t_modbus_ref *r, long n)
+{
+	t_modbus_chan *c = r->chan;
+	t_int32 gen;
+
+	if (!c || !c->writers)
+		return NULL;
+	gen = c->gen;
+	if (!gen || c->frames < n)
+		return NULL;
+	return c->slot[gen & 1];
+}
+
+#endif // _MODBUS_H_
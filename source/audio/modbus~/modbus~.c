@@ -0,0 +1,143 @@
+/**
+	@file
+	modbus~ - write signals onto a named modulation bus
+
+	[modbus~ name 4] has four signal inlets and puts them on channels 0 to
+	3 of the bus called name (@offset moves them up). Every lores~,
+	split~ and simpwave~ that names the bus in one of its bus attributes
+	reads the channel from there, without a patch cord, so one LFO can
+	drive hundreds of voices for the price of a single vector copy.
+
+	@ingroup	examples
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include "modbus.h"
+
+
+typedef struct _modbus_obj {
+	t_pxobject	m_obj;
+	t_symbol	*m_name;
+	long		m_nchans;		// signal inlets
+	long		m_offset;		// bus channel of the first inlet
+	t_modbus	*m_bus;
+	long		m_first;		// channels we count ourselves a writer of
+	long		m_count;
+} t_modbus_obj;
+
+
+void *modbus_new(t_symbol *s, long argc, t_atom *argv);
+void modbus_free(t_modbus_obj *x);
+void modbus_assist(t_modbus_obj *x, void *b, long m, long a, char *s);
+void modbus_set(t_modbus_obj *x, t_symbol *s);
+t_max_err modbus_attr_setoffset(t_modbus_obj *x, void *attr, long argc, t_atom *argv);
+void modbus_perform64(t_modbus_obj *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void modbus_dsp64(t_modbus_obj *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+
+
+static t_class *s_modbus_class;
+
+
+void ext_main(void *r)
+{
+	t_class *c = class_new("modbus~", (method)modbus_new, (method)modbus_free, sizeof(t_modbus_obj), NULL, A_GIMME, 0);
+
+	class_addmethod(c, (method)modbus_dsp64,	"dsp64",	A_CANT, 0);
+	class_addmethod(c, (method)modbus_set,		"set",		A_SYM, 0);
+	class_addmethod(c, (method)modbus_assist,	"assist",	A_CANT, 0);
+	class_dspinit(c);
+
+	CLASS_ATTR_LONG(c, "offset", 0, t_modbus_obj, m_offset);
+	CLASS_ATTR_ACCESSORS(c, "offset", NULL, modbus_attr_setoffset);
+	CLASS_ATTR_LABEL(c, "offset", 0, "Bus Channel of the First Inlet");
+
+	class_register(CLASS_BOX, c);
+	s_modbus_class = c;
+}
+
+
+// count ourselves as the writer of our channels, so readers know they are live
+static void modbus_attach(t_modbus_obj *x)
+{
+	long i;
+
+	if (x->m_bus) {
+		for (i = 0; i < x->m_count; i++)
+			x->m_bus->chans[x->m_first + i].writers--;
+	}
+	x->m_bus = modbus_get(x->m_name);
+	x->m_first = CLAMP(x->m_offset, 0, MODBUS_CHANS - 1);
+	x->m_count = MIN(x->m_nchans, MODBUS_CHANS - x->m_first);
+	if (x->m_bus) {
+		for (i = 0; i < x->m_count; i++)
+			x->m_bus->chans[x->m_first + i].writers++;
+	}
+	else if (x->m_name->s_name[0])
+		object_error((t_object *)x, "too many buses, %s won't be written", x->m_name->s_name);
+}
+
+
+void *modbus_new(t_symbol *s, long argc, t_atom *argv)
+{
+	t_modbus_obj *x = (t_modbus_obj *)object_alloc(s_modbus_class);
+	long offset = attr_args_offset((short)argc, argv);
+
+	x->m_name = offset > 0 ? atom_getsym(argv) : gensym("");
+	x->m_nchans = offset > 1 ? CLAMP(atom_getlong(argv + 1), 1, MODBUS_CHANS) : 1;
+	x->m_offset = 0;
+	dsp_setup((t_pxobject *)x, x->m_nchans);
+	attr_args_process(x, (short)argc, argv);
+	modbus_attach(x);
+	return x;
+}
+
+
+void modbus_free(t_modbus_obj *x)
+{
+	dsp_free((t_pxobject *)x);
+	x->m_nchans = 0;
+	modbus_attach(x);
+}
+
+
+void modbus_assist(t_modbus_obj *x, void *b, long m, long a, char *s)
+{
+	snprintf_zero(s, 256, "(signal) Bus %s Channel %ld, set", x->m_name->s_name, x->m_offset + a);
+}
+
+
+void modbus_set(t_modbus_obj *x, t_symbol *s)
+{
+	x->m_name = s;
+	modbus_attach(x);
+}
+
+
+t_max_err modbus_attr_setoffset(t_modbus_obj *x, void *attr, long argc, t_atom *argv)
+{
+	x->m_offset = argc ? CLAMP(atom_getlong(argv), 0, MODBUS_CHANS - 1) : 0;
+	if (x->m_bus)
+		modbus_attach(x);
+	return MAX_ERR_NONE;
+}
+
+
+void modbus_perform64(t_modbus_obj *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	t_modbus *b = x->m_bus;
+	long i;
+
+	if (!b || sampleframes > b->vs)
+		return;
+	for (i = 0; i < x->m_count; i++)
+		modbus_write(b->chans + x->m_first + i, ins[i], sampleframes);
+}
+
+
+void modbus_dsp64(t_modbus_obj *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	if (x->m_bus && modbus_prepare(x->m_bus, maxvectorsize) == MAX_ERR_NONE)
+		object_method(dsp64, gensym("dsp_add64"), x, modbus_perform64, 0, NULL);
+}
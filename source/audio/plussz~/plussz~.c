@@ -10,6 +10,7 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "z_dsp.h"
+#include "simdsig.h"
 
 void *plussz_class;
 
@@ -30,7 +31,11 @@ void plussz_assist(t_plussz *x, void *b, long m, long a, char *s);
 
 void ext_main(void *r)
 {
-	t_class *c = class_new("plussz~", (method)plussz_new, (method)dsp_free, sizeof(t_plussz), NULL, A_DEFFLOAT, 0);
+	t_class *c;
+
+	simdsig_init();												// pick the vector kernels for this CPU
+
+	c = class_new("plussz~", (method)plussz_new, (method)dsp_free, sizeof(t_plussz), NULL, A_DEFFLOAT, 0);
 
 	class_addmethod(c, (method)plussz_dsp64, "dsp64", A_CANT, 0); 	// respond to the dsp message
 	class_addmethod(c, (method)plussz_float, "float", A_FLOAT, 0);
@@ -88,10 +93,8 @@ void plussz_offset_perform64(t_plussz *x, t_object *dsp64, double **ins, long nu
 {
 	t_double	*in = ins[x->x_connected];
 	t_double	*out = outs[0];
-	double		val = x->x_val;
 
-	while (sampleframes--)
-		*out++ = val + *in++;
+	s_simdsig.offset(out, in, x->x_val, sampleframes);
 }
 
 
@@ -102,8 +105,7 @@ void plussz_perform64(t_plussz *x, t_object *dsp64, double **ins, long numins, d
 	t_double *in2 = ins[1];
 	t_double *out = outs[0];
 
-	while (sampleframes--)
-		*out++ = *in1++ + *in2++;
+	s_simdsig.add(out, in1, in2, sampleframes);
 }
 
 
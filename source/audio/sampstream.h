@@ -0,0 +1,198 @@
+/**
+	@file
+	sampstream.h - the part of a sampstream~ source that its readers share
+
+	A sampstream~ object memory-maps a sound file and runs a read-ahead
+	thread that decodes blocks of frames into a ring of float slots around
+	the playheads of its readers. The state both sides touch lives in a
+	reference counted t_sampstream_core, so a reader (bufreader.h) can keep
+	using it for the vector it is in when the sampstream~ is deleted.
+
+	The ring is direct mapped: block b lives in slot b & (nslots - 1). The
+	thread marks a slot empty before it refills it and publishes the new
+	block number afterwards; the audio thread checks the tag before and
+	after copying out of a slot, so it never needs a lock. Frames that are
+	not in the ring are decoded straight from the mapping (a miss) or, with
+	direct reads turned off, come out silent (an underrun).
+*/
+
+#ifndef _SAMPSTREAM_H_
+#define _SAMPSTREAM_H_
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_atomic.h"
+
+#define SAMPSTREAM_BLOCKFRAMES	4096	// frames per ring slot
+#define SAMPSTREAM_VOICES		8		// playheads the read-ahead thread follows
+
+#ifdef WIN_VERSION
+#define SAMPSTREAM_FENCE()		MemoryBarrier()
+#else
+#define SAMPSTREAM_FENCE()		__sync_synchronize()
+#endif
+
+enum {
+	SAMPSTREAM_INT16 = 0,
+	SAMPSTREAM_INT24,
+	SAMPSTREAM_INT32,
+	SAMPSTREAM_FLOAT32
+};
+
+typedef struct _sampstream_core
+{
+	t_int32_atomic	refcount;		// the sampstream~ plus every reader
+	t_int32_atomic	inuse;			// fetches in progress
+	volatile long	dead;			// the file has been closed, nothing more to read
+
+	const unsigned char	*data;		// first sample frame in the mapping
+	long			format;			// SAMPSTREAM_INT16 ...
+	long			bigendian;
+	long			bytes;			// bytes per sample
+	t_int64			frames;			// 64 bits even where long is 32, for files past 2^31 frames
+	long			nchans;
+	double			sr;
+
+	long			nslots;			// power of two
+	float			*slots;			// nslots * SAMPSTREAM_BLOCKFRAMES * nchans decoded samples
+	volatile long	*tags;			// block held by each slot, -1 while empty or being filled
+	char			direct;			// decode misses from the mapping instead of outputting silence
+
+	t_int32_atomic	users[SAMPSTREAM_VOICES];		// readers sharing each playhead
+	volatile t_int64 playheads[SAMPSTREAM_VOICES];	// latest frame read by each voice, -1 if idle
+
+	t_int32_atomic	hits;			// block runs copied from the ring
+	t_int32_atomic	misses;			// block runs decoded from the mapping on the audio thread
+	t_int32_atomic	underruns;		// block runs that came out silent
+	t_int32_atomic	torn;			// block runs refilled while being copied (also counted as misses)
+} t_sampstream_core;
+
+
+static inline void sampstream_core_retain(t_sampstream_core *c)
+{
+	ATOMIC_INCREMENT(&c->refcount);
+}
+
+// the last release frees the ring and the core itself; the mapping is gone by then
+static inline void sampstream_core_release(t_sampstream_core *c)
+{
+	if (ATOMIC_DECREMENT(&c->refcount) == 0) {
+		if (c->slots)
+			sysmem_freeptr(c->slots);
+		if (c->tags)
+			sysmem_freeptr((void *)c->tags);
+		sysmem_freeptr(c);
+	}
+}
+
+// enter / leave the region where the mapping may be read. Returns false if the file is closed.
+static inline t_bool sampstream_core_enter(t_sampstream_core *c)
+{
+	ATOMIC_INCREMENT(&c->inuse);
+	if (c->dead) {
+		ATOMIC_DECREMENT(&c->inuse);
+		return false;
+	}
+	return true;
+}
+
+static inline void sampstream_core_leave(t_sampstream_core *c)
+{
+	ATOMIC_DECREMENT(&c->inuse);
+}
+
+// main thread: a playhead for a new reader, the least shared one, since past
+// SAMPSTREAM_VOICES readers some have to share
+static inline long sampstream_core_voice(t_sampstream_core *c)
+{
+	long v, best = 0;
+
+	for (v = 1; v < SAMPSTREAM_VOICES; v++) {
+		if (c->users[v] < c->users[best])
+			best = v;
+	}
+	ATOMIC_INCREMENT(&c->users[best]);
+	return best;
+}
+
+// main thread: a reader is done with its playhead; the last one off it tells the read-ahead thread to stop following it
+static inline void sampstream_core_unvoice(t_sampstream_core *c, long voice)
+{
+	if (ATOMIC_DECREMENT(&c->users[voice]) == 0)
+		c->playheads[voice] = -1;
+}
+
+// decode count frames starting at frame from the mapping into dst, interleaved
+static inline void sampstream_decode(const t_sampstream_core *c, t_int64 frame, long count, float *dst)
+{
+	const unsigned char *p = c->data + (size_t)frame * c->nchans * c->bytes;
+	long i, n = count * c->nchans;
+	union { t_uint32 u; float f; } v;
+
+	switch (c->format) {
+	case SAMPSTREAM_INT16:
+		for (i = 0; i < n; i++, p += 2) {
+			v.u = c->bigendian ? ((t_uint32)p[0] << 24) | ((t_uint32)p[1] << 16)
+							   : ((t_uint32)p[1] << 24) | ((t_uint32)p[0] << 16);
+			dst[i] = (float)((t_int32)v.u * (1. / 2147483648.));
+		}
+		break;
+	case SAMPSTREAM_INT24:
+		for (i = 0; i < n; i++, p += 3) {
+			v.u = c->bigendian ? ((t_uint32)p[0] << 24) | ((t_uint32)p[1] << 16) | ((t_uint32)p[2] << 8)
+							   : ((t_uint32)p[2] << 24) | ((t_uint32)p[1] << 16) | ((t_uint32)p[0] << 8);
+			dst[i] = (float)((t_int32)v.u * (1. / 2147483648.));
+		}
+		break;
+	case SAMPSTREAM_INT32:
+	case SAMPSTREAM_FLOAT32:
+		for (i = 0; i < n; i++, p += 4) {
+			v.u = c->bigendian ? ((t_uint32)p[0] << 24) | ((t_uint32)p[1] << 16) | ((t_uint32)p[2] << 8) | p[3]
+							   : ((t_uint32)p[3] << 24) | ((t_uint32)p[2] << 16) | ((t_uint32)p[1] << 8) | p[0];
+			dst[i] = c->format == SAMPSTREAM_FLOAT32 ? v.f : (float)((t_int32)v.u * (1. / 2147483648.));
+		}
+		break;
+	}
+}
+
+// audio thread, between sampstream_core_enter() and sampstream_core_leave():
+// copy count interleaved frames starting at frame into dst and move the voice's playhead there
+static inline void sampstream_fetch(t_sampstream_core *c, long voice, t_int64 frame, long count, float *dst)
+{
+	const long nc = c->nchans;
+	long block, off, run, slot, tag;
+
+	c->playheads[voice] = frame;
+	while (count > 0) {
+		block = (long)(frame / SAMPSTREAM_BLOCKFRAMES);		// fits in a long up to 2^43 frames
+		off = (long)(frame - (t_int64)block * SAMPSTREAM_BLOCKFRAMES);
+		run = MIN(count, SAMPSTREAM_BLOCKFRAMES - off);
+		slot = block & (c->nslots - 1);
+
+		tag = c->tags[slot];
+		SAMPSTREAM_FENCE();
+		if (tag == block) {
+			memcpy(dst, c->slots + ((size_t)slot * SAMPSTREAM_BLOCKFRAMES + off) * nc, run * nc * sizeof(float));
+			SAMPSTREAM_FENCE();
+			if (c->tags[slot] == block) {
+				ATOMIC_INCREMENT(&c->hits);
+				goto next;
+			}
+			ATOMIC_INCREMENT(&c->torn);
+		}
+		if (c->direct) {
+			sampstream_decode(c, frame, run, dst);
+			ATOMIC_INCREMENT(&c->misses);
+		}
+		else {
+			memset(dst, 0, run * nc * sizeof(float));
+			ATOMIC_INCREMENT(&c->underruns);
+		}
+next:
+		dst += run * nc;
+		frame += run;
+		count -= run;
+	}
+}
+
+#endif // _SAMPSTREAM_H_
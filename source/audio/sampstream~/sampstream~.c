@@ -0,0 +1,597 @@
+/**
+	@file
+	sampstream~ - a disk-streamed sample source for index~, simpwave~ and jw_vindex~
+
+	sampstream~ name maps a WAV, AIFF or raw float file into memory instead of
+	loading it into a buffer~. Readers set to the same name (and finding no
+	buffer~ called that) read through it: a background thread decodes blocks
+	around each reader's playhead into a lock-free ring and asks the OS to
+	page in the file further ahead, so the audio thread only copies floats.
+	The ring and the read path are in ../sampstream.h.
+
+	@ingroup	examples
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_systhread.h"
+#include <math.h>
+#include "sampstream.h"
+
+#ifdef WIN_VERSION
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+
+typedef struct _sampstream {
+	t_object			s_obj;
+	t_symbol			*s_name;		// name readers use to find us
+	t_sampstream_core	*s_core;		// NULL when no file is open
+	void				*s_map;			// the whole file
+	size_t				s_maplen;
+#ifdef WIN_VERSION
+	HANDLE				s_file;
+	HANDLE				s_mapping;
+#endif
+	t_systhread			s_thread;		// read-ahead thread
+	volatile long		s_cancel;
+	long				s_lastblock[SAMPSTREAM_VOICES];	// block each playhead was in when we last prefetched
+	long				s_filled;		// blocks decoded by the read-ahead thread
+	long				s_advised;		// blocks handed to the OS for prefetch
+	long				s_majflt;		// page fault counts when the file was opened
+	long				s_minflt;
+	long				s_ahead;		// blocks decoded ahead of each playhead
+	long				s_behind;		// blocks kept behind it
+	long				s_prefetch;		// blocks paged in beyond the ring
+	char				s_direct;		// decode ring misses on the audio thread
+	long				s_rawchans;		// layout of headerless float files
+	double				s_rawsr;
+	void				*s_outlet;
+} t_sampstream;
+
+
+void *sampstream_new(t_symbol *s, long argc, t_atom *argv);
+void sampstream_free(t_sampstream *x);
+void sampstream_assist(t_sampstream *x, void *b, long m, long a, char *s);
+void sampstream_open(t_sampstream *x, t_symbol *s);
+void sampstream_doopen(t_sampstream *x, t_symbol *s, long argc, t_atom *argv);
+void sampstream_close(t_sampstream *x);
+void sampstream_report(t_sampstream *x);
+void sampstream_reset(t_sampstream *x);
+void *sampstream_getcore(t_sampstream *x);
+t_max_err sampstream_attr_setdirect(t_sampstream *x, void *attr, long argc, t_atom *argv);
+void *sampstream_threadproc(t_sampstream *x);
+
+
+static t_class *s_sampstream_class;
+static t_symbol *ps_sampstream;
+static t_symbol *ps_sampstream_changed;
+static t_symbol *ps_nothing;
+
+
+void ext_main(void *r)
+{
+	t_class *c = class_new("sampstream~", (method)sampstream_new, (method)sampstream_free, sizeof(t_sampstream), NULL, A_GIMME, 0);
+
+	class_addmethod(c, (method)sampstream_open,		"open",		A_DEFSYM, 0);
+	class_addmethod(c, (method)sampstream_close,	"close",	0);
+	class_addmethod(c, (method)sampstream_report,	"report",	0);
+	class_addmethod(c, (method)sampstream_reset,	"reset",	0);
+	class_addmethod(c, (method)sampstream_assist,	"assist",	A_CANT, 0);
+	class_addmethod(c, (method)sampstream_getcore,	"getcore",	A_CANT, 0);
+
+	CLASS_ATTR_LONG(c, "ahead", 0, t_sampstream, s_ahead);
+	CLASS_ATTR_FILTER_CLIP(c, "ahead", 1, 256);
+	CLASS_ATTR_LABEL(c, "ahead", 0, "Blocks Decoded Ahead (takes effect on open)");
+
+	CLASS_ATTR_LONG(c, "behind", 0, t_sampstream, s_behind);
+	CLASS_ATTR_FILTER_CLIP(c, "behind", 0, 64);
+	CLASS_ATTR_LABEL(c, "behind", 0, "Blocks Kept Behind (takes effect on open)");
+
+	CLASS_ATTR_LONG(c, "prefetch", 0, t_sampstream, s_prefetch);
+	CLASS_ATTR_FILTER_CLIP(c, "prefetch", 0, 4096);
+	CLASS_ATTR_LABEL(c, "prefetch", 0, "Blocks Paged In Beyond the Ring");
+
+	CLASS_ATTR_CHAR(c, "direct", 0, t_sampstream, s_direct);
+	CLASS_ATTR_STYLE_LABEL(c, "direct", 0, "onoff", "Read Misses From Disk");
+	CLASS_ATTR_ACCESSORS(c, "direct", NULL, sampstream_attr_setdirect);
+
+	CLASS_ATTR_LONG(c, "rawchans", 0, t_sampstream, s_rawchans);
+	CLASS_ATTR_FILTER_MIN(c, "rawchans", 1);
+	CLASS_ATTR_LABEL(c, "rawchans", 0, "Channels in Raw Files");
+
+	CLASS_ATTR_DOUBLE(c, "rawsr", 0, t_sampstream, s_rawsr);
+	CLASS_ATTR_FILTER_MIN(c, "rawsr", 1);
+	CLASS_ATTR_LABEL(c, "rawsr", 0, "Sample Rate of Raw Files");
+
+	class_register(CLASS_BOX, c);
+	s_sampstream_class = c;
+
+	ps_sampstream = gensym("sampstream");
+	ps_sampstream_changed = gensym("sampstream_changed");
+	ps_nothing = gensym("");
+}
+
+
+void *sampstream_new(t_symbol *s, long argc, t_atom *argv)
+{
+	t_sampstream *x = (t_sampstream *)object_alloc(s_sampstream_class);
+	long offset = attr_args_offset((short)argc, argv);
+	long i;
+
+	x->s_name = atom_getsymarg(0, offset, argv);
+	x->s_core = NULL;
+	x->s_map = NULL;
+	x->s_thread = NULL;
+	x->s_cancel = false;
+	x->s_ahead = 16;
+	x->s_behind = 2;
+	x->s_prefetch = 64;
+	x->s_direct = 1;
+	x->s_rawchans = 1;
+	x->s_rawsr = sys_getsr();
+	for (i = 0; i < SAMPSTREAM_VOICES; i++)
+		x->s_lastblock[i] = -1;
+	x->s_outlet = outlet_new((t_object *)x, NULL);
+
+	attr_args_process(x, (short)argc, argv);
+
+	if (x->s_name != ps_nothing)
+		object_register(ps_sampstream, x->s_name, x);
+	if (offset > 1)
+		sampstream_open(x, atom_getsym(argv + 1));
+	return x;
+}
+
+
+void sampstream_free(t_sampstream *x)
+{
+	sampstream_close(x);
+	if (x->s_name != ps_nothing)
+		object_unregister(x);
+}
+
+
+void sampstream_assist(t_sampstream *x, void *b, long m, long a, char *s)
+{
+	if (m == ASSIST_INLET)
+		snprintf_zero(s, 256, "open, close, report, reset");
+	else
+		snprintf_zero(s, 256, "report: hits misses underruns torn filled prefetched major-faults minor-faults");
+}
+
+
+// readers call this (through object_method) to share our state; the core comes back retained
+void *sampstream_getcore(t_sampstream *x)
+{
+	if (!x->s_core)
+		return NULL;
+	sampstream_core_retain(x->s_core);
+	return x->s_core;
+}
+
+
+t_max_err sampstream_attr_setdirect(t_sampstream *x, void *attr, long argc, t_atom *argv)
+{
+	x->s_direct = atom_getlong(argv) != 0;
+	if (x->s_core)
+		x->s_core->direct = x->s_direct;
+	return MAX_ERR_NONE;
+}
+
+
+static void sampstream_faults(long *majflt, long *minflt)
+{
+#ifdef WIN_VERSION
+	*majflt = *minflt = 0;		// not reported on Windows
+#else
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	*majflt = ru.ru_majflt;
+	*minflt = ru.ru_minflt;
+#endif
+}
+
+
+static t_bool sampstream_map(t_sampstream *x, const char *path)
+{
+#ifdef WIN_VERSION
+	LARGE_INTEGER size;
+
+	x->s_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (x->s_file == INVALID_HANDLE_VALUE)
+		return false;
+	if (!GetFileSizeEx(x->s_file, &size) || size.QuadPart == 0) {
+		CloseHandle(x->s_file);
+		return false;
+	}
+	x->s_mapping = CreateFileMapping(x->s_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!x->s_mapping) {
+		CloseHandle(x->s_file);
+		return false;
+	}
+	x->s_map = MapViewOfFile(x->s_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!x->s_map) {
+		CloseHandle(x->s_mapping);
+		CloseHandle(x->s_file);
+		return false;
+	}
+	x->s_maplen = (size_t)size.QuadPart;
+#else
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	x->s_map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);		// the mapping keeps the file open
+	if (x->s_map == MAP_FAILED) {
+		x->s_map = NULL;
+		return false;
+	}
+	x->s_maplen = (size_t)st.st_size;
+	madvise(x->s_map, x->s_maplen, MADV_RANDOM);	// we do our own read-ahead
+#endif
+	return true;
+}
+
+
+static void sampstream_unmap(t_sampstream *x)
+{
+	if (!x->s_map)
+		return;
+#ifdef WIN_VERSION
+	UnmapViewOfFile(x->s_map);
+	CloseHandle(x->s_mapping);
+	CloseHandle(x->s_file);
+#else
+	munmap(x->s_map, x->s_maplen);
+#endif
+	x->s_map = NULL;
+	x->s_maplen = 0;
+}
+
+
+// ask the OS to start paging in count frames from frame
+static void sampstream_advise(t_sampstream *x, t_sampstream_core *c, t_int64 frame, long count)
+{
+	size_t framebytes = (size_t)c->nchans * c->bytes;
+	const unsigned char *start = c->data + (size_t)frame * framebytes;
+	size_t len = (size_t)count * framebytes;
+#ifdef WIN_VERSION
+	volatile unsigned char touch;
+	size_t i;
+
+	for (i = 0; i < len; i += 4096)	// fault the pages in from this thread
+		touch = start[i];
+#else
+	long page = sysconf(_SC_PAGESIZE);
+	const unsigned char *aligned = (const unsigned char *)((size_t)start & ~(size_t)(page - 1));
+
+	madvise((void *)aligned, len + (start - aligned), MADV_WILLNEED);
+#endif
+}
+
+
+static t_uint32 sampstream_be32(const unsigned char *p)
+{
+	return ((t_uint32)p[0] << 24) | ((t_uint32)p[1] << 16) | ((t_uint32)p[2] << 8) | p[3];
+}
+
+static t_uint32 sampstream_le32(const unsigned char *p)
+{
+	return ((t_uint32)p[3] << 24) | ((t_uint32)p[2] << 16) | ((t_uint32)p[1] << 8) | p[0];
+}
+
+// 80-bit IEEE extended, as found in the AIFF COMM chunk
+static double sampstream_extended(const unsigned char *p)
+{
+	long expon = ((p[0] & 0x7F) << 8) | p[1];
+	double mant = sampstream_be32(p + 2) * 4294967296. + sampstream_be32(p + 6);
+
+	if (!expon && !mant)
+		return 0.;
+	return ((p[0] & 0x80) ? -1. : 1.) * ldexp(mant, (int)(expon - 16383 - 63));
+}
+
+static t_bool sampstream_setformat(t_sampstream_core *c, long bits, t_bool isfloat)
+{
+	if (isfloat) {
+		if (bits != 32)
+			return false;
+		c->format = SAMPSTREAM_FLOAT32;
+	}
+	else if (bits == 16)
+		c->format = SAMPSTREAM_INT16;
+	else if (bits == 24)
+		c->format = SAMPSTREAM_INT24;
+	else if (bits == 32)
+		c->format = SAMPSTREAM_INT32;
+	else
+		return false;
+	c->bytes = bits / 8;
+	return true;
+}
+
+// fill in the sample format and data pointer of c from a WAV or AIFF header,
+// or treat the file as raw little-endian floats
+static t_bool sampstream_parse(t_sampstream *x, t_sampstream_core *c)
+{
+	const unsigned char *m = (const unsigned char *)x->s_map;
+	const unsigned char *p, *end = m + x->s_maplen, *data = NULL;
+	size_t datalen = 0, size;
+	t_bool fmt = false;
+
+	if (x->s_maplen >= 12 && !memcmp(m, "RIFF", 4) && !memcmp(m + 8, "WAVE", 4)) {
+		c->bigendian = false;
+		for (p = m + 12; p + 8 <= end; p += 8 + size + (size & 1)) {
+			size = sampstream_le32(p + 4);
+			if (!memcmp(p, "fmt ", 4) && size >= 16 && p + 24 <= end) {
+				long tag = p[8] | (p[9] << 8);
+
+				if (tag == 0xFFFE && size >= 40 && p + 34 <= end)	// WAVE_FORMAT_EXTENSIBLE: the subformat GUID starts with the tag
+					tag = p[32] | (p[33] << 8);
+				c->nchans = p[10] | (p[11] << 8);
+				c->sr = sampstream_le32(p + 12);
+				if ((tag != 1 && tag != 3) || !sampstream_setformat(c, p[22] | (p[23] << 8), tag == 3))
+					return false;
+				fmt = true;
+			}
+			else if (!memcmp(p, "data", 4)) {
+				data = p + 8;
+				datalen = MIN(size, (size_t)(end - data));		// some writers leave the size at 0xFFFFFFFF
+			}
+			if (size > (size_t)(end - p))
+				break;
+		}
+	}
+	else if (x->s_maplen >= 12 && !memcmp(m, "FORM", 4) && (!memcmp(m + 8, "AIFF", 4) || !memcmp(m + 8, "AIFC", 4))) {
+		c->bigendian = true;
+		for (p = m + 12; p + 8 <= end; p += 8 + size + (size & 1)) {
+			size = sampstream_be32(p + 4);
+			if (!memcmp(p, "COMM", 4) && size >= 18 && p + 26 <= end) {
+				long bits = (p[14] << 8) | p[15];
+				t_bool isfloat = false;
+
+				c->nchans = (p[8] << 8) | p[9];
+				c->sr = sampstream_extended(p + 16);
+				if (size >= 22 && p + 30 <= end) {	// AIFC compression type
+					if (!memcmp(p + 26, "sowt", 4))
+						c->bigendian = false;
+					else if (!memcmp(p + 26, "fl32", 4) || !memcmp(p + 26, "FL32", 4))
+						isfloat = true;
+					else if (memcmp(p + 26, "NONE", 4))
+						return false;
+				}
+				if (!sampstream_setformat(c, bits, isfloat))
+					return false;
+				fmt = true;
+			}
+			else if (!memcmp(p, "SSND", 4) && p + 16 <= end) {
+				data = p + 16 + sampstream_be32(p + 8);
+				datalen = data < end ? MIN(size - 8, (size_t)(end - data)) : 0;
+			}
+			if (size > (size_t)(end - p))
+				break;
+		}
+	}
+	else {
+		c->bigendian = false;
+		c->nchans = x->s_rawchans;
+		c->sr = x->s_rawsr;
+		sampstream_setformat(c, 32, true);
+		data = m;
+		datalen = x->s_maplen;
+		fmt = true;
+	}
+
+	if (!fmt || !data || c->nchans < 1)
+		return false;
+	c->data = data;
+	c->frames = (t_int64)(datalen / ((size_t)c->nchans * c->bytes));
+	return c->frames > 0;
+}
+
+
+static t_sampstream_core *sampstream_core_new(t_sampstream *x)
+{
+	t_sampstream_core *c = (t_sampstream_core *)sysmem_newptrclear(sizeof(t_sampstream_core));
+	long i, want;
+
+	if (!c)
+		return NULL;
+	c->refcount = 1;
+	if (!sampstream_parse(x, c)) {
+		sysmem_freeptr(c);
+		return NULL;
+	}
+	// room for every voice's window without the ring wrapping onto itself
+	want = SAMPSTREAM_VOICES * (x->s_ahead + x->s_behind + 1);
+	for (c->nslots = 1; c->nslots < want; c->nslots <<= 1)
+		;
+	c->slots = (float *)sysmem_newptr(c->nslots * SAMPSTREAM_BLOCKFRAMES * c->nchans * sizeof(float));
+	c->tags = (volatile long *)sysmem_newptr(c->nslots * sizeof(long));
+	if (!c->slots || !c->tags) {
+		sampstream_core_release(c);
+		return NULL;
+	}
+	for (i = 0; i < c->nslots; i++)
+		c->tags[i] = -1;
+	for (i = 0; i < SAMPSTREAM_VOICES; i++)
+		c->playheads[i] = -1;
+	c->direct = x->s_direct;
+	return c;
+}
+
+
+void sampstream_open(t_sampstream *x, t_symbol *s)
+{
+	defer(x, (method)sampstream_doopen, s, 0, NULL);
+}
+
+
+void sampstream_doopen(t_sampstream *x, t_symbol *s, long argc, t_atom *argv)
+{
+	char filename[MAX_PATH_CHARS];
+	char fullpath[MAX_PATH_CHARS];
+	short path;
+	t_fourcc outtype;
+	long i;
+
+	sampstream_close(x);
+	if (s == ps_nothing) {
+		if (open_dialog(filename, &path, &outtype, NULL, 0))
+			return;
+	}
+	else {
+		strncpy_zero(filename, s->s_name, MAX_PATH_CHARS);
+		if (locatefile_extended(filename, &path, &outtype, NULL, 0)) {
+			object_error((t_object *)x, "%s: can't find file", s->s_name);
+			return;
+		}
+	}
+	if (path_toabsolutesystempath(path, filename, fullpath) || !sampstream_map(x, fullpath)) {
+		object_error((t_object *)x, "%s: can't map file", filename);
+		return;
+	}
+	x->s_core = sampstream_core_new(x);
+	if (!x->s_core) {
+		object_error((t_object *)x, "%s: not a 16/24/32 bit or float WAV or AIFF file", filename);
+		sampstream_unmap(x);
+		return;
+	}
+
+	sampstream_reset(x);
+	for (i = 0; i < SAMPSTREAM_VOICES; i++)
+		x->s_lastblock[i] = -1;
+	x->s_cancel = false;
+	systhread_create((method)sampstream_threadproc, x, 0, 0, 0, &x->s_thread);
+	object_notify(x, ps_sampstream_changed, NULL);	// readers pick up the new core
+}
+
+
+void sampstream_close(t_sampstream *x)
+{
+	t_sampstream_core *c = x->s_core;
+	unsigned int ret;
+
+	if (x->s_thread) {
+		x->s_cancel = true;
+		systhread_join(x->s_thread, &ret);
+		x->s_thread = NULL;
+	}
+	if (!c)
+		return;
+
+	// no reader may be inside the mapping when it goes away
+	c->dead = true;
+	SAMPSTREAM_FENCE();
+	while (c->inuse)
+		systhread_sleep(1);
+	c->data = NULL;
+	sampstream_unmap(x);
+
+	x->s_core = NULL;
+	object_notify(x, ps_sampstream_changed, NULL);	// readers let go of the old core
+	sampstream_core_release(c);
+}
+
+
+void sampstream_report(t_sampstream *x)
+{
+	t_sampstream_core *c = x->s_core;
+	t_atom av[8];
+	long majflt, minflt;
+
+	if (!c)
+		return;
+	sampstream_faults(&majflt, &minflt);
+	atom_setlong(av + 0, c->hits);
+	atom_setlong(av + 1, c->misses);
+	atom_setlong(av + 2, c->underruns);
+	atom_setlong(av + 3, c->torn);
+	atom_setlong(av + 4, x->s_filled);
+	atom_setlong(av + 5, x->s_advised);
+	atom_setlong(av + 6, majflt - x->s_majflt);
+	atom_setlong(av + 7, minflt - x->s_minflt);
+	outlet_list(x->s_outlet, NULL, 8, av);
+}
+
+
+void sampstream_reset(t_sampstream *x)
+{
+	t_sampstream_core *c = x->s_core;
+
+	if (c)
+		c->hits = c->misses = c->underruns = c->torn = 0;
+	x->s_filled = x->s_advised = 0;
+	sampstream_faults(&x->s_majflt, &x->s_minflt);
+}
+
+
+// decode block b into its slot unless it is already there
+static t_bool sampstream_fill(t_sampstream *x, t_sampstream_core *c, long b)
+{
+	long slot = b & (c->nslots - 1);
+	t_int64 frame = (t_int64)b * SAMPSTREAM_BLOCKFRAMES;
+
+	if (b < 0 || frame >= c->frames || c->tags[slot] == b)
+		return false;
+	c->tags[slot] = -1;
+	SAMPSTREAM_FENCE();
+	sampstream_decode(c, frame, (long)MIN(SAMPSTREAM_BLOCKFRAMES, c->frames - frame), c->slots + (size_t)slot * SAMPSTREAM_BLOCKFRAMES * c->nchans);
+	SAMPSTREAM_FENCE();
+	c->tags[slot] = b;
+	x->s_filled++;
+	return true;
+}
+
+
+void *sampstream_threadproc(t_sampstream *x)
+{
+	t_sampstream_core *c = x->s_core;
+	long v, k, b0, filled;
+	t_int64 ph;
+
+	while (!x->s_cancel) {
+		filled = 0;
+		for (v = 0; v < SAMPSTREAM_VOICES; v++) {
+			ph = c->playheads[v];
+			if (ph < 0)
+				continue;
+			b0 = (long)(ph / SAMPSTREAM_BLOCKFRAMES);
+
+			// nearest blocks first, a few at a time so a jumping playhead is followed quickly
+			for (k = 0; k <= x->s_ahead && filled < 4; k++)
+				filled += sampstream_fill(x, c, b0 + k);
+			for (k = 1; k <= x->s_behind && filled < 4; k++)
+				filled += sampstream_fill(x, c, b0 - k);
+
+			if (b0 != x->s_lastblock[v] && x->s_prefetch > 0) {
+				t_int64 from = ((t_int64)b0 + x->s_ahead + 1) * SAMPSTREAM_BLOCKFRAMES;
+				long count = (long)MIN((t_int64)x->s_prefetch * SAMPSTREAM_BLOCKFRAMES, c->frames - from);
+
+				if (count > 0) {
+					sampstream_advise(x, c, from, count);
+					x->s_advised += (count + SAMPSTREAM_BLOCKFRAMES - 1) / SAMPSTREAM_BLOCKFRAMES;
+				}
+				x->s_lastblock[v] = b0;
+			}
+		}
+		if (!filled)
+			systhread_sleep(1);
+	}
+	systhread_exit(0);
+	return NULL;
+}
@@ -0,0 +1,401 @@
+/**
+	@file
+	simdsig.h - vector kernels for the simple signal objects, with runtime dispatch
+
+	Each kernel has a scalar version plus SSE2, AVX2 and AVX-512 versions on
+	x86 and a NEON version on arm64. simdsig_init() picks the widest set the
+	CPU (and OS) supports; call it once from ext_main. All kernels take any
+	vector size, including sizes smaller than one register, and do not need
+	aligned buffers. An output may be the same buffer as an input.
+*/
+
+#ifndef _SIMDSIG_H_
+#define _SIMDSIG_H_
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || _M_IX86_FP >= 2))
+#define SIMDSIG_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMDSIG_TARGET_AVX2
+#define SIMDSIG_TARGET_AVX512
+#else
+#define SIMDSIG_TARGET_AVX2		__attribute__((target("avx2")))
+#define SIMDSIG_TARGET_AVX512	__attribute__((target("avx512f")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMDSIG_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+typedef void (*t_simdsig_binop)(double *out, const double *a, const double *b, long n);
+typedef void (*t_simdsig_scalarop)(double *out, const double *in, double k, long n);
+typedef void (*t_simdsig_splitop)(const double *in, const double *low, long lowstep, const double *high, long highstep,
+								  double *in_range, double *out_range, double *mask, long n);
+
+typedef struct _simdsig_ops
+{
+	const char			*name;
+	t_simdsig_binop		mul;		// out = a * b
+	t_simdsig_binop		add;		// out = a + b
+	t_simdsig_scalarop	scale;		// out = in * k
+	t_simdsig_scalarop	offset;		// out = in + k
+	t_simdsig_splitop	split;		// route in by low <= in <= high; a step of 0 holds that bound constant
+} t_simdsig_ops;
+
+static t_simdsig_ops s_simdsig;
+
+
+//***********************************************************************************************
+// scalar versions: also used for the tails of the vector versions
+
+static void simdsig_mul_scalar(double *out, const double *a, const double *b, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		out[i] = a[i] * b[i];
+}
+
+static void simdsig_add_scalar(double *out, const double *a, const double *b, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		out[i] = a[i] + b[i];
+}
+
+static void simdsig_scale_scalar(double *out, const double *in, double k, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		out[i] = in[i] * k;
+}
+
+static void simdsig_offset_scalar(double *out, const double *in, double k, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		out[i] = in[i] + k;
+}
+
+static void simdsig_split_scalar(const double *in, const double *low, long lowstep, const double *high, long highstep,
+								 double *in_range, double *out_range, double *mask, long n)
+{
+	long i;
+	double v;
+	int m;
+
+	for (i = 0; i < n; i++) {
+		v = in[i];
+		m = (v >= low[i * lowstep]) & (v <= high[i * highstep]);
+		in_range[i] = m ? v : 0.;
+		out_range[i] = m ? 0. : v;
+		mask[i] = m;
+	}
+}
+
+
+//***********************************************************************************************
+// x86
+
+#if SIMDSIG_X86
+
+// one body per instruction set: V is the register type, W the lane count, P the intrinsic prefix;
+// ZERO runs before the scalar tail, which is SSE code and stalls on dirty upper halves of the
+// AVX registers
+#define SIMDSIG_X86_KERNELS(SUFFIX, TARGET, V, W, P, ZERO) \
+TARGET static void simdsig_mul_##SUFFIX(double *out, const double *a, const double *b, long n) \
+{ \
+	long i = 0; \
+	for (; i + W <= n; i += W) \
+		P##_storeu_pd(out + i, P##_mul_pd(P##_loadu_pd(a + i), P##_loadu_pd(b + i))); \
+	ZERO; \
+	simdsig_mul_scalar(out + i, a + i, b + i, n - i); \
+} \
+TARGET static void simdsig_add_##SUFFIX(double *out, const double *a, const double *b, long n) \
+{ \
+	long i = 0; \
+	for (; i + W <= n; i += W) \
+		P##_storeu_pd(out + i, P##_add_pd(P##_loadu_pd(a + i), P##_loadu_pd(b + i))); \
+	ZERO; \
+	simdsig_add_scalar(out + i, a + i, b + i, n - i); \
+} \
+TARGET static void simdsig_scale_##SUFFIX(double *out, const double *in, double k, long n) \
+{ \
+	long i = 0; \
+	V vk = P##_set1_pd(k); \
+	for (; i + W <= n; i += W) \
+		P##_storeu_pd(out + i, P##_mul_pd(P##_loadu_pd(in + i), vk)); \
+	ZERO; \
+	simdsig_scale_scalar(out + i, in + i, k, n - i); \
+} \
+TARGET static void simdsig_offset_##SUFFIX(double *out, const double *in, double k, long n) \
+{ \
+	long i = 0; \
+	V vk = P##_set1_pd(k); \
+	for (; i + W <= n; i += W) \
+		P##_storeu_pd(out + i, P##_add_pd(P##_loadu_pd(in + i), vk)); \
+	ZERO; \
+	simdsig_offset_scalar(out + i, in + i, k, n - i); \
+}
+
+SIMDSIG_X86_KERNELS(sse2, , __m128d, 2, _mm, )
+SIMDSIG_X86_KERNELS(avx2, SIMDSIG_TARGET_AVX2, __m256d, 4, _mm256, _mm256_zeroupper())
+
+// AVX-512 handles the tail with a masked load and store instead of a scalar loop
+#define SIMDSIG_AVX512_TAIL(n, i) ((__mmask8)((1U << ((n) - (i))) - 1))
+
+SIMDSIG_TARGET_AVX512 static void simdsig_mul_avx512(double *out, const double *a, const double *b, long n)
+{
+	long i = 0;
+	__mmask8 m;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	if (i < n) {
+		m = SIMDSIG_AVX512_TAIL(n, i);
+		_mm512_mask_storeu_pd(out + i, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i)));
+	}
+}
+
+SIMDSIG_TARGET_AVX512 static void simdsig_add_avx512(double *out, const double *a, const double *b, long n)
+{
+	long i = 0;
+	__mmask8 m;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	if (i < n) {
+		m = SIMDSIG_AVX512_TAIL(n, i);
+		_mm512_mask_storeu_pd(out + i, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i)));
+	}
+}
+
+SIMDSIG_TARGET_AVX512 static void simdsig_scale_avx512(double *out, const double *in, double k, long n)
+{
+	long i = 0;
+	__m512d vk = _mm512_set1_pd(k);
+	__mmask8 m;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(in + i), vk));
+	if (i < n) {
+		m = SIMDSIG_AVX512_TAIL(n, i);
+		_mm512_mask_storeu_pd(out + i, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m, in + i), vk));
+	}
+}
+
+SIMDSIG_TARGET_AVX512 static void simdsig_offset_avx512(double *out, const double *in, double k, long n)
+{
+	long i = 0;
+	__m512d vk = _mm512_set1_pd(k);
+	__mmask8 m;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(in + i), vk));
+	if (i < n) {
+		m = SIMDSIG_AVX512_TAIL(n, i);
+		_mm512_mask_storeu_pd(out + i, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, in + i), vk));
+	}
+}
+
+// split is compare-and-mask work, where SSE2 already saturates the
+// load/store ports for the short vectors MSP runs; AVX2 widens it
+
+static void simdsig_split_sse2(const double *in, const double *low, long lowstep, const double *high, long highstep,
+							   double *in_range, double *out_range, double *mask, long n)
+{
+	long i = 0;
+	__m128d vlow = _mm_set1_pd(*low), vhigh = _mm_set1_pd(*high), one = _mm_set1_pd(1.), v, m;
+
+	for (; i + 2 <= n; i += 2) {
+		// all loads for a block happen before its stores, so outputs may alias any input
+		v = _mm_loadu_pd(in + i);
+		if (lowstep)
+			vlow = _mm_loadu_pd(low + i);
+		if (highstep)
+			vhigh = _mm_loadu_pd(high + i);
+		m = _mm_and_pd(_mm_cmpge_pd(v, vlow), _mm_cmple_pd(v, vhigh));
+		_mm_storeu_pd(in_range + i, _mm_and_pd(m, v));
+		_mm_storeu_pd(out_range + i, _mm_andnot_pd(m, v));
+		_mm_storeu_pd(mask + i, _mm_and_pd(m, one));
+	}
+	simdsig_split_scalar(in + i, low + i * lowstep, lowstep, high + i * highstep, highstep, in_range + i, out_range + i, mask + i, n - i);
+}
+
+SIMDSIG_TARGET_AVX2 static void simdsig_split_avx2(const double *in, const double *low, long lowstep, const double *high, long highstep,
+												   double *in_range, double *out_range, double *mask, long n)
+{
+	long i = 0;
+	__m256d vlow = _mm256_set1_pd(*low), vhigh = _mm256_set1_pd(*high), one = _mm256_set1_pd(1.), v, m;
+
+	for (; i + 4 <= n; i += 4) {
+		v = _mm256_loadu_pd(in + i);
+		if (lowstep)
+			vlow = _mm256_loadu_pd(low + i);
+		if (highstep)
+			vhigh = _mm256_loadu_pd(high + i);
+		m = _mm256_and_pd(_mm256_cmp_pd(v, vlow, _CMP_GE_OQ), _mm256_cmp_pd(v, vhigh, _CMP_LE_OQ));
+		_mm256_storeu_pd(in_range + i, _mm256_and_pd(m, v));
+		_mm256_storeu_pd(out_range + i, _mm256_andnot_pd(m, v));
+		_mm256_storeu_pd(mask + i, _mm256_and_pd(m, one));
+	}
+	_mm256_zeroupper();
+	simdsig_split_scalar(in + i, low + i * lowstep, lowstep, high + i * highstep, highstep, in_range + i, out_range + i, mask + i, n - i);
+}
+
+// 0 = SSE2, 1 = AVX2, 2 = AVX-512F, each only if the OS saves the registers
+static int simdsig_x86_level(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	unsigned long long xcr0;
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)))		// OSXSAVE
+		return 0;
+	xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6)		// XMM and YMM state
+		return 0;
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6)
+		return 2;
+	if (info[1] & (1 << 5))
+		return 1;
+	return 0;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return 2;
+	if (__builtin_cpu_supports("avx2"))
+		return 1;
+	return 0;
+#endif
+}
+
+#endif // SIMDSIG_X86
+
+
+//***********************************************************************************************
+// arm64
+
+#if SIMDSIG_NEON
+
+static void simdsig_mul_neon(double *out, const double *a, const double *b, long n)
+{
+	long i = 0;
+
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out + i, vmulq_f64(vld1q_f64(a + i), vld1q_f64(b + i)));
+	simdsig_mul_scalar(out + i, a + i, b + i, n - i);
+}
+
+static void simdsig_add_neon(double *out, const double *a, const double *b, long n)
+{
+	long i = 0;
+
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out + i, vaddq_f64(vld1q_f64(a + i), vld1q_f64(b + i)));
+	simdsig_add_scalar(out + i, a + i, b + i, n - i);
+}
+
+static void simdsig_scale_neon(double *out, const double *in, double k, long n)
+{
+	long i = 0;
+	float64x2_t vk = vdupq_n_f64(k);
+
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out + i, vmulq_f64(vld1q_f64(in + i), vk));
+	simdsig_scale_scalar(out + i, in + i, k, n - i);
+}
+
+static void simdsig_offset_neon(double *out, const double *in, double k, long n)
+{
+	long i = 0;
+	float64x2_t vk = vdupq_n_f64(k);
+
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out + i, vaddq_f64(vld1q_f64(in + i), vk));
+	simdsig_offset_scalar(out + i, in + i, k, n - i);
+}
+
+static void simdsig_split_neon(const double *in, const double *low, long lowstep, const double *high, long highstep,
+							   double *in_range, double *out_range, double *mask, long n)
+{
+	long i = 0;
+	float64x2_t vlow = vdupq_n_f64(*low), vhigh = vdupq_n_f64(*high), one = vdupq_n_f64(1.), v;
+	uint64x2_t m, bits;
+
+	for (; i + 2 <= n; i += 2) {
+		v = vld1q_f64(in + i);
+		if (lowstep)
+			vlow = vld1q_f64(low + i);
+		if (highstep)
+			vhigh = vld1q_f64(high + i);
+		bits = vreinterpretq_u64_f64(v);
+		m = vandq_u64(vcgeq_f64(v, vlow), vcleq_f64(v, vhigh));
+		vst1q_f64(in_range + i, vreinterpretq_f64_u64(vandq_u64(m, bits)));
+		vst1q_f64(out_range + i, vreinterpretq_f64_u64(vbicq_u64(bits, m)));
+		vst1q_f64(mask + i, vreinterpretq_f64_u64(vandq_u64(m, vreinterpretq_u64_f64(one))));
+	}
+	simdsig_split_scalar(in + i, low + i * lowstep, lowstep, high + i * highstep, highstep, in_range + i, out_range + i, mask + i, n - i);
+}
+
+#endif // SIMDSIG_NEON
+
+
+//***********************************************************************************************
+
+static void simdsig_init(void)
+{
+	t_simdsig_ops ops = {
+		"scalar",
+		simdsig_mul_scalar, simdsig_add_scalar, simdsig_scale_scalar, simdsig_offset_scalar,
+		simdsig_split_scalar
+	};
+
+#if SIMDSIG_X86
+	switch (simdsig_x86_level()) {
+	case 2:
+		ops.name = "avx512";
+		ops.mul = simdsig_mul_avx512;
+		ops.add = simdsig_add_avx512;
+		ops.scale = simdsig_scale_avx512;
+		ops.offset = simdsig_offset_avx512;
+		ops.split = simdsig_split_avx2;
+		break;
+	case 1:
+		ops.name = "avx2";
+		ops.mul = simdsig_mul_avx2;
+		ops.add = simdsig_add_avx2;
+		ops.scale = simdsig_scale_avx2;
+		ops.offset = simdsig_offset_avx2;
+		ops.split = simdsig_split_avx2;
+		break;
+	default:
+		ops.name = "sse2";
+		ops.mul = simdsig_mul_sse2;
+		ops.add = simdsig_add_sse2;
+		ops.scale = simdsig_scale_sse2;
+		ops.offset = simdsig_offset_sse2;
+		ops.split = simdsig_split_sse2;
+		break;
+	}
+#elif SIMDSIG_NEON
+	ops.name = "neon";
+	ops.mul = simdsig_mul_neon;
+	ops.add = simdsig_add_neon;
+	ops.scale = simdsig_scale_neon;
+	ops.offset = simdsig_offset_neon;
+	ops.split = simdsig_split_neon;
+#endif
+	s_simdsig = ops;
+}
+
+#endif // _SIMDSIG_H_
@@ -8,6 +8,7 @@
 #include "ext.h"			// standard Max include, always required (except in Jitter)
 #include "ext_obex.h"		// required for "new" style objects
 #include "z_dsp.h"			// required for MSP objects
+#include "simdsig.h"		// vector kernels shared by the simple signal objects
 
 
 // struct to represent the object's state
@@ -38,7 +39,11 @@ void ext_main(void *r)
 	// unless you need to free allocated memory, in which case you should call dsp_free from
 	// your custom free function.
 
-	t_class *c = class_new("simplemsp~", (method)simplemsp_new, (method)dsp_free, (long)sizeof(t_simplemsp), 0L, A_GIMME, 0);
+	t_class *c;
+
+	simdsig_init();		// choose the kernels for this CPU once, when the class is loaded
+
+	c = class_new("simplemsp~", (method)simplemsp_new, (method)dsp_free, (long)sizeof(t_simplemsp), 0L, A_GIMME, 0);
 
 	class_addmethod(c, (method)simplemsp_float,		"float",	A_FLOAT, 0);
 	class_addmethod(c, (method)simplemsp_dsp64,		"dsp64",	A_CANT, 0);
@@ -111,10 +116,8 @@ void simplemsp_perform64(t_simplemsp *x, t_object *dsp64, double **ins, long num
 {
 	t_double *inL = ins[0];		// we get audio for each inlet of the object from the **ins argument
 	t_double *outL = outs[0];	// we get audio for each outlet of the object from the **outs argument
-	int n = sampleframes;
 
 	// this perform method simply copies the input to the output, offsetting the value
-	while (n--)
-		*outL++ = *inL++ + x->offset;
+	s_simdsig.offset(outL, inL, x->offset, sampleframes);
 }
 
@@ -11,18 +11,23 @@
 #include "ext_buffer.h"
 #include "ext_atomic.h"
 #include "ext_obex.h"
+#include "bufreader.h"
+#include "modbus.h"
 
 
 typedef struct _simpwave {
 	t_pxobject w_obj;
-	t_buffer_ref *w_buf;
+	t_bufreader w_reader;
 	t_symbol *w_name;
-	long w_begin;
-	long w_len;
+	t_int64 w_begin;	// first frame of the table
+	t_int64 w_len;		// table length in frames
 	float w_start;
 	float w_end;
 	short w_connected[2];
-	t_bool w_buffer_modified;
+	t_modbus_ref w_startbus;	// modulation bus channels read when the start and end inlets have no signal
+	t_modbus_ref w_endbus;
+	t_bool w_limits_changed;
+	long w_interp;
 } t_simpwave;
 
 
@@ -35,11 +40,12 @@ void simpwave_set(t_simpwave *x, t_symbol *s, long ac, t_atom *av);
 void simpwave_float(t_simpwave *x, double f);
 void simpwave_int(t_simpwave *x, long n);
 void simpwave_dblclick(t_simpwave *x);
+t_max_err simpwave_attr_setstartbus(t_simpwave *x, void *attr, long argc, t_atom *argv);
+t_max_err simpwave_attr_setendbus(t_simpwave *x, void *attr, long argc, t_atom *argv);
 void simpwave_perform64(t_simpwave *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
 void simpwave_dsp64(t_simpwave *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 
 
-static t_symbol *ps_buffer_modified;
 static t_class *s_simpwave_class;
 
 
@@ -55,11 +61,24 @@ void ext_main(void *r)
 	class_addmethod(c, (method)simpwave_dblclick,	"dblclick",	A_CANT, 0);
 	class_addmethod(c, (method)simpwave_notify,		"notify",	A_CANT, 0);
 
+	CLASS_ATTR_LONG(c, "interp", 0, t_simpwave, w_interp);
+	CLASS_ATTR_ENUMINDEX4(c, "interp", 0, "None", "Linear", "Cubic", "Sinc");
+	CLASS_ATTR_FILTER_CLIP(c, "interp", BUFREADER_INTERP_NONE, BUFREADER_INTERP_SINC);
+	CLASS_ATTR_LABEL(c, "interp", 0, "Interpolation");
+
+	CLASS_ATTR_ATOM_VARSIZE(c, "startbus", 0, t_simpwave, w_startbus.atoms, w_startbus.natoms, 2);
+	CLASS_ATTR_LABEL(c, "startbus", 0, "Start Modulation Bus and Channel");
+	CLASS_ATTR_ACCESSORS(c, "startbus", NULL, simpwave_attr_setstartbus);
+
+	CLASS_ATTR_ATOM_VARSIZE(c, "endbus", 0, t_simpwave, w_endbus.atoms, w_endbus.natoms, 2);
+	CLASS_ATTR_LABEL(c, "endbus", 0, "End Modulation Bus and Channel");
+	CLASS_ATTR_ACCESSORS(c, "endbus", NULL, simpwave_attr_setendbus);
+
 	class_dspinit(c);
 	class_register(CLASS_BOX, c);
 	s_simpwave_class = c;
 
-	ps_buffer_modified = gensym("buffer_modified");
+	bufreader_tables_init();
 }
 
 
@@ -69,21 +88,28 @@ void *simpwave_new(t_symbol *s,  long argc, t_atom *argv)
 	t_symbol *buf=0;
 	float start=0., end=0.;
 	double msr = sys_getsr() * 0.001;
+	long offset = attr_args_offset((short)argc, argv);
 
 	dsp_setup((t_pxobject *)x,3);
-	buf = atom_getsymarg(0,argc,argv);
-	start = atom_getfloatarg(1,argc,argv);
-	end = atom_getfloatarg(2,argc,argv);
+	buf = atom_getsymarg(0,offset,argv);
+	start = atom_getfloatarg(1,offset,argv);
+	end = atom_getfloatarg(2,offset,argv);
 
 	x->w_name = buf;
 	x->w_start = start;
 	x->w_end = end;
 	x->w_begin = start * msr;
 	x->w_len = (end - start) * msr;
+	x->w_limits_changed = true;
+	x->w_interp = BUFREADER_INTERP_NONE;
+	modbus_ref_init(&x->w_startbus);
+	modbus_ref_init(&x->w_endbus);
 	outlet_new((t_object *)x, "signal");		// audio outlet
 
-	// create a new buffer reference, initially referencing a buffer with the provided name
-	x->w_buf = buffer_ref_new((t_object *)x, x->w_name);
+	// create a new buffer reader, initially referencing a buffer with the provided name
+	bufreader_init(&x->w_reader, (t_object *)x, x->w_name);
+
+	attr_args_process(x, (short)argc, argv);
 
 	return (x);
 }
@@ -94,17 +120,16 @@ void simpwave_free(t_simpwave *x)
 	dsp_free((t_pxobject *)x);
 
 	// must free our buffer reference when we will no longer use it
-	object_free(x->w_buf);
+	bufreader_free(&x->w_reader);
 }
 
 
 // A notify method is required for our buffer reference
 // This handles notifications when the buffer appears, disappears, or is modified.
+// The reader notes the modification and refreshes its cached buffer size in the next perform.
 t_max_err simpwave_notify(t_simpwave *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
 {
-	if (msg == ps_buffer_modified)
-		x->w_buffer_modified = true;
-	return buffer_ref_notify(x->w_buf, s, msg, sender, data);
+	return bufreader_notify(&x->w_reader, s, msg, sender, data);
 }
 
 
@@ -123,30 +148,27 @@ void simpwave_assist(t_simpwave *x, void *b, long m, long a, char *s)
 }
 
 
+// called from the perform routine with the samples locked, so the reader's cached buffer size is current
 void simpwave_limits(t_simpwave *x)
 {
-	t_buffer_obj *b = buffer_ref_getobject(x->w_buf); // get the actual buffer object from our reference
-
-	if (b) {
-		t_atom_long	channelcount = buffer_getchannelcount(b);		// number of floats in a frame
-		t_atom_long	framecount   = buffer_getframecount(b);			// number of floats long the buffer is for a single channel
-		double		msr			 = buffer_getmillisamplerate(b);	// sample rate of the buffer in samples per millisecond
-
-		x->w_begin = (long)(x->w_start * msr) * channelcount;//buffer sr-jkc
-		if (!x->w_end)	{// use entire table, eek!
-			x->w_len = framecount;
-		} else {
-			x->w_len = (x->w_end - x->w_start) * msr; //buffer sr-jkc
-		}
-		// now restrict these values
-		if (x->w_begin < 0)
-			x->w_begin = 0;
-		else if (x->w_begin >= framecount * channelcount)
-			x->w_begin = (framecount - 1) * channelcount;
-		if (x->w_begin + (x->w_len * channelcount) >= framecount * channelcount) {
-			x->w_len = framecount - (x->w_begin / channelcount);
-		}
+	t_int64	framecount = x->w_reader.frames;			// number of floats long the buffer is for a single channel
+	double	msr = x->w_reader.sr * 0.001;			// sample rate of the buffer in samples per millisecond
+
+	x->w_begin = (t_int64)(x->w_start * msr);			//buffer sr-jkc
+	if (!x->w_end)	{// use entire table, eek!
+		x->w_len = framecount;
+	} else {
+		x->w_len = (x->w_end - x->w_start) * msr; //buffer sr-jkc
 	}
+	// now restrict these values
+	if (x->w_begin < 0)
+		x->w_begin = 0;
+	else if (x->w_begin >= framecount)
+		x->w_begin = framecount - 1;
+	if (x->w_begin + x->w_len >= framecount)
+		x->w_len = framecount - x->w_begin;
+	if (x->w_len < 1)
+		x->w_len = 1;
 }
 
 
@@ -166,8 +188,8 @@ void simpwave_doset(t_simpwave *x, t_symbol *s, long ac, t_atom *av)
 	x->w_start = start;
 	x->w_end = end;
 
-	buffer_ref_set(x->w_buf, name);	// change the buffer used by our buffer reference
-	simpwave_limits(x);
+	bufreader_set(&x->w_reader, name);	// change the buffer used by our buffer reference
+	x->w_limits_changed = true;
 }
 
 
@@ -188,7 +210,7 @@ void simpwave_float(t_simpwave *x, double f)
 		if (f > x->w_end)
 			x->w_end = f;
 		x->w_start = f;
-		simpwave_limits(x);
+		x->w_limits_changed = true;
 	}
 	else if (in == 2) {	// set max
 		if (f < 0)
@@ -196,7 +218,7 @@ void simpwave_float(t_simpwave *x, double f)
 		if (f < x->w_start)
 			x->w_start = f;
 		x->w_end = f;
-		simpwave_limits(x);
+		x->w_limits_changed = true;
 	}
 }
 
@@ -209,7 +231,19 @@ void simpwave_int(t_simpwave *x, long n)
 
 void simpwave_dblclick(t_simpwave *x)
 {
-	buffer_view(buffer_ref_getobject(x->w_buf));
+	buffer_view(bufreader_getobject(&x->w_reader));
+}
+
+
+t_max_err simpwave_attr_setstartbus(t_simpwave *x, void *attr, long argc, t_atom *argv)
+{
+	return modbus_ref_set(&x->w_startbus, argc, argv);
+}
+
+
+t_max_err simpwave_attr_setendbus(t_simpwave *x, void *attr, long argc, t_atom *argv)
+{
+	return modbus_ref_set(&x->w_endbus, argc, argv);
 }
 
 
@@ -217,27 +251,24 @@ void simpwave_perform64(t_simpwave *x, t_object *dsp64, double **ins, long numin
 {
 	t_double		*in = ins[0];
 	t_double		*out = outs[0];
-	t_double		min = x->w_connected[0]? *ins[1] : x->w_start;
-	t_double		max = x->w_connected[1]? *ins[2] : x->w_end;
-	int				n = sampleframes;
+	const double	*startbus = x->w_connected[0] ? NULL : modbus_ref_read(&x->w_startbus, 1);
+	const double	*endbus = x->w_connected[1] ? NULL : modbus_ref_read(&x->w_endbus, 1);
+	t_double		min = x->w_connected[0]? *ins[1] : (startbus ? *startbus : x->w_start);
+	t_double		max = x->w_connected[1]? *ins[2] : (endbus ? *endbus : x->w_end);
+	long			n = sampleframes, i;
 	float			*b;
-	long			len, dex;
 	double			v;
-	t_buffer_obj	*buffer = buffer_ref_getobject(x->w_buf);
-	t_atom_long		channelcount;
 
-	b = buffer_locksamples(buffer);
+	b = bufreader_lock(&x->w_reader);
 	if (!b)
 		goto zero;
 
-	channelcount = buffer_getchannelcount(buffer);
-
-	if (x->w_buffer_modified) {
-		x->w_buffer_modified = false;
+	if (x->w_reader.changed || x->w_limits_changed) {
+		x->w_limits_changed = false;
 		simpwave_limits(x);
-		if (!x->w_connected[0])
+		if (!x->w_connected[0] && !startbus)
 			min = x->w_start;
-		if (!x->w_connected[1])
+		if (!x->w_connected[1] && !endbus)
 			max = x->w_end;
 	}
 
@@ -255,37 +286,14 @@ void simpwave_perform64(t_simpwave *x, t_object *dsp64, double **ins, long numin
 		simpwave_limits(x);
 	}
 
-	b += x->w_begin;
-	len = x->w_len;
-
-	if (channelcount == 1) {
-		while (n--) {
-			v = *in++;
-			if (v < 0)
-				v = 0;
-			if (v > 1)
-				v = 1;
-			dex = v * (double)len;
-			if (dex>len-1)
-				dex = len-1;
-			*out++ = b[dex];
-		}
-	}
-	else if (channelcount > 1) {
-		while (n--) {
-			v = *in++;
-			if (v < 0)
-				v = 0;
-			if (v > 1)
-				v = 1;
-			dex = (long)(v * (double)len) * channelcount;
-			if (dex>(len-1)*channelcount)
-				dex = (len-1)*channelcount;
-			*out++ = b[dex];
-		}
+	// keep the table position within 0-1, which spans the first to the last frame of the table
+	for (i = 0; i < n; i++) {
+		v = in[i];
+		out[i] = v < 0. ? 0. : (v > 1. ? 1. : v);
 	}
+	bufreader_read(&x->w_reader, b, out, (double)x->w_begin, (double)(x->w_len - 1), out, 0, n, x->w_interp);
 
-	buffer_unlocksamples(buffer);
+	bufreader_unlock(&x->w_reader);
 	return;
 zero:
 	while (n--)
@@ -297,6 +305,8 @@ void simpwave_dsp64(t_simpwave *x, t_object *dsp64, short *count, double sampler
 {
 	x->w_connected[0] = count[1];
 	x->w_connected[1] = count[2];
+	modbus_ref_resolve(&x->w_startbus, maxvectorsize);
+	modbus_ref_resolve(&x->w_endbus, maxvectorsize);
 	object_method(dsp64, gensym("dsp_add64"), x, simpwave_perform64, 0, NULL);
 }
 
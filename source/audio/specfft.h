@@ -0,0 +1,236 @@
+/**
+	@file
+	specfft.h - a single-precision real FFT for the spectral objects
+
+	A real frame of n samples (a power of two from 16 to 65536) goes
+	through a complex FFT of n/2 points and one split pass that untangles
+	the even and odd halves, giving n/2 + 1 bins from DC to Nyquist. The
+	complex FFT keeps its real and imaginary parts in separate arrays, so
+	each butterfly stage is a run of independent four-wide multiply-adds
+	that SSE (x86) or NEON (arm64) does four bins at a time; both are part
+	of the base instruction set there, so there is nothing to dispatch.
+
+	specfft_inverse(specfft_forward(x)) gives x back: the inverse carries
+	the whole 1/n scaling. All tables and work space come from
+	specfft_init(), so neither transform allocates.
+*/
+
+#ifndef _SPECFFT_H_
+#define _SPECFFT_H_
+
+#include "ext.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || _M_IX86_FP >= 2))
+#define SPECFFT_SSE 1
+#include <xmmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SPECFFT_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define SPECFFT_MINSIZE		16
+#define SPECFFT_MAXSIZE		65536
+
+typedef struct _specfft
+{
+	long		n;			// real frame size
+	long		m;			// complex points, n / 2
+	t_uint32	*bitrev;	// m bit-reversed indices
+	float		*twr;		// butterfly twiddles, m - 1 of them: the stage of half size h starts at h - 1
+	float		*twi;
+	float		*splitr;	// cos and -sin(2 pi k / n), k < m, for the split pass
+	float		*spliti;
+	float		*wr;		// m points of work space
+	float		*wi;
+} t_specfft;
+
+
+static t_bool specfft_validsize(long n)
+{
+	return n >= SPECFFT_MINSIZE && n <= SPECFFT_MAXSIZE && !(n & (n - 1));
+}
+
+static void specfft_free(t_specfft *f)
+{
+	if (f->bitrev) {
+		sysmem_freeptr(f->bitrev);
+		sysmem_freeptr(f->twr);
+	}
+	memset(f, 0, sizeof(t_specfft));
+}
+
+// the tables and work space are one block after the bit-reversal table
+static t_max_err specfft_init(t_specfft *f, long n)
+{
+	long m = n / 2, bits = 0, h, k, i, j;
+	float *p;
+
+	specfft_free(f);
+	if (!specfft_validsize(n))
+		return MAX_ERR_GENERIC;
+	f->bitrev = (t_uint32 *)sysmem_newptr(m * sizeof(t_uint32));
+	p = (float *)sysmem_newptrclear(6 * m * sizeof(float));
+	if (!f->bitrev || !p) {
+		if (f->bitrev)
+			sysmem_freeptr(f->bitrev);
+		if (p)
+			sysmem_freeptr(p);
+		f->bitrev = NULL;
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	f->n = n;
+	f->m = m;
+	f->twr = p;
+	f->twi = p + m;
+	f->splitr = p + 2 * m;
+	f->spliti = p + 3 * m;
+	f->wr = p + 4 * m;
+	f->wi = p + 5 * m;
+
+	while ((1L << bits) < m)
+		bits++;
+	for (i = 0; i < m; i++) {
+		for (j = 0, k = 0; k < bits; k++)
+			j |= ((i >> k) & 1) << (bits - 1 - k);
+		f->bitrev[i] = (t_uint32)j;
+	}
+	for (h = 1; h < m; h <<= 1) {
+		for (k = 0; k < h; k++) {
+			f->twr[h - 1 + k] = (float)cos(PI * k / h);
+			f->twi[h - 1 + k] = (float)-sin(PI * k / h);
+		}
+	}
+	for (k = 0; k < m; k++) {
+		f->splitr[k] = (float)cos(TWOPI * k / n);
+		f->spliti[k] = (float)-sin(TWOPI * k / n);
+	}
+	return MAX_ERR_NONE;
+}
+
+// one stage of radix-2 butterflies over m points already in bit-reversed order
+static void specfft_stage(float *re, float *im, const float *twr, const float *twi, long h, long m)
+{
+	long s, k;
+
+	for (s = 0; s < m; s += 2 * h) {
+		float *ar = re + s, *ai = im + s, *br = re + s + h, *bi = im + s + h;
+
+		k = 0;
+#if defined(SPECFFT_SSE)
+		for (; k + 4 <= h; k += 4) {
+			__m128 wr = _mm_loadu_ps(twr + k), wi = _mm_loadu_ps(twi + k);
+			__m128 xr = _mm_loadu_ps(br + k), xi = _mm_loadu_ps(bi + k);
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+			__m128 yr = _mm_loadu_ps(ar + k), yi = _mm_loadu_ps(ai + k);
+
+			_mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+			_mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+			_mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+			_mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+		}
+#elif defined(SPECFFT_NEON)
+		for (; k + 4 <= h; k += 4) {
+			float32x4_t wr = vld1q_f32(twr + k), wi = vld1q_f32(twi + k);
+			float32x4_t xr = vld1q_f32(br + k), xi = vld1q_f32(bi + k);
+			float32x4_t tr = vmlsq_f32(vmulq_f32(xr, wr), xi, wi);
+			float32x4_t ti = vmlaq_f32(vmulq_f32(xr, wi), xi, wr);
+			float32x4_t yr = vld1q_f32(ar + k), yi = vld1q_f32(ai + k);
+
+			vst1q_f32(ar + k, vaddq_f32(yr, tr));
+			vst1q_f32(ai + k, vaddq_f32(yi, ti));
+			vst1q_f32(br + k, vsubq_f32(yr, tr));
+			vst1q_f32(bi + k, vsubq_f32(yi, ti));
+		}
+#endif
+		for (; k < h; k++) {
+			float tr = br[k] * twr[k] - bi[k] * twi[k];
+			float ti = br[k] * twi[k] + bi[k] * twr[k];
+			float yr = ar[k], yi = ai[k];
+
+			ar[k] = yr + tr;
+			ai[k] = yi + ti;
+			br[k] = yr - tr;
+			bi[k] = yi - ti;
+		}
+	}
+}
+
+// forward complex FFT of f->m points in bit-reversed order; swapping re and im makes it the (unscaled) inverse
+static void specfft_complex(t_specfft *f, float *re, float *im)
+{
+	long h, s, m = f->m;
+
+	// the first stage has only the trivial twiddle
+	for (s = 0; s < m; s += 2) {
+		float yr = re[s], yi = im[s];
+
+		re[s] = yr + re[s + 1];
+		im[s] = yi + im[s + 1];
+		re[s + 1] = yr - re[s + 1];
+		im[s + 1] = yi - im[s + 1];
+	}
+	for (h = 2; h < m; h <<= 1)
+		specfft_stage(re, im, f->twr + h - 1, f->twi + h - 1, h, m);
+}
+
+// n real samples to n/2 + 1 bins
+static void specfft_forward(t_specfft *f, const float *in, float *re, float *im)
+{
+	long k, m = f->m;
+	const t_uint32 *br = f->bitrev;
+	float *zr = f->wr, *zi = f->wi;
+
+	for (k = 0; k < m; k++) {
+		zr[br[k]] = in[2 * k];
+		zi[br[k]] = in[2 * k + 1];
+	}
+	specfft_complex(f, zr, zi);
+
+	// X[k] = (Z[k] + Z*[m-k]) / 2 - i W^k (Z[k] - Z*[m-k]) / 2, W = e^(-2 pi i / n)
+	re[0] = zr[0] + zi[0];
+	im[0] = 0;
+	re[m] = zr[0] - zi[0];
+	im[m] = 0;
+	for (k = 1; k < m; k++) {
+		float er = 0.5f * (zr[k] + zr[m - k]), ei = 0.5f * (zi[k] - zi[m - k]);
+		float orr = 0.5f * (zi[k] + zi[m - k]), oi = -0.5f * (zr[k] - zr[m - k]);
+		float c = f->splitr[k], s = f->spliti[k];
+
+		re[k] = er + c * orr - s * oi;
+		im[k] = ei + c * oi + s * orr;
+	}
+}
+
+// n/2 + 1 bins back to n real samples; the imaginary parts of DC and Nyquist are ignored
+static void specfft_inverse(t_specfft *f, const float *re, const float *im, float *out)
+{
+	long k, m = f->m;
+	const t_uint32 *br = f->bitrev;
+	float *zr = f->wr, *zi = f->wi;
+	float scale = 1.f / m;
+
+	// Z[k] = E[k] + i O[k], with E and O taken back apart from X[k] and X*[m-k]
+	for (k = 0; k < m; k++) {
+		float er = 0.5f * (re[k] + re[m - k]), ei = 0.5f * (im[k] - im[m - k]);
+		float dr = re[k] - re[m - k], di = im[k] + im[m - k];
+		float c = f->splitr[k], s = f->spliti[k];
+		float orr = 0.5f * (dr * c + di * s), oi = 0.5f * (di * c - dr * s);
+
+		zr[br[k]] = er - oi;
+		zi[br[k]] = ei + orr;
+	}
+	if (m) {
+		// DC's partner is Nyquist, not itself
+		zr[0] = 0.5f * (re[0] + re[m]);
+		zi[0] = 0.5f * (re[0] - re[m]);
+	}
+	specfft_complex(f, zi, zr);
+	for (k = 0; k < m; k++) {
+		out[2 * k] = zr[k] * scale;
+		out[2 * k + 1] = zi[k] * scale;
+	}
+}
+
+#endif // _SPECFFT_H_
@@ -0,0 +1,576 @@
+/**
+	@file
+	spectral~ - windowing, FFT, a chain of bin-wise kernels and overlap-add in one object
+
+	On its own, spectral~ cuts its input into Hann-windowed frames of
+	@fftsize samples every @hop samples, runs the kernels named by @chain
+	on the spectrum of each frame and overlap-adds the result back into a
+	signal, @fftsize samples late. The right inlet is the sidechain that
+	cross synthesis takes its magnitudes from; it is only transformed when
+	it is connected and cross is in the chain.
+
+	Inside a pfft~ there is nothing to window or transform: spectral~ finds
+	the owning pfft~ the way fftinfo~ does and works on the frames fftin~
+	hands it, real and imaginary in the left two inlets, the sidechain's in
+	the right two, real and imaginary out. The FFT size and hop are then
+	the pfft~'s, and @fftsize and @hop are ignored.
+
+	Kernels, run in the order @chain lists them:
+	mask	gain per bin from the buffer~ named by @mask, stretched from DC to Nyquist
+	gate	bins quieter than @gate dB (a full-scale sine is 0 dB) are silenced
+	freeze	while @freeze is on, the magnitudes of the frame it was turned on in are held, with their phases running on
+	cross	the magnitudes of the sidechain, on the phases of the input, by @cross (0 to 1)
+
+	@ingroup	examples
+*/
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include "r_pfft.h"		// public pfft struct, as fftinfo~ reads it
+#include "specfft.h"
+#include "bufreader.h"
+
+#define SPECTRAL_MAXKERNELS	8
+#define SPECTRAL_TINY		1e-20f	// keeps the cross gain finite over silent bins, even at fftsize 65536
+
+enum {
+	SPECTRAL_MASK = 0,
+	SPECTRAL_GATE,
+	SPECTRAL_FREEZE,
+	SPECTRAL_CROSS,
+	SPECTRAL_NUMKERNELS
+};
+
+enum {
+	SPECTRAL_LIVE = 0,		// freeze is off
+	SPECTRAL_CAPTURE,		// the first frame after freeze went on: keep its phases
+	SPECTRAL_FROZEN			// magnitudes and phase steps taken from the next one
+};
+
+typedef struct _spectral
+{
+	t_pxobject	s_obj;
+	t_pfftpub	*s_pfft;		// owning pfft~, if we were made inside one
+
+	// attributes
+	long		s_fftsize;
+	long		s_hop;
+	t_symbol	*s_chain[SPECTRAL_MAXKERNELS];
+	long		s_chainlen;
+	t_symbol	*s_maskname;
+	double		s_gate;			// dB
+	char		s_freeze;
+	double		s_cross;
+
+	char		s_kernels[SPECTRAL_MAXKERNELS];	// s_chain as SPECTRAL_MASK etc., for the audio thread
+	long		s_nkernels;
+	t_bufreader	s_mask;
+
+	// sizes in use, fixed by dsp64
+	long		s_n;			// fft size
+	long		s_h;			// hop
+	long		s_bins;			// bins per frame we work on
+	long		s_fill;			// samples into the current hop
+	char		s_side;			// the sidechain is connected
+	char		s_state;		// SPECTRAL_LIVE etc.
+	t_specfft	s_fft;
+
+	// one block each for the floats and doubles below, made by dsp64
+	float		*s_block;
+	float		*s_win;			// s_n, analysis and synthesis window
+	float		*s_norm;		// s_h, 1 / the sum of the squared windows landing on each sample of a hop
+	float		*s_in;			// s_n, the input of the next frame
+	float		*s_sidein;		// s_n
+	float		*s_acc;			// s_n, overlap-add accumulator
+	float		*s_out;			// s_h, finished samples going out during this hop
+	float		*s_frame;		// s_n, windowed time-domain frame
+	float		*s_re;			// s_bins each from here down
+	float		*s_im;
+	float		*s_sre;
+	float		*s_sim;
+	float		*s_mag;			// freeze state
+	float		*s_phase;
+	float		*s_dphi;
+	double		*s_dblock;
+	double		*s_pos;			// s_bins, where each bin reads the mask
+	double		*s_gain;		// s_bins, the mask as read
+} t_spectral;
+
+
+void *spectral_new(t_symbol *s, long argc, t_atom *argv);
+void spectral_free(t_spectral *x);
+void spectral_assist(t_spectral *x, void *b, long m, long a, char *s);
+t_max_err spectral_notify(t_spectral *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
+t_max_err spectral_attr_setchain(t_spectral *x, void *attr, long argc, t_atom *argv);
+t_max_err spectral_attr_setmask(t_spectral *x, void *attr, long argc, t_atom *argv);
+void spectral_perform64(t_spectral *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void spectral_perform64_pfft(t_spectral *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void spectral_dsp64(t_spectral *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+
+
+static t_class *s_spectral_class;
+static t_symbol *ps_spfft;
+static t_symbol *s_spectral_kernelnames[SPECTRAL_NUMKERNELS];
+
+
+void ext_main(void *r)
+{
+	t_class *c = class_new("spectral~", (method)spectral_new, (method)spectral_free, sizeof(t_spectral), NULL, A_GIMME, 0);
+
+	class_addmethod(c, (method)spectral_dsp64,	"dsp64",	A_CANT, 0);
+	class_addmethod(c, (method)spectral_notify,	"notify",	A_CANT, 0);
+	class_addmethod(c, (method)spectral_assist,	"assist",	A_CANT, 0);
+	class_dspinit(c);
+
+	CLASS_ATTR_LONG(c, "fftsize", 0, t_spectral, s_fftsize);
+	CLASS_ATTR_FILTER_CLIP(c, "fftsize", SPECFFT_MINSIZE, SPECFFT_MAXSIZE);
+	CLASS_ATTR_LABEL(c, "fftsize", 0, "FFT Size (takes effect when audio is turned on)");
+
+	CLASS_ATTR_LONG(c, "hop", 0, t_spectral, s_hop);
+	CLASS_ATTR_FILTER_MIN(c, "hop", 1);
+	CLASS_ATTR_LABEL(c, "hop", 0, "Hop Size (takes effect when audio is turned on)");
+
+	CLASS_ATTR_SYM_VARSIZE(c, "chain", 0, t_spectral, s_chain, s_chainlen, SPECTRAL_MAXKERNELS);
+	CLASS_ATTR_ACCESSORS(c, "chain", NULL, spectral_attr_setchain);
+	CLASS_ATTR_LABEL(c, "chain", 0, "Kernels (mask gate freeze cross)");
+
+	CLASS_ATTR_SYM(c, "mask", 0, t_spectral, s_maskname);
+	CLASS_ATTR_ACCESSORS(c, "mask", NULL, spectral_attr_setmask);
+	CLASS_ATTR_LABEL(c, "mask", 0, "Gain Mask buffer~");
+
+	CLASS_ATTR_DOUBLE(c, "gate", 0, t_spectral, s_gate);
+	CLASS_ATTR_FILTER_MAX(c, "gate", 0.);
+	CLASS_ATTR_LABEL(c, "gate", 0, "Gate Threshold (dB)");
+
+	CLASS_ATTR_CHAR(c, "freeze", 0, t_spectral, s_freeze);
+	CLASS_ATTR_STYLE_LABEL(c, "freeze", 0, "onoff", "Freeze");
+
+	CLASS_ATTR_DOUBLE(c, "cross", 0, t_spectral, s_cross);
+	CLASS_ATTR_FILTER_CLIP(c, "cross", 0., 1.);
+	CLASS_ATTR_LABEL(c, "cross", 0, "Cross Synthesis Amount");
+
+	class_register(CLASS_BOX, c);
+	s_spectral_class = c;
+
+	ps_spfft = gensym("__pfft~__");	// owning pfft~ is bound to this while its patch is loaded, as fftinfo~ relies on
+	s_spectral_kernelnames[SPECTRAL_MASK] = gensym("mask");
+	s_spectral_kernelnames[SPECTRAL_GATE] = gensym("gate");
+	s_spectral_kernelnames[SPECTRAL_FREEZE] = gensym("freeze");
+	s_spectral_kernelnames[SPECTRAL_CROSS] = gensym("cross");
+	bufreader_tables_init();
+}
+
+
+void *spectral_new(t_symbol *s, long argc, t_atom *argv)
+{
+	t_spectral *x = (t_spectral *)object_alloc(s_spectral_class);
+	long offset = attr_args_offset((short)argc, argv);
+
+	x->s_pfft = (t_pfftpub *)ps_spfft->s_thing;
+	if (x->s_pfft) {
+		dsp_setup((t_pxobject *)x, 4);
+		outlet_new((t_object *)x, "signal");
+		outlet_new((t_object *)x, "signal");
+	}
+	else {
+		dsp_setup((t_pxobject *)x, 2);
+		outlet_new((t_object *)x, "signal");
+	}
+
+	x->s_fftsize = 1024;
+	x->s_gate = -60.;
+	x->s_cross = 1.;
+	x->s_maskname = gensym("");
+	if (offset > 0)
+		x->s_fftsize = CLAMP(atom_getlong(argv), SPECFFT_MINSIZE, SPECFFT_MAXSIZE);
+	x->s_hop = offset > 1 ? MAX(atom_getlong(argv + 1), 1) : x->s_fftsize / 4;
+	bufreader_init(&x->s_mask, (t_object *)x, x->s_maskname);
+	attr_args_process(x, (short)argc, argv);
+	return x;
+}
+
+
+static void spectral_release(t_spectral *x)
+{
+	if (x->s_block)
+		sysmem_freeptr(x->s_block);
+	if (x->s_dblock)
+		sysmem_freeptr(x->s_dblock);
+	x->s_block = NULL;
+	x->s_dblock = NULL;
+	specfft_free(&x->s_fft);
+	x->s_n = x->s_h = x->s_bins = 0;
+}
+
+
+void spectral_free(t_spectral *x)
+{
+	dsp_free((t_pxobject *)x);
+	bufreader_free(&x->s_mask);
+	spectral_release(x);
+}
+
+
+void spectral_assist(t_spectral *x, void *b, long m, long a, char *s)
+{
+	static const char *pfftin[] = { "Real", "Imaginary", "Sidechain Real", "Sidechain Imaginary" };
+
+	if (x->s_pfft) {
+		if (m == ASSIST_INLET)
+			snprintf_zero(s, 256, "(signal) %s (from fftin~)", pfftin[a]);
+		else
+			snprintf_zero(s, 256, "(signal) %s (to fftout~)", pfftin[a]);
+	}
+	else if (m == ASSIST_OUTLET)
+		snprintf_zero(s, 256, "(signal) Output, delayed by fftsize");
+	else if (a == 0)
+		snprintf_zero(s, 256, "(signal) Input");
+	else
+		snprintf_zero(s, 256, "(signal) Sidechain for cross synthesis");
+}
+
+
+t_max_err spectral_notify(t_spectral *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
+{
+	return bufreader_notify(&x->s_mask, s, msg, sender, data);
+}
+
+
+t_max_err spectral_attr_setchain(t_spectral *x, void *attr, long argc, t_atom *argv)
+{
+	char kernels[SPECTRAL_MAXKERNELS];
+	long i, k, n = 0;
+
+	for (i = 0; i < argc && n < SPECTRAL_MAXKERNELS; i++) {
+		t_symbol *name = atom_getsym(argv + i);
+
+		for (k = 0; k < SPECTRAL_NUMKERNELS; k++) {
+			if (name == s_spectral_kernelnames[k])
+				break;
+		}
+		if (k == SPECTRAL_NUMKERNELS) {
+			object_error((t_object *)x, "no kernel %s", name->s_name);
+			continue;
+		}
+		x->s_chain[n] = name;
+		kernels[n++] = (char)k;
+	}
+	// the audio thread reads the count first, so shorten it before the kernels change under it
+	x->s_nkernels = 0;
+	memcpy(x->s_kernels, kernels, n);
+	x->s_nkernels = n;
+	x->s_chainlen = n;
+	return MAX_ERR_NONE;
+}
+
+
+t_max_err spectral_attr_setmask(t_spectral *x, void *attr, long argc, t_atom *argv)
+{
+	x->s_maskname = argc ? atom_getsym(argv) : gensym("");
+	bufreader_set(&x->s_mask, x->s_maskname);
+	return MAX_ERR_NONE;
+}
+
+
+//***********************************************************************************************
+// kernels: each is one pass over the bins of a frame
+
+static void spectral_mask(t_spectral *x, float *re, float *im, long n)
+{
+	t_bufreader *r = &x->s_mask;
+	float *tab = bufreader_lock(r);
+	long k;
+
+	if (!tab)
+		return;
+	if (r->frames > 0) {
+		bufreader_read(r, tab, x->s_pos, 0., (double)(r->frames - 1), x->s_gain, 0, n, BUFREADER_INTERP_LINEAR);
+		for (k = 0; k < n; k++) {
+			re[k] *= (float)x->s_gain[k];
+			im[k] *= (float)x->s_gain[k];
+		}
+	}
+	bufreader_unlock(r);
+}
+
+// a full-scale sine comes out of the Hann window with a peak bin of fftsize / 4
+static void spectral_gate(t_spectral *x, float *re, float *im, long n, long fftsize)
+{
+	float thresh = (float)(0.25 * fftsize * pow(10., x->s_gate * 0.05));
+	float t2 = thresh * thresh;
+	long k;
+
+	for (k = 0; k < n; k++) {
+		float g = (re[k] * re[k] + im[k] * im[k]) >= t2 ? 1.f : 0.f;
+
+		re[k] *= g;
+		im[k] *= g;
+	}
+}
+
+static inline float spectral_wrap(float p)
+{
+	return p - (float)TWOPI * floorf((p + (float)PI) * (float)(1. / TWOPI));
+}
+
+static void spectral_freeze(t_spectral *x, float *re, float *im, long n)
+{
+	long k;
+
+	if (!x->s_freeze) {
+		x->s_state = SPECTRAL_LIVE;
+		return;
+	}
+	if (x->s_state == SPECTRAL_LIVE) {
+		for (k = 0; k < n; k++)
+			x->s_phase[k] = atan2f(im[k], re[k]);
+		x->s_state = SPECTRAL_CAPTURE;
+	}
+	else if (x->s_state == SPECTRAL_CAPTURE) {
+		// the phase each bin moved by over one hop is what keeps it sounding like itself
+		for (k = 0; k < n; k++) {
+			float ph = atan2f(im[k], re[k]);
+
+			x->s_mag[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+			x->s_dphi[k] = spectral_wrap(ph - x->s_phase[k]);
+			x->s_phase[k] = ph;
+		}
+		x->s_state = SPECTRAL_FROZEN;
+	}
+	else {
+		for (k = 0; k < n; k++) {
+			float ph = spectral_wrap(x->s_phase[k] + x->s_dphi[k]);
+
+			x->s_phase[k] = ph;
+			re[k] = x->s_mag[k] * cosf(ph);
+			im[k] = x->s_mag[k] * sinf(ph);
+		}
+	}
+}
+
+static void spectral_cross(t_spectral *x, float *re, float *im, const float *sre, const float *sim, long n)
+{
+	float amount = (float)x->s_cross;
+	long k;
+
+	if (amount == 1.f) {
+		for (k = 0; k < n; k++) {
+			float g = sqrtf((sre[k] * sre[k] + sim[k] * sim[k]) / (re[k] * re[k] + im[k] * im[k] + SPECTRAL_TINY));
+
+			re[k] *= g;
+			im[k] *= g;
+		}
+	}
+	else if (amount > 0.f) {
+		for (k = 0; k < n; k++) {
+			float g = powf((sre[k] * sre[k] + sim[k] * sim[k] + SPECTRAL_TINY) / (re[k] * re[k] + im[k] * im[k] + SPECTRAL_TINY), 0.5f * amount);
+
+			re[k] *= g;
+			im[k] *= g;
+		}
+	}
+}
+
+static void spectral_kernels(t_spectral *x, long n, long fftsize)
+{
+	long i, count = x->s_nkernels;
+
+	for (i = 0; i < count; i++) {
+		switch (x->s_kernels[i]) {
+			case SPECTRAL_MASK:		spectral_mask(x, x->s_re, x->s_im, n); break;
+			case SPECTRAL_GATE:		spectral_gate(x, x->s_re, x->s_im, n, fftsize); break;
+			case SPECTRAL_FREEZE:	spectral_freeze(x, x->s_re, x->s_im, n); break;
+			case SPECTRAL_CROSS:
+				if (x->s_side)
+					spectral_cross(x, x->s_re, x->s_im, x->s_sre, x->s_sim, n);
+				break;
+		}
+	}
+}
+
+static t_bool spectral_wantsside(t_spectral *x)
+{
+	long i;
+
+	if (!x->s_side)
+		return false;
+	for (i = 0; i < x->s_nkernels; i++) {
+		if (x->s_kernels[i] == SPECTRAL_CROSS)
+			return true;
+	}
+	return false;
+}
+
+
+//***********************************************************************************************
+// overlap-add
+
+static void spectral_frame(t_spectral *x)
+{
+	long k, n = x->s_n, h = x->s_h;
+	const float *win = x->s_win;
+	float *frame = x->s_frame, *acc = x->s_acc;
+
+	for (k = 0; k < n; k++)
+		frame[k] = x->s_in[k] * win[k];
+	specfft_forward(&x->s_fft, frame, x->s_re, x->s_im);
+	if (spectral_wantsside(x)) {
+		for (k = 0; k < n; k++)
+			frame[k] = x->s_sidein[k] * win[k];
+		specfft_forward(&x->s_fft, frame, x->s_sre, x->s_sim);
+	}
+
+	spectral_kernels(x, x->s_bins, n);
+
+	specfft_inverse(&x->s_fft, x->s_re, x->s_im, frame);
+	for (k = 0; k < n; k++)
+		acc[k] += frame[k] * win[k];
+
+	// the first hop of the accumulator has had every frame it will get
+	for (k = 0; k < h; k++)
+		x->s_out[k] = acc[k] * x->s_norm[k];
+	memmove(acc, acc + h, (n - h) * sizeof(float));
+	memset(acc + n - h, 0, h * sizeof(float));
+	memmove(x->s_in, x->s_in + h, (n - h) * sizeof(float));
+	memmove(x->s_sidein, x->s_sidein + h, (n - h) * sizeof(float));
+}
+
+void spectral_perform64(t_spectral *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	const double *in = ins[0], *side = ins[1];
+	double *out = outs[0];
+	long i = 0, j, h = x->s_h;
+	float *inpos, *sidepos, *outpos;
+
+	while (i < sampleframes) {
+		long run = MIN(sampleframes - i, h - x->s_fill);
+
+		inpos = x->s_in + x->s_n - h + x->s_fill;
+		sidepos = x->s_sidein + x->s_n - h + x->s_fill;
+		outpos = x->s_out + x->s_fill;
+		for (j = 0; j < run; j++) {
+			inpos[j] = (float)in[i + j];
+			sidepos[j] = (float)side[i + j];
+			out[i + j] = outpos[j];
+		}
+		i += run;
+		x->s_fill += run;
+		if (x->s_fill == h) {
+			spectral_frame(x);
+			x->s_fill = 0;
+		}
+	}
+}
+
+// inside a pfft~, each vector is a frame
+void spectral_perform64_pfft(t_spectral *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	long k, n = MIN(sampleframes, x->s_bins);
+
+	for (k = 0; k < n; k++) {
+		x->s_re[k] = (float)ins[0][k];
+		x->s_im[k] = (float)ins[1][k];
+		x->s_sre[k] = (float)ins[2][k];
+		x->s_sim[k] = (float)ins[3][k];
+	}
+
+	spectral_kernels(x, n, x->s_n);
+
+	for (k = 0; k < n; k++) {
+		outs[0][k] = x->s_re[k];
+		outs[1][k] = x->s_im[k];
+	}
+}
+
+
+static t_max_err spectral_alloc(t_spectral *x, long fftsize, long hop, long bins)
+{
+	long k, j;
+	float *p;
+
+	if (x->s_block && fftsize == x->s_n && hop == x->s_h && bins == x->s_bins)
+		return MAX_ERR_NONE;
+	spectral_release(x);
+	if (!x->s_pfft && specfft_init(&x->s_fft, fftsize))
+		return MAX_ERR_OUT_OF_MEM;
+	x->s_block = (float *)sysmem_newptrclear((5 * fftsize + 2 * hop + 7 * bins) * sizeof(float));
+	x->s_dblock = (double *)sysmem_newptrclear(2 * bins * sizeof(double));
+	if (!x->s_block || !x->s_dblock) {
+		spectral_release(x);
+		return MAX_ERR_OUT_OF_MEM;
+	}
+	x->s_n = fftsize;
+	x->s_h = hop;
+	x->s_bins = bins;
+
+	p = x->s_block;
+	x->s_win = p;		p += fftsize;
+	x->s_in = p;		p += fftsize;
+	x->s_sidein = p;	p += fftsize;
+	x->s_acc = p;		p += fftsize;
+	x->s_frame = p;		p += fftsize;
+	x->s_norm = p;		p += hop;
+	x->s_out = p;		p += hop;
+	x->s_re = p;		p += bins;
+	x->s_im = p;		p += bins;
+	x->s_sre = p;		p += bins;
+	x->s_sim = p;		p += bins;
+	x->s_mag = p;		p += bins;
+	x->s_phase = p;		p += bins;
+	x->s_dphi = p;
+	x->s_pos = x->s_dblock;
+	x->s_gain = x->s_dblock + bins;
+
+	// periodic Hann on both sides of the transform
+	for (k = 0; k < fftsize; k++)
+		x->s_win[k] = (float)(0.5 - 0.5 * cos(TWOPI * k / fftsize));
+	for (k = 0; k < hop; k++) {
+		double sum = 0.;
+
+		for (j = k; j < fftsize; j += hop)
+			sum += (double)x->s_win[j] * x->s_win[j];
+		x->s_norm[k] = sum > 0. ? (float)(1. / sum) : 0.f;
+	}
+	for (k = 0; k < bins; k++)
+		x->s_pos[k] = bins > 1 ? (double)k / (bins - 1) : 0.;
+	return MAX_ERR_NONE;
+}
+
+void spectral_dsp64(t_spectral *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	long fftsize, hop;
+
+	if (x->s_pfft) {
+		fftsize = x->s_pfft->x_fftsize;
+		if (spectral_alloc(x, fftsize, x->s_pfft->x_ffthop, maxvectorsize)) {
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		x->s_side = count[2] || count[3];
+		x->s_state = SPECTRAL_LIVE;
+		object_method(dsp64, gensym("dsp_add64"), x, spectral_perform64_pfft, 0, NULL);
+		return;
+	}
+
+	fftsize = x->s_fftsize;
+	if (!specfft_validsize(fftsize)) {
+		while (fftsize & (fftsize - 1))
+			fftsize &= fftsize - 1;
+		object_warn((t_object *)x, "fftsize %ld is not a power of two, using %ld", x->s_fftsize, fftsize);
+	}
+	// hops that divide the frame keep every output sample under the same windows
+	hop = MIN(x->s_hop, fftsize / 2);
+	while (hop & (hop - 1))
+		hop &= hop - 1;
+	if (spectral_alloc(x, fftsize, hop, fftsize / 2 + 1)) {
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	x->s_fill = 0;
+	x->s_side = count[1];
+	x->s_state = SPECTRAL_LIVE;
+	memset(x->s_in, 0, 4 * fftsize * sizeof(float));	// input, sidechain input, accumulator and frame
+	memset(x->s_out, 0, hop * sizeof(float));
+	object_method(dsp64, gensym("dsp_add64"), x, spectral_perform64, 0, NULL);
+}
@@ -7,6 +7,8 @@
 #include "ext.h"		// standard Max include
 #include "ext_obex.h"	// required for "new" (Max 4.5 and later) style objects
 #include "z_dsp.h"		// required for audio objects
+#include "simdsig.h"	// vector kernels shared by the simple signal objects
+#include "modbus.h"		// named modulation buses, read when the limit inlets have no signal
 
 
 // struct to represent the object's state
@@ -15,6 +17,8 @@ typedef struct _split {
 	float		s_low;			// low bound of the range
 	float		s_high;			// high bound of the range
 	char		s_connected[3];	// array of bools indicating which inlets have audio signals
+	t_modbus_ref	s_lowbus;	// modulation bus channels for the limits
+	t_modbus_ref	s_highbus;
 } t_split;
 
 
@@ -23,6 +27,8 @@ void *split_new(t_symbol *msg, long argc, t_atom *argv);
 void split_assist(t_split *x, void *b, long m, long a, char *s);
 void split_int(t_split *x, long n);
 void split_float(t_split *x, double val);
+t_max_err split_attr_setlowbus(t_split *x, void *attr, long argc, t_atom *argv);
+t_max_err split_attr_sethighbus(t_split *x, void *attr, long argc, t_atom *argv);
 // (we can skip the prototypes for the perform methods; we'll define them in the body above the point where they are called)
 void split_dsp64(t_split *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 
@@ -35,13 +41,25 @@ static t_class *s_split_class = NULL;
 
 void ext_main(void *r)
 {
-	t_class *c = class_new("split~", (method)split_new, (method)dsp_free, sizeof(t_split), NULL, A_GIMME, 0);
+	t_class *c;
+
+	simdsig_init();
+
+	c = class_new("split~", (method)split_new, (method)dsp_free, sizeof(t_split), NULL, A_GIMME, 0);
 
 	class_addmethod(c, (method)split_int,		"int",		A_LONG, 0);
 	class_addmethod(c, (method)split_float,		"float",	A_FLOAT, 0);
 	class_addmethod(c, (method)split_dsp64,		"dsp64",	A_CANT, 0);		// New 64-bit MSP dsp chain compilation for Max 6
 	class_addmethod(c, (method)split_assist,	"assist",	A_CANT, 0);
 
+	CLASS_ATTR_ATOM_VARSIZE(c, "lowbus", 0, t_split, s_lowbus.atoms, s_lowbus.natoms, 2);
+	CLASS_ATTR_LABEL(c, "lowbus", 0, "Low Limit Modulation Bus and Channel");
+	CLASS_ATTR_ACCESSORS(c, "lowbus", NULL, split_attr_setlowbus);
+
+	CLASS_ATTR_ATOM_VARSIZE(c, "highbus", 0, t_split, s_highbus.atoms, s_highbus.natoms, 2);
+	CLASS_ATTR_LABEL(c, "highbus", 0, "High Limit Modulation Bus and Channel");
+	CLASS_ATTR_ACCESSORS(c, "highbus", NULL, split_attr_sethighbus);
+
 	class_dspinit(c);
 	class_register(CLASS_BOX, c);
 	s_split_class = c;
@@ -60,6 +78,9 @@ void *split_new(t_symbol *s, long argc, t_atom *argv)
 
 		atom_arg_getfloat(&x->s_low, 0, argc, argv);	// get typed in args
 		atom_arg_getfloat(&x->s_high, 1, argc, argv);	// ...
+		modbus_ref_init(&x->s_lowbus);
+		modbus_ref_init(&x->s_highbus);
+		attr_args_process(x, (short)argc, argv);
 	}
 	return x;
 }
@@ -105,10 +126,22 @@ void split_int(t_split *x, long value)
 }
 
 
+t_max_err split_attr_setlowbus(t_split *x, void *attr, long argc, t_atom *argv)
+{
+	return modbus_ref_set(&x->s_lowbus, argc, argv);
+}
+
+
+t_max_err split_attr_sethighbus(t_split *x, void *attr, long argc, t_atom *argv)
+{
+	return modbus_ref_set(&x->s_highbus, argc, argv);
+}
+
+
 //***********************************************************************************************
 
 // We have 2 perform methods:
-// One of the perform methods is for all 3 audio signals connected.
+// One of the perform methods is for all 3 audio signals connected (or read from a modulation bus).
 // The other perform method is optimized for the case where only the first audio signal is connected.
 
 
@@ -119,27 +152,16 @@ void split_perform364(t_split *x, t_object *dsp64, double **ins, long numins, do
 	t_double	*out1 = outs[0];	// Output 1
 	t_double	*out2 = outs[1];	// Output 2
 	t_double	*out3 = outs[2];	// Output 3
-	int			n = sampleframes;
-	t_double	value, low, high;
-
-	// low and high only updated at the vector-rate, for efficiency
-	// (cpu was in short supply on the G3 PowerBook when this object was written)
-	low  = x->s_connected[1]? *ins[1] : x->s_low;
-	high = x->s_connected[2]? *ins[2] : x->s_high;
-
-	while (n--) {
-		value = *in1++;
-		if ((value >= low) && (value <= high)) {
-			*out1++ = value;
-			*out2++ = 0;
-			*out3++ = 1;
-		}
-		else {
-			*out1++ = 0;
-			*out2++ = value;
-			*out3++ = 0;
-		}
-	}
+	t_double	low = x->s_low;
+	t_double	high = x->s_high;
+	const double	*lows = x->s_connected[1] ? ins[1] : modbus_ref_read(&x->s_lowbus, sampleframes);
+	const double	*highs = x->s_connected[2] ? ins[2] : modbus_ref_read(&x->s_highbus, sampleframes);
+
+	// a low or high signal (from the inlet or a bus) is honoured per sample; otherwise it is held at its float value
+	s_simdsig.split(in1,
+					lows ? lows : &low, lows ? 1 : 0,
+					highs ? highs : &high, highs ? 1 : 0,
+					out1, out2, out3, sampleframes);
 }
 
 
@@ -150,24 +172,11 @@ void split_perform164(t_split *x, t_object *dsp64, double **ins, long numins, do
 	t_double	*out1 = outs[0];		// Output 1
 	t_double	*out2 = outs[1];		// Output 2
 	t_double	*out3 = outs[2];		// Output 3
-	int			n = sampleframes;
-	t_double	value;
-	t_double	low = x->s_low;		// cache struct object members locally to keep them in registers on the processor
-	t_double	high = x->s_high;	// ... thus improving performance.
-
-	while (n--) {
-		value = *in1++;
-		if ((value >= low) && (value <= high)) {
-			*out1++ = value;
-			*out2++ = 0;
-			*out3++ = 1;
-		}
-		else {
-			*out1++ = 0;
-			*out2++ = value;
-			*out3++ = 0;
-		}
-	}
+	t_double	low = x->s_low;
+	t_double	high = x->s_high;
+
+	// the comparison is done as a mask, so all three outputs are written without branching
+	s_simdsig.split(in1, &low, 0, &high, 0, out1, out2, out3, sampleframes);
 }
 
 
@@ -177,10 +186,16 @@ void split_dsp64(t_split *x, t_object *dsp64, short *count, double samplerate, l
 {
 	short i;
 
-	for (i=0; i<6; i++)
+	for (i=0; i<3; i++)
 		x->s_connected[i] = count[i];
 
-	if (count[1] || count[2])	// IF the 2nd or 3rd inlet has a signal connected to it...
+	// a bus stands in for a limit inlet with nothing connected
+	if (!count[1])
+		modbus_ref_resolve(&x->s_lowbus, maxvectorsize);
+	if (!count[2])
+		modbus_ref_resolve(&x->s_highbus, maxvectorsize);
+
+	if (count[1] || count[2] || x->s_lowbus.chan || x->s_highbus.chan)	// IF the 2nd or 3rd inlet has a signal...
 		object_method(dsp64, gensym("dsp_add64"), x, split_perform364, 0, NULL);
 	else
 		object_method(dsp64, gensym("dsp_add64"), x, split_perform164, 0, NULL);
@@ -9,13 +9,8 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "z_dsp.h"
-
-// #define WIN_SSE_INTRINSICS
-
-#ifdef WIN_VERSION
-#include <xmmintrin.h>
-#include <emmintrin.h>
-#endif
+#include "simdsig.h"
+#include "denorm.h"
 
 
 static t_class *times_class;
@@ -24,11 +19,14 @@ static t_class *times_class;
 typedef struct _times {
 	t_pxobject	x_obj;
 	t_sample	x_val;
+	t_denorm_counter	*x_denorm;	// what the scrub after our perform routine found
+	t_denorm_wrap	x_wrap;
 } t_times;
 
 
 void times_assist(t_times *x, void *b, long m, long a, char *s);
 void *times_new(double val);
+void times_free(t_times *x);
 void times_dsp64(t_times *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void times_float(t_times *x, double f);
 void times_int(t_times *x, long n);
@@ -40,7 +38,10 @@ C74_EXPORT void ext_main(void *r)
 {
 	t_class *c;
 
-	c = class_new("times~", (method)times_new, (method)dsp_free, sizeof(t_times), 0L, A_DEFFLOAT, 0);
+	simdsig_init();
+	denorm_init();
+
+	c = class_new("times~", (method)times_new, (method)times_free, sizeof(t_times), 0L, A_DEFFLOAT, 0);
 	class_dspinit(c);
 
 	class_addmethod(c, (method)times_dsp64, "dsp64", A_CANT, 0);
@@ -68,14 +69,15 @@ void times_int(t_times *x, long n)
 
 void times_dsp64(t_times *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
 {
+	// the wrapper scrubs the output, which is what FIX_DENORM_NAN_DOUBLE used to do per sample
 	if (!count[1]) {
-		dsp_add64(dsp64, (t_object *) x, (t_perfroutine64) scale_perform64_method, 0, 0);
+		denorm_add64(dsp64, (t_object *) x, &x->x_wrap, x->x_denorm, (t_perfroutine64) scale_perform64_method, 0, 0);
 	}
 	else if (!count[0]) {
-		dsp_add64(dsp64, (t_object *) x, (t_perfroutine64) scale_perform64_method, 0, (void *) 1);
+		denorm_add64(dsp64, (t_object *) x, &x->x_wrap, x->x_denorm, (t_perfroutine64) scale_perform64_method, 0, (void *) 1);
 	}
 	else {
-		dsp_add64(dsp64, (t_object *) x, (t_perfroutine64) times_perform64_method, 0, 0);
+		denorm_add64(dsp64, (t_object *) x, &x->x_wrap, x->x_denorm, (t_perfroutine64) times_perform64_method, 0, 0);
 	}
 }
 
@@ -85,41 +87,9 @@ void scale_perform64_method(t_times *x, t_object *dsp64, double **ins, long numi
 	int invec = (int) userparam;   // used to signal which one is the signal input (1 for right, 0 for left)
 	t_double *in = ins[invec];
 	t_double *out = outs[0];
-	t_double val = x->x_val;
-#if defined(WIN_VERSION) && defined(WIN_SSE_INTRINSICS)
-	__m128d mm_in1;
-	__m128d *mm_out1 = (__m128d *) out;
-	__m128d mm_in2;
-	__m128d *mm_out2 = (__m128d *) out;
-	__m128d mm_val;
-	__declspec(align(16)) t_double aligned_val = x->x_val;
-	int i;
-
-	mm_val = _mm_set1_pd(aligned_val);
-
-	// rbs fix: this version will break if the SVS is smaller than 4
-	C74_ASSERT(sampleframes >= 4);
-	for (i=0; i < sampleframes; i+=4) {
-		mm_in1 = _mm_load_pd(in+i);
-		mm_out1[i/2] = _mm_mul_pd(mm_in1, mm_val);
-		mm_in2 = _mm_load_pd(in+i+2);
-		mm_out2[i/2 + 1] = _mm_mul_pd(mm_in2, mm_val);
-	}
-
-#else
-	t_double ftmp;
-
-//	if (IS_DENORM_DOUBLE(*in)) {
-//		static int counter = 0;
-//		post("times~ (%p): saw denorm (%d)", x, counter++);
-//	}
 
-	while (sampleframes--) {
-		ftmp = val **in++;
-		FIX_DENORM_NAN_DOUBLE(ftmp);
-		*out++ = ftmp;
-	}
-#endif
+	// any vector size works; the kernels handle the tail themselves
+	s_simdsig.scale(out, in, x->x_val, sampleframes);
 }
 
 
@@ -128,18 +98,8 @@ void times_perform64_method(t_times *x, t_object *dsp64, double **ins, long numi
 	t_double *in1 = ins[0];
 	t_double *in2 = ins[1];
 	t_double *out = outs[0];
-	t_double ftmp;
-
-//	if (IS_DENORM_DOUBLE(*in1) || IS_DENORM_DOUBLE(*in2)) {
-//		static int counter = 0;
-//		post("times~ (%p): saw denorm (%d)", x, counter++);
-//	}
 
-	while (sampleframes--) {
-		ftmp = *in1++ **in2++;
-		FIX_DENORM_NAN_DOUBLE(ftmp);
-		*out++ = ftmp;
-	}
+	s_simdsig.mul(out, in1, in2, sampleframes);
 }
 
 
@@ -165,7 +125,14 @@ void *times_new(double val)
 	dsp_setup((t_pxobject *)x,2);
 	outlet_new((t_pxobject *)x, "signal");
 	x->x_val = val; // splatted in _dsp method if optimizations are on
+	x->x_denorm = denorm_counter_new((t_object *)x);
 
 	return (x);
 }
 
+void times_free(t_times *x)
+{
+	dsp_free((t_pxobject *)x);
+	denorm_counter_free(x->x_denorm);
+}
+
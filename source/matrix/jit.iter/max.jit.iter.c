@@ -4,9 +4,25 @@
 */
 
 // revised at some point by jb to include 2nd mode (necessary for particles)
+// output, predicate/threshold and budget attributes add row, match and sliced
+// iteration for large matrices.
 
 #include "jit.common.h"
 
+#define MAX_JIT_ITER_SLICE_CELLS	256		// cells output between budget checks in cell mode
+
+enum {
+	MAX_JIT_ITER_OUTPUT_CELL = 0,	// one coordinate and one value message per cell
+	MAX_JIT_ITER_OUTPUT_ROW,		// one coordinate and one value list per row
+	MAX_JIT_ITER_OUTPUT_MATCH		// packed coordinates and values of matching cells, per row
+};
+
+enum {
+	MAX_JIT_ITER_PREDICATE_NONZERO = 0,
+	MAX_JIT_ITER_PREDICATE_ABOVE,
+	MAX_JIT_ITER_PREDICATE_BELOW
+};
+
 typedef struct _max_jit_iter
 {
 	t_object			ob;
@@ -15,6 +31,18 @@ typedef struct _max_jit_iter
 	void 				*coordout;
 	//outputmode: 0=no output, 1=calc, 2=input(no calc)(irrelevant), 3=output(no calc)
 	char				mode;
+	long				output;
+	long				predicate;
+	double				threshold;
+	double				budget;			// ms per slice, 0 iterates synchronously
+	void				*qelem;
+	void				*iter_matrix;	// private copy iterated across slices
+	long				iter_line;
+	long				iter_cell;
+	long				iter_linecount;
+	t_atom				*a_vals;
+	t_atom				*a_coords;
+	long				a_size;			// atoms allocated in a_vals and a_coords
 } t_max_jit_iter;
 
 void *max_jit_iter_new(t_symbol *s, long argc, t_atom *argv);
@@ -22,6 +50,11 @@ void max_jit_iter_free(t_max_jit_iter *x);
 void max_jit_iter_assist(t_max_jit_iter *x, void *b, long m, long a, char *s);
 void max_jit_iter_jit_matrix(t_max_jit_iter *x, t_symbol *s, long argc, t_atom *argv);
 void max_jit_iter_calculate_ndim(t_max_jit_iter *x, long dimcount, long *dim, t_atom *a_coord, t_jit_matrix_info *in_minfo, char *bip);
+long max_jit_iter_linecount(t_max_jit_iter *x, t_jit_matrix_info *minfo);
+void max_jit_iter_line(t_max_jit_iter *x, t_jit_matrix_info *minfo, char *bp, long line, long start, long end);
+void max_jit_iter_start(t_max_jit_iter *x, void *matrix);
+void max_jit_iter_slice(t_max_jit_iter *x);
+void max_jit_iter_stop(t_max_jit_iter *x);
 
 t_messlist *max_jit_iter_class;
 
@@ -51,7 +84,36 @@ C74_EXPORT void ext_main(void *r)
 	object_addattr_parse(attr,"enumvals",_jit_sym_symbol,0,"\"Horizontal Traversal\" \"Vertical Traversal\"");
 	max_jit_classex_addattr(p,attr);
 
+	attr = jit_object_new(_jit_sym_jit_attr_offset,"output",_jit_sym_long,attrflags,
+						  (method)0,(method)0,calcoffset(t_max_jit_iter,output));
+	object_addattr_parse(attr,"category",_jit_sym_symbol,0,"Behavior");
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"\"Output Mode\"");
+	object_addattr_parse(attr,"style",_jit_sym_symbol,0,"enumindex");
+	object_addattr_parse(attr,"enumvals",_jit_sym_symbol,0,"Cell Row Match");
+	max_jit_classex_addattr(p,attr);
+
+	attr = jit_object_new(_jit_sym_jit_attr_offset,"predicate",_jit_sym_long,attrflags,
+						  (method)0,(method)0,calcoffset(t_max_jit_iter,predicate));
+	object_addattr_parse(attr,"category",_jit_sym_symbol,0,"Behavior");
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"\"Match Predicate\"");
+	object_addattr_parse(attr,"style",_jit_sym_symbol,0,"enumindex");
+	object_addattr_parse(attr,"enumvals",_jit_sym_symbol,0,"\"Non-zero\" Above Below");
+	max_jit_classex_addattr(p,attr);
+
+	attr = jit_object_new(_jit_sym_jit_attr_offset,"threshold",_jit_sym_float64,attrflags,
+						  (method)0,(method)0,calcoffset(t_max_jit_iter,threshold));
+	object_addattr_parse(attr,"category",_jit_sym_symbol,0,"Behavior");
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"\"Match Threshold\"");
+	max_jit_classex_addattr(p,attr);
+
+	attr = jit_object_new(_jit_sym_jit_attr_offset,"budget",_jit_sym_float64,attrflags,
+						  (method)0,(method)0,calcoffset(t_max_jit_iter,budget));
+	object_addattr_parse(attr,"category",_jit_sym_symbol,0,"Behavior");
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"\"Slice Budget (ms)\"");
+	max_jit_classex_addattr(p,attr);
+
 	max_jit_classex_standard_wrap(p,NULL,0);
+	addmess((method)max_jit_iter_stop,				"stop",				0);
 	addmess((method)max_jit_iter_assist,			"assist",			A_CANT,0);
 
 	ps_done = gensym("done");
@@ -72,6 +134,16 @@ void max_jit_iter_jit_matrix(t_max_jit_iter *x, t_symbol *s, long argc, t_atom *
 		//find matrix
 		matrix = jit_object_findregistered(jit_atom_getsym(argv));
 		if (matrix&&jit_object_method(matrix, _jit_sym_class_jit_matrix)) {
+			if (x->budget>0) {
+				// sliced iteration owns its state on the main thread
+				if (!systhread_ismainthread()) {
+					defer_low(x,(method)max_jit_iter_jit_matrix,s,argc,argv);
+					goto out;
+				}
+				max_jit_iter_start(x,matrix);
+				goto out;
+			}
+
 			//calculate
 			in_savelock = (long) jit_object_method(matrix,_jit_sym_lock,1);
 			jit_object_method(matrix,_jit_sym_getinfo,&in_minfo);
@@ -90,7 +162,14 @@ void max_jit_iter_jit_matrix(t_max_jit_iter *x, t_symbol *s, long argc, t_atom *
 			}
 
 			//calculate
-			max_jit_iter_calculate_ndim(x, dimcount, dim, a_coord, &in_minfo, in_bp);
+			if (x->output==MAX_JIT_ITER_OUTPUT_CELL) {
+				max_jit_iter_calculate_ndim(x, dimcount, dim, a_coord, &in_minfo, in_bp);
+			} else {
+				long linecount = max_jit_iter_linecount(x,&in_minfo);
+
+				for (i=0; i<linecount; i++)
+					max_jit_iter_line(x,&in_minfo,in_bp,i,0,-1);
+			}
 
 			jit_object_method(matrix,_jit_sym_lock,in_savelock);
 			max_jit_obex_dumpout(x,ps_done,0,0L);
@@ -297,6 +376,257 @@ void max_jit_iter_calculate_ndim(t_max_jit_iter *x, long dimcount, long *dim, t_
 	}
 }
 
+// lines run along dim 0, or along dim 1 in vertical traversal mode. the
+// remaining dimensions enumerate the lines, lowest dimension fastest.
+static long max_jit_iter_axis(t_max_jit_iter *x, t_jit_matrix_info *minfo)
+{
+	return (x->mode==1 && minfo->dimcount>1) ? 1 : 0;
+}
+
+long max_jit_iter_linecount(t_max_jit_iter *x, t_jit_matrix_info *minfo)
+{
+	long d,axis,count=1;
+
+	if (minfo->dimcount<1)
+		return 0;
+	axis = max_jit_iter_axis(x,minfo);
+	for (d=0; d<minfo->dimcount; d++) {
+		if (d!=axis)
+			count *= minfo->dim[d];
+	}
+	return count;
+}
+
+static long max_jit_iter_reserve(t_max_jit_iter *x, long n)
+{
+	if (n>x->a_size) {
+		t_atom *vals = (t_atom *)sysmem_resizeptr(x->a_vals, n * sizeof(t_atom));
+		t_atom *coords = (t_atom *)sysmem_resizeptr(x->a_coords, n * sizeof(t_atom));
+
+		if (vals)
+			x->a_vals = vals;
+		if (coords)
+			x->a_coords = coords;
+		if (!vals || !coords) {
+			jit_object_error((t_object *)x,"jit.iter: out of memory");
+			return 0;
+		}
+		x->a_size = n;
+	}
+	return 1;
+}
+
+static void max_jit_iter_cell_atoms(t_jit_matrix_info *minfo, char *cp, t_atom *av)
+{
+	long k;
+
+	if (minfo->type==_jit_sym_char) {
+		for (k=0; k<minfo->planecount; k++)
+			jit_atom_setlong(av+k,((uchar *)cp)[k]);
+	} else if (minfo->type==_jit_sym_long) {
+		for (k=0; k<minfo->planecount; k++)
+			jit_atom_setlong(av+k,((t_int32 *)cp)[k]);
+	} else if (minfo->type==_jit_sym_float32) {
+		for (k=0; k<minfo->planecount; k++)
+			jit_atom_setfloat(av+k,((float *)cp)[k]);
+	} else if (minfo->type==_jit_sym_float64) {
+		for (k=0; k<minfo->planecount; k++)
+			jit_atom_setfloat(av+k,((double *)cp)[k]);
+	}
+}
+
+// a cell matches when any of its planes satisfies the predicate
+static long max_jit_iter_cell_match(t_max_jit_iter *x, t_jit_matrix_info *minfo, char *cp)
+{
+	long k;
+	double v;
+
+	for (k=0; k<minfo->planecount; k++) {
+		if (minfo->type==_jit_sym_char)
+			v = ((uchar *)cp)[k];
+		else if (minfo->type==_jit_sym_long)
+			v = ((t_int32 *)cp)[k];
+		else if (minfo->type==_jit_sym_float32)
+			v = ((float *)cp)[k];
+		else
+			v = ((double *)cp)[k];
+
+		switch (x->predicate) {
+		case MAX_JIT_ITER_PREDICATE_ABOVE:
+			if (v>x->threshold) return 1;
+			break;
+		case MAX_JIT_ITER_PREDICATE_BELOW:
+			if (v<x->threshold) return 1;
+			break;
+		default:
+			if (v!=0.) return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+static void max_jit_iter_outlet(void *out, long ac, t_atom *av)
+{
+	if (ac==1) {
+		if (av->a_type==A_FLOAT)
+			outlet_float(out,jit_atom_getfloat(av));
+		else
+			outlet_int(out,jit_atom_getlong(av));
+	} else if (ac>1) {
+		outlet_anything(out,_jit_sym_list,ac,av);
+	}
+}
+
+// output cells [start, end) of one line according to the output mode. row and
+// match output always cover the whole line; end < 0 means the end of the line.
+void max_jit_iter_line(t_max_jit_iter *x, t_jit_matrix_info *minfo, char *bp, long line, long start, long end)
+{
+	long coord[JIT_MATRIX_MAX_DIMCOUNT];
+	t_atom a_coord[JIT_MATRIX_MAX_DIMCOUNT];
+	t_atom a_val[JIT_MATRIX_MAX_PLANECOUNT];
+	long d,c,count,axis,len,stride;
+	long dimcount = minfo->dimcount;
+	long planecount = minfo->planecount;
+	char *lp,*cp;
+
+	axis = max_jit_iter_axis(x,minfo);
+	lp = bp;
+	for (d=0; d<dimcount; d++) {
+		if (d==axis) {
+			coord[d] = 0;
+		} else {
+			coord[d] = line % minfo->dim[d];
+			line /= minfo->dim[d];
+		}
+		lp += coord[d] * minfo->dimstride[d];
+	}
+	len = minfo->dim[axis];
+	stride = minfo->dimstride[axis];
+
+	switch (x->output) {
+	case MAX_JIT_ITER_OUTPUT_ROW:
+		if (!max_jit_iter_reserve(x,MAX(len*planecount,dimcount)))
+			return;
+		for (c=0, cp=lp; c<len; c++, cp+=stride)
+			max_jit_iter_cell_atoms(minfo,cp,x->a_vals+c*planecount);
+		for (d=0; d<dimcount; d++)
+			jit_atom_setlong(x->a_coords+d,coord[d]);
+		max_jit_iter_outlet(x->coordout,dimcount,x->a_coords);
+		max_jit_iter_outlet(x->valout,len*planecount,x->a_vals);
+		break;
+	case MAX_JIT_ITER_OUTPUT_MATCH:
+		if (!max_jit_iter_reserve(x,len*MAX(planecount,dimcount)))
+			return;
+		count = 0;
+		for (c=0, cp=lp; c<len; c++, cp+=stride) {
+			if (max_jit_iter_cell_match(x,minfo,cp)) {
+				coord[axis] = c;
+				for (d=0; d<dimcount; d++)
+					jit_atom_setlong(x->a_coords+count*dimcount+d,coord[d]);
+				max_jit_iter_cell_atoms(minfo,cp,x->a_vals+count*planecount);
+				count++;
+			}
+		}
+		if (count) {
+			max_jit_iter_outlet(x->coordout,count*dimcount,x->a_coords);
+			max_jit_iter_outlet(x->valout,count*planecount,x->a_vals);
+		}
+		break;
+	default:
+		if (end<0 || end>len)
+			end = len;
+		for (d=0; d<dimcount; d++)
+			jit_atom_setlong(a_coord+d,coord[d]);
+		for (c=start, cp=lp+start*stride; c<end; c++, cp+=stride) {
+			jit_atom_setlong(a_coord+axis,c);
+			max_jit_iter_cell_atoms(minfo,cp,a_val);
+			max_jit_iter_outlet(x->coordout,dimcount,a_coord);
+			max_jit_iter_outlet(x->valout,planecount,a_val);
+		}
+		break;
+	}
+}
+
+// copy the matrix so it may change while we iterate, then start slicing
+void max_jit_iter_start(t_max_jit_iter *x, void *matrix)
+{
+	t_jit_matrix_info info;
+
+	max_jit_iter_stop(x);
+
+	jit_object_method(matrix,_jit_sym_getinfo,&info);
+	info.flags = 0;
+	if (x->iter_matrix)
+		jit_object_method(x->iter_matrix,_jit_sym_setinfo,&info);
+	else
+		x->iter_matrix = jit_object_new(_jit_sym_jit_matrix,&info);
+	if (!x->iter_matrix) {
+		jit_error_sym(x,_jit_sym_err_calculate);
+		return;
+	}
+	jit_object_method(x->iter_matrix,_jit_sym_frommatrix,matrix,NULL);
+	jit_object_method(x->iter_matrix,_jit_sym_getinfo,&info);
+
+	x->iter_line = 0;
+	x->iter_cell = 0;
+	x->iter_linecount = max_jit_iter_linecount(x,&info);
+	qelem_set(x->qelem);
+}
+
+// output as many lines as fit in the budget, then yield to the scheduler
+void max_jit_iter_slice(t_max_jit_iter *x)
+{
+	t_jit_matrix_info info;
+	long savelock,len,end;
+	char *bp=NULL;
+	double start;
+
+	if (!x->iter_matrix || x->iter_line>=x->iter_linecount)
+		return;
+
+	start = systimer_gettime();
+	savelock = (long) jit_object_method(x->iter_matrix,_jit_sym_lock,1);
+	jit_object_method(x->iter_matrix,_jit_sym_getinfo,&info);
+	jit_object_method(x->iter_matrix,_jit_sym_getdata,&bp);
+	if (!bp) {
+		jit_object_method(x->iter_matrix,_jit_sym_lock,savelock);
+		x->iter_linecount = 0;
+		return;
+	}
+	len = info.dim[max_jit_iter_axis(x,&info)];
+
+	while (x->iter_line<x->iter_linecount) {
+		if (x->output==MAX_JIT_ITER_OUTPUT_CELL) {
+			end = MIN(x->iter_cell+MAX_JIT_ITER_SLICE_CELLS,len);
+			max_jit_iter_line(x,&info,bp,x->iter_line,x->iter_cell,end);
+			x->iter_cell = end;
+			if (x->iter_cell>=len) {
+				x->iter_cell = 0;
+				x->iter_line++;
+			}
+		} else {
+			max_jit_iter_line(x,&info,bp,x->iter_line,0,-1);
+			x->iter_line++;
+		}
+		if (systimer_gettime()-start>=x->budget)
+			break;
+	}
+	jit_object_method(x->iter_matrix,_jit_sym_lock,savelock);
+
+	if (x->iter_line<x->iter_linecount)
+		qelem_set(x->qelem);
+	else
+		max_jit_obex_dumpout(x,ps_done,0,0L);
+}
+
+void max_jit_iter_stop(t_max_jit_iter *x)
+{
+	qelem_unset(x->qelem);
+	x->iter_line = x->iter_linecount = 0;
+	x->iter_cell = 0;
+}
+
 void max_jit_iter_assist(t_max_jit_iter *x, void *b, long m, long a, char *s)
 {
 	if (m == 1) { //input
@@ -318,6 +648,13 @@ void max_jit_iter_assist(t_max_jit_iter *x, void *b, long m, long a, char *s)
 
 void max_jit_iter_free(t_max_jit_iter *x)
 {
+	qelem_free(x->qelem);
+	if (x->iter_matrix)
+		jit_object_free(x->iter_matrix);
+	if (x->a_vals)
+		sysmem_freeptr(x->a_vals);
+	if (x->a_coords)
+		sysmem_freeptr(x->a_coords);
 	//only max object, no jit object
 	max_jit_obex_free(x);
 }
@@ -332,6 +669,15 @@ void *max_jit_iter_new(t_symbol *s, long argc, t_atom *argv)
 		x->valout 	= outlet_new(x,0L);
 
 		x->mode = 0;
+		x->output = MAX_JIT_ITER_OUTPUT_CELL;
+		x->predicate = MAX_JIT_ITER_PREDICATE_NONZERO;
+		x->threshold = 0.;
+		x->budget = 0.;
+		x->qelem = qelem_new(x,(method)max_jit_iter_slice);
+		x->iter_matrix = NULL;
+		x->iter_line = x->iter_cell = x->iter_linecount = 0;
+		x->a_vals = x->a_coords = NULL;
+		x->a_size = 0;
 
 		//no normal args, no matrices
 		max_jit_attr_args(x,argc,argv); //handle attribute args
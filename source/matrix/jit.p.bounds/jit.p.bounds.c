@@ -11,7 +11,15 @@
 I didn't fully implement it, due to > 3 dimensional rotation issues. Will readdress
 at some point. */
 
-#define MAX_RANDOM 4294967294
+#define JIT_P_BOUNDS_CHUNK 1024 // particles per parallel work unit
+#define JIT_P_BOUNDS_BENCH_PLANES 5 // id, life and three axes
+
+enum {
+	JIT_P_BOUNDS_MODE_BOUNCE = 0,
+	JIT_P_BOUNDS_MODE_KILL,
+	JIT_P_BOUNDS_MODE_TORUS,
+	JIT_P_BOUNDS_MODE_CLIP
+};
 
 typedef struct _jit_p_bounds
 {
@@ -27,9 +35,34 @@ typedef struct _jit_p_bounds
 	long					squishcount;
 	long					squish_varcount;
 	t_int32					random;
-	char					mode; // 0 = bounce, 1 = torus, 2 = kill
+	char					mode; // 0 = bounce, 1 = kill, 2 = torus, 3 = clip
+	char					compact; // remove killed particles instead of zeroing their life
+	char					*killed;
+	long					killedsize;
 } t_jit_p_bounds;
 
+typedef struct _jit_p_bounds_vecdata t_jit_p_bounds_vecdata;
+typedef void (*t_jit_p_bounds_vector_fn)(long n, t_jit_p_bounds_vecdata *v, long index, char *bip, char *bop);
+
+struct _jit_p_bounds_vecdata
+{
+	t_jit_p_bounds_vector_fn	fn;
+	long					axes;
+	long					in_pstride;		// bytes per particle
+	long					out_pstride;
+	long					in_rowstride;	// bytes to the previous positions
+	long					out_rowstride;
+	char					*in_base;		// for recovering particle indices
+	t_uint32				seed;
+	double					lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	double					hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	char					enable_lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	char					enable_hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	double					squish[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	double					squish_var[JIT_MATRIX_MAX_PLANECOUNT - 2];
+	char					*killed;		// per-particle flags for the compaction pass, or NULL
+};
+
 void *_jit_p_bounds_class;
 
 t_jit_p_bounds *jit_p_bounds_new(void);
@@ -37,21 +70,25 @@ void jit_p_bounds_free(t_jit_p_bounds *x);
 t_jit_err jit_p_bounds_matrix_calc(t_jit_p_bounds *x, void *inputs, void *outputs);
 void jit_p_bounds_calculate_ndim(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
 								 t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop);
-void jit_p_bounds_calculate_2d_float32(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
-									   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop);
-void jit_p_bounds_calculate_2d_float64(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
-									   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop);
+void jit_p_bounds_calculate_2d(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
+							   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop);
+void jit_p_bounds_calculate_chunks(t_jit_p_bounds_vecdata *vecdata, long dimcount, long *dim, long planecount,
+								   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop);
+void jit_p_bounds_calculate_particles(t_jit_p_bounds *x, t_jit_p_bounds_vecdata *vecdata, long n, long planecount,
+									  t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop, long parallel);
+void jit_p_bounds_getvecdata(t_jit_p_bounds *x, long planecount, t_jit_matrix_info *in_minfo, t_jit_matrix_info *out_minfo, t_jit_p_bounds_vecdata *v);
+long jit_p_bounds_active(long n, t_jit_matrix_info *in_minfo, char *bip);
+void jit_p_bounds_compact(t_jit_p_bounds_vecdata *vecdata, long n, char *bop);
 void jit_p_bounds_bounds_hi(t_jit_p_bounds *x, void *attr, long ac, t_atom *av);
 t_jit_err jit_p_bounds_getbounds_hi(t_jit_p_bounds *x, void *attr, long *ac, t_atom **av);
 void jit_p_bounds_bounds_lo(t_jit_p_bounds *x, void *attr, long ac, t_atom *av);
 t_jit_err jit_p_bounds_getbounds_lo(t_jit_p_bounds *x, void *attr, long *ac, t_atom **av);
+t_jit_err jit_p_bounds_bench(t_jit_p_bounds *x, t_symbol *s, long ac, t_atom *av);
+double jit_p_bounds_bench_run(t_jit_p_bounds *x, long n, t_symbol *type, char *in, char *out, long parallel, long repeats);
 
-float jit_p_bounds_random_num(t_jit_p_bounds *x);
 void jit_p_bounds_rotation_to_direction(float pitch, float yaw, float *direction);
 t_jit_err jit_p_bounds_init(void);
 
-static const long HALF_RAND = (MAX_RANDOM / 2);
-
 t_jit_err jit_p_bounds_init(void)
 {
 	long attrflags=0;
@@ -79,6 +116,7 @@ t_jit_err jit_p_bounds_init(void)
 	jit_class_addadornment(_jit_p_bounds_class,mop);
 	//add methods
 	jit_class_addmethod(_jit_p_bounds_class, (method)jit_p_bounds_matrix_calc, "matrix_calc", A_CANT, 0L);
+	jit_class_addmethod(_jit_p_bounds_class, (method)jit_p_bounds_bench, "bench", A_DEFER_LOW, 0L);
 
 	//add attributes
 	attrflags = JIT_ATTR_GET_DEFER_LOW | JIT_ATTR_SET_USURP_LOW;
@@ -107,6 +145,12 @@ t_jit_err jit_p_bounds_init(void)
 	jit_class_addattr(_jit_p_bounds_class,attr);
 	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"Mode");
 
+	attr = jit_object_new(_jit_sym_jit_attr_offset, "compact", _jit_sym_char, attrflags,
+						  (method)0L, (method)0L, calcoffset(t_jit_p_bounds, compact));
+	jit_class_addattr(_jit_p_bounds_class,attr);
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"Compact");
+	object_addattr_parse(attr,"style",_jit_sym_symbol,0,"onoff");
+
 //	jit_class_addmethod(_jit_p_bounds_class, (method)jit_p_bounds_reset, "reset", A_DEFER_LOW, 0);
 
 	jit_class_register(_jit_p_bounds_class);
@@ -300,10 +344,7 @@ void jit_p_bounds_calculate_ndim(t_jit_p_bounds *x, long dimcount, long *dim, lo
 	case 1:
 		dim[1]=1;
 	case 2:
-		if (in_minfo->type==_jit_sym_float32)
-			jit_p_bounds_calculate_2d_float32(x,dimcount,dim,planecount,in_minfo,bip,out_minfo,bop);
-		else if (in_minfo->type==_jit_sym_float64)
-			jit_p_bounds_calculate_2d_float64(x,dimcount,dim,planecount,in_minfo,bip,out_minfo,bop);
+		jit_p_bounds_calculate_2d(x,dimcount,dim,planecount,in_minfo,bip,out_minfo,bop);
 		break;
 	default:
 		for	(i=0; i<dim[dimcount-1]; i++) {
@@ -314,16 +355,6 @@ void jit_p_bounds_calculate_ndim(t_jit_p_bounds *x, long dimcount, long *dim, lo
 	}
 }
 
-float jit_p_bounds_random_num(t_jit_p_bounds *x)
-{
-	t_int32 rn = x->random;
-
-	rn = 1664525L * rn + 1013904223L;
-	x->random = rn;
-
-	return ((float)(rn - HALF_RAND) / (float)HALF_RAND);
-}
-
 void jit_p_bounds_rotation_to_direction(float pitch, float yaw, float *direction)
 {
 	*direction = (float)(-jit_math_sin(yaw) * jit_math_cos(pitch));
@@ -331,975 +362,339 @@ void jit_p_bounds_rotation_to_direction(float pitch, float yaw, float *direction
 	*(direction + 2) = (float)(jit_math_cos(pitch) * jit_math_cos(yaw));
 }
 
-void jit_p_bounds_calculate_2d_float32(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
-									   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop)
+// the particle engine. each frame the active particles (those before the
+// first zero id) are cut into fixed size chunks and handed to
+// jit_parallel_ndim_simplecalc2 as the rows of a virtual 2D matrix, so
+// the split is independent of the particle count. the mode and type are
+// resolved to one vector function before the loop, and all the per-axis
+// math is select based.
+
+static inline double jit_p_bounds_rand(t_uint32 seed, t_uint32 index, long axis)
 {
-	long j, k, n;
-	long width, rowstride;
-	float *ip, *op, *ip2, *op2, *kill;
-	float tmp;
-	float squish[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	float squish_var[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	float newsquish[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	float bounds_hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	float bounds_lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	char bounds_enable_hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	char bounds_enable_lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	char killflag;
-
-	x->random = jit_rand();
-
-	width = dim[0];
-	rowstride = in_minfo->dimstride[1] / 4;
-
-	for (j = 0; j < JIT_MATRIX_MAX_PLANECOUNT - 2; j++) {
-		bounds_hi[j] = x->bounds_hi[j];
-		bounds_lo[j] = x->bounds_lo[j];
-		bounds_enable_hi[j] = x->bounds_enable_hi[j];
-		bounds_enable_lo[j] = x->bounds_enable_lo[j];
-		squish[j] = x->squish[j];
-		squish_var[j] = x->squish_var[j];
-	}
+	// counter based: the value depends only on the frame seed, the particle
+	// and the axis, so it is the same however the particles are split
+	t_uint32 h = seed ^ (index * 0x9E3779B9U) ^ ((t_uint32)axis * 0x85EBCA6BU);
+
+	h ^= h >> 16;
+	h *= 0x7FEB352DU;
+	h ^= h >> 15;
+	h *= 0x846CA68BU;
+	h ^= h >> 16;
+	return (double)h * (2. / 4294967296.) - 1.;
+}
 
-//	squish = x->squish;
-//	squish_var = x->squish_var;
-
-	ip = (float *)(bip);
-	op = (float *)(bop);
-	ip2 = ip + rowstride;
-	op2 = op + rowstride;
-	n = width;
-//	newsquish = squish;
-
-	switch(x->mode) {
-	case 3: //clip
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[0];
-					ip++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[0];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[1];
-					ip++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[1];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[2];
-					ip++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[2];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						*op2++ = *ip2++;
-						*op++ = bounds_lo[k];
-						ip++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						*op2++ = *ip2++;
-						*op++ = bounds_hi[k];
-						ip++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-			}
-			break;
-		}
+static inline void jit_p_bounds_axis(const long mode, t_jit_p_bounds_vecdata *v, long k, t_uint32 index, double *pp, double *qp, long *kill)
+{
+	double p = *pp, q = *qp;
+	double lo = v->lo[k], hi = v->hi[k]; // +/-HUGE_VAL when disabled
+	double t = (p < lo) ? lo : (p > hi) ? hi : p;
+	long out = (t != p);
+
+	switch (mode) {
+	case JIT_P_BOUNDS_MODE_CLIP:
+		*pp = t;
 		break;
-	case 2: // torus
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if ((bounds_enable_hi[0] && (*ip > bounds_hi[0]))) {
-					if (bounds_enable_lo[0]) {
-						*op2++ = bounds_lo[0];
-						*op++ = bounds_lo[0] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[0] && (*ip < bounds_lo[0]))) {
-					if (bounds_enable_hi[0]) {
-						*op2++ = bounds_hi[0];
-						*op++ = bounds_hi[0] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_hi[1] && (*ip > bounds_hi[1]))) {
-					if (bounds_enable_lo[1]) {
-						*op2++ = bounds_lo[1];
-						*op++ = bounds_lo[1] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[1] && (*ip < bounds_lo[1]))) {
-					if (bounds_enable_hi[1]) {
-						*op2++ = bounds_hi[1];
-						*op++ = bounds_hi[1] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_hi[2] && (*ip > bounds_hi[2]))) {
-					if (bounds_enable_lo[2]) {
-						*op2++ = bounds_lo[2];
-						*op++ = bounds_lo[2] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[2] && (*ip < bounds_lo[2]))) {
-					if (bounds_enable_hi[2]) {
-						*op2++ = bounds_hi[2];
-						*op++ = bounds_hi[2] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if ((bounds_enable_hi[k] && (*ip > bounds_hi[k]))) {
-						if (bounds_enable_lo[k]) {
-							*op2++ = bounds_lo[k];
-							*op++ = bounds_lo[k] + (*ip++ - *ip2++);
-						}
-						else {
-							killflag = 1;
-							*op2++ = *ip2++;
-							*op++ = *ip++;
-						}
-					}
-					else if ((bounds_enable_lo[k] && (*ip < bounds_lo[k]))) {
-						if (bounds_enable_hi[k]) {
-							*op2++ = bounds_hi[k];
-							*op++ = bounds_hi[k] + (*ip++ - *ip2++);
-						}
-						else {
-							killflag = 1;
-							*op2++ = *ip2++;
-							*op++ = *ip++;
-						}
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
-		}
+	case JIT_P_BOUNDS_MODE_KILL:
+		*pp = t;
+		*kill |= out;
 		break;
-	case 1: //kill
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[0];
-					ip++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[0];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[1];
-					ip++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[1];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[2];
-					ip++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[2];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = bounds_lo[k];
-						ip++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = bounds_hi[k];
-						ip++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
+	case JIT_P_BOUNDS_MODE_TORUS:
+		{
+			long over = (p > hi);
+			long dead = (over & !v->enable_lo[k]) | ((p < lo) & !v->enable_hi[k]);
+			long wrap = out & !dead;
+			double base = over ? lo : hi;
+
+			// wrap to the opposite bound, keeping the velocity
+			*pp = wrap ? base + (p - q) : p;
+			*qp = wrap ? base : q;
+			*kill |= dead;
 		}
 		break;
-	case 0:
-	default: // bounce
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-
-				for (j = 0; j < 3; j++)
-					newsquish[j] = squish[j] + (squish_var[j] * jit_p_bounds_random_num(x));
-
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if ((bounds_enable_lo[0] && bounds_enable_hi[0]) && ((*ip < bounds_lo[0]) || (*ip > bounds_hi[0]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[0], bounds_hi[0]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_lo[0], bounds_hi[0]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[0]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_lo[0]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[0]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_hi[0]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_lo[1] && bounds_enable_hi[1]) && ((*ip < bounds_lo[1]) || (*ip > bounds_hi[1]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[1], bounds_hi[1]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_lo[1], bounds_hi[1]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[1]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_lo[1]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[1]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_hi[1]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_lo[2] && bounds_enable_hi[2]) && ((*ip < bounds_lo[2]) || (*ip > bounds_hi[2]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[2], bounds_hi[2]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_lo[2], bounds_hi[2]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[2]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_lo[2]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[2]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_hi[2]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				for (j = 0; j < planecount - 2; j++)
-					newsquish[j] = squish[j] + (squish_var[j] * jit_p_bounds_random_num(x));
-
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if ((bounds_enable_lo[k] && bounds_enable_hi[k]) && ((*ip < bounds_lo[k]) || (*ip > bounds_hi[k]))) {
-						*op2++ = tmp = CLAMP(*ip, bounds_lo[k], bounds_hi[k]);
-						*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_lo[k], bounds_hi[k]);
-						ip++; ip2++;
-					}
-					else if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						*op2++ = tmp = MAX(*ip, bounds_lo[k]);
-						*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_lo[k]);
-						ip++; ip2++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						*op2++ = tmp = MIN(*ip, bounds_hi[k]);
-						*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_hi[k]);
-						ip++; ip2++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-			}
-			break;
+	case JIT_P_BOUNDS_MODE_BOUNCE:
+	default:
+		{
+			double s = v->squish[k] + v->squish_var[k] * jit_p_bounds_rand(v->seed, index, k);
+			double b = t - (t - q) * s;
+
+			b = (b < lo) ? lo : (b > hi) ? hi : b;
+			*pp = out ? b : p;
+			*qp = out ? t : q;
 		}
 		break;
 	}
 }
 
-void jit_p_bounds_calculate_2d_float64(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
-									   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop)
+#define JIT_P_BOUNDS_VECTOR(type, typename, modename, mode) \
+void jit_p_bounds_vector_##typename##_##modename(long n, t_jit_p_bounds_vecdata *v, long index, char *bip, char *bop) \
+{ \
+	long i, k, kill; \
+	long axes = v->axes; \
+	type *ip, *op, *ip2, *op2; \
+	double p, q; \
+\
+	for (i = 0; i < n; i++) { \
+		ip = (type *)(bip + i * v->in_pstride); \
+		op = (type *)(bop + i * v->out_pstride); \
+		ip2 = (type *)((char *)ip + v->in_rowstride); \
+		op2 = (type *)((char *)op + v->out_rowstride); \
+		kill = 0; \
+		for (k = 0; k < axes; k++) { \
+			p = ip[k + 2]; \
+			q = ip2[k + 2]; \
+			jit_p_bounds_axis(mode, v, k, (t_uint32)(index + i), &p, &q, &kill); \
+			op[k + 2] = (type)p; \
+			op2[k + 2] = (type)q; \
+		} \
+		op[0] = ip[0];			/* id */ \
+		op2[0] = ip2[0]; \
+		op[1] = kill ? 0 : ip[1];	/* life */ \
+		op2[1] = ip2[1]; \
+		if (v->killed) \
+			v->killed[index + i] = (char)kill; \
+	} \
+}
+
+JIT_P_BOUNDS_VECTOR(float, float32, bounce, JIT_P_BOUNDS_MODE_BOUNCE)
+JIT_P_BOUNDS_VECTOR(float, float32, kill, JIT_P_BOUNDS_MODE_KILL)
+JIT_P_BOUNDS_VECTOR(float, float32, torus, JIT_P_BOUNDS_MODE_TORUS)
+JIT_P_BOUNDS_VECTOR(float, float32, clip, JIT_P_BOUNDS_MODE_CLIP)
+JIT_P_BOUNDS_VECTOR(double, float64, bounce, JIT_P_BOUNDS_MODE_BOUNCE)
+JIT_P_BOUNDS_VECTOR(double, float64, kill, JIT_P_BOUNDS_MODE_KILL)
+JIT_P_BOUNDS_VECTOR(double, float64, torus, JIT_P_BOUNDS_MODE_TORUS)
+JIT_P_BOUNDS_VECTOR(double, float64, clip, JIT_P_BOUNDS_MODE_CLIP)
+
+static t_jit_p_bounds_vector_fn jit_p_bounds_vectors[2][4] = {
+	{ jit_p_bounds_vector_float32_bounce, jit_p_bounds_vector_float32_kill, jit_p_bounds_vector_float32_torus, jit_p_bounds_vector_float32_clip },
+	{ jit_p_bounds_vector_float64_bounce, jit_p_bounds_vector_float64_kill, jit_p_bounds_vector_float64_torus, jit_p_bounds_vector_float64_clip },
+};
+
+void jit_p_bounds_getvecdata(t_jit_p_bounds *x, long planecount, t_jit_matrix_info *in_minfo, t_jit_matrix_info *out_minfo, t_jit_p_bounds_vecdata *v)
 {
-	long j, k, n;
-	long width, rowstride;
-	double *ip, *op, *ip2, *op2, *kill;
-	double squish[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	double squish_var[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	double newsquish[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	double bounds_hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	double bounds_lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	double tmp;
-	char bounds_enable_hi[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	char bounds_enable_lo[JIT_MATRIX_MAX_PLANECOUNT - 2];
-	char killflag;
-
-	x->random = jit_rand();
-
-	width = dim[0];
-	rowstride = in_minfo->dimstride[1] / 8;
-
-	for (j = 0; j < JIT_MATRIX_MAX_PLANECOUNT - 2; j++) {
-		bounds_hi[j] = x->bounds_hi[j];
-		bounds_lo[j] = x->bounds_lo[j];
-		bounds_enable_hi[j] = x->bounds_enable_hi[j];
-		bounds_enable_lo[j] = x->bounds_enable_lo[j];
-		squish[j] = x->squish[j];
-		squish_var[j] = x->squish_var[j];
+	long k, mode;
+
+	mode = (x->mode >= 0 && x->mode < 4) ? x->mode : JIT_P_BOUNDS_MODE_BOUNCE;
+	v->fn = jit_p_bounds_vectors[(in_minfo->type == _jit_sym_float64) ? 1 : 0][mode];
+	v->axes = MIN(planecount - 2, JIT_MATRIX_MAX_PLANECOUNT - 2);
+	v->in_pstride = in_minfo->dimstride[0];
+	v->out_pstride = out_minfo->dimstride[0];
+	v->in_rowstride = in_minfo->dimstride[1];
+	v->out_rowstride = out_minfo->dimstride[1];
+	v->seed = x->random = jit_rand();
+	v->killed = NULL;
+
+	for (k = 0; k < JIT_MATRIX_MAX_PLANECOUNT - 2; k++) {
+		v->enable_lo[k] = x->bounds_enable_lo[k];
+		v->enable_hi[k] = x->bounds_enable_hi[k];
+		v->lo[k] = x->bounds_enable_lo[k] ? x->bounds_lo[k] : -HUGE_VAL;
+		v->hi[k] = x->bounds_enable_hi[k] ? x->bounds_hi[k] : HUGE_VAL;
+		v->squish[k] = x->squish[k];
+		v->squish_var[k] = x->squish_var[k];
 	}
+}
 
-//	squish = x->squish;
-//	squish_var = x->squish_var;
-
-	ip = (double *)(bip);
-	op = (double *)(bop);
-	ip2 = ip + rowstride;
-	op2 = op + rowstride;
-	n = width;
-//	newsquish = squish;
-
-	switch(x->mode) {
-	case 3: //clip
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[0];
-					ip++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[0];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[1];
-					ip++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[1];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[2];
-					ip++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[2];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						*op2++ = *ip2++;
-						*op++ = bounds_lo[k];
-						ip++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						*op2++ = *ip2++;
-						*op++ = bounds_hi[k];
-						ip++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
+// particles are packed at the front of the matrix, the first zero id ends the list
+long jit_p_bounds_active(long n, t_jit_matrix_info *in_minfo, char *bip)
+{
+	long i;
+
+	if (in_minfo->type == _jit_sym_float64) {
+		for (i = 0; i < n; i++, bip += in_minfo->dimstride[0])
+			if (!*(double *)bip) break;
+	}
+	else {
+		for (i = 0; i < n; i++, bip += in_minfo->dimstride[0])
+			if (!*(float *)bip) break;
+	}
+	return i;
+}
+
+void jit_p_bounds_calculate_2d(t_jit_p_bounds *x, long dimcount, long *dim, long planecount,
+							   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop)
+{
+	t_jit_p_bounds_vecdata vecdata;
+	long n;
+
+	n = jit_p_bounds_active(dim[0], in_minfo, bip);
+	if (!n)
+		return;
+
+	jit_p_bounds_getvecdata(x, planecount, in_minfo, out_minfo, &vecdata);
+	jit_p_bounds_calculate_particles(x, &vecdata, n, planecount, in_minfo, bip, out_minfo, bop, 1);
+}
+
+// the n active particles, split between Jitter's workers, or all on this thread when parallel is 0
+void jit_p_bounds_calculate_particles(t_jit_p_bounds *x, t_jit_p_bounds_vecdata *vecdata, long n, long planecount,
+									  t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop, long parallel)
+{
+	t_jit_matrix_info in_vinfo, out_vinfo;
+	long chunks, rest, vdim[2];
+
+	vecdata->in_base = bip;
+	vecdata->killed = NULL;
+
+	if (x->compact && (x->mode == JIT_P_BOUNDS_MODE_KILL || x->mode == JIT_P_BOUNDS_MODE_TORUS)) {
+		if (x->killedsize < n) {
+			char *killed = x->killed ? (char *)sysmem_resizeptr(x->killed, n) : (char *)sysmem_newptr(n);
+
+			if (killed) {
+				x->killed = killed;
+				x->killedsize = n;
 			}
-			break;
 		}
-		break;
-	case 2: // torus
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if ((bounds_enable_hi[0] && (*ip > bounds_hi[0]))) {
-					if (bounds_enable_lo[0]) {
-						*op2++ = bounds_lo[0];
-						*op++ = bounds_lo[0] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[0] && (*ip < bounds_lo[0]))) {
-					if (bounds_enable_hi[0]) {
-						*op2++ = bounds_hi[0];
-						*op++ = bounds_hi[0] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_hi[1] && (*ip > bounds_hi[1]))) {
-					if (bounds_enable_lo[1]) {
-						*op2++ = bounds_lo[1];
-						*op++ = bounds_lo[1] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[1] && (*ip < bounds_lo[1]))) {
-					if (bounds_enable_hi[1]) {
-						*op2++ = bounds_hi[1];
-						*op++ = bounds_hi[1] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_hi[2] && (*ip > bounds_hi[2]))) {
-					if (bounds_enable_lo[2]) {
-						*op2++ = bounds_lo[2];
-						*op++ = bounds_lo[2] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else if ((bounds_enable_lo[2] && (*ip < bounds_lo[2]))) {
-					if (bounds_enable_hi[2]) {
-						*op2++ = bounds_hi[2];
-						*op++ = bounds_hi[2] + (*ip++ - *ip2++);
-					}
-					else {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if ((bounds_enable_hi[k] && (*ip > bounds_hi[k]))) {
-						if (bounds_enable_lo[k]) {
-							*op2++ = bounds_lo[k];
-							*op++ = bounds_lo[k] + (*ip++ - *ip2++);
-						}
-						else {
-							killflag = 1;
-							*op2++ = *ip2++;
-							*op++ = *ip++;
-						}
-					}
-					else if ((bounds_enable_lo[k] && (*ip < bounds_lo[k]))) {
-						if (bounds_enable_hi[k]) {
-							*op2++ = bounds_hi[k];
-							*op++ = bounds_hi[k] + (*ip++ - *ip2++);
-						}
-						else {
-							killflag = 1;
-							*op2++ = *ip2++;
-							*op++ = *ip++;
-						}
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
+		if (x->killedsize >= n)
+			vecdata->killed = x->killed;
+	}
+
+	chunks = n / JIT_P_BOUNDS_CHUNK;
+	rest = n - chunks * JIT_P_BOUNDS_CHUNK;
+
+	if (chunks) {
+		in_vinfo = *in_minfo;
+		out_vinfo = *out_minfo;
+		vdim[0] = in_vinfo.dim[0] = out_vinfo.dim[0] = JIT_P_BOUNDS_CHUNK;
+		vdim[1] = in_vinfo.dim[1] = out_vinfo.dim[1] = chunks;
+		in_vinfo.dimcount = out_vinfo.dimcount = 2;
+		in_vinfo.dimstride[1] = JIT_P_BOUNDS_CHUNK * in_minfo->dimstride[0];
+		out_vinfo.dimstride[1] = JIT_P_BOUNDS_CHUNK * out_minfo->dimstride[0];
+
+		if (parallel)
+			jit_parallel_ndim_simplecalc2((method)jit_p_bounds_calculate_chunks,
+										  vecdata, 2, vdim, planecount, &in_vinfo, bip, &out_vinfo, bop,
+										  0 /* flags1 */, 0 /* flags2 */);
+		else
+			jit_p_bounds_calculate_chunks(vecdata, 2, vdim, planecount, &in_vinfo, bip, &out_vinfo, bop);
+	}
+	if (rest) {
+		(*vecdata->fn)(rest, vecdata, chunks * JIT_P_BOUNDS_CHUNK,
+					   bip + chunks * JIT_P_BOUNDS_CHUNK * in_minfo->dimstride[0],
+					   bop + chunks * JIT_P_BOUNDS_CHUNK * out_minfo->dimstride[0]);
+	}
+
+	if (vecdata->killed)
+		jit_p_bounds_compact(vecdata, n, bop);
+}
+
+void jit_p_bounds_calculate_chunks(t_jit_p_bounds_vecdata *vecdata, long dimcount, long *dim, long planecount,
+								   t_jit_matrix_info *in_minfo, char *bip, t_jit_matrix_info *out_minfo, char *bop)
+{
+	long i;
+	char *ip, *op;
+
+	if (dimcount < 2) return; //safety
+
+	for (i = 0; i < dim[1]; i++) {
+		ip = bip + i * in_minfo->dimstride[1];
+		op = bop + i * out_minfo->dimstride[1];
+		(*vecdata->fn)(dim[0], vecdata, (ip - vecdata->in_base) / vecdata->in_pstride, ip, op);
+	}
+}
+
+// move the survivors of a kill down over the dead particles, both rows,
+// and zero what is left so the next zero id still ends the list
+void jit_p_bounds_compact(t_jit_p_bounds_vecdata *vecdata, long n, char *bop)
+{
+	long i, live = 0;
+	long pstride = vecdata->out_pstride, rowstride = vecdata->out_rowstride;
+	long bytes = pstride; // a particle is one cell
+
+	for (i = 0; i < n; i++) {
+		if (vecdata->killed[i])
+			continue;
+		if (live != i) {
+			memcpy(bop + live * pstride, bop + i * pstride, bytes);
+			memcpy(bop + rowstride + live * pstride, bop + rowstride + i * pstride, bytes);
 		}
-		break;
-	case 1: //kill
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[0];
-					ip++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[0];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[1];
-					ip++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[1];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_lo[2];
-					ip++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					killflag = 1;
-					*op2++ = *ip2++;
-					*op++ = bounds_hi[2];
-					ip++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-
-				kill = op;
-				killflag = 0;
-
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = bounds_lo[k];
-						ip++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						killflag = 1;
-						*op2++ = *ip2++;
-						*op++ = bounds_hi[k];
-						ip++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-
-				if (killflag)
-					*kill = 0;
-			}
-			break;
+		live++;
+	}
+	if (live < n) {
+		memset(bop + live * pstride, 0, (n - live) * pstride);
+		memset(bop + rowstride + live * pstride, 0, (n - live) * pstride);
+	}
+}
+
+// bench [largest]: time a frame of 1024 particles up to largest (1048576), in steps of four, as
+// float32 and float64, on this thread alone and split between Jitter's workers, with the object's
+// current mode and bounds. Both have to give the same particles. Posts ns per particle and the speedup.
+t_jit_err jit_p_bounds_bench(t_jit_p_bounds *x, t_symbol *s, long ac, t_atom *av)
+{
+	long largest = ac ? (long)jit_atom_getlong(av) : 1048576;
+	long n, t, bytes, repeats;
+	t_symbol *type;
+	char *in, *out, *check;
+	double serial, parallel;
+
+	largest = MAX(largest, JIT_P_BOUNDS_CHUNK);
+	bytes = largest * 2 * JIT_P_BOUNDS_BENCH_PLANES * sizeof(double);
+	in = (char *)sysmem_newptr(bytes);
+	out = (char *)sysmem_newptr(bytes);
+	check = (char *)sysmem_newptr(bytes);
+	if (!in || !out || !check) {
+		jit_object_error((t_object *)x, "bench: out of memory");
+		goto done;
+	}
+
+	jit_object_post((t_object *)x, "bench: particles, type, ns per particle on one thread, split, speedup");
+	for (n = JIT_P_BOUNDS_CHUNK; n <= largest; n *= 4) {
+		for (t = 0; t < 2; t++) {
+			type = t ? _jit_sym_float64 : _jit_sym_float32;
+			repeats = MAX(4194304 / n, 1);		// a few million particles per measurement
+			serial = jit_p_bounds_bench_run(x, n, type, in, check, 0, repeats);
+			parallel = jit_p_bounds_bench_run(x, n, type, in, out, 1, repeats);
+			if (memcmp(out, check, n * 2 * JIT_P_BOUNDS_BENCH_PLANES * (t ? sizeof(double) : sizeof(float))))
+				jit_object_error((t_object *)x, "bench: %ld %s particles came out differently when split", n, type->s_name);
+			jit_object_post((t_object *)x, "%ld %s: %.2f, %.2f, %.2fx", n, type->s_name, serial, parallel, parallel > 0 ? serial / parallel : 0.);
 		}
-		break;
-	case 0:
-	default: // bounce
-		switch(planecount) {
-		case 5:
-			while (n-- && *ip) {
-				for (j = 0; j < 3; j++)
-					newsquish[j] = squish[j] + (squish_var[j] * jit_p_bounds_random_num(x));
-
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				if ((bounds_enable_lo[0] && bounds_enable_hi[0]) && ((*ip < bounds_lo[0]) || (*ip > bounds_hi[0]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[0], bounds_hi[0]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_lo[0], bounds_hi[0]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[0] && (*ip < bounds_lo[0])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[0]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_lo[0]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[0] && (*ip > bounds_hi[0])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[0]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[0]), bounds_hi[0]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_lo[1] && bounds_enable_hi[1]) && ((*ip < bounds_lo[1]) || (*ip > bounds_hi[1]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[1], bounds_hi[1]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_lo[1], bounds_hi[1]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[1] && (*ip < bounds_lo[1])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[1]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_lo[1]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[1] && (*ip > bounds_hi[1])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[1]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[1]), bounds_hi[1]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-
-				if ((bounds_enable_lo[2] && bounds_enable_hi[2]) && ((*ip < bounds_lo[2]) || (*ip > bounds_hi[2]))) {
-					*op2++ = tmp = CLAMP(*ip, bounds_lo[2], bounds_hi[2]);
-					*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_lo[2], bounds_hi[2]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_lo[2] && (*ip < bounds_lo[2])) {
-					*op2++ = tmp = MAX(*ip, bounds_lo[2]);
-					*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_lo[2]);
-					ip++; ip2++;
-				}
-				else if (bounds_enable_hi[2] && (*ip > bounds_hi[2])) {
-					*op2++ = tmp = MIN(*ip, bounds_hi[2]);
-					*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[2]), bounds_hi[2]);
-					ip++; ip2++;
-				}
-				else {
-					*op2++ = *ip2++;
-					*op++ = *ip++;
-				}
-			}
-			break;
-		default:
-			while (n-- && *ip) {
-				for (j = 0; j < planecount - 2; j++)
-					newsquish[j] = squish[j] + (squish_var[j] * jit_p_bounds_random_num(x));
-
-				*op++ = *ip++;			//id
-				*op2++ = *ip2++;
-				*op++ = *ip++;			//life
-				*op2++ = *ip2++;
-
-				for (k = 0; k < planecount - 2; k++) {
-					if ((bounds_enable_lo[k] && bounds_enable_hi[k]) && ((*ip < bounds_lo[k]) || (*ip > bounds_hi[k]))) {
-						*op2++ = tmp = CLAMP(*ip, bounds_lo[k], bounds_hi[k]);
-						*op++ = CLAMP(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_lo[k], bounds_hi[k]);
-						ip++; ip2++;
-					}
-					else if (bounds_enable_lo[k] && (*ip < bounds_lo[k])) {
-						*op2++ = tmp = MAX(*ip, bounds_lo[k]);
-						*op++ = MAX(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_lo[k]);
-						ip++; ip2++;
-					}
-					else if (bounds_enable_hi[k] && (*ip > bounds_hi[k])) {
-						*op2++ = tmp = MIN(*ip, bounds_hi[k]);
-						*op++ = MIN(tmp + (-(tmp - *ip2) * newsquish[k]), bounds_hi[k]);
-						ip++; ip2++;
-					}
-					else {
-						*op2++ = *ip2++;
-						*op++ = *ip++;
-					}
-				}
-			}
-			break;
+	}
+
+done:
+	if (in)
+		sysmem_freeptr(in);
+	if (out)
+		sysmem_freeptr(out);
+	if (check)
+		sysmem_freeptr(check);
+	return JIT_ERR_NONE;
+}
+
+// ns per particle to run n particles of type from in to out, repeats times, with the same seed each time
+double jit_p_bounds_bench_run(t_jit_p_bounds *x, long n, t_symbol *type, char *in, char *out, long parallel, long repeats)
+{
+	t_jit_matrix_info in_minfo, out_minfo;
+	t_jit_p_bounds_vecdata vecdata;
+	long size = (type == _jit_sym_float64) ? sizeof(double) : sizeof(float);
+	long i, k, r;
+	double start, value;
+
+	// two rows of particles with ids from 1, full life, spread over twice the default bounds and moving
+	memset(&in_minfo, 0, sizeof(t_jit_matrix_info));
+	in_minfo.type = type;
+	in_minfo.dimcount = 2;
+	in_minfo.dim[0] = n;
+	in_minfo.dim[1] = 2;
+	in_minfo.planecount = JIT_P_BOUNDS_BENCH_PLANES;
+	in_minfo.dimstride[0] = JIT_P_BOUNDS_BENCH_PLANES * size;
+	in_minfo.dimstride[1] = n * in_minfo.dimstride[0];
+	in_minfo.size = 2 * in_minfo.dimstride[1];
+	out_minfo = in_minfo;
+	for (i = 0; i < 2 * n; i++) {
+		for (k = 0; k < JIT_P_BOUNDS_BENCH_PLANES; k++) {
+			value = k == 0 ? (i % n) + 1 : k == 1 ? 1. : 4. * ((i * 7919 + k * 104729) % 1000) / 1000. - 2.;
+			if (i >= n && k >= 2)
+				value *= 0.99;		// the previous positions
+			if (size == sizeof(double))
+				((double *)in)[i * JIT_P_BOUNDS_BENCH_PLANES + k] = value;
+			else
+				((float *)in)[i * JIT_P_BOUNDS_BENCH_PLANES + k] = (float)value;
 		}
-		break;
 	}
+
+	jit_p_bounds_getvecdata(x, JIT_P_BOUNDS_BENCH_PLANES, &in_minfo, &out_minfo, &vecdata);
+	vecdata.seed = 0x2545F491;
+	start = systimer_gettime();
+	for (r = 0; r < repeats; r++)
+		jit_p_bounds_calculate_particles(x, &vecdata, n, JIT_P_BOUNDS_BENCH_PLANES, &in_minfo, in, &out_minfo, out, parallel);
+	return (systimer_gettime() - start) * 1e6 / ((double)repeats * n);
 }
 
 t_jit_p_bounds *jit_p_bounds_new(void)
@@ -1321,6 +716,9 @@ t_jit_p_bounds *jit_p_bounds_new(void)
 
 		x->boundscount_hi = x->boundscount_lo = 0.;
 		x->mode = 0;
+		x->compact = 0;
+		x->killed = NULL;
+		x->killedsize = 0;
 	}
 	else {
 		x = NULL;
@@ -1330,5 +728,6 @@ t_jit_p_bounds *jit_p_bounds_new(void)
 
 void jit_p_bounds_free(t_jit_p_bounds *x)
 {
-	//nada
+	if (x->killed)
+		sysmem_freeptr(x->killed);
 }
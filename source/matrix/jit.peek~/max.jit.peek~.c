@@ -5,12 +5,35 @@
 
 
 // 03.08.05 -- added normalize attribute.  rld.
+// interp 2 selects cubic (catmull-rom) interpolation. 1d/2d/3d matrices use
+// specialized kernels chosen when the matrix or interp mode changes.
 
 #include "jit.common.h"
 #include "ext_atomic.h"
 #include "z_dsp.h"
+#include <math.h>
 
-typedef struct _max_jit_peek
+#define MAX_JIT_PEEK_CHUNK		64		// samples per index/kernel pass
+#define MAX_JIT_PEEK_KERNEL_DIMS	3		// dimcounts above this use recursive_interp
+
+enum {
+	MAX_JIT_PEEK_INTERP_NONE = 0,
+	MAX_JIT_PEEK_INTERP_LINEAR,
+	MAX_JIT_PEEK_INTERP_CUBIC
+};
+
+enum {
+	MAX_JIT_PEEK_TYPE_CHAR = 0,
+	MAX_JIT_PEEK_TYPE_LONG,
+	MAX_JIT_PEEK_TYPE_FLOAT32,
+	MAX_JIT_PEEK_TYPE_FLOAT64,
+	MAX_JIT_PEEK_TYPE_COUNT
+};
+
+typedef struct _max_jit_peek t_max_jit_peek;
+typedef void (*t_max_jit_peek_kernel)(t_max_jit_peek *x, char *bp, double *out, long n);
+
+struct _max_jit_peek
 {
 	t_pxobject			ob;
 	void				*obex;
@@ -24,7 +47,13 @@ typedef struct _max_jit_peek
 	char				*mdata;
 	long				normalize;
 	t_jit_matrix_info	minfo;
-} t_max_jit_peek;
+	long				type;		// MAX_JIT_PEEK_TYPE_*, or -1 if unsupported
+	long				typesize;
+	t_max_jit_peek_kernel kernel;	// NULL when no specialized kernel applies
+	long				taps;		// 2 for linear, 4 for cubic
+	t_ptr_int			offsets[MAX_JIT_PEEK_KERNEL_DIMS][4][MAX_JIT_PEEK_CHUNK];	// byte offset per dim, tap and sample
+	double				fracs[MAX_JIT_PEEK_KERNEL_DIMS][MAX_JIT_PEEK_CHUNK];
+};
 
 void *max_jit_peek_new(t_symbol *s, long argc, t_atom *argv);
 void max_jit_peek_free(t_max_jit_peek *x);
@@ -32,6 +61,9 @@ void max_jit_peek_assist(t_max_jit_peek *x, void *b, long m, long a, char *s);
 void max_jit_peek_notify(t_max_jit_peek *x, t_symbol *s, t_symbol *msg, void *ob, void *data);
 void max_jit_peek_matrix_name(t_max_jit_peek *x, void *attr, long argc, t_atom *argv);
 void max_jit_peek_update(t_max_jit_peek *x);
+t_jit_err max_jit_peek_interp(t_max_jit_peek *x, void *attr, long argc, t_atom *argv);
+void max_jit_peek_kernel_select(t_max_jit_peek *x);
+void max_jit_peek_offsets(t_max_jit_peek *x, double **in_dim, long start, long n, long dimcount, double *mult);
 void max_jit_peek_dsp(t_max_jit_peek *x, t_signal **sp, short *count);
 void max_jit_peek_dsp64(t_max_jit_peek *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 t_int *max_jit_peek_perform(t_int *w);
@@ -68,7 +100,7 @@ C74_EXPORT void ext_main(void *r)
 	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"Plane");
 	
 	attr = jit_object_new(_jit_sym_jit_attr_offset,"interp",_jit_sym_long,attrflags,
-						  (method)0L,(method)0L,calcoffset(t_max_jit_peek,interp));
+						  (method)0L,(method)max_jit_peek_interp,calcoffset(t_max_jit_peek,interp));
 	max_jit_classex_addattr(p,attr);
 	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"Interp");
 	
@@ -243,19 +275,275 @@ zero:
 	return (w+3);
 }
 
+// fill x->offsets and x->fracs for samples [start, start+n). each dimension gets
+// the byte offsets of its 2 (linear) or 4 (cubic) neighbouring cells, wrapped
+// at the matrix edges, so the kernels below never touch minfo.
+void max_jit_peek_offsets(t_max_jit_peek *x, double **in_dim, long start, long n, long dimcount, double *mult)
+{
+	long d,k,dim,i0,im1,i1,i2;
+	t_ptr_int stride;
+	double *in,*frac,f,fl;
+	t_ptr_int *o0,*o1,*o2,*o3;
+
+	for (d=0; d<dimcount; d++) {
+		dim = x->minfo.dim[d];
+		stride = x->minfo.dimstride[d];
+		in = in_dim[d]+start;
+		frac = x->fracs[d];
+		o0 = x->offsets[d][0];
+		o1 = x->offsets[d][1];
+		o2 = x->offsets[d][2];
+		o3 = x->offsets[d][3];
+
+		if (dim<1) {
+			for (k=0; k<n; k++) {
+				frac[k] = 0.;
+				o0[k] = o1[k] = o2[k] = o3[k] = 0;
+			}
+			continue;
+		}
+
+		if (x->taps==2) {
+			for (k=0; k<n; k++) {
+				f = in[k]*mult[d];
+				fl = floor(f);
+				frac[k] = f - fl;
+				i0 = (long)fl % dim;
+				if (i0<0) i0 += dim;
+				i1 = (i0+1<dim) ? i0+1 : 0;
+				o0[k] = i0*stride;
+				o1[k] = i1*stride;
+			}
+		}
+		else {
+			// cubic taps are stored as [i-1, i, i+1, i+2]
+			for (k=0; k<n; k++) {
+				f = in[k]*mult[d];
+				fl = floor(f);
+				frac[k] = f - fl;
+				i0 = (long)fl % dim;
+				if (i0<0) i0 += dim;
+				im1 = (i0>0) ? i0-1 : dim-1;
+				i1 = (i0+1<dim) ? i0+1 : 0;
+				i2 = (i1+1<dim) ? i1+1 : 0;
+				o0[k] = im1*stride;
+				o1[k] = i0*stride;
+				o2[k] = i1*stride;
+				o3[k] = i2*stride;
+			}
+		}
+	}
+}
+
+static inline double max_jit_peek_fetch(char *p, long type)
+{
+	switch (type) {
+	case MAX_JIT_PEEK_TYPE_CHAR:	return (double)(*((uchar *)p)) * (1./255.);
+	case MAX_JIT_PEEK_TYPE_LONG:	return (double)(*((t_int32 *)p));
+	case MAX_JIT_PEEK_TYPE_FLOAT32:	return (double)(*((float *)p));
+	default:						return *((double *)p);
+	}
+}
+
+// catmull-rom spline through b..c with neighbours a and d
+static inline double max_jit_peek_catmullrom(double a, double b, double c, double d, double t)
+{
+	return b + 0.5 * t * (c - a + t * (2.*a - 5.*b + 4.*c - d + t * (3.*(b - c) + d - a)));
+}
+
+// the generic kernels below take the matrix type as a constant argument; the
+// per-type wrappers generated by MAX_JIT_PEEK_KERNELS let the compiler fold
+// the fetch switch out of the inner loops.
+
+static inline void max_jit_peek_linear1d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	t_ptr_int *ox0=x->offsets[0][0],*ox1=x->offsets[0][1];
+	double *fx=x->fracs[0];
+	double a,b;
+	long k;
+
+	for (k=0; k<n; k++) {
+		a = max_jit_peek_fetch(bp+ox0[k],type);
+		b = max_jit_peek_fetch(bp+ox1[k],type);
+		out[k] = a + (b - a) * fx[k];
+	}
+}
+
+static inline void max_jit_peek_linear2d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	t_ptr_int *ox0=x->offsets[0][0],*ox1=x->offsets[0][1];
+	t_ptr_int *oy0=x->offsets[1][0],*oy1=x->offsets[1][1];
+	double *fx=x->fracs[0],*fy=x->fracs[1];
+	double a,b,c,d;
+	char *r0,*r1;
+	long k;
+
+	for (k=0; k<n; k++) {
+		r0 = bp+oy0[k];
+		r1 = bp+oy1[k];
+		a = max_jit_peek_fetch(r0+ox0[k],type);
+		b = max_jit_peek_fetch(r0+ox1[k],type);
+		c = max_jit_peek_fetch(r1+ox0[k],type);
+		d = max_jit_peek_fetch(r1+ox1[k],type);
+		a += (b - a) * fx[k];
+		c += (d - c) * fx[k];
+		out[k] = a + (c - a) * fy[k];
+	}
+}
+
+static inline void max_jit_peek_linear3d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	t_ptr_int *ox0=x->offsets[0][0],*ox1=x->offsets[0][1];
+	t_ptr_int *oy0=x->offsets[1][0],*oy1=x->offsets[1][1];
+	t_ptr_int *oz0=x->offsets[2][0],*oz1=x->offsets[2][1];
+	double *fx=x->fracs[0],*fy=x->fracs[1],*fz=x->fracs[2];
+	double a,b,c,d,p0,p1;
+	char *s,*r0,*r1;
+	long k;
+
+	for (k=0; k<n; k++) {
+		s = bp+oz0[k];
+		r0 = s+oy0[k];
+		r1 = s+oy1[k];
+		a = max_jit_peek_fetch(r0+ox0[k],type);
+		b = max_jit_peek_fetch(r0+ox1[k],type);
+		c = max_jit_peek_fetch(r1+ox0[k],type);
+		d = max_jit_peek_fetch(r1+ox1[k],type);
+		a += (b - a) * fx[k];
+		c += (d - c) * fx[k];
+		p0 = a + (c - a) * fy[k];
+
+		s = bp+oz1[k];
+		r0 = s+oy0[k];
+		r1 = s+oy1[k];
+		a = max_jit_peek_fetch(r0+ox0[k],type);
+		b = max_jit_peek_fetch(r0+ox1[k],type);
+		c = max_jit_peek_fetch(r1+ox0[k],type);
+		d = max_jit_peek_fetch(r1+ox1[k],type);
+		a += (b - a) * fx[k];
+		c += (d - c) * fx[k];
+		p1 = a + (c - a) * fy[k];
+
+		out[k] = p0 + (p1 - p0) * fz[k];
+	}
+}
+
+// one cubic row along dim 0, starting at row pointer r
+static inline double max_jit_peek_cubic_row(t_max_jit_peek *x, char *r, long k, const long type)
+{
+	return max_jit_peek_catmullrom(max_jit_peek_fetch(r+x->offsets[0][0][k],type),
+								   max_jit_peek_fetch(r+x->offsets[0][1][k],type),
+								   max_jit_peek_fetch(r+x->offsets[0][2][k],type),
+								   max_jit_peek_fetch(r+x->offsets[0][3][k],type),
+								   x->fracs[0][k]);
+}
+
+// 4x4 cubic patch along dims 0 and 1, starting at slice pointer s
+static inline double max_jit_peek_cubic_patch(t_max_jit_peek *x, char *s, long k, const long type)
+{
+	return max_jit_peek_catmullrom(max_jit_peek_cubic_row(x,s+x->offsets[1][0][k],k,type),
+								   max_jit_peek_cubic_row(x,s+x->offsets[1][1][k],k,type),
+								   max_jit_peek_cubic_row(x,s+x->offsets[1][2][k],k,type),
+								   max_jit_peek_cubic_row(x,s+x->offsets[1][3][k],k,type),
+								   x->fracs[1][k]);
+}
+
+static inline void max_jit_peek_cubic1d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	long k;
+
+	for (k=0; k<n; k++)
+		out[k] = max_jit_peek_cubic_row(x,bp,k,type);
+}
+
+static inline void max_jit_peek_cubic2d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	long k;
+
+	for (k=0; k<n; k++)
+		out[k] = max_jit_peek_cubic_patch(x,bp,k,type);
+}
+
+static inline void max_jit_peek_cubic3d(t_max_jit_peek *x, char *bp, double *out, long n, const long type)
+{
+	long k;
+
+	for (k=0; k<n; k++) {
+		out[k] = max_jit_peek_catmullrom(max_jit_peek_cubic_patch(x,bp+x->offsets[2][0][k],k,type),
+										 max_jit_peek_cubic_patch(x,bp+x->offsets[2][1][k],k,type),
+										 max_jit_peek_cubic_patch(x,bp+x->offsets[2][2][k],k,type),
+										 max_jit_peek_cubic_patch(x,bp+x->offsets[2][3][k],k,type),
+										 x->fracs[2][k]);
+	}
+}
+
+#define MAX_JIT_PEEK_KERNELS(name, type) \
+	static void max_jit_peek_linear1d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_linear1d(x,bp,out,n,type); } \
+	static void max_jit_peek_linear2d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_linear2d(x,bp,out,n,type); } \
+	static void max_jit_peek_linear3d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_linear3d(x,bp,out,n,type); } \
+	static void max_jit_peek_cubic1d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_cubic1d(x,bp,out,n,type); } \
+	static void max_jit_peek_cubic2d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_cubic2d(x,bp,out,n,type); } \
+	static void max_jit_peek_cubic3d_##name(t_max_jit_peek *x, char *bp, double *out, long n) { max_jit_peek_cubic3d(x,bp,out,n,type); }
+
+MAX_JIT_PEEK_KERNELS(char, MAX_JIT_PEEK_TYPE_CHAR)
+MAX_JIT_PEEK_KERNELS(long, MAX_JIT_PEEK_TYPE_LONG)
+MAX_JIT_PEEK_KERNELS(float32, MAX_JIT_PEEK_TYPE_FLOAT32)
+MAX_JIT_PEEK_KERNELS(float64, MAX_JIT_PEEK_TYPE_FLOAT64)
+
+#define MAX_JIT_PEEK_KERNEL_ROW(mode, name) \
+	{ max_jit_peek_##mode##1d_##name, max_jit_peek_##mode##2d_##name, max_jit_peek_##mode##3d_##name }
+
+// indexed by [type][interp-1][dimcount-1]
+static const t_max_jit_peek_kernel max_jit_peek_kernels[MAX_JIT_PEEK_TYPE_COUNT][2][MAX_JIT_PEEK_KERNEL_DIMS] = {
+	{ MAX_JIT_PEEK_KERNEL_ROW(linear, char),	MAX_JIT_PEEK_KERNEL_ROW(cubic, char) },
+	{ MAX_JIT_PEEK_KERNEL_ROW(linear, long),	MAX_JIT_PEEK_KERNEL_ROW(cubic, long) },
+	{ MAX_JIT_PEEK_KERNEL_ROW(linear, float32),	MAX_JIT_PEEK_KERNEL_ROW(cubic, float32) },
+	{ MAX_JIT_PEEK_KERNEL_ROW(linear, float64),	MAX_JIT_PEEK_KERNEL_ROW(cubic, float64) }
+};
+
+// choose the interpolation kernel for the current matrix type, dimcount and
+// interp mode. called whenever one of those changes, never from perform.
+void max_jit_peek_kernel_select(t_max_jit_peek *x)
+{
+	long dimcount = MIN(x->dimcount,x->minfo.dimcount);
+	long mode = x->interp;
+
+	CLIP_ASSIGN(mode,MAX_JIT_PEEK_INTERP_NONE,MAX_JIT_PEEK_INTERP_CUBIC);
+	x->taps = (mode==MAX_JIT_PEEK_INTERP_CUBIC) ? 4 : 2;
+
+	if (x->type<0 || mode==MAX_JIT_PEEK_INTERP_NONE || dimcount<1 || dimcount>MAX_JIT_PEEK_KERNEL_DIMS)
+		x->kernel = NULL;
+	else
+		x->kernel = max_jit_peek_kernels[x->type][mode-1][dimcount-1];
+}
+
+t_jit_err max_jit_peek_interp(t_max_jit_peek *x, void *attr, long argc, t_atom *argv)
+{
+	long v = (argc&&argv) ? jit_atom_getlong(argv) : 0;
+	long valid = x->mvalid;
+
+	x->mvalid = 0;			// mark invalid for perform loop
+	while (x->inperform) ; 	// lightweight spinwait
+	x->interp = v;
+	max_jit_peek_kernel_select(x);
+	x->mvalid = valid;
+	return JIT_ERR_NONE;
+}
+
 void max_jit_peek_perform64(t_max_jit_peek *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
 {
 	long n = sampleframes;
-	long i,j,dimcount;
+	long i,j,dimcount,count;
 	char *bp,*p;
 	//float *out_val=x->vectors[0];
 	double *out_val = outs[0];
 	//float **in_dim=x->vectors+1;
 	double **in_dim = ins;
-	long tmp,outofbounds,typesize;
+	long tmp,outofbounds;
 	long dim_int[JIT_MATRIX_MAX_DIMCOUNT];
 	float dim_frak[JIT_MATRIX_MAX_DIMCOUNT];
 	long mult[JIT_MATRIX_MAX_DIMCOUNT]; // added to perform routine for normalization
+	double fmult[JIT_MATRIX_MAX_DIMCOUNT];
 
 	ATOMIC_INCREMENT(&x->inperform);
 
@@ -287,29 +575,32 @@ void max_jit_peek_perform64(t_max_jit_peek *x, t_object *dsp64, double **ins, lo
 
 
 		if (x->interp) {
-			if (x->minfo.type==_jit_sym_char) {
-				typesize = 1;
-			} else if (x->minfo.type==_jit_sym_long) {
-				typesize = 4;
-			} else if (x->minfo.type==_jit_sym_float32) {
-				typesize = 4;
-			} else if (x->minfo.type==_jit_sym_float64) {
-				typesize = 8;
+			if (x->type<0 || dimcount<1) {
+				goto zero;
 			}
-			bp += x->plane*typesize;
-
-
-			for (i=0; i<n; i++) {
-				for (j=0; j<dimcount; j++) {
-					dim_int[j] = in_dim[j][i]*mult[j];
-					dim_frak[j] = in_dim[j][i]*mult[j] - (float) dim_int[j];
-					dim_int[j] = dim_int[j]%x->minfo.dim[j];
+			bp += x->plane*x->typesize;
+
+			if (x->kernel) {
+				// offsets are computed a chunk at a time so the kernels only gather and blend
+				for (j=0; j<dimcount; j++)
+					fmult[j] = mult[j];
+				for (i=0; i<n; i+=count) {
+					count = MIN(n-i,MAX_JIT_PEEK_CHUNK);
+					max_jit_peek_offsets(x,in_dim,i,count,dimcount,fmult);
+					(*x->kernel)(x,bp,out_val+i,count);
 				}
-
-				*out_val++ = recursive_interp(bp,dimcount,&x->minfo,dim_int,dim_frak);
-
 			}
+			else {
+				for (i=0; i<n; i++) {
+					for (j=0; j<dimcount; j++) {
+						dim_int[j] = in_dim[j][i]*mult[j];
+						dim_frak[j] = in_dim[j][i]*mult[j] - (float) dim_int[j];
+						dim_int[j] = dim_int[j]%x->minfo.dim[j];
+					}
 
+					*out_val++ = recursive_interp(bp,dimcount,&x->minfo,dim_int,dim_frak);
+				}
+			}
 		}
 		else {
 			if (x->minfo.type==_jit_sym_char) {
@@ -478,6 +769,7 @@ void max_jit_peek_dsp64(t_max_jit_peek *x, t_object *dsp64, short *count, double
 		jit_atom_setsym(&a,x->matrix_name);
 		max_jit_peek_matrix_name(x,NULL,1,&a);
 	}
+	max_jit_peek_kernel_select(x);
 
 //	x->vectors[0] = (t_float*)sp[x->dimcount]->s_vec;
 //	for (i=0;i<(x->dimcount);i++)
@@ -558,6 +850,23 @@ void max_jit_peek_update(t_max_jit_peek *x)
 		//should not call savelock, since this will lock the handle if the matrix is a handle
 		//which is not interrupt safe, most matrices are not handles, so this call is not needed
 		jit_object_method(matrix,_jit_sym_getinfo,&x->minfo);
+		if (x->minfo.type==_jit_sym_char) {
+			x->type = MAX_JIT_PEEK_TYPE_CHAR;
+			x->typesize = 1;
+		} else if (x->minfo.type==_jit_sym_long) {
+			x->type = MAX_JIT_PEEK_TYPE_LONG;
+			x->typesize = 4;
+		} else if (x->minfo.type==_jit_sym_float32) {
+			x->type = MAX_JIT_PEEK_TYPE_FLOAT32;
+			x->typesize = 4;
+		} else if (x->minfo.type==_jit_sym_float64) {
+			x->type = MAX_JIT_PEEK_TYPE_FLOAT64;
+			x->typesize = 8;
+		} else {
+			x->type = -1;
+			x->typesize = 0;
+		}
+		max_jit_peek_kernel_select(x);
 		if ((x->minfo.flags&&JIT_MATRIX_DATA_HANDLE)||(x->minfo.flags&&JIT_MATRIX_DATA_REFERENCE)) {
 			// do not allow handle or reference data
 			return;
@@ -599,6 +908,11 @@ void *max_jit_peek_new(t_symbol *s, long argc, t_atom *argv)
 		x->inperform = 0;
 		x->mvalid = 0;
 		x->mdata = 0;
+		x->type = -1;
+		x->typesize = 0;
+		x->kernel = NULL;
+		x->taps = 2;
+		x->minfo.dimcount = 0;
 
 		attrstart = max_jit_attr_args_offset(argc,argv);
 		if (attrstart&&argv) {
@@ -5,6 +5,8 @@
 */
 
 #include "jit.common.h"
+#include "ext_path.h"
+#include "ext_systhread.h"
 
 #define ROW_DELIM '\r'
 #define COL_DELIM ','
@@ -17,6 +19,28 @@
 
 #define BYTE_WRITE_COUNT 1024
 
+// export writes straight to a file through a large buffer instead of posting.
+// text formats write one line per matrix row, every plane of every cell as a
+// separate field; raw writes a small header followed by the packed cells.
+// export_mutex is held while a matrix is written, so that a close from the
+// main thread can't free the file or buffer under a calc on another thread.
+#define EXPORT_BUFFER_SIZE	(1024 * 1024)
+#define EXPORT_FIELD_MAX	64 // longest formatted value plus delimiter
+#define EXPORT_RAW_MAGIC	FOUR_CHAR_CODE('JXR1')
+
+enum {
+	EXPORT_FORMAT_CSV = 0,
+	EXPORT_FORMAT_TSV,
+	EXPORT_FORMAT_RAW
+};
+
+enum {
+	EXPORT_TYPE_CHAR = 0,
+	EXPORT_TYPE_LONG,
+	EXPORT_TYPE_FLOAT32,
+	EXPORT_TYPE_FLOAT64
+};
+
 typedef struct _jit_print
 {
 	t_object		ob;
@@ -33,6 +57,12 @@ typedef struct _jit_print
 	char			info; // 0 - body no info, 1 - body + info, 2 - info no body
 	t_bool			write_cherry;
 	t_bool			read_cherry;
+	t_filehandle	export_fh;
+	char			*export_buf;
+	long			export_pos;
+	long			export_format;
+	t_jit_err		export_err;
+	t_systhread_mutex export_mutex;
 } t_jit_print;
 
 t_jit_print *jit_print_new(void);
@@ -47,6 +77,11 @@ t_jit_err jit_print_packtext_float32(t_jit_print *x, long *dim, t_jit_matrix_inf
 t_jit_err jit_print_packtext_float64(t_jit_print *x, long *dim, t_jit_matrix_info *info, char *bip);
 t_jit_err jit_print_write_print_ndim(t_jit_print *x, long dimcount, long *dim, t_jit_matrix_info *info, char *bip);
 
+// matrix to file functions
+t_jit_err jit_print_export_open(t_jit_print *x, t_filehandle fh, long format);
+t_jit_err jit_print_export_close(t_jit_print *x);
+t_jit_err jit_print_export_matrix(t_jit_print *x, t_jit_matrix_info *info, char *bip);
+
 void jit_print_planedelim_set(t_jit_print *x, t_symbol *s, long ac, t_atom *av);
 t_jit_err jit_print_planedelim_get(t_jit_print *x, void *attr, long *ac, t_atom **av);
 void jit_print_coldelim_set(t_jit_print *x, t_symbol *s, long ac, t_atom *av);
@@ -74,6 +109,8 @@ t_jit_err jit_print_init(void)
 	jit_class_addadornment(_jit_print_class,mop);
 	//add methods
 	jit_class_addmethod(_jit_print_class, (method)jit_print_matrix_calc, "matrix_calc", A_CANT, 0L);
+	jit_class_addmethod(_jit_print_class, (method)jit_print_export_open, "export_open", A_CANT, 0L);
+	jit_class_addmethod(_jit_print_class, (method)jit_print_export_close, "export_close", A_CANT, 0L);
 
 	//add attributes
 	attrflags = JIT_ATTR_GET_DEFER_LOW | JIT_ATTR_SET_USURP_LOW;
@@ -327,6 +364,14 @@ t_jit_err jit_print_matrix_calc(t_jit_print *x, void *in_matrix)
 
 		if (!bip) { err=JIT_ERR_INVALID_INPUT; goto out;}
 
+		systhread_mutex_lock(x->export_mutex);
+		if (x->export_fh) {
+			err = jit_print_export_matrix(x, &info, bip);
+			systhread_mutex_unlock(x->export_mutex);
+			goto out;
+		}
+		systhread_mutex_unlock(x->export_mutex);
+
 		for (i = 0; i < info.dimcount; i++) {
 			dim[i] = info.dim[i];
 		}
@@ -786,6 +831,270 @@ t_jit_err jit_print_packtext_float64(t_jit_print *x, long *dim, t_jit_matrix_inf
 }
 
 
+static const char jit_print_digitpairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// unsigned decimal, two digits per step. returns the number of characters written.
+static long jit_print_format_uint(char *p, t_uint64 v)
+{
+	char tmp[24];
+	char *t = tmp + sizeof(tmp);
+	long len;
+
+	while (v >= 100) {
+		long pair = (long)(v % 100) * 2;
+		v /= 100;
+		*--t = jit_print_digitpairs[pair + 1];
+		*--t = jit_print_digitpairs[pair];
+	}
+	if (v >= 10) {
+		*--t = jit_print_digitpairs[v * 2 + 1];
+		*--t = jit_print_digitpairs[v * 2];
+	}
+	else
+		*--t = (char)('0' + v);
+
+	len = (long)(tmp + sizeof(tmp) - t);
+	memcpy(p, t, len);
+	return len;
+}
+
+static long jit_print_format_long(char *p, t_int64 v)
+{
+	if (v < 0) {
+		*p = '-';
+		return 1 + jit_print_format_uint(p + 1, (t_uint64)0 - (t_uint64)v);
+	}
+	return jit_print_format_uint(p, (t_uint64)v);
+}
+
+// fixed point with 'precision' fractional digits, rounded. values too large
+// to scale into 64 bits (and nan/inf) fall back to snprintf.
+static long jit_print_format_double(char *p, double v, long precision)
+{
+	static const double scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+									 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	double scaled;
+	t_uint64 fixed, ipart, fpart, pow10;
+	long len = 0, flen, i;
+	char digits[24];
+
+	CLIP_ASSIGN(precision, 0, 15);
+	scaled = v * scales[precision];
+	if (!(scaled > -9.0e15 && scaled < 9.0e15))
+		return snprintf(p, EXPORT_FIELD_MAX - 1, "%.*g", (int)MAX(precision, 1), v);
+
+	if (scaled < 0) {
+		p[len++] = '-';
+		scaled = -scaled;
+	}
+	fixed = (t_uint64)(scaled + 0.5);
+	pow10 = (t_uint64)scales[precision];
+	ipart = fixed / pow10;
+	fpart = fixed - ipart * pow10;
+	if (len && !fixed)
+		len = 0; // no "-0"
+
+	len += jit_print_format_uint(p + len, ipart);
+	if (precision) {
+		p[len++] = '.';
+		flen = jit_print_format_uint(digits, fpart);
+		for (i = flen; i < precision; i++)
+			p[len++] = '0';
+		memcpy(p + len, digits, flen);
+		len += flen;
+	}
+	return len;
+}
+
+static t_jit_err jit_print_export_flush(t_jit_print *x)
+{
+	t_ptr_size count = x->export_pos;
+	t_max_err err;
+
+	if (!count)
+		return JIT_ERR_NONE;
+	err = sysfile_write(x->export_fh, &count, x->export_buf);
+	if (err || count != (t_ptr_size)x->export_pos) {
+		x->export_pos = 0;
+		x->export_err = JIT_ERR_GENERIC;
+		return JIT_ERR_GENERIC;
+	}
+	x->export_pos = 0;
+	return JIT_ERR_NONE;
+}
+
+static t_jit_err jit_print_export_write(t_jit_print *x, const void *data, long size)
+{
+	const char *bytes = (const char *)data;
+	long count;
+
+	while (size > 0) {
+		if (x->export_pos == EXPORT_BUFFER_SIZE && jit_print_export_flush(x))
+			return x->export_err;
+		count = MIN(size, EXPORT_BUFFER_SIZE - x->export_pos);
+		memcpy(x->export_buf + x->export_pos, bytes, count);
+		x->export_pos += count;
+		bytes += count;
+		size -= count;
+	}
+	return JIT_ERR_NONE;
+}
+
+// the caller holds export_mutex
+static t_jit_err jit_print_export_doclose(t_jit_print *x)
+{
+	t_jit_err err;
+	t_ptr_size position;
+
+	if (!x->export_fh)
+		return JIT_ERR_NONE;
+
+	jit_print_export_flush(x);
+	err = x->export_err;
+	sysfile_getpos(x->export_fh, &position);
+	sysfile_seteof(x->export_fh, position);
+	if (sysfile_close(x->export_fh))
+		err = JIT_ERR_GENERIC;
+	x->export_fh = 0;
+	x->export_pos = 0;
+	return err;
+}
+
+t_jit_err jit_print_export_open(t_jit_print *x, t_filehandle fh, long format)
+{
+	t_jit_err err = JIT_ERR_NONE;
+
+	systhread_mutex_lock(x->export_mutex);
+	jit_print_export_doclose(x);
+	if (!fh)
+		err = JIT_ERR_INVALID_PTR;
+	else if (!x->export_buf && !(x->export_buf = sysmem_newptr(EXPORT_BUFFER_SIZE)))
+		err = JIT_ERR_OUT_OF_MEM;
+	else {
+		CLIP_ASSIGN(format, EXPORT_FORMAT_CSV, EXPORT_FORMAT_RAW);
+		x->export_fh = fh;
+		x->export_pos = 0;
+		x->export_format = format;
+		x->export_err = JIT_ERR_NONE;
+	}
+	systhread_mutex_unlock(x->export_mutex);
+	return err;
+}
+
+t_jit_err jit_print_export_close(t_jit_print *x)
+{
+	t_jit_err err;
+
+	systhread_mutex_lock(x->export_mutex);
+	err = jit_print_export_doclose(x);
+	systhread_mutex_unlock(x->export_mutex);
+	return err;
+}
+
+// write every dim[0] row of the matrix, higher dimensions in order, as one
+// line of text or one packed run of binary cells
+t_jit_err jit_print_export_matrix(t_jit_print *x, t_jit_matrix_info *info, char *bip)
+{
+	long rowcount = 1, row, r, d, i, k, type, typesize, rowbytes, len;
+	long width = info->dim[0];
+	long planecount = info->planecount;
+	char delim = (x->export_format == EXPORT_FORMAT_TSV) ? '\t' : ',';
+	char *ip, *op;
+
+	if (info->dimcount < 1)
+		return JIT_ERR_NONE;
+
+	if (info->type == _jit_sym_char) {
+		type = EXPORT_TYPE_CHAR;
+		typesize = 1;
+	} else if (info->type == _jit_sym_long) {
+		type = EXPORT_TYPE_LONG;
+		typesize = 4;
+	} else if (info->type == _jit_sym_float32) {
+		type = EXPORT_TYPE_FLOAT32;
+		typesize = 4;
+	} else if (info->type == _jit_sym_float64) {
+		type = EXPORT_TYPE_FLOAT64;
+		typesize = 8;
+	} else
+		return JIT_ERR_MISMATCH_TYPE;
+
+	for (d = 1; d < info->dimcount; d++)
+		rowcount *= info->dim[d];
+	rowbytes = width * planecount * typesize;
+
+	if (x->export_format == EXPORT_FORMAT_RAW) {
+		// header: magic, type, planecount, dimcount, dim[dimcount], all native-endian t_uint32
+		t_uint32 header[4 + JIT_MATRIX_MAX_DIMCOUNT];
+
+		header[0] = EXPORT_RAW_MAGIC;
+		header[1] = (t_uint32)type;
+		header[2] = (t_uint32)planecount;
+		header[3] = (t_uint32)info->dimcount;
+		for (d = 0; d < info->dimcount; d++)
+			header[4 + d] = (t_uint32)info->dim[d];
+		jit_print_export_write(x, header, (4 + info->dimcount) * sizeof(t_uint32));
+	}
+
+	for (row = 0; row < rowcount && !x->export_err; row++) {
+		ip = bip;
+		for (d = 1, r = row; d < info->dimcount; d++) {
+			ip += (r % info->dim[d]) * info->dimstride[d];
+			r /= info->dim[d];
+		}
+
+		if (x->export_format == EXPORT_FORMAT_RAW) {
+			if (info->dimstride[0] == planecount * typesize)
+				jit_print_export_write(x, ip, rowbytes);
+			else {
+				for (i = 0; i < width; i++)
+					jit_print_export_write(x, ip + i * info->dimstride[0], planecount * typesize);
+			}
+			continue;
+		}
+
+		for (i = 0; i < width; i++) {
+			char *cp = ip + i * info->dimstride[0];
+
+			for (k = 0; k < planecount; k++) {
+				if (EXPORT_BUFFER_SIZE - x->export_pos < EXPORT_FIELD_MAX && jit_print_export_flush(x))
+					break;
+				op = x->export_buf + x->export_pos;
+				switch (type) {
+				case EXPORT_TYPE_CHAR:
+					len = jit_print_format_uint(op, ((uchar *)cp)[k]);
+					break;
+				case EXPORT_TYPE_LONG:
+					len = jit_print_format_long(op, ((t_int32 *)cp)[k]);
+					break;
+				case EXPORT_TYPE_FLOAT32:
+					len = jit_print_format_double(op, ((float *)cp)[k], x->precision);
+					break;
+				default:
+					len = jit_print_format_double(op, ((double *)cp)[k], x->precision);
+					break;
+				}
+				op[len++] = (i == width - 1 && k == planecount - 1) ? '\n' : delim;
+				x->export_pos += len;
+			}
+		}
+	}
+	if (x->export_format != EXPORT_FORMAT_RAW)
+		jit_print_export_write(x, "\n", 1); // blank line between matrices
+
+	return x->export_err;
+}
+
 t_jit_print *jit_print_new(void)
 {
 	t_jit_print *x;
@@ -811,6 +1120,13 @@ t_jit_print *jit_print_new(void)
 		x->info = 0;
 		x->title = ps_null;
 
+		x->export_fh = 0;
+		x->export_buf = NULL;
+		x->export_pos = 0;
+		x->export_format = EXPORT_FORMAT_CSV;
+		x->export_err = JIT_ERR_NONE;
+		systhread_mutex_new(&x->export_mutex,0);
+
 	} else {
 		x = NULL;
 	}
@@ -819,5 +1135,8 @@ t_jit_print *jit_print_new(void)
 
 void jit_print_free(t_jit_print *x)
 {
-	//nada
+	jit_print_export_close(x);
+	if (x->export_buf)
+		sysmem_freeptr(x->export_buf);
+	systhread_mutex_free(x->export_mutex);
 }
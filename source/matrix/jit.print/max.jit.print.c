@@ -4,6 +4,7 @@
 */
 
 #include "jit.common.h"
+#include "ext_path.h"
 
 typedef struct _max_jit_print
 {
@@ -19,6 +20,8 @@ void *max_jit_print_new(t_symbol *s, long argc, t_atom *argv);
 void max_jit_print_jit_matrix(t_max_jit_print *x, t_symbol *s, long argc, t_atom *argv);
 void max_jit_print_assist(t_max_jit_print *x, void *b, long m, long a, char *s);
 void max_jit_print_free(t_max_jit_print *x);
+void max_jit_print_export(t_max_jit_print *x, t_symbol *s, long argc, t_atom *argv);
+void max_jit_print_close(t_max_jit_print *x);
 
 typedef struct _jit_print t_jit_print;
 t_jit_err jit_print_matrix_calc(t_jit_print *x, void *in_matrix);
@@ -37,9 +40,69 @@ C74_EXPORT void ext_main(void *r)
 	q = jit_class_findbyname(gensym("jit_print"));
 	max_jit_classex_standard_wrap(p,q,0);
 	addmess((method)max_jit_print_jit_matrix, "jit_matrix", A_GIMME,0);
+	addmess((method)max_jit_print_export, "export", A_GIMME,0);
+	addmess((method)max_jit_print_close, "close", 0);
 	addmess((method)max_jit_print_assist, "assist", A_CANT,0);
 }
 
+// export [csv|tsv|raw] [filename]: subsequent matrices are written to the file
+// instead of the Max window until close
+void max_jit_print_export(t_max_jit_print *x, t_symbol *s, long argc, t_atom *argv)
+{
+	char filename[MAX_PATH_CHARS];
+	char tempname[MAX_PATH_CHARS];
+	short path=0, err;
+	t_fourcc type = FOUR_CHAR_CODE('TEXT');
+	t_filehandle fh;
+	t_symbol *format = gensym("csv");
+	long formatindex = 0;
+
+	if (argc && argv && atom_gettype(argv) == A_SYM) {
+		format = jit_atom_getsym(argv);
+		argc--;
+		argv++;
+	}
+	if (format == gensym("csv"))
+		formatindex = 0;
+	else if (format == gensym("tsv"))
+		formatindex = 1;
+	else if (format == gensym("raw")) {
+		formatindex = 2;
+		type = FOUR_CHAR_CODE('DATA');
+	}
+	else {
+		jit_object_error((t_object *)x,"jit.print: unknown export format %s", format->s_name);
+		return;
+	}
+
+	snprintf(filename, MAX_PATH_CHARS, "matrix.%s", format->s_name);
+	if (argc && argv) {
+		strncpy(tempname, jit_atom_getsym(argv)->s_name, MAX_PATH_CHARS - 1);
+		tempname[MAX_PATH_CHARS - 1] = 0;
+		if (path_frompotentialpathname(tempname, &path, filename)) {
+			strcpy(filename, tempname);
+			path = path_getdefault();
+		}
+	}
+	else if (saveasdialog_extended(filename, &path, &type, &type, 1))
+		return;
+
+	if ((err = path_createsysfile(filename, path, type, &fh))) {
+		jit_object_error((t_object *)x,"jit.print: %s: error %d creating file", filename, err);
+		return;
+	}
+	if (jit_object_method(max_jit_obex_jitob_get(x), gensym("export_open"), fh, formatindex)) {
+		jit_object_error((t_object *)x,"jit.print: could not start export");
+		sysfile_close(fh);
+	}
+}
+
+void max_jit_print_close(t_max_jit_print *x)
+{
+	if (jit_object_method(max_jit_obex_jitob_get(x), gensym("export_close")))
+		jit_object_error((t_object *)x,"jit.print: error writing export file");
+}
+
 void max_jit_print_jit_matrix(t_max_jit_print *x, t_symbol *s, long argc, t_atom *argv)
 {
 	void *matrix;
@@ -46,6 +46,7 @@ t_jit_err jit_str_op_init(void)
 	jit_class_addadornment(_jit_str_op_class,mop);
 	//add methods
 	jit_class_addmethod(_jit_str_op_class, (method)jit_str_op_matrix_calc, "matrix_calc", A_CANT, 0L);
+	jit_class_addmethod(_jit_str_op_class, (method)jit_str_op_getrowresults, "getrowresults", A_CANT, 0L);
 
 	//add attributes
 	attrflags = JIT_ATTR_GET_DEFER_LOW | JIT_ATTR_SET_USURP_LOW;
@@ -74,6 +75,12 @@ t_jit_err jit_str_op_init(void)
 	jit_class_addattr(_jit_str_op_class,attr);
 	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"\"Multiline Out\"");
 
+	attr = jit_object_new(_jit_sym_jit_attr_offset,"columnar",_jit_sym_char,attrflags,
+						  (method)0,(method)0L,calcoffset(t_jit_str_op,columnar));
+	jit_class_addattr(_jit_str_op_class,attr);
+	object_addattr_parse(attr,"label",_jit_sym_symbol,0,"Columnar");
+	object_addattr_parse(attr,"style",_jit_sym_symbol,0,"onoff");
+
 	attrflags = JIT_ATTR_GET_OPAQUE_USER | JIT_ATTR_SET_OPAQUE_USER;
 	attr = jit_object_new(_jit_sym_jit_attr_offset,"adaptflag",_jit_sym_long,attrflags,
 						  (method)0,(method)0L,calcoffset(t_jit_str_op,adaptflag));
@@ -218,6 +225,10 @@ t_jit_err jit_str_op_matrix_calc(t_jit_str_op *x, void *inputs, void *outputs) {
 			err = JIT_ERR_MISMATCH_DIM;
 			goto out;
 		}
+		else if (x->columnar) { // one string per row, no collapsing
+			err = jit_str_op_columnar_calc(x, &vecdata, &in1_minfo, in1_bp, &in2_minfo, in2_bp, out_matrix);
+			goto out;
+		}
 		else if (in1_minfo.dimcount == 2 && in1_minfo.dim[1] > 1 && x->multiline_in) { // we need to collapse the matrix
 			long dim[2]; // limit to 2D at the moment;
 			long rowstride;
@@ -349,6 +360,178 @@ out:
 	return err;
 }
 
+// columnar mode: every row of in1 is an independent string. row lengths are
+// found once up front into the length plane, then the op runs over the
+// output rows in parallel. in2 is matched row for row, or broadcast if it
+// has a single row.
+t_jit_err jit_str_op_columnar_calc(t_jit_str_op *x, t_jit_str_op_vecdata *vecdata, t_jit_matrix_info *in1_minfo, char *in1_bp, t_jit_matrix_info *in2_minfo, char *in2_bp, void *out_matrix)
+{
+	t_jit_str_op_rowdata rowdata;
+	t_jit_matrix_info out_minfo;
+	t_jit_op_info in1_opinfo, in2_opinfo;
+	char *out_bp;
+	long i, rows, width, savelock;
+	long dim[JIT_MATRIX_MAX_DIMCOUNT];
+
+	if (in2_minfo->dimcount > 2)
+		return JIT_ERR_MISMATCH_DIM;
+
+	rowdata.x = x;
+	rowdata.opfn = vecdata->opfn;
+	rowdata.in1_minfo = in1_minfo;
+	rowdata.in2_minfo = in2_minfo;
+	rowdata.in1_bp = in1_bp;
+	rowdata.in2_bp = in2_bp;
+	rowdata.in1_rows = (in1_minfo->dimcount > 1) ? in1_minfo->dim[1] : 1;
+	rowdata.in2_rows = (in2_minfo->dimcount > 1) ? in2_minfo->dim[1] : 1;
+	rows = rowdata.in1_rows;
+
+	if (x->lengthsize < rows + rowdata.in2_rows) {
+		long size = rows + rowdata.in2_rows;
+		long *lengths = (long *)jit_getbytes(size * 2 * sizeof(long));
+
+		if (!lengths)
+			return JIT_ERR_OUT_OF_MEM;
+		if (x->lengths)
+			jit_freebytes(x->lengths, x->lengthsize * 2 * sizeof(long));
+		x->lengths = lengths;
+		x->lengthsize = size;
+	}
+	rowdata.in1_len = x->lengths;
+	rowdata.in2_len = x->lengths + rows;
+	// results share the allocation, after the length plane
+	x->rowresults = x->lengths + x->lengthsize;
+
+	for (i = 0; i < rows; i++) {
+		in1_opinfo.p = in1_bp + i * in1_minfo->dimstride[1];
+		rowdata.in1_len[i] = jit_str_op_checklen(in1_minfo->dim[0], &in1_opinfo);
+	}
+	for (i = 0; i < rowdata.in2_rows; i++) {
+		in2_opinfo.p = in2_bp + i * in2_minfo->dimstride[1];
+		rowdata.in2_len[i] = jit_str_op_checklen(in2_minfo->dim[0], &in2_opinfo);
+	}
+
+	if (vecdata->opfn == jit_str_op_strlen || vecdata->opfn == jit_str_op_strcmp) {
+		for (i = 0; i < rows; i++) {
+			jit_str_op_row_setup(&rowdata, i, vecdata, &in1_opinfo, &in2_opinfo);
+			(*(vecdata->opfn))(0, vecdata, &in1_opinfo, &in2_opinfo, NULL);
+			x->rowresults[i] = vecdata->outlong[0];
+		}
+		x->rowcount = rows;
+		x->outmode = 3;
+		return JIT_ERR_NONE;
+	}
+
+	jit_object_method(out_matrix,_jit_sym_getinfo,&out_minfo);
+	if (x->adaptflag) {
+		width = 1;
+		for (i = 0; i < rows; i++)
+			width = MAX(width, jit_str_op_row_outlen(&rowdata, i));
+		out_minfo.dim[0] = width;
+		out_minfo.dim[1] = rows;
+		out_minfo.dimcount = 2;
+		jit_object_method(out_matrix, _jit_sym_setinfo, &out_minfo);
+		jit_object_method(out_matrix, _jit_sym_getinfo, &out_minfo);
+	}
+
+	savelock = (long) jit_object_method(out_matrix,_jit_sym_lock,1);
+	jit_object_method(out_matrix,_jit_sym_getdata,&out_bp);
+	if (!out_bp) {
+		jit_object_method(out_matrix,_jit_sym_lock,savelock);
+		return JIT_ERR_INVALID_OUTPUT;
+	}
+	rowdata.out_bp = out_bp;
+
+	dim[0] = out_minfo.dim[0];
+	dim[1] = (out_minfo.dimcount > 1) ? out_minfo.dim[1] : 1;
+	jit_parallel_ndim_simplecalc1((method)jit_str_op_columnar_ndim, &rowdata, out_minfo.dimcount, dim, 1, &out_minfo, out_bp, 0);
+
+	jit_object_method(out_matrix,_jit_sym_lock,savelock);
+	x->outmode = 0;
+	x->rowcount = 0;
+	return JIT_ERR_NONE;
+}
+
+void jit_str_op_columnar_ndim(t_jit_str_op_rowdata *rowdata, long dimcount, long *dim, long planecount, t_jit_matrix_info *out_minfo, char *bop)
+{
+	t_jit_str_op_vecdata vecdata;
+	t_jit_op_info in1_opinfo, in2_opinfo, out_opinfo;
+	long i, n, row, rows, firstrow;
+	char *op;
+
+	if (dimcount < 1) return; //safety
+
+	n = dim[0];
+	rows = (dimcount > 1) ? dim[1] : 1;
+	// each worker gets a band of rows; recover where it starts
+	firstrow = (dimcount > 1) ? (bop - rowdata->out_bp) / out_minfo->dimstride[1] : 0;
+	vecdata.opfn = rowdata->opfn;
+	out_opinfo.stride = 1;
+
+	for (i = 0; i < rows; i++) {
+		op = bop + i * ((dimcount > 1) ? out_minfo->dimstride[1] : 0);
+		row = firstrow + i;
+		memset(op, 0, n);
+		if (row >= rowdata->in1_rows)
+			continue;
+
+		jit_str_op_row_setup(rowdata, row, &vecdata, &in1_opinfo, &in2_opinfo);
+		out_opinfo.p = op;
+		(*(vecdata.opfn))(n, &vecdata, &in1_opinfo, &in2_opinfo, &out_opinfo);
+	}
+}
+
+// point the op infos at row of in1 (and the matching row of in2) and fill
+// in the per-row lengths and slice bounds
+void jit_str_op_row_setup(t_jit_str_op_rowdata *rowdata, long row, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2)
+{
+	t_jit_str_op *x = rowdata->x;
+	long row2 = MIN(row, rowdata->in2_rows - 1);
+	long len, start, end;
+
+	in1->stride = 1;
+	in1->p = rowdata->in1_bp + (row ? row * rowdata->in1_minfo->dimstride[1] : 0);
+	in2->stride = 1;
+	in2->p = rowdata->in2_bp + (row2 ? row2 * rowdata->in2_minfo->dimstride[1] : 0);
+	len = vecdata->in1_len = rowdata->in1_len[row];
+	vecdata->in2_len = rowdata->in2_len[row2];
+	vecdata->outlong[0] = 0;
+	vecdata->outlong[1] = 0;
+
+	if (vecdata->opfn == jit_str_op_slice) {
+		start = x->start[0];
+		end = (x->end[1] != 0) ? len - 1 : x->end[0];
+		vecdata->start = (start < 0) ? 0 : (start > len - 1) ? len - 1 : start;
+		vecdata->end = (end < 0) ? 0 : (end > len - 1) ? len - 1 : end;
+	}
+	else if (vecdata->opfn == jit_str_op_strrev) {
+		vecdata->start = len - 1;
+		vecdata->end = 0;
+	}
+}
+
+long jit_str_op_row_outlen(t_jit_str_op_rowdata *rowdata, long row)
+{
+	t_jit_str_op_vecdata vecdata;
+	t_jit_op_info in1_opinfo, in2_opinfo;
+
+	vecdata.opfn = rowdata->opfn;
+	jit_str_op_row_setup(rowdata, row, &vecdata, &in1_opinfo, &in2_opinfo);
+
+	if (vecdata.opfn == jit_str_op_strcat)
+		return vecdata.in1_len + vecdata.in2_len;
+	else if (vecdata.opfn == jit_str_op_slice)
+		return vecdata.in1_len ? ABS(vecdata.end - vecdata.start) + 1 : 0;
+	return vecdata.in1_len;
+}
+
+void *jit_str_op_getrowresults(t_jit_str_op *x, long *count)
+{
+	if (count)
+		*count = x->rowcount;
+	return x->rowresults;
+}
+
 void jit_str_op_expand(t_jit_str_op *x, void *out_matrix, const char *buf)
 {
 	long loc, crcount, longline;
@@ -368,21 +551,16 @@ void jit_str_op_expand(t_jit_str_op *x, void *out_matrix, const char *buf)
 		jit_object_method(out_matrix, _jit_sym_getinfo, &info);
 
 		size = strlen(text);
-		for (n = 0; n < size; n++) {
-			if (*text++ == CR_MAC) {
-				if (loc > longline)
-					longline = loc;
-				loc = 0;
-				crcount++;
-			}
-			else {
-				loc++;
-			}
-		}
-		if (*(--text) != CR_MAC) { // in case last line not cr terminated
+		while (size > 0) {
+			char *cr = memchr(text, CR_MAC, size);
+
+			loc = cr ? cr - text : size; // last line may not be cr terminated
 			if (loc > longline)
 				longline = loc;
 			crcount++;
+			n = cr ? loc + 1 : loc;
+			text += n;
+			size -= n;
 		}
 
 		if (longline || crcount) {
@@ -435,12 +613,12 @@ void jit_str_op_packmatrix(t_jit_str_op *x, long dimcount, long *dim,  t_jit_mat
 
 void jit_str_op_read_char(t_jit_str_op *x, long *dim, t_jit_matrix_info *info, char *bop, const char *buf)
 {
-	long i, j, k;
+	long i;
 	uchar *op;
 	long width, height, planecount, bytecount;
-	long size, err = 0, pos;
-	long n, loc, crloc;
+	long size, linelen;
 	char *text = (char *)buf;
+	char *cr;
 
 
 	width = dim[0];
@@ -454,28 +632,13 @@ void jit_str_op_read_char(t_jit_str_op *x, long *dim, t_jit_matrix_info *info, c
 		for (i = 0; i < height && size > 0; i++) {
 			op = (uchar *)(bop + i * info->dimstride[1]);
 
-			for (j = 0; j < width && size > 0; j++) {
-				for (k = 0; k < planecount && size > 0; k++) {
-					if (*text != CR_MAC) {
-						*op++ = *text++;
-						size--;
-					}
-					else {
-						text++; //advance past cr if found, and the start new row
-						size--;
-						goto cont;
-					}
-				}
-			}
-			while (*text != CR_MAC && size) { //advance past next cr
-				text++;
-				size--;
-			}
-			text++;
-			size--;
-
-cont:
-			;
+			cr = memchr(text, CR_MAC, size);
+			linelen = cr ? cr - text : size;
+			memcpy(op, text, MIN(linelen, bytecount)); // anything past the row width is dropped
+			if (cr) //advance past cr if found, and the start new row
+				linelen++;
+			text += linelen;
+			size -= linelen;
 		}
 	}
 }
@@ -639,16 +802,13 @@ char *jit_str_op_tostring(t_jit_str_op *x, long dimcount, long *dim, long rowstr
 
 long jit_str_op_checklen(long n, t_jit_op_info *in1)
 {
-	char *s1;
-	long i;
-
-	s1 = in1->p;
+	char *end;
 
-	for (i = 0; i < n; i++) {
-		if (!*s1++) break;
-	}
-
-	return i;
+	if (n <= 0)
+		return 0;
+	// memchr is vectorized by every libc we ship against
+	end = memchr(in1->p, 0, n);
+	return end ? end - (char *)in1->p : n;
 }
 
 t_jit_str_op *jit_str_op_new(void)
@@ -668,6 +828,11 @@ t_jit_str_op *jit_str_op_new(void)
 		x->endcount = 1;
 		x->multiline_in = 1;
 		x->multiline_out = 0;
+		x->columnar = 0;
+		x->lengths = NULL;
+		x->lengthsize = 0;
+		x->rowresults = NULL;
+		x->rowcount = 0;
 	} else {
 		x = NULL;
 	}
@@ -676,5 +841,6 @@ t_jit_str_op *jit_str_op_new(void)
 
 void jit_str_op_free(t_jit_str_op *x)
 {
-	//nada
+	if (x->lengths)
+		jit_freebytes(x->lengths, x->lengthsize * 2 * sizeof(long));
 }
@@ -1,6 +1,82 @@
 #include "jit.common.h"
 #include "jit.str.op.h"
 
+// SSE2 is always present on x86_64 and NEON on arm64, so the vector paths
+// need no runtime dispatch. everything else takes the scalar loops.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JIT_STR_OP_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define JIT_STR_OP_NEON 1
+#endif
+
+// add delta to every byte in [lo, hi], copying len bytes from s to os
+static void jit_str_op_changecase(char *os, const char *s, long len, char lo, char hi, char delta)
+{
+	long i = 0;
+
+#if JIT_STR_OP_SSE2
+	__m128i vlo = _mm_set1_epi8((char)(lo - 1));
+	__m128i vhi = _mm_set1_epi8((char)(hi + 1));
+	__m128i vdelta = _mm_set1_epi8(delta);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, vlo), _mm_cmplt_epi8(v, vhi));
+		_mm_storeu_si128((__m128i *)(os + i), _mm_add_epi8(v, _mm_and_si128(m, vdelta)));
+	}
+#elif JIT_STR_OP_NEON
+	uint8x16_t vlo = vdupq_n_u8((uint8_t)lo);
+	uint8x16_t vhi = vdupq_n_u8((uint8_t)hi);
+	uint8x16_t vdelta = vdupq_n_u8((uint8_t)delta);
+
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)(s + i));
+		uint8x16_t m = vandq_u8(vcgeq_u8(v, vlo), vcleq_u8(v, vhi));
+		vst1q_u8((uint8_t *)(os + i), vaddq_u8(v, vandq_u8(m, vdelta)));
+	}
+#endif
+	for (; i < len; i++)
+		os[i] = (s[i] >= lo && s[i] <= hi) ? s[i] + delta : s[i];
+}
+
+// index of the first byte that differs between a and b, or len
+static long jit_str_op_mismatch(const char *a, const char *b, long len)
+{
+	long i = 0;
+
+#if JIT_STR_OP_SSE2
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+
+		if (mask) {
+#ifdef _MSC_VER
+			unsigned long bit;
+			_BitScanForward(&bit, mask);
+			return i + bit;
+#else
+			return i + __builtin_ctz(mask);
+#endif
+		}
+	}
+#elif JIT_STR_OP_NEON
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)(a + i)), vld1q_u8((const uint8_t *)(b + i)));
+
+		if (vminvq_u8(eq) != 0xFF)
+			break; // the scalar loop finds the exact byte
+	}
+#endif
+	for (; i < len; i++) {
+		if (a[i] != b[i])
+			break;
+	}
+	return i;
+}
+
 void jit_str_op_strcat (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out)//, long *outlong)
 {
 	char *s1, *s2, *os;
@@ -76,7 +152,6 @@ void jit_str_op_strrev(long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1
 
 void jit_str_op_strcmp(long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out)//, long *outlong)
 {
-	char c1, c2, dif;
 	char *s1, *s2;
 	long len, i;
 
@@ -85,19 +160,12 @@ void jit_str_op_strcmp(long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1
 	s2 = in2->p;
 	len = MIN(vecdata->in1_len, vecdata->in2_len);
 
-	for (i = 0; i < len; i++) {
-		if (s1[i] == s2[i]) {
-			if (s1[i] == 0) {
-				vecdata->outlong[0] = 0;
-//				*outlong = 0;
-				goto out;
-			}
-		}
-		else {
-			vecdata->outlong[0] = s1[i] - s2[i];
-//			*outlong = s1[i] - s2[i];
-			goto out;
-		}
+	// in1_len and in2_len stop at the first 0, so only a mismatch can end the scan early
+	i = jit_str_op_mismatch(s1, s2, len);
+	if (i < len) {
+		vecdata->outlong[0] = s1[i] - s2[i];
+//		*outlong = s1[i] - s2[i];
+		goto out;
 	}
 
 	if (vecdata->in1_len == vecdata->in2_len)
@@ -127,47 +195,25 @@ void jit_str_op_strlen (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in
 
 void jit_str_op_toupper (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out)//, long *outlong)
 {
-	char *s, *os;
+	long len = MIN(n, vecdata->in1_len);
 
 	vecdata->outputtype = 0;
 
-	s = in1->p;
-	os = out->p;
-
-	while (n--) {
-		if ((*s >= 97) && (*s <= 122))
-			*os++ = *s++ - 32;
-		else {
-			if (*os++ = *s++) ;
-			else break;
-		}
-	}
-
-	if (n)
-		*os = 0;
+	jit_str_op_changecase(out->p, in1->p, len, 'a', 'z', 'A' - 'a');
+	if (len < n)
+		((char *)out->p)[len] = 0;
 }
 
 
 void jit_str_op_tolower (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out)//, long *outlong)
 {
-	char *s, *os;
+	long len = MIN(n, vecdata->in1_len);
 
 	vecdata->outputtype = 0;
 
-	s = in1->p;
-	os = out->p;
-
-	while (n--) {
-		if ((*s >= 65) && (*s <= 90))
-			*os++ = *s++ + 32;
-		else {
-			if (*os++ = *s++) ;
-			else break;
-		}
-	}
-
-	if (n)
-		*os = 0;
+	jit_str_op_changecase(out->p, in1->p, len, 'A', 'Z', 'a' - 'A');
+	if (len < n)
+		((char *)out->p)[len] = 0;
 }
 
 void jit_str_op_thru (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out)//, long *outlong)
@@ -176,16 +222,14 @@ void jit_str_op_thru (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1,
 	long len;
 
 	vecdata->outputtype = 0;
-	len = vecdata->in1_len;
+	len = MIN(n, vecdata->in1_len);
 
 	s = in1->p;
 	os = out->p;
 
-	while (len-- && n--)
-		*os++ = *s++;
-
-	if (n)
-		*os = 0;
+	memcpy(os, s, len);
+	if (len < n)
+		os[len] = 0;
 }
 /*
 void jit_str_op_delim(long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out, long *outlong)
@@ -22,6 +22,11 @@ typedef struct _jit_str_op
 	long		endcount;
 	char		multiline_in;
 	char		multiline_out;
+	char		columnar;		// each row of a 2D input is its own string
+	long		*lengths;		// length plane: per-row lengths of in1, then in2
+	long		lengthsize;
+	long		*rowresults;	// per-row strlen/strcmp results (outmode 3)
+	long		rowcount;
 } t_jit_str_op;
 
 typedef struct _jit_str_op_vecdata
@@ -35,6 +40,21 @@ typedef struct _jit_str_op_vecdata
 	long		outlong[2];
 } t_jit_str_op_vecdata;
 
+typedef struct _jit_str_op_rowdata
+{
+	t_jit_str_op		*x;
+	t_jit_op_fn_binary	opfn;
+	t_jit_matrix_info	*in1_minfo;
+	t_jit_matrix_info	*in2_minfo;
+	char				*in1_bp;
+	char				*in2_bp;
+	char				*out_bp;
+	long				in1_rows;
+	long				in2_rows;
+	long				*in1_len;
+	long				*in2_len;
+} t_jit_str_op_rowdata;
+
 t_jit_err jit_str_op_matrix_calc(t_jit_str_op *x, void *inputs, void *outputs);
 
 void jit_str_op_strcat (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out);//, long *outlong);
@@ -45,6 +65,11 @@ void jit_str_op_strlen (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in
 void jit_str_op_toupper (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out);//, long *outlong);
 void jit_str_op_tolower (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out);//, long *outlong);
 void jit_str_op_thru (long n, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2, t_jit_op_info *out);//, long *outlong);
+t_jit_err jit_str_op_columnar_calc(t_jit_str_op *x, t_jit_str_op_vecdata *vecdata, t_jit_matrix_info *in1_minfo, char *in1_bp, t_jit_matrix_info *in2_minfo, char *in2_bp, void *out_matrix);
+void jit_str_op_columnar_ndim(t_jit_str_op_rowdata *rowdata, long dimcount, long *dim, long planecount, t_jit_matrix_info *out_minfo, char *bop);
+void jit_str_op_row_setup(t_jit_str_op_rowdata *rowdata, long row, t_jit_str_op_vecdata *vecdata, t_jit_op_info *in1, t_jit_op_info *in2);
+long jit_str_op_row_outlen(t_jit_str_op_rowdata *rowdata, long row);
+void *jit_str_op_getrowresults(t_jit_str_op *x, long *count);
 void jit_str_op_expand(t_jit_str_op *x, void *out_matrix, const char *buf);
 void jit_str_op_packmatrix(t_jit_str_op *x, long dimcount, long *dim,  t_jit_matrix_info *info, char *bop, const char *buf);
 void jit_str_op_read_char(t_jit_str_op *x, long *dim, t_jit_matrix_info *info, char *bop, const char *buf);
@@ -71,6 +71,20 @@ void max_jit_str_op_mproc(t_max_jit_str_op *x, void *mop)
 			jit_atom_setlong(&a[0], jit_attr_getlong(o, gensym("outlong")));
 			max_jit_obex_dumpout(x, s, ac, a);
 			break;
+		case 3: // columnar: one result per row
+			{
+				long i, count = 0;
+				long *results = (long *)jit_object_method(o, gensym("getrowresults"), &count);
+				t_atom *av;
+
+				if (results && count && (av = (t_atom *)jit_getbytes(count * sizeof(t_atom)))) {
+					for (i = 0; i < count; i++)
+						jit_atom_setlong(&av[i], results[i]);
+					max_jit_obex_dumpout(x, s, count, av);
+					jit_freebytes(av, count * sizeof(t_atom));
+				}
+			}
+			break;
 		}
 	}
 }
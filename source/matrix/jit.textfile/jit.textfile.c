@@ -14,6 +14,18 @@
 #define IS_LBCHAR(text)	(((text)[0]=='\r')||((text)[0]=='\n'))
 #define IS_LBPAIR(text)	(((text)[0]=='\r')&&((text)[1]=='\n'))
 
+// line scanner for the tomatrix paths. the next '\r' and '\n' are located with
+// memchr and remembered until passed, so each byte is examined once and lines
+// are copied with memcpy instead of byte by byte.
+typedef struct _jit_textfile_scan
+{
+	const char		*p;
+	const char		*end;	// end of text or first 0
+	const char		*cr;	// next '\r' at or after p, or end
+	const char		*lf;	// next '\n' at or after p, or end
+	char			done;
+} t_jit_textfile_scan;
+
 
 typedef struct _jit_textfile
 {
@@ -42,6 +54,9 @@ void jit_textfile_read_char(t_jit_textfile *x, long *dim,
 t_jit_err jit_textfile_set_texthandle(t_jit_textfile* x, t_handle handle);
 t_jit_err jit_textfile_get_texthandle(t_jit_textfile* x, t_handle* handle);
 
+void jit_textfile_scan_init(t_jit_textfile_scan *scan, const char *text, long size);
+long jit_textfile_scan_line(t_jit_textfile_scan *scan, const char **line);
+
 // matrix to textfile functions
 void jit_textfile_write_char(t_jit_textfile *x, long *dim, t_jit_matrix_info *info, char *bip);
 void jit_textfile_write_textfile_ndim(t_jit_textfile *x, long dimcount, long *dim, t_jit_matrix_info *info, char *bip);
@@ -293,36 +308,19 @@ t_jit_err jit_textfile_tomatrix_adapt(t_jit_textfile *x, void *inputs, void *out
 		jit_object_method(out_matrix,_jit_sym_getinfo,&info);
 
 		{
-			long size;
-			long n, loc;
+			t_jit_textfile_scan scan;
+			const char *line;
+			long len;
 			t_handle th = x->text_local;
-			char *text;
 
 			if (!th) return JIT_ERR_NONE;
-			text = *th;
-			size = sysmem_handlesize(x->text_local);
+			jit_textfile_scan_init(&scan, *th, sysmem_handlesize(th));
 
-			loc = 0;
 			crcount = 0;
 			longline = 0;
-
-			for (n = 0; *text && n < size; n++) {
-				if (IS_LBCHAR(text)) {
-					if (loc > longline)
-						longline = loc;
-					loc = 0;
-					crcount++;
-					if (IS_LBPAIR(text))
-						text++;
-				}
-				else {
-					loc++;
-				}
-				text++;
-			}
-			if (!IS_LBCHAR(text)) { // in case last line not cr terminated
-				if (loc > longline)
-					longline = loc;
+			while ((len = jit_textfile_scan_line(&scan, &line)) >= 0) {
+				if (len > longline)
+					longline = len;
 				crcount++;
 			}
 		}
@@ -381,59 +379,71 @@ void jit_textfile_packmatrix(t_jit_textfile *x, long dimcount, long *dim,  t_jit
 
 void jit_textfile_read_char(t_jit_textfile *x, long *dim, t_jit_matrix_info *info, char *bop)
 {
-	long i, j, k;
-	uchar *op;
-	long width, height, planecount, bytecount;
-	long size;
-	uchar *text;
+	long i, len, rowbytes;
+	t_jit_textfile_scan scan;
+	const char *line;
 	t_handle th = x->text_local;
 
 	if (!th) return;
 
-	width = dim[0];
-	height = dim[1];
-	planecount = info->planecount;
-	bytecount = sizeof(char) * width * planecount;
-
-	size = sysmem_handlesize(th);
-	text = (uchar *)*th;
-
-	if (size) {
-		for (i = 0; i < height && size > 0; i++) {
-			op = (uchar *)(bop + i * info->dimstride[1]);
-
-			for (j = 0; j < width && size > 0; j++) {
-				for (k = 0; k < planecount && size > 0; k++) {
-					if (!IS_LBCHAR(text)) {
-						*op++ = *text++;
-						size--;
-					}
-					else {
-						if (IS_LBPAIR(text)) {
-							text++;
-							size--;
-						}
-						text++; //advance past cr if found, and the start new row
-						size--;
-						goto cont;
-					}
-				}
-			}
-			while ((!IS_LBCHAR(text)) && size) { //advance past next cr
-				text++;
-				size--;
-			}
-			if (IS_LBPAIR(text)) {
-				text++;
-				size--;
-			}
-			text++;
-			size--;
+	// each line fills one row; longer lines are truncated, shorter lines leave
+	// the rest of the row untouched
+	rowbytes = dim[0] * info->planecount;
+	jit_textfile_scan_init(&scan, *th, sysmem_handlesize(th));
 
-cont:
-			;
-		}
+	for (i = 0; i < dim[1]; i++) {
+		if ((len = jit_textfile_scan_line(&scan, &line)) < 0)
+			break;
+		memcpy(bop + i * info->dimstride[1], line, MIN(len, rowbytes));
+	}
+}
+
+void jit_textfile_scan_init(t_jit_textfile_scan *scan, const char *text, long size)
+{
+	const char *nul;
+
+	if (size < 0)
+		size = 0;
+	nul = (const char *)memchr(text, 0, size);
+	scan->p = text;
+	scan->end = nul ? nul : text + size;
+	scan->cr = scan->lf = text - 1; // forces a search on first use
+	scan->done = 0;
+}
+
+// returns the length of the next line (without its break) and points *line at
+// it, or -1 at the end of the text. '\r\n' counts as a single break, and text
+// with n breaks has n+1 lines, the last one possibly empty.
+long jit_textfile_scan_line(t_jit_textfile_scan *scan, const char **line)
+{
+	const char *p = scan->p;
+	const char *brk;
+	long remaining = (long)(scan->end - p);
+
+	if (scan->done)
+		return -1;
+
+	if (scan->cr < p) {
+		scan->cr = (const char *)memchr(p, '\r', remaining);
+		if (!scan->cr) scan->cr = scan->end;
+	}
+	if (scan->lf < p) {
+		scan->lf = (const char *)memchr(p, '\n', remaining);
+		if (!scan->lf) scan->lf = scan->end;
 	}
+	brk = MIN(scan->cr, scan->lf);
+
+	*line = p;
+	if (brk < scan->end) {
+		if (brk[0] == '\r' && brk + 1 < scan->end && brk[1] == '\n')
+			scan->p = brk + 2;
+		else
+			scan->p = brk + 1;
+	}
+	else
+		scan->done = 1;
+
+	return (long)(brk - p);
 }
 
 t_jit_err jit_textfile_tomatrix_line(t_jit_textfile *x, void *inputs, void *outputs)
@@ -444,13 +454,12 @@ t_jit_err jit_textfile_tomatrix_line(t_jit_textfile *x, void *inputs, void *outp
 	long 				dim[JIT_MATRIX_MAX_DIMCOUNT], dimcount = 0;
 	t_jit_matrix_info 	info;
 	void				*out_matrix;
-	long				crcount, longline;
-	long 				size;
-	long 				n, loc;
+	long 				n;
 	long 				linecount = 0;
-	char 				*text, *p;
+	char 				*text;
 	long				line = x->line;
-	t_handle				th;
+	t_handle			th;
+	t_jit_textfile_scan	scan;
 
 	if (line < 0)
 		return 1;
@@ -462,35 +471,13 @@ t_jit_err jit_textfile_tomatrix_line(t_jit_textfile *x, void *inputs, void *outp
 
 		th = x->text_local;
 		if (!th) return JIT_ERR_NONE;
-		text = *th;
-		size = sysmem_handlesize(th);
-
-		n = 0;
-		loc = 0;
-		crcount = 0;
-		longline = 0;
-
-		if (line) {	// cue up to start of line
-			for (n = 0; crcount < line && n < size; n++) {
-				if (IS_LBCHAR(text)) {
-					crcount++;
-					if (IS_LBPAIR(text))
-						text++;
-				}
-				text++;
-			}
-		}
-
-		if (crcount < line)
-			return 1; // error - bad line
-
-		p = text;
+		jit_textfile_scan_init(&scan, *th, sysmem_handlesize(th));
 
-		while ((!IS_LBCHAR(p)) && *p != '\0' && n++ < size) {
-			p++;
-			linecount++;
+		// cue up to start of line
+		for (n = 0; n <= line; n++) {
+			if ((linecount = jit_textfile_scan_line(&scan, (const char **)&text)) < 0)
+				return 1; // error - bad line
 		}
-//		linecount++; // add the 0;
 
 		dim[0] = info.dim[0] = linecount;
 		dimcount = info.dimcount = 1;
@@ -0,0 +1,207 @@
+// mc.lores~ -- lores~ for multichannel signals: one object runs every channel of the bundle
+// the filter is in ../../audio/lores.h; channels are processed in groups of LORES_LANES
+
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "commonsyms.h"
+#include "z_dsp.h"
+#include "lores.h"
+#include "denorm.h"
+
+
+typedef struct _mclores {
+	t_pxobject m_obj;
+	double m_freq;			// cutoff frequency in Hz, used when no signal is connected
+	double m_r;				// resonance (0-1)
+	t_lores_bank m_bank;
+	long m_size;			// the count of input (and output) channels
+	long m_inchans[3];		// channels arriving at each inlet
+	short m_fcon;			// is a signal connected to the frequency inlet
+	short m_rcon;			// is a signal connected to the resonance inlet
+	char m_accurate;		// recompute coefficients every sample from the signal inlets
+	t_denorm_counter *m_denorm;	// what the scrub after our perform routine found, over every channel
+	t_denorm_wrap m_wrap;
+} t_mclores;
+
+
+void *mclores_new(t_symbol *s, long argc, t_atom *argv);
+void mclores_free(t_mclores *x);
+void mclores_assist(t_mclores *x, void *b, long m, long a, char *s);
+void mclores_int(t_mclores *x, long n);
+void mclores_float(t_mclores *x, double f);
+void mclores_clear(t_mclores *x);
+t_max_err mclores_attr_setresonance(t_mclores *x, void *attr, long argc, t_atom *argv);
+void mclores_perform64(t_mclores *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void mclores_dsp64(t_mclores *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+long mclores_inputchanged(t_mclores *x, long index, long count);
+long mclores_multichanneloutputs(t_mclores *x, long index);
+
+static t_class *s_mclores_class;
+static t_symbol *ps_getnuminputchannels;
+
+void ext_main(void *r)
+{
+	t_class *c = class_new("mc.lores~", (method)mclores_new, (method)mclores_free, sizeof(t_mclores), 0L, A_GIMME, 0);
+
+	lores_tables_init();
+	denorm_init();
+	ps_getnuminputchannels = gensym("getnuminputchannels");
+
+	class_addmethod(c, (method)mclores_dsp64,			"dsp64",	A_CANT, 0);
+	class_addmethod(c, (method)mclores_assist,		"assist",	A_CANT, 0);
+	class_addmethod(c, (method)mclores_multichanneloutputs, "multichanneloutputs", A_CANT, 0);
+	class_addmethod(c, (method)mclores_inputchanged, "inputchanged", A_CANT, 0);
+	class_addmethod(c, (method)mclores_clear, "clear", 0);
+	class_addmethod(c, (method)mclores_int, "int", A_LONG, 0);
+	class_addmethod(c, (method)mclores_float, "float", A_FLOAT, 0);
+
+	CLASS_ATTR_DOUBLE(c, "cutoff", 0, t_mclores, m_freq);
+	CLASS_ATTR_BASIC(c, "cutoff", 0);
+	CLASS_ATTR_LABEL(c, "cutoff", 0, "Cutoff Frequency");
+	CLASS_ATTR_ALIAS(c, "cutoff", "freq");
+
+	CLASS_ATTR_DOUBLE(c, "resonance", 0, t_mclores, m_r);
+	CLASS_ATTR_BASIC(c, "resonance", 0);
+	CLASS_ATTR_ALIAS(c, "resonance", "q");
+	CLASS_ATTR_LABEL(c, "resonance", 0, "Resonance");
+	CLASS_ATTR_ACCESSORS(c, "resonance", 0, mclores_attr_setresonance);
+
+	CLASS_ATTR_CHAR(c, "sampleaccurate", 0, t_mclores, m_accurate);
+	CLASS_ATTR_STYLE_LABEL(c, "sampleaccurate", 0, "onoff", "Sample Accurate Modulation");
+
+	class_dspinit(c);
+
+	s_mclores_class = c;
+	class_register(CLASS_BOX, s_mclores_class);
+}
+
+long mclores_multichanneloutputs(t_mclores *x, long index)
+{
+	return x->m_size;
+}
+
+long mclores_inputchanged(t_mclores *x, long index, long count)
+{
+	// only the audio inlet decides how many channels come out
+	if (index == 0 && count != x->m_size) {
+		x->m_size = count;
+		return true;
+	} else
+		return false;
+}
+
+void *mclores_new(t_symbol *s, long argc, t_atom *argv)
+{
+	t_mclores *x = (t_mclores *)object_alloc(s_mclores_class);
+	long offset;
+	double freq = 0, reso = 0;
+
+	offset = attr_args_offset((short)argc, argv);
+	dsp_setup((t_pxobject *)x, 3);
+	x->m_obj.z_misc |= Z_MC_INLETS;
+
+	if (offset) {
+		freq = atom_getfloat(argv);
+		if (offset > 1)
+			reso = atom_getfloat(argv + 1);
+	}
+	x->m_freq = freq;
+	x->m_r = reso >= 1.0 ? 1. - 1E-20 : reso;
+	x->m_size = 1;
+	x->m_inchans[0] = x->m_inchans[1] = x->m_inchans[2] = 0;
+	x->m_fcon = x->m_rcon = 0;
+	x->m_accurate = 0;
+	lores_bank_init(&x->m_bank);
+	x->m_denorm = denorm_counter_new((t_object *)x);
+
+	attr_args_process(x, (short)argc, argv);	// attr versions win out over arguments
+
+	outlet_new((t_object *)x, "multichannelsignal");
+	return x;
+}
+
+void mclores_free(t_mclores *x)
+{
+	dsp_free((t_pxobject *)x);
+	lores_bank_free(&x->m_bank);
+	denorm_counter_free(x->m_denorm);
+}
+
+void mclores_assist(t_mclores *x, void *b, long m, long a, char *s)
+{
+	if (m == 2)
+		strcpy(s, "(multi-channel signal) Output");
+	else {
+		switch (a) {
+		case 0: strcpy(s, "(multi-channel signal) Input"); break;
+		case 1: strcpy(s, "(multi-channel signal/float) Cutoff Frequency"); break;
+		case 2: strcpy(s, "(multi-channel signal/float) Resonance Control (0-1)"); break;
+		}
+	}
+}
+
+void mclores_int(t_mclores *x, long n)
+{
+	mclores_float(x, (double)n);
+}
+
+void mclores_float(t_mclores *x, double f)
+{
+	long in = proxy_getinlet((t_object *)x);
+
+	if (in == 1) {
+		x->m_freq = f;
+		object_attr_touch((t_object *)x, gensym("cutoff"));
+	} else if (in == 2) {
+		x->m_r = f >= 1.0 ? 1 - 1E-20 : f;
+		object_attr_touch((t_object *)x, gensym("resonance"));
+	}
+}
+
+t_max_err mclores_attr_setresonance(t_mclores *x, void *attr, long argc, t_atom *argv)
+{
+	double reso = atom_getfloat(argv);
+
+	x->m_r = reso >= 1.0 ? 1. - 1E-20 : reso;
+	return 0;
+}
+
+void mclores_clear(t_mclores *x)
+{
+	lores_bank_clear(&x->m_bank);
+}
+
+void mclores_perform64(t_mclores *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+	t_lores_mod mod;
+	long i;
+
+	// inlets are laid out one after the other in ins: audio, frequency, resonance
+	mod.fins = x->m_fcon ? (const double *const *)(ins + x->m_inchans[0]) : NULL;
+	mod.fchans = x->m_inchans[1];
+	mod.freq = x->m_freq;
+	mod.rins = x->m_rcon ? (const double *const *)(ins + x->m_inchans[0] + x->m_inchans[1]) : NULL;
+	mod.rchans = x->m_inchans[2];
+	mod.res = x->m_r;
+	mod.accurate = x->m_accurate;
+
+	lores_bank_process(&x->m_bank, ins, outs, &mod, sampleframes);
+
+	// outlet channels with no input channel behind them are silent
+	for (i = x->m_bank.chans; i < numouts; i++)
+		set_zero64(outs[i], sampleframes);
+}
+
+void mclores_dsp64(t_mclores *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	long i;
+
+	for (i = 0; i < 3; i++)
+		x->m_inchans[i] = (long)object_method(dsp64, ps_getnuminputchannels, x, i);
+	x->m_fcon = count[1] && x->m_inchans[1] > 0;	// signal connected to the frequency inlet?
+	x->m_rcon = count[2] && x->m_inchans[2] > 0;	// signal connected to the resonance inlet?
+
+	if (lores_bank_resize(&x->m_bank, MIN(x->m_inchans[0], x->m_size), maxvectorsize, samplerate) == MAX_ERR_NONE)
+		denorm_add64(dsp64, (t_object *)x, &x->m_wrap, x->m_denorm, (t_perfroutine64)mclores_perform64, 0, NULL);
+}
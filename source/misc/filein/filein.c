@@ -1,6 +1,9 @@
 /**
  @file
  filein - read in a file of binary data and output the data at various points in the file
+ When spooling, the file is memory-mapped or read through a cache of blocks (see filereader.h)
+ instead of seeking and reading for every value. A list of offsets comes back as one list of
+ values, of the type set by the type attribute; bigendian sets the byte order for every read.
 
  updated 3/22/09 ajm: new API
 
@@ -10,24 +13,39 @@
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_path.h"
+#include "ext_atomic.h"
+#include "filereader.h"
+
+#define FILEIN_STACKATOMS	64		// values output without allocating
 
 void *filein_class;
 
 typedef struct filein {
 	t_object f_ob;
 	t_filehandle f_fh;
+	t_filereader f_reader;		/* spooled file */
 	short f_open;			/* spool flag */
 	short f_spool;
+	t_int32_atomic f_pending;	/* reads deferred to the main thread and not yet done */
 	t_handle f_data;			/* read in data */
 	t_ptr_size f_size;
+	t_symbol *f_type;			/* of lists */
+	long f_typeindex;
+	char f_bigendian;
+	char f_map;				/* memory-map spooled files */
+	long f_blocks;				/* cached blocks when not mapped */
+	long f_readahead;			/* blocks read ahead of forward reads */
 	void *f_out;
 	void *f_eof;
 	void *f_readdone;
 } t_filein;
 
-t_symbol *ps_nothing,*ps_spool,*ps_int,*ps_in1,*ps_in2;
+t_symbol *ps_nothing,*ps_spool,*ps_int,*ps_in1,*ps_in2,*ps_list,*ps_report;
 
 void filein_access(t_filein *x, t_symbol *s, long ac, t_atom *av);
+void filein_doaccess(t_filein *x, t_symbol *s, long ac, t_atom *av);
+void filein_list(t_filein *x, t_symbol *s, long ac, t_atom *av);
+void filein_report(t_filein *x);
 void filein_int(t_filein *x, t_atom_long n);
 void filein_in1(t_filein *x, t_atom_long n);
 void filein_in2(t_filein *x, t_atom_long n);
@@ -38,21 +56,44 @@ void filein_spool(t_filein *x, t_symbol *s);
 void filein_read(t_filein *x, t_symbol *s);
 void filein_free(t_filein *x);
 void filein_assist(t_filein *x, void *b, long m, long a, char *s);
-void *filein_new(t_symbol *fn, t_symbol *spoolFlag);
+t_max_err filein_attr_settype(t_filein *x, void *attr, long argc, t_atom *argv);
+void *filein_new(t_symbol *s, long argc, t_atom *argv);
 
 C74_EXPORT void ext_main(void *r)
 {
 	t_class *c;
 
 	c = class_new("filein", (method)filein_new, (method)filein_free, (short)sizeof(t_filein),
-				  0L, A_DEFSYM, A_DEFSYM, 0);
+				  0L, A_GIMME, 0);
 	class_addmethod(c, (method)filein_int,		"int",		A_LONG, 0);
 	class_addmethod(c, (method)filein_in1,		"in1",		A_LONG, 0);
 	class_addmethod(c, (method)filein_in2,		"in2",		A_LONG, 0);
+	class_addmethod(c, (method)filein_list,		"list",		A_GIMME, 0);
+	class_addmethod(c, (method)filein_report,	"report",	0);
 	class_addmethod(c, (method)filein_close,	"fclose",	0);
 	class_addmethod(c, (method)filein_spool,	"spool",	A_DEFSYM,0);
 	class_addmethod(c, (method)filein_read,		"read",		A_DEFSYM,0);
 	class_addmethod(c, (method)filein_assist,	"assist",	A_CANT,0);
+
+	CLASS_ATTR_SYM(c, "type", 0, t_filein, f_type);
+	CLASS_ATTR_ENUM(c, "type", 0, FILEREADER_TYPENAMES);
+	CLASS_ATTR_LABEL(c, "type", 0, "List Value Type");
+	CLASS_ATTR_ACCESSORS(c, "type", NULL, filein_attr_settype);
+
+	CLASS_ATTR_CHAR(c, "bigendian", 0, t_filein, f_bigendian);
+	CLASS_ATTR_STYLE_LABEL(c, "bigendian", 0, "onoff", "Big Endian Values");
+
+	CLASS_ATTR_CHAR(c, "map", 0, t_filein, f_map);
+	CLASS_ATTR_STYLE_LABEL(c, "map", 0, "onoff", "Memory-Map Spooled Files (takes effect on spool)");
+
+	CLASS_ATTR_LONG(c, "blocks", 0, t_filein, f_blocks);
+	CLASS_ATTR_FILTER_CLIP(c, "blocks", 1, 65536);
+	CLASS_ATTR_LABEL(c, "blocks", 0, "Cached Blocks (takes effect on spool)");
+
+	CLASS_ATTR_LONG(c, "readahead", 0, t_filein, f_readahead);
+	CLASS_ATTR_FILTER_CLIP(c, "readahead", 0, FILEREADER_MAXRUN - 1);
+	CLASS_ATTR_LABEL(c, "readahead", 0, "Blocks Read Ahead (takes effect on spool)");
+
 	class_register(CLASS_BOX, c);
 	filein_class = c;
 
@@ -61,85 +102,126 @@ C74_EXPORT void ext_main(void *r)
 	ps_int = gensym("int");
 	ps_in1 = gensym("in1");
 	ps_in2 = gensym("in2");
+	ps_list = gensym("list");
+	ps_report = gensym("report");
 
 	return;
 }
 
-static t_atom_long get_value_for_data(const char* data, t_symbol *s)
+static long get_type_for_symbol(t_filein *x, t_symbol *s)
 {
-	t_atom_long value;
 	if (s == ps_int) {
-		const t_uint8 *pd = (const t_uint8*) data;
-		value = *pd;
+		return FILEREADER_UINT8;
 	}
 	else if (s == ps_in1) {
-		const t_uint16 *pd = (const t_uint16*) data;
-		value = *pd;
+		return FILEREADER_UINT16;
 	}
 	else if (s == ps_in2) {
-		const t_uint32 *pd = (const t_uint32*) data;
-		value = *pd;
+		return FILEREADER_UINT32;
 	}
-	else {
-		C74_ASSERT(false);
-		value = 0;
-	}
-	return value;
+	return x->f_typeindex;
 }
 
-static int get_data_size_for_symbol(t_symbol *s)
+// read the values at the offsets in av and output them (one on its own, more as a list),
+// then bang if the read stopped at the end of the file
+static void filein_output(t_filein *x, t_symbol *s, long ac, t_atom *av, t_bool locked)
 {
-	if (s == ps_int) {
-		return 1;
+	const long type = get_type_for_symbol(x, s);
+	const long datasize = filereader_typesize(type);
+	t_atom stack[FILEIN_STACKATOMS];
+	t_atom *out = stack;
+	long n;
+
+	if (ac > FILEIN_STACKATOMS && !(out = (t_atom *)sysmem_newptr(ac * sizeof(t_atom)))) {
+		if (locked)
+			systhread_mutex_unlock(x->f_reader.lock);
+		object_error((t_object *)x, "out of memory");
+		return;
 	}
-	else if (s == ps_in1) {
-		return 2;
+	if (x->f_open) {
+		if (!locked)
+			systhread_mutex_lock(x->f_reader.lock);
+		n = filereader_getv(&x->f_reader, ac, av, type, x->f_bigendian, out);
+		systhread_mutex_unlock(x->f_reader.lock);
+	} else {
+		for (n = 0; n < ac; n++) {
+			t_atom_long offset = atom_getlong(av + n);
+
+			if (offset < 0 || offset + datasize > (t_atom_long)x->f_size)
+				break;
+			filereader_decode((const unsigned char *)*(x->f_data) + offset, type, x->f_bigendian, out + n);
+		}
 	}
-	else if (s == ps_in2) {
-		return 4;
+
+	if (n == 1 && s != ps_list) {
+		if (atom_gettype(out) == A_FLOAT)
+			outlet_float(x->f_out, atom_getfloat(out));
+		else
+			outlet_int(x->f_out, atom_getlong(out));
+	}
+	else if (n)
+		outlet_list(x->f_out, NULL, (short)n, out);
+	if (n < ac) {
+		if (atom_getlong(av + n) < 0)
+			object_error((t_object *)x, "access out of range");
+		else
+			outlet_bang(x->f_eof);
 	}
-	C74_ASSERT(false);
-	return 0;
+	if (out != stack)
+		sysmem_freeptr(out);
+}
+
+void filein_doaccess(t_filein *x, t_symbol *s, long ac, t_atom *av)
+{
+	if (x->f_open)
+		filein_output(x, s, ac, av, false);
+	ATOMIC_DECREMENT(&x->f_pending);
 }
 
 void filein_access(t_filein *x, t_symbol *s, long ac, t_atom *av)
 {
-	t_atom_long n = atom_getlong(av);
-	const t_ptr_size datasize = get_data_size_for_symbol(s);
+	t_filereader *r = &x->f_reader;
 
 	if (x->f_open) {
-		if (systhread_istimerthread()) {
-			defer(x, (method) filein_access, s, ac, av);
-		} else {
-			t_max_err err = sysfile_setpos(x->f_fh,SYSFILE_FROMSTART,n);
-			if (err)
-				object_error((t_object *)x, "seek err %d",err);
-			else {
-				char data[8] = { 0 };
-				t_ptr_size count = datasize;
-				sysfile_read(x->f_fh, &count, data);
-				if (count < datasize) {
-					outlet_bang(x->f_eof);
-				}
-				else {
-					t_atom_long value = get_value_for_data(data, s);
-					outlet_int(x->f_out, value);
+		// reads that have to go to the disk wait for the main thread, and so does everything after them
+		if (!x->f_pending) {
+			if (!systhread_istimerthread()) {
+				filein_output(x, s, ac, av, false);
+				return;
+			}
+			if (!systhread_mutex_trylock(r->lock)) {
+				if (!filereader_needsio(r, ac, av, get_type_for_symbol(x, s))) {
+					filein_output(x, s, ac, av, true);		// unlocks
+					return;
 				}
+				systhread_mutex_unlock(r->lock);
 			}
 		}
+		ATOMIC_INCREMENT(&x->f_pending);
+		defer_low(x, (method) filein_doaccess, s, (short)ac, av);
 	} else if (x->f_data) {
-		if (n < 0)
-			object_error((t_object *)x, "access out of range");
-		else if (n+datasize > x->f_size)
-			outlet_bang(x->f_eof);
-		else {
-			const char* pd = (*(x->f_data)) + n;
-			t_atom_long value = get_value_for_data(pd, s);
-			outlet_int(x->f_out, value);
-		}
+		filein_output(x, s, ac, av, false);
 	}
 }
 
+void filein_list(t_filein *x, t_symbol *s, long ac, t_atom *av)
+{
+	if (ac)
+		filein_access(x, ps_list, ac, av);
+}
+
+// report mapped size reads hits misses hit% blocks syscalls, for a spooled file
+void filein_report(t_filein *x)
+{
+	t_atom av[8];
+	long ac;
+
+	systhread_mutex_lock(x->f_reader.lock);
+	ac = filereader_report(&x->f_reader, av);
+	systhread_mutex_unlock(x->f_reader.lock);
+	outlet_anything(x->f_out, ps_report, (short)ac, av);
+}
+
 void filein_int(t_filein *x, t_atom_long n)		/* byte access */
 {
 	t_atom a;
@@ -167,8 +249,9 @@ void filein_in2(t_filein *x, t_atom_long n)		/* long access */
 void filein_close(t_filein *x)
 {
 	if (x->f_open) {
-		sysfile_close(x->f_fh);
-		x->f_fh = 0;
+		systhread_mutex_lock(x->f_reader.lock);
+		filereader_close(&x->f_reader);
+		systhread_mutex_unlock(x->f_reader.lock);
 		x->f_open = FALSE;
 	}
 	if (x->f_data) {
@@ -182,20 +265,16 @@ void filein_open(t_filein *x, char *name)
 {
 	t_ptr_size size;
 
-	if (x->f_spool)
-		x->f_open = TRUE;
+	sysfile_geteof(x->f_fh,&size);
+	if (!(x->f_data = sysmem_newhandle(size)))
+		object_error((t_object *)x, "%s too big to read",name);
 	else {
-		sysfile_geteof(x->f_fh,&size);
-		if (!(x->f_data = sysmem_newhandle(size)))
-			object_error((t_object *)x, "%s too big to read",name);
-		else {
-			sysmem_lockhandle(x->f_data,1);
-			sysfile_read(x->f_fh,&size,*x->f_data);
-			x->f_size = size;
-		}
-		sysfile_close(x->f_fh);
+		sysmem_lockhandle(x->f_data,1);
+		sysfile_read(x->f_fh,&size,*x->f_data);
+		x->f_size = size;
 	}
-	x->f_spool = FALSE;
+	sysfile_close(x->f_fh);
+	x->f_fh = 0;
 }
 
 void filein_doread(t_filein *x, t_symbol *s)
@@ -215,12 +294,24 @@ void filein_doread(t_filein *x, t_symbol *s)
 			return;
 		}
 	}
-	err = path_opensysfile(ps,vol,&x->f_fh,READ_PERM);
-	if (err) {
-		object_error((t_object *)x, "%s: error %d opening file",ps,err);
-		return;
+	if (x->f_spool) {
+		x->f_spool = FALSE;
+		systhread_mutex_lock(x->f_reader.lock);
+		err = filereader_open(&x->f_reader, ps, vol, x->f_map, x->f_blocks, x->f_readahead);
+		systhread_mutex_unlock(x->f_reader.lock);
+		if (err) {
+			object_error((t_object *)x, "%s: error %d opening file",ps,err);
+			return;
+		}
+		x->f_open = TRUE;
+	} else {
+		err = path_opensysfile(ps,vol,&x->f_fh,READ_PERM);
+		if (err) {
+			object_error((t_object *)x, "%s: error %d opening file",ps,err);
+			return;
+		}
+		filein_open(x,ps);
 	}
-	filein_open(x,ps);
 	outlet_bang(x->f_readdone);
 }
 
@@ -239,6 +330,7 @@ void filein_read(t_filein *x, t_symbol *s)
 void filein_free(t_filein *x)
 {
 	filein_close(x);
+	filereader_free(&x->f_reader);
 }
 
 void filein_assist(t_filein *x, void *b, long m, long a, char *s)
@@ -253,7 +345,7 @@ void filein_assist(t_filein *x, void *b, long m, long a, char *s)
 	}
 	else if (m==2) {
 		switch (a) {
-		case 0: sprintf(s,"File Data Output"); break;
+		case 0: sprintf(s,"File Data Output, list of Values for a list of Offsets"); break;
 		case 1: sprintf(s,"bang On End of File"); break;
 		case 2: sprintf(s,"bang When Read/Spool Finished"); break;
 		}
@@ -261,20 +353,43 @@ void filein_assist(t_filein *x, void *b, long m, long a, char *s)
 }
 
 
-void *filein_new(t_symbol *fn, t_symbol *spoolFlag)
+t_max_err filein_attr_settype(t_filein *x, void *attr, long argc, t_atom *argv)
+{
+	long type = argc ? filereader_type(atom_getsym(argv)) : -1;
+
+	if (type < 0) {
+		object_error((t_object *)x, "type must be one of " FILEREADER_TYPENAMES);
+		return MAX_ERR_GENERIC;
+	}
+	x->f_type = atom_getsym(argv);
+	x->f_typeindex = type;
+	return MAX_ERR_NONE;
+}
+
+void *filein_new(t_symbol *s, long argc, t_atom *argv)
 {
 	t_filein *x;
+	long attrstart = attr_args_offset((short)argc, argv);
+	t_symbol *fn = attrstart > 0 && atom_gettype(argv) == A_SYM ? atom_getsym(argv) : ps_nothing;
+	t_symbol *spoolFlag = attrstart > 1 && atom_gettype(argv + 1) == A_SYM ? atom_getsym(argv + 1) : ps_nothing;
 
 	x = object_alloc(filein_class);
 	x->f_readdone = bangout(x);
 	x->f_eof = bangout(x);
-	x->f_out = intout(x);
+	x->f_out = outlet_new(x, NULL);
 	intin(x,2);
 	intin(x,1);
 	x->f_open = FALSE;
 	x->f_fh = 0;
 	x->f_spool = 0;
 	x->f_data = 0;
+	filereader_init(&x->f_reader);
+	x->f_type = gensym("uint8");
+	x->f_typeindex = FILEREADER_UINT8;
+	x->f_map = 1;
+	x->f_blocks = FILEREADER_BLOCKS;
+	x->f_readahead = 4;
+	attr_args_process(x, (short)argc, argv);
 	if (fn != ps_nothing) {
 		if (spoolFlag==ps_spool)
 			x->f_spool = TRUE;
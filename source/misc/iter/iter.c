@@ -15,6 +15,7 @@ typedef struct iter {
 	t_object i_ob;
 	t_atom *i_av;
 	long i_ac;
+	long i_size;		// atoms allocated: only grows, so a stream of lists doesn't allocate
 } t_iter;
 
 static t_class *s_iter_class;
@@ -27,7 +28,7 @@ void iter_list(t_iter *x, t_symbol *s, long ac, t_atom *av);
 void iter_anything(t_iter *x, t_symbol *s, long ac, t_atom *av);
 void *iter_new(long dummy);
 void iter_free(t_iter *x);
-void iter_resize(t_iter *x, long size);
+t_bool iter_resize(t_iter *x, long size);
 
 C74_EXPORT void ext_main(void *r)
 {
@@ -54,71 +55,64 @@ void iter_assist(t_iter *x, void *b, long m, long a, char *s)
 
 void iter_int(t_iter *x, t_atom_long n)
 {
-	iter_resize(x, 1);
-	x->i_ac = 1;
-	atom_setlong(x->i_av, n);
+	if (iter_resize(x, 1)) {
+		x->i_ac = 1;
+		atom_setlong(x->i_av, n);
+	}
 	outlet_int(x->i_ob.o_outlet, n);
 }
 
 void iter_float(t_iter *x, double f)
 {
-	iter_resize(x, 1);
-	x->i_ac = 1;
-	atom_setfloat(x->i_av, f);
+	if (iter_resize(x, 1)) {
+		x->i_ac = 1;
+		atom_setfloat(x->i_av, f);
+	}
 	outlet_float(x->i_ob.o_outlet, f);
 }
 
-void iter_bang(t_iter *x)
+// output ac atoms one at a time
+static void iter_output(t_iter *x, long ac, t_atom *av)
 {
-	long i;
-	t_atom *av;
-
-	for (i=0, av = x->i_av; i < x->i_ac; i++,av++) {
-		if (atom_gettype(av) == A_LONG)
-			outlet_int(x->i_ob.o_outlet, atom_getlong(av));
-		else if (atom_gettype(av) == A_FLOAT)
-			outlet_float(x->i_ob.o_outlet, atom_getfloat(av));
-		else if (atom_gettype(av) == A_SYM)
-			outlet_anything(x->i_ob.o_outlet, atom_getsym(av), 0, 0);
+	void *out = x->i_ob.o_outlet;
+	t_atom *end = av + ac;
+
+	for (; av < end; av++) {
+		switch (atom_gettype(av)) {
+		case A_LONG:	outlet_int(out, atom_getlong(av));				break;
+		case A_FLOAT:	outlet_float(out, atom_getfloat(av));			break;
+		case A_SYM:		outlet_anything(out, atom_getsym(av), 0, 0);	break;
+		}
 	}
 }
 
+void iter_bang(t_iter *x)
+{
+	iter_output(x, x->i_ac, x->i_av);
+}
+
+// the list is stored in one copy up front, and output from the caller's atoms,
+// which stay put even if something downstream sends us another list meanwhile
 void iter_list(t_iter *x, t_symbol *s, long ac, t_atom *av)
 {
-	long i;
-
-	iter_resize(x, ac);
-	
-	for (i = 0; i < ac; i++,av++) {
-		x->i_av[i] = *av;
-		if (atom_gettype(av)==A_LONG)
-			outlet_int(x->i_ob.o_outlet, atom_getlong(av));
-		else if (atom_gettype(av)==A_FLOAT)
-			outlet_float(x->i_ob.o_outlet, atom_getfloat(av));
-		else if (atom_gettype(av)==A_SYM)
-			outlet_anything(x->i_ob.o_outlet, atom_getsym(av),0,0);
+	if (iter_resize(x, ac)) {
+		if (ac)
+			sysmem_copyptr(av, x->i_av, ac * sizeof(t_atom));
+		x->i_ac = ac;
 	}
-	x->i_ac = ac;
+	iter_output(x, ac, av);
 }
 
 void iter_anything(t_iter *x, t_symbol *s, long ac, t_atom *av)
 {
-	short i;
-
-	iter_resize(x, ac+1);
-	outlet_anything(x->i_ob.o_outlet, s, 0, 0);
-	atom_setsym(x->i_av + 0, s);
-
-	for (i = 0; i < ac; i++,av++) {
-		x->i_av[i + 1] = *av;
-		if (atom_gettype(av)==A_LONG)
-			outlet_int(x->i_ob.o_outlet, atom_getlong(av));
-		else if (atom_gettype(av)==A_FLOAT)
-			outlet_float(x->i_ob.o_outlet, atom_getfloat(av));
-		else if (atom_gettype(av)==A_SYM)
-			outlet_anything(x->i_ob.o_outlet, atom_getsym(av), 0, 0);
+	if (iter_resize(x, ac+1)) {
+		atom_setsym(x->i_av + 0, s);
+		if (ac)
+			sysmem_copyptr(av, x->i_av + 1, ac * sizeof(t_atom));
+		x->i_ac = ac+1;
 	}
-	x->i_ac = ac+1;
+	outlet_anything(x->i_ob.o_outlet, s, 0, 0);
+	iter_output(x, ac, av);
 }
 
 void *iter_new(long dummy)
@@ -128,6 +122,7 @@ void *iter_new(long dummy)
 	x = object_alloc(s_iter_class);
 	x->i_ac = 0;
 	x->i_av = NULL;
+	x->i_size = 0;
 	outlet_new(x, NULL);
 	return x;
 }
@@ -138,15 +133,20 @@ void iter_free(t_iter *x)
 		sysmem_freeptr(x->i_av);
 }
 
-void iter_resize(t_iter *x, long size)
+// room for size atoms; the stored list is lost if they have to be reallocated. False if out of memory.
+t_bool iter_resize(t_iter *x, long size)
 {
-	if (size != x->i_ac) {
-		if (x->i_av)
-			sysmem_freeptr(x->i_av);
-		if (size)
-			x->i_av = (t_atom *)sysmem_newptr(size * sizeof(t_atom));
-		else
-			x->i_av = NULL;
-		x->i_ac = size;
-	}
+	t_atom *av;
+
+	if (size <= x->i_size)
+		return true;
+	av = (t_atom *)sysmem_newptr(size * sizeof(t_atom));
+	if (!av)
+		return false;
+	if (x->i_av)
+		sysmem_freeptr(x->i_av);
+	x->i_av = av;
+	x->i_ac = 0;
+	x->i_size = size;
+	return true;
 }
@@ -4,12 +4,18 @@
 
  updated 3/22/09 ajm: new API
 
+ A list is matched in one pass over the window it slides through (the atoms seen so far
+ followed by the list), rather than by shifting the window along one atom at a time. Where
+ the pattern ends in a number, a scan of the list as doubles (see numlist.h) finds the
+ places the window could end, and only those are compared atom by atom.
+
  @ingroup	examples
  */
 
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_critical.h"
+#include "numlist.h"
 
 #define ANYONE MAGIC
 
@@ -21,6 +27,11 @@ typedef struct match
 	long m_where;
 	void *m_out;
 	t_critical m_critical;
+	t_atom *m_buf;			// the window a list slides through: only grows
+	long m_bufsize;
+	t_numlist m_list;		// the list as numbers
+	long m_busy;			// matching a list
+	long m_changes;			// counts changes to m_seen, to spot a list sent back to us from the outlet
 } t_match;
 
 static t_class *s_match_class;
@@ -29,10 +40,10 @@ void match_assist(t_match *x, void *b, long m, long a, char *s);
 void match_freebytes(t_match *x);
 void match_int(t_match *x, t_atom_long n);
 void match_float(t_match *x, double f);
-void match_list(t_match *x, t_symbol *s, short argc, t_atom *argv);
-void match_anything(t_match *x, t_symbol *s, short argc, t_atom *argv);
+void match_list(t_match *x, t_symbol *s, long argc, t_atom *argv);
+void match_anything(t_match *x, t_symbol *s, long argc, t_atom *argv);
 void match_atom(t_match *x, t_atom *a);
-static void atom_compare(t_match *x);
+static t_bool atom_compare(t_match *x, t_atom *seen);
 static t_bool atom_equal(t_atom *a, t_atom *b);
 static void outlet_atomlist(void *out, long argc, t_atom *argv);
 void match_clear(t_match *x);
@@ -99,18 +110,70 @@ void match_float(t_match *x, double f)
 		match_atom(x,&a);
 }
 
-void match_list(t_match *x, t_symbol *s, short argc, t_atom *argv)
+// room for size atoms in the window, or false
+static t_bool match_reserve(t_match *x, long size)
 {
-	long i;
+	t_atom *buf;
 
-	if (!x->m_size)
+	if (size <= x->m_bufsize)
+		return true;
+	if (!(buf = (t_atom *)sysmem_newptr(size * sizeof(t_atom))))
+		return false;
+	if (x->m_buf)
+		sysmem_freeptr(x->m_buf);
+	x->m_buf = buf;
+	x->m_bufsize = size;
+	return true;
+}
+
+void match_list(t_match *x, t_symbol *s, long argc, t_atom *argv)
+{
+	long i, k, m = x->m_size, changes;
+	t_atom *buf, *last;
+	t_bool numeric;
+	double key;
+
+	if (!m)
+		return;
+
+	// a list sent back to us while we output a match, or one we can't make room for, goes atom by atom
+	if (x->m_busy || argc < 2 || !match_reserve(x, m + argc) || !numlist_set(&x->m_list, argc, argv)) {
+		for (i = 0; i < argc && x->m_size; i++)
+			match_atom(x,argv+i);
 		return;
+	}
 
-	for (i = 0; i < argc; i++)
-		match_atom(x,argv+i);
+	buf = x->m_buf;
+	sysmem_copyptr(x->m_seen, buf, m * sizeof(t_atom));
+	sysmem_copyptr(argv, buf + m, argc * sizeof(t_atom));
+	last = x->m_want + m - 1;
+	numeric = (atom_gettype(last) == A_LONG || atom_gettype(last) == A_FLOAT);
+	key = atom_getfloat(last);
+
+	// the window ending at argv[k] is buf[k+1 ... k+m]
+	x->m_busy = true;
+	for (k = 0; k < argc; k++) {
+		if (numeric && (k = numlist_find(&x->m_list, k, key)) >= argc)
+			break;
+		if (atom_compare(x, buf + k + 1)) {
+			sysmem_copyptr(buf + k + 1, x->m_seen, m * sizeof(t_atom));	// what the outlet's listeners would find
+			changes = ++x->m_changes;
+			outlet_atomlist(x->m_out, m, x->m_seen);
+			if (x->m_changes != changes) {
+				// we were sent more, or set, meanwhile: carry on from where that left us
+				x->m_busy = false;
+				for (i = k + 1; i < argc && x->m_size; i++)
+					match_atom(x, argv+i);
+				return;
+			}
+		}
+	}
+	x->m_busy = false;
+	sysmem_copyptr(buf + argc, x->m_seen, m * sizeof(t_atom));
+	x->m_changes++;
 }
 
-void match_anything(t_match *x, t_symbol *s, short argc, t_atom *argv)
+void match_anything(t_match *x, t_symbol *s, long argc, t_atom *argv)
 {
 	t_atom a;
 
@@ -129,18 +192,21 @@ void match_atom(t_match *x, t_atom *a)
 	for (i = 0; i < x->m_size-1; i++)
 		x->m_seen[i] = x->m_seen[i+1];
 	x->m_seen[x->m_size-1] = *a;
-	atom_compare(x);
+	x->m_changes++;
+	if (atom_compare(x, x->m_seen))
+		outlet_atomlist(x->m_out,x->m_size,x->m_seen);
 }
 
-static void atom_compare(t_match *x)
+// whether the m_size atoms in seen match what we want
+static t_bool atom_compare(t_match *x, t_atom *seen)
 {
 	long i;
 
 	for (i = 0; i < x->m_size; i++) {
-		if (!atom_equal(x->m_seen+i,x->m_want+i))
-			return;
+		if (!atom_equal(seen+i,x->m_want+i))
+			return false;
 	}
-	outlet_atomlist(x->m_out,x->m_size,x->m_seen);
+	return true;
 }
 
 static t_bool atom_equal(t_atom *a, t_atom *b)
@@ -202,6 +268,7 @@ void match_clear(t_match *x)
 
 	for (i = 0; i < x->m_size; i++)
 		x->m_seen[i] = atom_novalue;
+	x->m_changes++;
 }
 
 void match_set(t_match *x, t_symbol *s, long ac, t_atom *av)
@@ -238,6 +305,9 @@ void match_setwant(t_atom *temp, long ac, t_atom *av)
 void match_free(t_match *x)
 {
 	match_freebytes(x);
+	if (x->m_buf)
+		sysmem_freeptr(x->m_buf);
+	numlist_free(&x->m_list);
 	critical_free(x->m_critical);
 }
 
@@ -248,6 +318,11 @@ void *match_new(t_symbol *s, long ac, t_atom *av)
 	x = object_alloc(s_match_class);
 	x->m_out = outlet_new((t_object *)x,0);
 	critical_new(&x->m_critical);
+	x->m_buf = NULL;
+	x->m_bufsize = 0;
+	numlist_init(&x->m_list);
+	x->m_busy = false;
+	x->m_changes = 0;
 	if (ac) {
 		x->m_want = (t_atom *)sysmem_newptr(ac * sizeof(t_atom));
 		match_setwant(x->m_want,ac,av);
@@ -13,13 +13,16 @@
 
 void *thresh_class;
 
-#define MAXSIZE 32767
+#define MAXSIZE 32767		// outlet_list() takes a short count
+#define STARTSIZE 64
 
 typedef struct thresh {
 	t_object t_ob;
-	t_atom *t_av;
+	t_atom *t_av;		// grows as lists get longer, up to MAXSIZE, and never shrinks
 	long t_ac;
+	long t_size;
 	void *t_clock;
+	char t_pending;		// the clock is set
 	double t_interval;
 	double t_time;
 	void *t_proxy;
@@ -32,6 +35,8 @@ void thresh_int(t_thresh *x, t_atom_long n);
 void thresh_float(t_thresh *x, double f);
 void thresh_bang(t_thresh *x);
 void thresh_list(t_thresh *x, t_symbol *s, long ac, t_atom *av);
+long thresh_reserve(t_thresh *x, long n);
+void thresh_arrived(t_thresh *x);
 void thresh_tick(t_thresh *x);
 void thresh_free(t_thresh *x);
 void thresh_assist(t_thresh *x, void *b, long m, long a, char *s);
@@ -61,11 +66,10 @@ void thresh_int(t_thresh *x, t_atom_long n)
 	if (proxy_getinlet((t_object *)x))
 		x->t_interval = n < 5? 5 : n;
 	else {
-		if (x->t_ac < MAXSIZE) {
-			x->t_time = gettime_forobject((t_object *)x);
+		if (thresh_reserve(x, x->t_ac + 1) > x->t_ac) {
 			atom_setlong(x->t_av+x->t_ac,n);
 			x->t_ac++;
-			clock_fdelay(x->t_clock,x->t_interval);
+			thresh_arrived(x);
 		}
 	}
 }
@@ -75,11 +79,10 @@ void thresh_float(t_thresh *x, double f)
 	if (proxy_getinlet((t_object *)x))
 		x->t_interval = f < 5? 5 : f;
 	else {
-		if (x->t_ac < MAXSIZE) {
-			x->t_time = gettime_forobject((t_object *)x);
+		if (thresh_reserve(x, x->t_ac + 1) > x->t_ac) {
 			atom_setfloat(x->t_av+x->t_ac,f);
 			x->t_ac++;
-			clock_fdelay(x->t_clock,x->t_interval);
+			thresh_arrived(x);
 		}
 	}
 }
@@ -93,15 +96,47 @@ void thresh_bang(t_thresh *x)
 
 void thresh_list(t_thresh *x, t_symbol *s, long ac, t_atom *av)
 {
-	long i, upto;
+	long upto;
 
+	upto = thresh_reserve(x, ac+x->t_ac);
+	if (upto > x->t_ac)
+		sysmem_copyptr(av, x->t_av+x->t_ac, (upto-x->t_ac)*sizeof(t_atom));	// one copy, however long the list
+	x->t_ac = upto;
+	thresh_arrived(x);
+}
+
+// make room for n atoms, doubling as need be; returns how many there is room for, which is less
+// than n past MAXSIZE or when memory runs out
+long thresh_reserve(t_thresh *x, long n)
+{
+	long size;
+	t_atom *av;
+
+	if (n <= x->t_size)
+		return n;
+	for (size = x->t_size ? x->t_size : STARTSIZE; size < n && size < MAXSIZE; size *= 2)
+		;
+	size = MIN(size, MAXSIZE);
+	if (x->t_av)
+		av = (t_atom *)sysmem_resizeptr(x->t_av, size*sizeof(t_atom));
+	else
+		av = (t_atom *)sysmem_newptr(size*sizeof(t_atom));
+	if (av) {
+		x->t_av = av;
+		x->t_size = size;
+	}
+	return MIN(n, x->t_size);
+}
+
+// something came in: the list goes out once nothing more has for t_interval. Only the first
+// arrival sets the clock; later ones move the time on and the tick puts the clock back to match.
+void thresh_arrived(t_thresh *x)
+{
 	x->t_time = gettime_forobject((t_object *)x);
-	upto = MIN(ac+x->t_ac,MAXSIZE);
-	for (i=x->t_ac; i < upto; i++,av++) {
-		x->t_av[i] = *av;
+	if (!x->t_pending) {
+		x->t_pending = 1;
+		clock_fdelay(x->t_clock,x->t_interval);
 	}
-	x->t_ac = upto;
-	clock_fdelay(x->t_clock,x->t_interval);
 }
 
 void thresh_tick(t_thresh *x)
@@ -109,10 +144,12 @@ void thresh_tick(t_thresh *x)
 	double tt;
 	
 	tt = gettime_forobject((t_object *)x);
-	if (tt - x->t_time >= x->t_interval)
+	if (tt - x->t_time >= x->t_interval) {
+		x->t_pending = 0;
 		thresh_bang(x);
+	}
 	else
-		clock_fdelay(x->t_clock, x->t_interval);
+		clock_fdelay(x->t_clock, x->t_time + x->t_interval - tt);
 }
 
 void thresh_free(t_thresh *x)
@@ -149,7 +186,6 @@ void thresh_assist(t_thresh *x, void *b, long m, long a, char *s)
 void *thresh_new(double interval)
 {
 	t_thresh *x;
-	long i;
 
 	x = object_alloc(thresh_class);
 	x->t_proxy = proxy_new(x, 1, NULL);
@@ -157,10 +193,10 @@ void *thresh_new(double interval)
 	x->t_clock = clock_new(x,(method)thresh_tick);
 	x->t_time = gettime_forobject((t_object *)x);
 	x->t_interval = interval < 5 ? 5 : interval;
-	x->t_av = (t_atom *) sysmem_newptr(MAXSIZE*sizeof(t_atom));
-	x->t_ac = 0;
-	for (i=0; i < MAXSIZE; i++)
-		atom_setlong(x->t_av+i,0);
+	x->t_av = NULL;
+	x->t_ac = x->t_size = 0;
+	x->t_pending = 0;
+	thresh_reserve(x, STARTSIZE);
 
 	return x;
 }